@@ -120,3 +120,33 @@ bool chain::ProcessBlockDelegates(CBlock &block, CCacheWrapper &cw, CValidationS
     }
     return true;
 }
+
+int32_t chain::GetActiveDelegatesEndHeight(CCacheWrapper &cw, int32_t tipHeight, int32_t forkHeight) {
+    // the votes are counted and the delegates activated at every block before V3
+    if (GetFeatureForkVersion(forkHeight + 1) < MAJOR_VER_R3)
+        return forkHeight == tipHeight ? tipHeight + 1 : -1;
+
+    PendingDelegates pendingDelegates;
+    cw.delegateCache.GetPendingDelegates(pendingDelegates);
+
+    int32_t countedHeight = pendingDelegates.counted_vote_height;
+    if (pendingDelegates.state == VoteDelegateState::ACTIVATED) {
+        // the delegates were activated at the end of the block
+        int32_t activatedHeight = countedHeight;
+        if (GetFeatureForkVersion(countedHeight) >= MAJOR_VER_R3)
+            activatedHeight += ACTIVATE_DELEGATE_DELAY_AFTER_V3;
+        if (forkHeight < activatedHeight)
+            return -1;
+    } else if (forkHeight != tipHeight) {
+        // the last activation is unknown
+        return -1;
+    }
+
+    // the next count of the votes after the fork activates the delegates at the earliest
+    int32_t endHeight = (forkHeight / (int32_t)COUNT_VOTE_INTERVAL_AFTER_V3 + 1) * COUNT_VOTE_INTERVAL_AFTER_V3 +
+                        ACTIVATE_DELEGATE_DELAY_AFTER_V3;
+    if (pendingDelegates.state == VoteDelegateState::PENDING)
+        endHeight = std::min<int32_t>(endHeight, countedHeight + ACTIVATE_DELEGATE_DELAY_AFTER_V3);
+
+    return endHeight;
+}
@@ -13,6 +13,10 @@ namespace chain {
 
     // process block delegates, call in the tail of block executing
     bool ProcessBlockDelegates(CBlock &block, CCacheWrapper &cw, CValidationState &state);
+
+    // the last height of the blocks produced by the active delegates of the tip on a chain forking from the active
+    // chain at forkHeight, -1 if the active delegates at the fork may differ from the ones of the tip
+    int32_t GetActiveDelegatesEndHeight(CCacheWrapper &cw, int32_t tipHeight, int32_t forkHeight);
 };
 
 
@@ -0,0 +1,397 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainverifier.h"
+
+#include "commons/util/util.h"
+#include "commons/util/workerpool.h"
+#include "logging.h"
+#include "main.h"
+#include "persistence/blockdb.h"
+#include "persistence/blockundo.h"
+#include "persistence/cachewrapper.h"
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+CChainVerifier chainVerifier;
+
+// a block of the window and the result of its checks
+struct CVerifyItem {
+    CBlockIndex *pIndex = nullptr;
+    uint32_t tx_count   = 0;
+    uint64_t bytes      = 0;
+    std::string error;
+};
+
+/**
+ * The chain state at the tip a run started from, while the active chain goes on. The blocks connected on
+ * top of that tip are disconnected on a base layer under the overlay, which holds the data written by the
+ * checks only, so every window sees the chain state of the blocks it checks. Must be used under cs_main.
+ */
+class CVerifyStateView {
+public:
+    explicit CVerifyStateView(CBlockIndex *pAnchorIn)
+        : pAnchor(pAnchorIn), pSyncedTip(pAnchorIn), spBaseCW(std::make_shared<CCacheWrapper>(pCdMan)),
+          spOverlayCW(std::make_shared<CCacheWrapper>(spBaseCW.get())) {}
+
+    // roll the blocks connected since the last sync back to the anchor on a new base layer
+    bool Sync(std::string &error) {
+        AssertLockHeld(cs_main);
+        CBlockIndex *pTip = chainActive.Tip();
+        if (pTip == pSyncedTip)
+            return true;
+
+        if (!chainActive.Contains(pAnchor)) {
+            error = strprintf("the verified tip %d left the active chain, hash=%s", pAnchor->height,
+                              pAnchor->GetBlockHash().ToString());
+            return false;
+        }
+
+        // the blocks of a fork above the anchor are gone from the chain state too
+        CBlockIndex *pFork = pSyncedTip;
+        while (!chainActive.Contains(pFork))
+            pFork = pFork->pprev;
+
+        auto spNewBaseCW = std::make_shared<CCacheWrapper>(pCdMan);
+        for (CBlockIndex *pIndex = pTip; pIndex != pFork; pIndex = pIndex->pprev) {
+            CBlock block;
+            CValidationState state;
+            if (!ReadBlockFromDisk(pIndex, block) || !DisconnectBlock(block, *spNewBaseCW, pIndex, state)) {
+                error = strprintf("roll back the new block at %d failed, hash=%s", pIndex->height,
+                                  pIndex->GetBlockHash().ToString());
+                return false;
+            }
+        }
+        // the data of the old base layer is at the anchor already, it goes over the new one
+        spBaseCW->SetBaseViewPtr(spNewBaseCW.get());
+        spBaseCW->Flush();
+        spOverlayCW->SetBaseViewPtr(spNewBaseCW.get());
+        spBaseCW   = spNewBaseCW;
+        pSyncedTip = pTip;
+        return true;
+    }
+
+    CCacheWrapper &GetOverlay() { return *spOverlayCW; }
+
+private:
+    CBlockIndex *pAnchor;
+    CBlockIndex *pSyncedTip;    // the tip of the active chain the base layer is rolled back from
+    std::shared_ptr<CCacheWrapper> spBaseCW;
+    std::shared_ptr<CCacheWrapper> spOverlayCW;
+};
+
+bool CChainVerifier::Run(int32_t nCheckLevel, int32_t nCheckDepth, uint32_t workerCount) {
+    nCheckLevel = std::max(0, std::min(4, nCheckLevel));
+
+    CBlockIndex *pIndex  = nullptr;
+    CBlockIndex *pAnchor = nullptr;
+    std::shared_ptr<CCacheWrapper> spCW;
+    {
+        LOCK(cs_main);
+        CBlockIndex *pTip = chainActive.Tip();
+        if (pTip == nullptr || pTip->pprev == nullptr)
+            return true;
+
+        if (nCheckDepth <= 0 || nCheckDepth > pTip->height)
+            nCheckDepth = pTip->height;
+
+        CVerifyDBProgress saved;
+        CBlockIndex *pSavedTip = nullptr;
+        if (pCdMan->pBlockIndexDb->ReadVerifyProgress(saved) && !saved.IsNull()) {
+            auto it = mapBlockIndex.find(saved.tip_hash);
+            if (it != mapBlockIndex.end() && chainActive.Contains(it->second))
+                pSavedTip = it->second;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pSavedTip == pTip && saved.finished && saved.error.empty() && saved.check_level >= nCheckLevel) {
+            LogPrint(BCLog::INFO, "%s, the blocks down to %d were verified at level %d already\n", __func__,
+                     saved.stop_height, saved.check_level);
+            progress = saved;
+            state    = FINISHED;
+            return true;
+        }
+
+        if (pSavedTip != nullptr && !saved.finished && saved.check_level == nCheckLevel) {
+            progress = saved;
+            resumed  = true;
+            pAnchor  = pSavedTip;
+            pIndex   = pSavedTip->GetAncestor(saved.next_height);
+        } else {
+            progress             = CVerifyDBProgress();
+            progress.tip_hash    = pTip->GetBlockHash();
+            progress.tip_height  = pTip->height;
+            progress.check_level = nCheckLevel;
+            progress.stop_height = std::max(1, pTip->height - nCheckDepth);
+            progress.next_height = pTip->height;
+            resumed              = false;
+            pAnchor              = pTip;
+            pIndex               = pTip;
+        }
+        state          = VERIFY_BLOCKS;
+        begin_time     = GetTimeMillis();
+        end_time       = 0;
+        session_blocks = 0;
+        session_bytes  = 0;
+        spCW           = std::make_shared<CCacheWrapper>(pCdMan);
+    }
+    LogPrint(BCLog::INFO, "%s, %s verifying blocks %d..%d at level %d with %u workers\n", __func__,
+             resumed ? "go on" : "start", progress.next_height, progress.stop_height, nCheckLevel, workerCount);
+
+    std::unique_ptr<CWorkerPool> pWorkerPool;
+    if (workerCount > 0)
+        pWorkerPool.reset(new CWorkerPool("verifydb", workerCount));
+    const size_t windowSize = std::max<uint32_t>(workerCount, 1) * BLOCKS_PER_WORKER;
+
+    // only this thread changes the progress, it is read without the lock here
+    vector<CVerifyItem> items;
+    while (pIndex != nullptr && pIndex->height >= progress.stop_height) {
+        boost::this_thread::interruption_point();
+
+        // the pprev of the block index never changes, the window is walked without cs_main
+        items.clear();
+        for (; pIndex != nullptr && pIndex->height >= progress.stop_height && items.size() < windowSize;
+             pIndex = pIndex->pprev) {
+            items.emplace_back();
+            items.back().pIndex = pIndex;
+        }
+
+        auto verifyBlock = [&](size_t i) {
+            CVerifyItem &item = items[i];
+            CBlock block;
+            // check level 0: read from disk
+            if (!ReadBlockFromDisk(item.pIndex, block)) {
+                item.error = strprintf("ReadBlockFromDisk failed at %d, hash=%s", item.pIndex->height,
+                                       item.pIndex->GetBlockHash().ToString());
+                return;
+            }
+
+            // check level 1: verify block validity, CheckBlock does not touch the cache wrapper without fCheckTx
+            CValidationState state;
+            if (nCheckLevel >= 1 && !CheckBlock(block, state, *spCW, false)) {
+                item.error = strprintf("found bad block at %d, hash=%s", item.pIndex->height,
+                                       item.pIndex->GetBlockHash().ToString());
+                return;
+            }
+
+            // check level 2: verify undo validity
+            if (nCheckLevel >= 2 && !item.pIndex->GetUndoPos().IsNull()) {
+                CBlockUndo undo;
+                if (!ReadBlockUndo(item.pIndex, undo)) {
+                    item.error = strprintf("found bad undo data at %d, hash=%s", item.pIndex->height,
+                                           item.pIndex->GetBlockHash().ToString());
+                    return;
+                }
+            }
+            item.tx_count = block.vptx.size();
+            item.bytes    = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        };
+        if (pWorkerPool != nullptr) {
+            pWorkerPool->Run(items.size(), verifyBlock);
+        } else {
+            for (size_t i = 0; i < items.size(); i++)
+                verifyBlock(i);
+        }
+
+        // take the results down the chain, up to the first bad block
+        for (const auto &item : items) {
+            if (!item.error.empty())
+                return Fail(item.error);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            progress.next_height = item.pIndex->height - 1;
+            progress.verified_blocks++;
+            progress.verified_txs += item.tx_count;
+            session_blocks++;
+            session_bytes += item.bytes;
+
+            // the blocks up to a loaded snapshot have no undo data
+            if (!(item.pIndex->nStatus & BLOCK_HAVE_UNDO)) {
+                LogPrint(BCLog::INFO, "%s, no undo data below %d, the chain state was loaded from a snapshot\n",
+                         __func__, item.pIndex->height + 1);
+                progress.stop_height = item.pIndex->height;
+                pIndex               = nullptr;
+                break;
+            }
+        }
+        SaveProgress();
+    }
+
+    // check level 3 and 4: disconnect and reconnect the top blocks on an overlay of the chain state
+    if (nCheckLevel >= 3 && !VerifyState(pAnchor, windowSize))
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        progress.finished = true;
+        state             = FINISHED;
+        end_time          = GetTimeMillis();
+    }
+    SaveProgress();
+
+    LogPrint(BCLog::INFO, "%s, verified %llu blocks (%llu transactions) down to %d at level %d, took %lldms\n",
+             __func__, progress.verified_blocks, progress.verified_txs, progress.stop_height, nCheckLevel,
+             end_time - begin_time);
+    return true;
+}
+
+bool CChainVerifier::VerifyState(CBlockIndex *pAnchor, size_t windowSize) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        state                 = VERIFY_STATE;
+        progress.state_height = pAnchor->height;
+    }
+    SaveProgress();
+
+    CVerifyStateView view(pAnchor);
+    std::string error;
+    vector<CBlock> blocks;
+    // the blocks of a window are read without cs_main, then checked on the overlay under it
+    auto readWindow = [&](const vector<CBlockIndex *> &indexes) {
+        blocks.assign(indexes.size(), CBlock());
+        for (size_t i = 0; i < indexes.size(); i++) {
+            if (!ReadBlockFromDisk(indexes[i], blocks[i])) {
+                error = strprintf("ReadBlockFromDisk failed at %d, hash=%s", indexes[i]->height,
+                                  indexes[i]->GetBlockHash().ToString());
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // check level 3: disconnect the blocks down from the anchor
+    CBlockIndex *pStateIndex = pAnchor;  // the overlay is at the state of the block
+    vector<CBlockIndex *> indexes;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        indexes.clear();
+        for (CBlockIndex *pIndex = pStateIndex; pIndex->pprev != nullptr && pIndex->height >= progress.stop_height &&
+             (pIndex->nStatus & BLOCK_HAVE_UNDO) && indexes.size() < windowSize; pIndex = pIndex->pprev)
+            indexes.push_back(pIndex);
+        if (indexes.empty())
+            break;
+        if (!readWindow(indexes))
+            return Fail(error);
+
+        {
+            LOCK(cs_main);
+            if (!view.Sync(error))
+                return Fail(error);
+
+            for (size_t i = 0; i < indexes.size(); i++) {
+                CValidationState state;
+                bool fClean = true;
+                if (!DisconnectBlock(blocks[i], view.GetOverlay(), indexes[i], state, &fClean) || !fClean) {
+                    error = strprintf("found inconsistencies of the chain state at %d, hash=%s", indexes[i]->height,
+                                      indexes[i]->GetBlockHash().ToString());
+                    break;
+                }
+                pStateIndex = indexes[i]->pprev;
+            }
+        }
+        if (!error.empty())
+            return Fail(error);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            progress.state_height = pStateIndex->height;
+        }
+        SaveProgress();
+    }
+
+    // check level 4: reconnect the blocks up to the anchor
+    while (progress.check_level >= 4 && pStateIndex != pAnchor) {
+        boost::this_thread::interruption_point();
+
+        indexes.clear();
+        for (int32_t height = pStateIndex->height + 1; height <= pAnchor->height && indexes.size() < windowSize;
+             height++)
+            indexes.push_back(pAnchor->GetAncestor(height));
+        if (!readWindow(indexes))
+            return Fail(error);
+
+        {
+            LOCK(cs_main);
+            if (!view.Sync(error))
+                return Fail(error);
+
+            for (size_t i = 0; i < indexes.size(); i++) {
+                CValidationState state;
+                if (!ConnectBlock(blocks[i], view.GetOverlay(), indexes[i], state, false)) {
+                    error = strprintf("found un-connectable block at %d, hash=%s", indexes[i]->height,
+                                      indexes[i]->GetBlockHash().ToString());
+                    break;
+                }
+                pStateIndex = indexes[i];
+            }
+        }
+        if (!error.empty())
+            return Fail(error);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            progress.state_height = pStateIndex->height;
+        }
+        SaveProgress();
+    }
+    return true;
+}
+
+bool CChainVerifier::Fail(const std::string &error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        progress.error    = error;
+        progress.finished = true;
+        state             = FAILED;
+        end_time          = GetTimeMillis();
+    }
+    SaveProgress();
+    return ERRORMSG("CChainVerifier::Run() : *** %s", error);
+}
+
+void CChainVerifier::SaveProgress() {
+    CVerifyDBProgress saving;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        saving = progress;
+    }
+    if (!pCdMan->pBlockIndexDb->WriteVerifyProgress(saving))
+        LogPrint(BCLog::ERROR, "%s, write the verify progress failed\n", __func__);
+}
+
+Object CChainVerifier::GetInfo() const {
+    static const char *stateNames[] = {"idle", "verifying blocks", "verifying state", "finished", "failed"};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Object obj;
+    obj.push_back(Pair("state",             stateNames[state]));
+    if (progress.IsNull())
+        return obj;
+
+    obj.push_back(Pair("check_level",       progress.check_level));
+    obj.push_back(Pair("tip_height",        progress.tip_height));
+    obj.push_back(Pair("tip_hash",          progress.tip_hash.GetHex()));
+    obj.push_back(Pair("stop_height",       progress.stop_height));
+    obj.push_back(Pair("next_height",       progress.next_height));
+    obj.push_back(Pair("verified_blocks",   progress.verified_blocks));
+    obj.push_back(Pair("verified_txs",      progress.verified_txs));
+    if (progress.check_level >= 3)
+        obj.push_back(Pair("state_height",  progress.state_height));
+    obj.push_back(Pair("resumed",           resumed));
+    if (!progress.error.empty())
+        obj.push_back(Pair("error",         progress.error));
+
+    if (begin_time > 0) {
+        int64_t elapsedMs = std::max<int64_t>((end_time > 0 ? end_time : GetTimeMillis()) - begin_time, 1);
+        obj.push_back(Pair("elapsed_ms",    elapsedMs));
+        obj.push_back(Pair("blocks_per_sec", session_blocks * 1000.0 / elapsedMs));
+        obj.push_back(Pair("mb_per_sec",    session_bytes * 1000.0 / elapsedMs / 1048576));
+    }
+    return obj;
+}
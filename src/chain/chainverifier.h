@@ -0,0 +1,95 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CHAIN_CHAINVERIFIER_H
+#define CHAIN_CHAINVERIFIER_H
+
+#include "commons/json/json_spirit_value.h"
+#include "commons/serialize.h"
+#include "commons/uint256.h"
+
+#include <mutex>
+#include <string>
+
+class CBlockIndex;
+
+using namespace json_spirit;
+
+/**
+ * The progress of a verification run of CChainVerifier, saved in the block index db after every window,
+ * so that the run goes on from there after a restart.
+ */
+class CVerifyDBProgress {
+public:
+    uint256 tip_hash;               // the tip when the run started, the blocks are verified down from it
+    int32_t tip_height       = -1;
+    int32_t check_level      = 0;
+    int32_t stop_height      = 0;   // the lowest height to verify
+    int32_t next_height      = -1;  // the next height to verify, the blocks above it are verified
+    uint64_t verified_blocks = 0;
+    uint64_t verified_txs    = 0;
+    int32_t state_height     = -1;  // the state check of the levels 3 and 4 is at the state of the block
+    bool finished            = false;
+    std::string error;              // the error which stopped the run, empty if none
+
+public:
+    bool IsNull() const { return tip_height < 0; }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(tip_hash);
+        READWRITE(tip_height);
+        READWRITE(check_level);
+        READWRITE(stop_height);
+        READWRITE(next_height);
+        READWRITE(verified_blocks);
+        READWRITE(verified_txs);
+        READWRITE(state_height);
+        READWRITE(finished);
+        READWRITE(error);
+    )
+};
+
+/**
+ * CChainVerifier
+ * The background VerifyDB of -backgroundverify. It verifies the top blocks of the active chain in windows
+ * without holding cs_main: the workers read the blocks, check them (level 1, which builds the merkle roots)
+ * and read their undo data (level 2). The progress is saved after every window. Then the blocks are
+ * disconnected (level 3) and reconnected (level 4) in windows on an overlay of the chain state at the tip
+ * the run started from, cs_main is held for a window only. The state check starts again from that tip
+ * after a restart, the overlay is in memory.
+ */
+class CChainVerifier {
+public:
+    // the blocks of a window per worker
+    static const uint32_t BLOCKS_PER_WORKER = 8;
+
+    enum State { IDLE, VERIFY_BLOCKS, VERIFY_STATE, FINISHED, FAILED };
+
+public:
+    // verify the top nCheckDepth blocks at nCheckLevel with workerCount workers, go on with the saved run
+    // if it is of the same level and its tip is still in the active chain
+    bool Run(int32_t nCheckLevel, int32_t nCheckDepth, uint32_t workerCount);
+
+    Object GetInfo() const;
+
+private:
+    bool VerifyState(CBlockIndex *pAnchor, size_t windowSize);
+    bool Fail(const std::string &error);
+    void SaveProgress();
+
+private:
+    mutable std::mutex mutex;
+    State state = IDLE;
+    CVerifyDBProgress progress;
+    bool resumed            = false;
+    // the throughput of this session
+    int64_t begin_time      = 0;
+    int64_t end_time        = 0;
+    uint64_t session_blocks = 0;
+    uint64_t session_bytes  = 0;
+};
+
+extern CChainVerifier chainVerifier;
+
+#endif  // CHAIN_CHAINVERIFIER_H
@@ -5,27 +5,50 @@
 
 #include "merkletree.h"
 
+#include "crypto/sha256.h"
+
+#include <cstring>
+
+void ComputeMerkleLevel(const uint256 *pLevel, size_t count, uint256 *pNext) {
+    size_t pairs = count / 2;
+    if (pairs > 0)
+        SHA256D64(pNext[0].begin(), pLevel[0].begin(), pairs);
+
+    if (count & 1) {
+        unsigned char blob[64];
+        memcpy(blob, pLevel[count - 1].begin(), 32);
+        memcpy(blob + 32, pLevel[count - 1].begin(), 32);
+        SHA256D64(pNext[pairs].begin(), blob, 1);
+    }
+}
+
+void BuildMerkleTreeLevels(vector<uint256> &tree) {
+    // size the whole tree at once, the levels are written in place
+    size_t total = tree.size();
+    for (size_t size = tree.size(); size > 1; size = (size + 1) / 2)
+        total += (size + 1) / 2;
+
+    size_t begin = 0;
+    size_t size  = tree.size();
+    tree.resize(total);
+    for (; size > 1; size = (size + 1) / 2) {
+        ComputeMerkleLevel(&tree[begin], size, &tree[begin + size]);
+        begin += size;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // class CPartialMerkleTree
 
-uint256 CPartialMerkleTree::CalcHash(int32_t height, uint32_t pos, const vector<uint256> &vTxid) {
-    if (height == 0) {
-        // hash at height 0 is the txids themself
-        return vTxid[pos];
-    } else {
-        // calculate left hash
-        uint256 left = CalcHash(height - 1, pos * 2, vTxid), right;
-        // calculate right hash if not beyond the end of the array - copy left hash otherwise1
-        if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-            right = CalcHash(height - 1, pos * 2 + 1, vTxid);
-        else
-            right = left;
-        // combine subhashes
-        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
-    }
+uint256 CPartialMerkleTree::CalcHash(int32_t height, uint32_t pos, const vector<uint256> &vTree) {
+    // the levels below height come first in the tree
+    size_t begin = 0;
+    for (int32_t h = 0; h < height; h++)
+        begin += CalcTreeWidth(h);
+    return vTree[begin + pos];
 }
 
-void CPartialMerkleTree::TraverseAndBuild(int32_t height, uint32_t pos, const vector<uint256> &vTxid, const vector<bool> &vMatch) {
+void CPartialMerkleTree::TraverseAndBuild(int32_t height, uint32_t pos, const vector<uint256> &vTree, const vector<bool> &vMatch) {
     // determine whether this node is the parent of at least one matched txid
     bool fParentOfMatch = false;
     for (uint32_t p = pos << height; p < (pos + 1) << height && p < nTransactions; p++)
@@ -34,12 +57,12 @@ void CPartialMerkleTree::TraverseAndBuild(int32_t height, uint32_t pos, const ve
     vBits.push_back(fParentOfMatch);
     if (height == 0 || !fParentOfMatch) {
         // if at height 0, or nothing interesting below, store hash and stop
-        vHash.push_back(CalcHash(height, pos, vTxid));
+        vHash.push_back(CalcHash(height, pos, vTree));
     } else {
         // otherwise, don't store any hash, but descend into the subtrees
-        TraverseAndBuild(height - 1, pos * 2, vTxid, vMatch);
+        TraverseAndBuild(height - 1, pos * 2, vTree, vMatch);
         if (pos * 2 + 1 < CalcTreeWidth(height - 1))
-            TraverseAndBuild(height - 1, pos * 2 + 1, vTxid, vMatch);
+            TraverseAndBuild(height - 1, pos * 2 + 1, vTree, vMatch);
     }
 }
 
@@ -85,8 +108,12 @@ CPartialMerkleTree::CPartialMerkleTree(const vector<uint256> &vTxid, const vecto
     while (CalcTreeWidth(height) > 1)
         height++;
 
+    // hash all the levels at once, the traverse takes the node hashes from them
+    vector<uint256> vTree(vTxid);
+    BuildMerkleTreeLevels(vTree);
+
     // traverse the partial tree
-    TraverseAndBuild(height, 0, vTxid, vMatch);
+    TraverseAndBuild(height, 0, vTree, vMatch);
 }
 
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
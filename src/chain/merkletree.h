@@ -9,6 +9,19 @@
 #include "persistence/block.h"
 #include "commons/bloom.h"
 
+/**
+ * Hash the pairs of the count hashes of a merkle tree level into the count / 2 rounded up hashes of the next
+ * level, the last hash is paired with itself if count is odd. The pairs are adjacent 64-byte blobs, they are
+ * double hashed by SHA256D64 in one call, which runs the multi-way kernels picked by SHA256AutoDetect.
+ */
+void ComputeMerkleLevel(const uint256 *pLevel, size_t count, uint256 *pNext);
+
+/**
+ * Append all the levels above the leaves in tree to it, level by level, the root at last. The layout is the one
+ * of CBlock::vMerkleTree, the level of height h starts after the CalcTreeWidth(h') hashes of all h' < h.
+ */
+void BuildMerkleTreeLevels(vector<uint256> &tree);
+
 /** Data structure that represents a partial merkle tree.
  *
  * It respresents a subset of the txid's of a known block, in a way that
@@ -62,11 +75,11 @@ protected:
         return (nTransactions + (1 << height) - 1) >> height;
     }
 
-    // calculate the hash of a node in the merkle tree (at leaf level: the txid's themself)
-    uint256 CalcHash(int32_t height, uint32_t pos, const vector<uint256> &vTxid);
+    // get the hash of a node from the full tree of BuildMerkleTreeLevels (at leaf level: the txid's themself)
+    uint256 CalcHash(int32_t height, uint32_t pos, const vector<uint256> &vTree);
 
     // recursive function that traverses tree nodes, storing the data as bits and hashes
-    void TraverseAndBuild(int32_t height, uint32_t pos, const vector<uint256> &vTxid, const vector<bool> &vMatch);
+    void TraverseAndBuild(int32_t height, uint32_t pos, const vector<uint256> &vTree, const vector<bool> &vMatch);
 
     // recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
     // it returns the hash of the respective node.
@@ -11,6 +11,7 @@
 #include "rpc/core/rpcclient.h"
 #include "rpc/core/rpcserver.h"
 #include "commons/util/util.h"
+#include "persistence/dbprofile.h"
 
 /* Introduction text for doxygen: */
 
@@ -88,6 +89,12 @@ bool AppInit(int argc, char* argv[], boost::thread_group& threadGroup) {
             int ret = CommandLineRPC(argc, argv);
             exit(ret);
         }
+
+        // replay a db trace against the leveldb profiles, no node is started
+        if (SysCfg().IsArgCount("-dbbench")) {
+            int ret = BenchDBProfiles(SysCfg().GetArg("-dbbench", "")) ? 0 : 1;
+            exit(ret);
+        }
 #ifndef WIN32
         fDaemon = SysCfg().GetBoolArg("-daemon", false);
         if (fDaemon) {
@@ -0,0 +1,87 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "workerpool.h"
+
+#include "util.h"
+
+#include <algorithm>
+
+CWorkerPool::CWorkerPool(const std::string &nameIn, uint32_t threadCount) : name(nameIn) {
+    threadCount = std::min(threadCount, MAX_THREADS);
+    for (uint32_t i = 0; i < threadCount; i++)
+        threads.emplace_back(&CWorkerPool::ThreadWork, this);
+}
+
+CWorkerPool::~CWorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        is_stopping = true;
+    }
+    pool_cond.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void CWorkerPool::Run(size_t count, const std::function<void(size_t)> &task) {
+    if (count == 0)
+        return;
+
+    std::lock_guard<std::mutex> runLock(run_mutex);
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        pTask      = &task;
+        task_count = count;
+        next_task  = 0;
+        done_tasks = 0;
+        round++;
+    }
+    pool_cond.notify_all();
+
+    RunTasks();
+
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    pool_cond.wait(lock, [&] { return done_tasks == task_count; });
+    pTask = nullptr;
+}
+
+void CWorkerPool::ThreadWork() {
+    RenameThread(("coin-" + name).c_str());
+
+    uint64_t lastRound = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(pool_mutex);
+            pool_cond.wait(lock, [&] { return is_stopping || (pTask != nullptr && round != lastRound); });
+            if (is_stopping)
+                return;
+            lastRound = round;
+        }
+        RunTasks();
+    }
+}
+
+void CWorkerPool::RunTasks() {
+    while (true) {
+        const std::function<void(size_t)> *pCurTask = nullptr;
+        size_t index = 0;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            if (pTask == nullptr || next_task >= task_count)
+                return;
+            pCurTask = pTask;
+            index    = next_task++;
+        }
+
+        (*pCurTask)(index);
+
+        bool allDone = false;
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex);
+            allDone = (++done_tasks == task_count);
+        }
+        if (allDone)
+            pool_cond.notify_all();
+    }
+}
@@ -0,0 +1,56 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COMMONS_UTIL_WORKERPOOL_H
+#define COMMONS_UTIL_WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * CWorkerPool
+ * Worker threads running the tasks of one round at a time. Run() hands out the task indexes to
+ * the workers and the calling thread, and returns when all the tasks of the round are done.
+ * The rounds of the threads calling Run() at the same time run one after another, so a task must
+ * not call Run() of its own pool.
+ */
+class CWorkerPool {
+public:
+    static const uint32_t MAX_THREADS = 16;
+
+public:
+    CWorkerPool(const std::string &nameIn, uint32_t threadCount);
+    ~CWorkerPool();
+
+    // run task(0) .. task(count - 1), the task must not throw
+    void Run(size_t count, const std::function<void(size_t)> &task);
+
+    uint32_t GetThreadCount() const { return threads.size(); }
+
+private:
+    void ThreadWork();
+    // run the tasks of the current round until there are none left
+    void RunTasks();
+
+private:
+    std::string name;
+    std::vector<std::thread> threads;
+
+    std::mutex run_mutex;   // serializes the callers of Run()
+    std::mutex pool_mutex;
+    std::condition_variable pool_cond;
+    const std::function<void(size_t)> *pTask = nullptr;
+    size_t task_count   = 0;
+    size_t next_task    = 0;
+    size_t done_tasks   = 0;
+    uint64_t round      = 0;    // the run round, the workers wake up when it changes
+    bool is_stopping    = false;
+};
+
+#endif  // COMMONS_UTIL_WORKERPOOL_H
@@ -432,6 +432,7 @@ CBaseParams::CBaseParams() {
     fBenchmark              = false;
     fTxIndex                = false;
     fLogFailures            = false;
+    fParallelExec           = false;
     fServer                 = false;
     nTxCacheHeight          = 500;
     nTimeBestReceived       = 0;
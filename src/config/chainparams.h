@@ -67,6 +67,7 @@ protected:
     mutable bool fTxIndex;
     mutable bool fLogFailures;
     mutable bool fGenReceipt;
+    mutable bool fParallelExec;
     mutable int64_t nTimeBestReceived;
     mutable uint32_t nCacheSize;
     mutable int32_t nTxCacheHeight;
@@ -155,6 +156,7 @@ public:
     bool IsTxIndex() const { return fTxIndex; }
     bool IsLogFailures() const { return fLogFailures; };
     bool IsGenReceipt() const { return fGenReceipt; };
+    bool IsParallelExec() const { return fParallelExec; };
     int64_t GetBestRecvTime() const { return nTimeBestReceived; }
     uint32_t GetCacheSize() const { return nCacheSize; }
     int32_t GetTxCacheHeight() const { return nTxCacheHeight; }
@@ -164,6 +166,7 @@ public:
     void SetTxIndex(bool flag) const { fTxIndex = flag; }
     void SetLogFailures(bool flag) const { fLogFailures = flag; }
     void SetGenReceipt(bool flag) const { fGenReceipt = flag; }
+    void SetParallelExec(bool flag) const { fParallelExec = flag; }
     void SetBestRecvTime(int64_t nTime) const { nTimeBestReceived = nTime; }
     int32_t GetMaxForkHeight(int32_t currBlockHeight) const;
     const MessageStartChars& MessageStart() const { return pchMessageStart; }
@@ -194,12 +194,26 @@ static const uint32_t DEFAULT_BLOCK_MAX_SIZE = 3750000;
 /** The maximum size for transactions we're willing to relay/mine */
 static const uint32_t MAX_STANDARD_TX_SIZE = 100000;
 
+/** Default for -mempooldumpinterval, the seconds between the dumps of the mempool to mempool.dat */
+static const int64_t DEFAULT_MEMPOOL_DUMP_INTERVAL = 600;
+
 /** The maximum number of orphan blocks kept in memory */
 static const uint32_t MAX_ORPHAN_BLOCKS = 750;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int32_t MAX_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 /** Timeout in seconds before considering a block download peer unresponsive. */
 static const uint32_t BLOCK_DOWNLOAD_TIMEOUT  = 60;
+/** The blocks above the tip downloaded at once by the headers-first sync, the early ones are kept as orphans */
+static const int32_t BLOCK_DOWNLOAD_WINDOW = 512;
+/** The initial and the minimum number of blocks in flight from a single peer of the headers-first sync. */
+static const int32_t INITIAL_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+static const int32_t MIN_BLOCKS_IN_TRANSIT_PER_PEER     = 2;
+/** Timeout in seconds before considering a peer stalling the block next to the tip. */
+static const uint32_t BLOCK_STALLING_TIMEOUT = 2;
+/** The maximum number of headers in a headers message. */
+static const uint32_t MAX_HEADERS_RESULTS = 2000;
+/** The maximum number of headers ahead of the tip kept by the headers-first sync. */
+static const int32_t MAX_HEADERS_AHEAD = 100000;
 
 /** Minimum disk space required */
 static const uint64_t MIN_DISK_SPACE = 52428800;
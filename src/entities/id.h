@@ -106,6 +106,9 @@ private:
 
 class CRegIDKey {
 public:
+    // fixed serialized size, see dbk::CDBKeySize
+    static const uint32_t KEY_SIZE = CFixedUInt32::SIZE + CFixedUInt16::SIZE;
+
     CRegID regid;
 
     CRegIDKey() {}
@@ -18,15 +18,19 @@
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
 #include "main.h"
+#include "chain/chainverifier.h"
 #include "miner/miner.h"
 #include "net.h"
 #include "persistence/blockdb.h"
 #include "persistence/accountdb.h"
 #include "persistence/txdb.h"
 #include "persistence/contractdb.h"
+#include "persistence/snapshot.h"
 #include "tx/tx.h"
+#include "tx/txadmission.h"
 #include "commons/util/util.h"
 #include "commons/util/time.h"
+#include "crypto/sha256.h"
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -133,6 +137,9 @@ void Shutdown() {
 
     RenameThread("Coin-shutoff");
 
+    // the RPC threads waiting for the admission results are released first
+    if (pTxAdmission != nullptr)
+        pTxAdmission->Stop();
     StopRPCServer();
 
     GenerateProduceBlockThread(false, nullptr, 0);
@@ -142,6 +149,9 @@ void Shutdown() {
     StopNode();
     UnregisterNodeSignals(GetNodeSignals());
 
+    if (SysCfg().GetBoolArg("-persistmempool", true))
+        DumpMemPool();
+
     {
         LOCK(cs_main);
 
@@ -157,6 +167,11 @@ void Shutdown() {
         }
     }
 
+    delete pBlockWorkerPool;
+    pBlockWorkerPool = nullptr;
+    delete pTxAdmission;
+    pTxAdmission = nullptr;
+
     boost::filesystem::remove(GetPidFile());
     UnregisterAllWallets();
 
@@ -182,6 +197,19 @@ void HandleSIGHUP(int32_t) {
     fReopenDebugLog = true;
 }
 
+// the signatures of the txs to verify ahead of their admission, against the accounts of the mempool
+static void GetAdmissionSigVerifyItems(const vector<std::shared_ptr<CBaseTx>> &txs, vector<CSigVerifyItem> &items) {
+    LOCK(cs_main);
+    CCacheWrapper cw(mempool.cw.get());
+    int32_t height = chainActive.Height() + 1;
+    for (const auto &pTx : txs)
+        pTx->GetSigVerifyItems(cw, height, items);
+}
+
+static bool CommitAdmissionTx(CBaseTx &tx, string &message) {
+    return pWalletMain->CommitTx(&tx, message);
+}
+
 bool static InitError(const string &str) {
     LogPrint(BCLog::ERROR, "%s\n", str);
     return false;
@@ -207,15 +235,30 @@ string HelpMessage() {
     strUsage += "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n";
     strUsage += "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 288, 0 = all)") + "\n";
     strUsage += "  -checklevel=<n>        " + _("How thorough the block verification of -checkblocks is (0-4, default: 3)") + "\n";
+    strUsage += "  -backgroundverify      " + _("Verify the -checkblocks blocks in the background after startup, going on from the last run after a restart (default: 0)") + "\n";
     strUsage += "  -conf=<file>           " + _("Specify configuration file (default: ") + IniCfg().GetCoinName() + ".conf)" + "\n";
 #if !defined(WIN32)
     strUsage += "  -daemon                " + _("Run in the background as a daemon and accept commands") + "\n";
 #endif
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -dbcache=<n>           " + strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), MIN_DB_CACHE, MAX_DB_CACHE, DEFAULT_DB_CACHE) + "\n";
+    strUsage += "  -dbbloomfilter=<prefix> " + _("Keep an in-memory bloom filter of the db keys of the key prefix type, e.g. idac (can be specified multiple times)") + "\n";
+    strUsage += "  -asyncdbflush          " + _("Write the chain state to disk in a dedicated writer thread (default: 0)") + "\n";
+    strUsage += "  -singledbstore         " + _("Keep all the chain state dbs in one store with one write per flush, changing it needs deleting the chain state of the other layout and -reindex (default: 0)") + "\n";
+    strUsage += "  -blockworkers=<n>      " + _("Number of the block validation worker threads, which pre-verify the tx signatures and run -parallelexec, 0 = off (default: cores - 1, max 16)") + "\n";
+    strUsage += "  -admissionworkers=<n>  " + _("Number of the worker threads of the staged mempool admission of the RPC txs, which pre-verify the tx signatures of a batch before the txs take cs_main, 0 = off (default: 0, max 16)") + "\n";
+    strUsage += "  -persistmempool        " + _("Dump the mempool to mempool.dat on shutdown and reload it on startup (default: 1)") + "\n";
+    strUsage += "  -mempooldumpinterval=<n> " + strprintf(_("Seconds between the dumps of the mempool with -persistmempool, 0 = on shutdown only (default: %d)"), DEFAULT_MEMPOOL_DUMP_INTERVAL) + "\n";
+    strUsage += "  -parallelexec          " + _("Execute the independent transfer txs of a block in parallel on the block validation workers (default: 0)") + "\n";
+    strUsage += "  -dbprofile=<db>:<profile> " + _("Use the leveldb option profile for the db, e.g. accounts:randomread, or for all the dbs without <db>: (default, randomread, append, writeonce, can be specified multiple times)") + "\n";
+    strUsage += "  -dbtrace               " + _("Record the db accesses to <datadir>/dbtraces for -dbbench (default: 0)") + "\n";
+    strUsage += "  -dbbench=<file>        " + _("Replay the db trace file against every leveldb option profile and exit") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + " " + _("on startup") + "\n";
     strUsage += "  -pid=<file>            " + _("Specify pid file (default: coin.pid)") + "\n";
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + " " + _("on startup") + "\n";
+    strUsage += "  -loadsnapshot=<file>   " + _("With -reindex, rebuild the chain state from the snapshot file of dumpsnapshot, the blocks up to the snapshot block are not executed") + "\n";
+    strUsage += "  -snapshothash=<hash>   " + _("The expected state hash of the -loadsnapshot file, required by -loadsnapshot") + "\n";
+    strUsage += "  -unverifiedsnapshot    " + _("Allow -loadsnapshot without -snapshothash, the chain state is trusted as is (default: 0)") + "\n";
     strUsage += "  -txindex               " + _("Maintain a full transaction index (default: 0)") + "\n";
     strUsage += "  -logfailures           " + _("Log failures into level db in detail (default: 0)") + "\n";
     strUsage += "  -genreceipt            " + _("Whether generate receipt(default: 0)") + "\n";
@@ -231,6 +274,7 @@ string HelpMessage() {
     strUsage += "  -dnsseed               " + _("Query for peer addresses via DNS lookup, if low on addresses (default: 1 unless -connect)") + "\n";
     strUsage += "  -forcednsseed          " + _("Always query for peer addresses via DNS lookup (default: 0)") + "\n";
     strUsage += "  -externalip=<ip>       " + _("Specify your own public address") + "\n";
+    strUsage += "  -headersfirst          " + _("Download the headers first and the blocks from multiple peers in parallel (default: 0)") + "\n";
     strUsage += "  -listen                " + _("Accept connections from outside (default: 1 if no -proxy or -connect)") + "\n";
     strUsage += "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n";
     strUsage += "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n";
@@ -301,6 +345,7 @@ string HelpMessage() {
 
     strUsage += "\n" + _("Block creation options:") + "\n";
     strUsage += "  -blockmaxsize=<n>      " + strprintf(_("Set maximum block size in bytes (default: %d)"), DEFAULT_BLOCK_MAX_SIZE) + "\n";
+    strUsage += "  -blocktemplate         " + _("Keep the block of the next slot of the producer up to date while waiting for the slot, executing the txs as they enter the mempool (default: 0)") + "\n";
 
     strUsage += "\n" + _("RPC server options:") + "\n";
     strUsage += "  -rpcserver             " + _("Accept command line and JSON-RPC commands") + "\n";
@@ -384,6 +429,11 @@ void ThreadImport(vector<boost::filesystem::path> vImportFiles) {
             LogPrint(BCLog::INFO, "Warning: Could not open blocks file %s\n", path.string());
         }
     }
+
+    // -backgroundverify, after the blocks are imported
+    if (SysCfg().GetBoolArg("-backgroundverify", false))
+        chainVerifier.Run(SysCfg().GetArg("-checklevel", 3), SysCfg().GetArg("-checkblocks", 288),
+                          pBlockWorkerPool != nullptr ? pBlockWorkerPool->GetThreadCount() : 0);
 }
 
 /** Initialize Coin.
@@ -437,6 +487,9 @@ bool AppInit(boost::thread_group &threadGroup) {
     sa_hup.sa_flags = 0;
     sigaction(SIGHUP, &sa_hup, nullptr);
 
+    // Pick the fastest sha256 kernels of the cpu, for the merkle trees of SHA256D64
+    std::string sha256_algo = SHA256AutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -493,16 +546,26 @@ bool AppInit(boost::thread_group &threadGroup) {
             LogPrint(BCLog::INFO, "AppInit : parameter interaction: -salvagewallet=1 -> setting -rescan=1\n");
     }
 
-    // Make sure enough file descriptors are available
-    int32_t nBind   = max((int32_t)SysCfg().IsArgCount("-bind"), 1);
-    nMaxConnections = SysCfg().GetArg("-maxconnections", 125);
-    nMaxConnections = max(min(nMaxConnections, (int32_t)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
-    int32_t nFD     = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
-        return InitError(_("Not enough file descriptors available."));
-
-    if (nFD - MIN_CORE_FILEDESCRIPTORS < nMaxConnections)
-        nMaxConnections = nFD - MIN_CORE_FILEDESCRIPTORS;
+    // Make sure enough file descriptors are available, the dbs may keep the files of their profiles open
+#ifdef WIN32
+    int32_t nDbFiles = 0;
+#else
+    int32_t nDbFiles = CCacheDBManager::GetMaxOpenFiles();
+#endif
+    int32_t nReservedFD = MIN_CORE_FILEDESCRIPTORS + nDbFiles;
+    int32_t nBind       = max((int32_t)SysCfg().IsArgCount("-bind"), 1);
+    nMaxConnections     = SysCfg().GetArg("-maxconnections", 125);
+    nMaxConnections     = max(min(nMaxConnections, (int32_t)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS)), 0);
+    int32_t nFD         = RaiseFileDescriptorLimit(nMaxConnections + nReservedFD);
+    if (nFD < nReservedFD)
+        return InitError(strprintf(_("Not enough file descriptors available, %d are needed, %d of them by the dbs. "
+                                     "Raise the limit (ulimit -n) or use -dbprofile of fewer open files."),
+                                   nReservedFD, nDbFiles));
+
+    if (nFD - nReservedFD < nMaxConnections)
+        nMaxConnections = nFD - nReservedFD;
+    LogPrint(BCLog::INFO, "file descriptors: limit=%d, reserved=%d (dbs=%d), max_connections=%d\n", nFD, nReservedFD,
+             nDbFiles, nMaxConnections);
 
     SysCfg().SetBenchMark(SysCfg().GetBoolArg("-benchmark", false));
     mempool.SetSanityCheck(SysCfg().GetBoolArg("-checkmempool", RegTest()));
@@ -546,6 +609,7 @@ bool AppInit(boost::thread_group &threadGroup) {
     string leveldb_version = strprintf("%d.%d", leveldb::kMajorVersion, leveldb::kMinorVersion);
     LogPrint(BCLog::INFO, "Using Level DB version %s\n", leveldb_version);
     LogPrint(BCLog::INFO, "Using Berkeley DB version %s\n", DB_VERSION_STRING);
+    LogPrint(BCLog::INFO, "Using the '%s' SHA256 implementation\n", sha256_algo);
 
 #ifdef USE_UPNP
     LogPrint(BCLog::INFO, "Using miniupnpc version %s,API version %d\n", MINIUPNPC_VERSION, MINIUPNPC_API_VERSION);
@@ -665,11 +729,39 @@ bool AppInit(boost::thread_group &threadGroup) {
     }
 
     SysCfg().SetReIndex(SysCfg().GetBoolArg("-reindex", false));
+    if (SysCfg().IsArgCount("-loadsnapshot") && !SysCfg().IsReindex())
+        LogPrint(BCLog::INFO, "-loadsnapshot is ignored without -reindex\n");
+    if (SysCfg().IsArgCount("-loadsnapshot") && SysCfg().IsReindex() && !SysCfg().IsArgCount("-snapshothash")) {
+        // the snapshot replaces the execution of all the blocks up to its block, it must be known to be good
+        if (!SysCfg().GetBoolArg("-unverifiedsnapshot", false))
+            return InitError(_("-loadsnapshot requires -snapshothash, the state hash of a trusted snapshot "
+                               "(or -unverifiedsnapshot to load it unverified)"));
+
+        strMiscWarning = _("Warning: The chain state is loaded from a snapshot without -snapshothash, it is unverified!");
+        LogPrint(BCLog::INFO, "****************************************************************\n");
+        LogPrint(BCLog::INFO, "WARNING: -loadsnapshot %s without -snapshothash, the chain state is NOT verified!\n",
+                 SysCfg().GetArg("-loadsnapshot", ""));
+        LogPrint(BCLog::INFO, "****************************************************************\n");
+    }
 
     SysCfg().SetLogFailures(SysCfg().GetBoolArg("-logfailures", false));
 
     SysCfg().SetGenReceipt(SysCfg().GetBoolArg("-genreceipt", false));
 
+    // the memory budget shared by all the db caches
+    int64_t nDbCache = SysCfg().GetArg("-dbcache", DEFAULT_DB_CACHE);
+    nDbCache         = std::max(std::min(nDbCache, MAX_DB_CACHE), MIN_DB_CACHE);
+    DBCacheBudget().SetLimit(nDbCache << 20);
+
+    // the block validation workers of ConnectBlock, besides the calling thread
+    int64_t nBlockWorkers = SysCfg().GetArg("-blockworkers", (int64_t)std::thread::hardware_concurrency() - 1);
+    nBlockWorkers         = std::max<int64_t>(std::min<int64_t>(nBlockWorkers, CWorkerPool::MAX_THREADS), 0);
+    if (nBlockWorkers > 0) {
+        pBlockWorkerPool = new CWorkerPool("blockworker", nBlockWorkers);
+        LogPrint(BCLog::INFO, "Using %d block validation worker threads\n", nBlockWorkers);
+    }
+    SysCfg().SetParallelExec(pBlockWorkerPool != nullptr && SysCfg().GetBoolArg("-parallelexec", false));
+
     filesystem::path blocksDir = GetDataDir() / "blocks";
     if (!filesystem::exists(blocksDir)) {
         filesystem::create_directories(blocksDir);
@@ -696,6 +788,21 @@ bool AppInit(boost::thread_group &threadGroup) {
 
                 bool fReIndex = SysCfg().IsReindex();
                 pCdMan = new CCacheDBManager(fReIndex, false);
+
+                if (fReIndex && SysCfg().IsArgCount("-loadsnapshot")) {
+                    CChainSnapshotHeader snapshotHeader;
+                    CChainSnapshotStats snapshotStats;
+                    uint256 snapshotHash = uint256S(SysCfg().GetArg("-snapshothash", ""));
+                    if (!LoadChainSnapshot(*pCdMan, SysCfg().GetArg("-loadsnapshot", ""), pBlockWorkerPool,
+                                           snapshotHash, snapshotHeader, snapshotStats)) {
+                        strLoadError = _("Error loading chain state snapshot");
+                        break;
+                    }
+                    SetLoadedSnapshot(snapshotHeader.height, snapshotHeader.block_hash);
+                }
+                // built from the dbs as loaded, the snapshot is written to the stores, not through the filters
+                if (!pCdMan->InitBloomFilters())
+                    return InitError(_("Invalid -dbbloomfilter, see the log for the unsupported key prefix type"));
                 if (fReIndex)
                     pCdMan->pBlockCache->WriteReindexing(true);
 
@@ -723,14 +830,16 @@ bool AppInit(boost::thread_group &threadGroup) {
                     break;
                 }
 
-                if (!VerifyDB(SysCfg().GetArg("-checklevel", 3), SysCfg().GetArg("-checkblocks", 288))) {
+                if (!SysCfg().GetBoolArg("-backgroundverify", false) &&
+                    !VerifyDB(SysCfg().GetArg("-checklevel", 3), SysCfg().GetArg("-checkblocks", 288))) {
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
 
             } catch (std::exception &e) {
                 LogPrint(BCLog::INFO, "%s\n", e.what());
-                strLoadError = _("Error opening block database");
+                // e.g. the chain state layout to delete by the user
+                strLoadError = strprintf("%s: %s", _("Error opening block database"), e.what());
                 break;
             }
 
@@ -812,6 +921,17 @@ bool AppInit(boost::thread_group &threadGroup) {
         return InitError("Init prices of PriceFeedMemCache failed");
     }
 
+    // the mempool is reloaded before the blocks are imported and the node is started, a reindex drops it
+    if (SysCfg().GetBoolArg("-persistmempool", true) && !SysCfg().IsReindex()) {
+        if (!LoadMemPool(pBlockWorkerPool))
+            LogPrint(BCLog::INFO, "Invalid mempool.dat, the mempool starts empty\n");
+
+        int64_t nDumpInterval = SysCfg().GetArg("-mempooldumpinterval", DEFAULT_MEMPOOL_DUMP_INTERVAL);
+        if (nDumpInterval > 0)
+            threadGroup.create_thread(
+                boost::bind(&LoopForever<bool (*)()>, "dumpmempool", &DumpMemPool, nDumpInterval * 1000));
+    }
+
     vector<boost::filesystem::path> vImportFiles;
     if (SysCfg().IsArgCount("-loadblock")) {
         vector<string> tmp = SysCfg().GetMultiArgs("-loadblock");
@@ -859,6 +979,15 @@ bool AppInit(boost::thread_group &threadGroup) {
         threadGroup.create_thread(boost::bind(&ThreadRelayTx, pWalletMain));
     }
 
+    // the staged admission of the RPC txs
+    int64_t nAdmissionWorkers = SysCfg().GetArg("-admissionworkers", 0);
+    nAdmissionWorkers         = std::min<int64_t>(nAdmissionWorkers, CWorkerPool::MAX_THREADS);
+    if (pWalletMain && nAdmissionWorkers > 0) {
+        pTxAdmission = new CTxAdmission(signatureCache, &GetAdmissionSigVerifyItems, &CommitAdmissionTx);
+        pTxAdmission->Start(nAdmissionWorkers);
+        LogPrint(BCLog::INFO, "Using %d tx admission worker threads\n", nAdmissionWorkers);
+    }
+
     return !fRequestShutdown;
 }
 
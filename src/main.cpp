@@ -27,10 +27,13 @@
 #include "p2p/sendmessage.hpp"
 #include "chain/blockdelegates.h"
 #include "persistence/blockundo.h"
+#include "persistence/snapshot.h"
+#include "persistence/speculativeexec.h"
 #include "tx/txserializer.h"
 
 #include <sstream>
 #include <algorithm>
+#include <atomic>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -54,10 +57,17 @@ CCacheDBManager *pCdMan = nullptr;
 CCriticalSection cs_main;
 CTxMemPool mempool;
 map<uint256, CBlockIndex *> mapBlockIndex;
+// must be defined before CMainCleanup, which tells the loaded indexes of mapBlockIndex from the new'ed ones
+CBlockIndexArena blockIndexArena;
 int32_t nSyncTipHeight = 0;
 string publicIp;
 map<uint256/* blockhash */, std::shared_ptr<CCacheWrapper>> mapForkCache;
 CSignatureCache signatureCache;
+// the reward txs of the latest connected blocks, the mature ones are executed again in ConnectBlock
+static CRewardTxQueue rewardTxQueue(BLOCK_REWARD_MATURITY * 2);
+CWorkerPool *pBlockWorkerPool = nullptr;
+// the snapshot block of the chain state loaded by -loadsnapshot, null once it is connected
+static CChainSnapshotHeader loadedSnapshot;
 CChain chainActive;
 CChain chainMostWork;
 bool mining;        // could change from time to time due to vote change
@@ -97,6 +107,7 @@ namespace {
             mapBlocksToDownload.erase(hash);
 
         mapNodeState.erase(nodeid);
+        headersSync.RemovePeer(nodeid);
     }
 
     struct CBlockIndexWorkComparator {
@@ -251,7 +262,7 @@ bool VerifySignature(const uint256 &sigHash, const std::vector<uint8_t> &signatu
 }
 
 bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state, CBaseTx *pBaseTx,
-                        bool fLimitFree, bool fRejectInsaneFee) {
+                        bool fLimitFree, bool fRejectInsaneFee, int64_t entryTime, uint32_t entryHeight) {
     AssertLockHeld(cs_main);
 
     // is it already in the memory pool?
@@ -284,7 +295,8 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state, CBaseTx *pBas
     if (!pBaseTx->CheckBaseTx(context) || !pBaseTx->CheckTx(context))
         return ERRORMSG("AcceptToMemoryPool() : CheckBaseTx/CheckTx failed, txid: %s", hash.GetHex());
 
-    CTxMemPoolEntry entry(pBaseTx, GetTime(), newHeight);
+    CTxMemPoolEntry entry(pBaseTx, entryTime > 0 ? entryTime : GetTime(),
+                          entryHeight > 0 ? std::min<uint32_t>(entryHeight, newHeight) : newHeight);
     auto nFees = std::get<1>(entry.GetFees());
     auto nSize = entry.GetTxSize();
     // Continuously rate-limit free trx
@@ -316,6 +328,78 @@ bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state, CBaseTx *pBas
     return pool.AddUnchecked(hash, entry, state);
 }
 
+// the dump must not replace mempool.dat before the mempool is loaded from it
+static std::atomic<bool> fMemPoolLoaded{false};
+
+bool DumpMemPool() {
+    if (!fMemPoolLoaded)
+        return false;
+
+    int64_t beginTime = GetTimeMillis();
+    vector<CMemPoolDumpEntry> entries;
+    mempool.GetDumpEntries(entries);
+    if (!WriteMemPoolFile(GetDataDir() / "mempool.dat", entries))
+        return false;
+
+    LogPrint(BCLog::INFO, "Dumped %u mempool txs to mempool.dat (%dms)\n", (uint32_t)entries.size(),
+             GetTimeMillis() - beginTime);
+    return true;
+}
+
+bool LoadMemPool(CWorkerPool *pWorkerPool) {
+    int64_t beginTime = GetTimeMillis();
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    if (!boost::filesystem::exists(path)) {
+        fMemPoolLoaded = true;
+        return true;
+    }
+
+    // a bad file is replaced by the next dump
+    vector<CMemPoolDumpEntry> entries;
+    if (!ReadMemPoolFile(path, pWorkerPool, entries)) {
+        fMemPoolLoaded = true;
+        return false;
+    }
+    int64_t readTime = GetTimeMillis();
+
+    LOCK(cs_main);
+    // the stateless checks ahead, the signatures are verified on the workers into the signature cache
+    if (pWorkerPool != nullptr) {
+        CCacheWrapper cw(mempool.cw.get());
+        int32_t height = chainActive.Height() + 1;
+        vector<CSigVerifyItem> items;
+        items.reserve(entries.size());
+        for (const auto &entry : entries) {
+            if (entry.pTx != nullptr)
+                entry.pTx->GetSigVerifyItems(cw, height, items);
+        }
+        VerifySignatures(*pWorkerPool, signatureCache, items);
+    }
+    int64_t verifyTime = GetTimeMillis();
+
+    // the rehearsal execution in the order of the dump, a tx follows the ones it depends on
+    uint32_t acceptedCount = 0, failedCount = 0, existedCount = 0;
+    for (const auto &entry : entries) {
+        if (entry.pTx == nullptr) {
+            failedCount++;
+            continue;
+        }
+        CValidationState state;
+        if (AcceptToMemoryPool(mempool, state, entry.pTx.get(), false, false, entry.time, entry.height))
+            acceptedCount++;
+        else if (state.GetRejectReason() == "tx-already-in-mempool")
+            existedCount++;
+        else
+            failedCount++;
+    }
+    fMemPoolLoaded = true;
+
+    LogPrint(BCLog::INFO, "Loaded %u of %u mempool txs from mempool.dat, failed=%u, existed=%u, read: %dms, "
+             "verify: %dms, execute: %dms\n", acceptedCount, (uint32_t)entries.size(), failedCount, existedCount,
+             readTime - beginTime, verifyTime - readTime, GetTimeMillis() - verifyTime);
+    return true;
+}
+
 int32_t CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex *&pindexRet) const {
     if (blockHash.IsNull() || index == -1)
         return 0;
@@ -685,17 +769,27 @@ bool DisconnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CVal
 
     bool fClean = true;
 
-    CBlockUndo blockUndo;
     CDiskBlockPos pos = pIndex->GetUndoPos();
     if (pos.IsNull())
         return ERRORMSG("DisconnectBlock() : no undo data available");
 
-    if (!blockUndo.ReadFromDisk(pos, pIndex->pprev->GetBlockHash()))
-        return ERRORMSG("DisconnectBlock() : failure reading undo data");
+    CBlockUndo blockUndo;
+    CBlockUndoJournal undoJournal;
+    size_t undoTxCount;
+    if (pIndex->nStatus & BLOCK_UNDO_JOURNAL) {
+        if (!undoJournal.ReadFromDisk(pos, pIndex->pprev->GetBlockHash()))
+            return ERRORMSG("DisconnectBlock() : failure reading undo data");
+        undoTxCount = undoJournal.GetTxCount();
+    } else {
+        if (!blockUndo.ReadFromDisk(pos, pIndex->pprev->GetBlockHash()))
+            return ERRORMSG("DisconnectBlock() : failure reading undo data");
+        undoTxCount = blockUndo.vtxundo.size();
+    }
 
-    if ((blockUndo.vtxundo.size() != block.vptx.size()) && (blockUndo.vtxundo.size() != (block.vptx.size() + 1)))
+    if ((undoTxCount != block.vptx.size()) && (undoTxCount != (block.vptx.size() + 1)))
         return ERRORMSG("DisconnectBlock() : block and undo data inconsistent");
-    CBlockUndoExecutor undoExecutor(cw, blockUndo);
+    CBlockUndoExecutor undoExecutor = (pIndex->nStatus & BLOCK_UNDO_JOURNAL) ?
+            CBlockUndoExecutor(cw, undoJournal) : CBlockUndoExecutor(cw, blockUndo);
     if (!undoExecutor.Execute()) {
         return ERRORMSG("DisconnectBlock() : Undo all data in block failed");
     }
@@ -704,7 +798,7 @@ bool DisconnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CVal
     cw.blockCache.SetBestBlock(pIndex->pprev->GetBlockHash());
 
     // Delete the disconnected block's transactions from transaction memory cache.
-    if (!cw.txCache.RemoveBlockTx(block)) {
+    if (!cw.txCache.RemoveBlockTx(pIndex->height)) {
         return state.Abort(_("DisconnectBlock() : failed to delete block from transaction memory cache"));
     }
 
@@ -910,18 +1004,12 @@ bool SaveTxIndex(const uint256 &txid, CCacheWrapper &cw, CValidationState &state
 // compute vote staking interest && revoke votes
 static bool ComputeVoteStakingInterestAndRevokeVotes(const int32_t currHeight, const uint32_t currBlockTime,
                                                     CCacheWrapper &cw, CValidationState &state) {
-    // acquire votes list
-    map<CRegIDKey, vector<CCandidateReceivedVote>> regId2ReceivedVotes;
-    if (!cw.delegateCache.GetVoterList(regId2ReceivedVotes)) {
-        return state.DoS(100, ERRORMSG("ComputeVoteStakingInterestAndRevokeVotes() : failed to get vote list"),
-                         REJECT_INVALID, "bad-get-vote-list");
-    }
-
-    // revoke votes if necessary
+    // revoke votes if necessary, the voters are read lazily from the vote list
     map<CRegID, vector<CCandidateVote>> regId2CandidateVotes;
-    for (auto &item : regId2ReceivedVotes) {
-        const CRegID &regId = item.first.regid;
-        auto &candidateReceivedVotes = item.second;
+    auto spVoterIt = cw.delegateCache.CreateVoterIterator();
+    for (spVoterIt->First(); spVoterIt->IsValid(); spVoterIt->Next()) {
+        const CRegID &regId = spVoterIt->GetKey().regid;
+        const auto &candidateReceivedVotes = spVoterIt->GetValue();
         vector<CCandidateVote> candidateVotes;
         assert(!candidateReceivedVotes.empty());
         // If the voter only votes to one candidate, not bother to revoke votes.
@@ -1007,6 +1095,29 @@ static bool ComputeVoteStakingInterestAndRevokeVotes(const int32_t currHeight, c
     return true;
 }
 
+// the txs which may be executed speculatively in parallel, see -parallelexec
+static bool IsParallelExecTx(TxType txType) {
+    return txType == BCOIN_TRANSFER_TX || txType == UCOIN_TRANSFER_TX;
+}
+
+// verify the tx signatures of the block on the block workers, the valid ones are put into the signature
+// cache, so the serial tx execution mostly hits the cache
+static void PreVerifyBlockSignatures(CBlock &block, CCacheWrapper &cw, int32_t height) {
+    if (pBlockWorkerPool == nullptr || block.vptx.size() <= 2)
+        return;
+
+    int64_t beginTime = GetTimeMicros();
+    vector<CSigVerifyItem> items;
+    items.reserve(block.vptx.size());
+    for (size_t index = 1; index < block.vptx.size(); index++)
+        block.vptx[index]->GetSigVerifyItems(cw, height, items);
+
+    VerifySignatures(*pBlockWorkerPool, signatureCache, items);
+    if (SysCfg().IsBenchmark())
+        LogPrint(BCLog::INFO, "- Pre-verify %u signatures: %.2fms\n", (uint32_t)items.size(),
+                 0.001 * (GetTimeMicros() - beginTime));
+}
+
 bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValidationState &state, bool fJustCheck) {
     AssertLockHeld(cs_main);
 
@@ -1059,13 +1170,16 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
     if (!VerifyRewardTx(&block, cw, curDelegate, totalDelegateNum))
         return state.DoS(100, ERRORMSG("ConnectBlock() : verify reward tx error"), REJECT_INVALID, "bad-reward-tx");
 
-    CBlockUndo blockUndo;
+    PreVerifyBlockSignatures(block, cw, pIndex->height);
+
+    CBlockUndoJournal blockUndo;
     int64_t nStart = GetTimeMicros();
     std::vector<pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vptx.size());
 
     CDiskTxPos pos(pIndex->GetBlockPos(), GetSizeOfCompactSize(block.vptx.size()));
     CDiskTxPos rewardPos = pos;
+    // the txs read with the block keep their sizes, they are not serialized again for the positions
     pos.nTxOffset += ::GetSerializeSize(block.vptx[0], SER_DISK, CLIENT_VERSION);
 
     // Re-compute reward values and total fuel
@@ -1078,8 +1192,36 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
         int32_t validHeight   = SysCfg().GetTxCacheHeight();
         uint32_t fuelRate     = block.GetFuelRate();
         uint64_t totalRunStep = 0;
+        uint32_t prevBlockTime = pIndex->pprev != nullptr ? pIndex->pprev->GetBlockTime() : pIndex->GetBlockTime();
+
+        // the runs of transfer txs are executed speculatively on the block workers, each tx on a copy of
+        // itself and its own cache, then committed in order below
+        std::unique_ptr<CSpeculativeExecutor<CCacheWrapper>> pExecutor;
+        vector<std::shared_ptr<CBaseTx>> speculatedTxs;
+        vector<CValidationState> speculatedStates;
+        if (SysCfg().IsParallelExec() && pBlockWorkerPool != nullptr) {
+            pExecutor.reset(new CSpeculativeExecutor<CCacheWrapper>(*pBlockWorkerPool, cw));
+            speculatedTxs.resize(block.vptx.size());
+            speculatedStates.resize(block.vptx.size());
+        }
+        auto speculateTx = [&](size_t index, CCacheWrapper &txCw) {
+            speculatedTxs[index]            = block.vptx[index]->GetNewInstance();
+            speculatedTxs[index]->nFuelRate = fuelRate;
+            speculatedStates[index]         = CValidationState();
+            CTxExecuteContext context(pIndex->height, index, fuelRate, pIndex->nTime, prevBlockTime, &txCw,
+                                      &speculatedStates[index]);
+            return speculatedTxs[index]->CheckAndExecuteTx(context);
+        };
 
         for (int32_t index = 1; index < (int32_t)block.vptx.size(); ++index) {
+            if (pExecutor && !pExecutor->IsSpeculated(index)) {
+                int32_t runEnd = index;
+                while (runEnd < (int32_t)block.vptx.size() && IsParallelExecTx(block.vptx[runEnd]->nTxType))
+                    runEnd++;
+                if (runEnd - index > 1)
+                    pExecutor->Speculate(index, runEnd, speculateTx);
+            }
+
             std::shared_ptr<CBaseTx> &pBaseTx = block.vptx[index];
             if (cw.txCache.HasTx((pBaseTx->GetHash())))
                 return state.DoS(100, ERRORMSG("ConnectBlock() : txid=%s duplicated", pBaseTx->GetHash().GetHex()),
@@ -1092,9 +1234,18 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
             pBaseTx->nFuelRate = fuelRate;
             CTxUndoOpLogger opLogger(cw, pBaseTx->GetHash(), blockUndo);
 
-            uint32_t prevBlockTime = pIndex->pprev != nullptr ? pIndex->pprev->GetBlockTime() : pIndex->GetBlockTime();
-            CTxExecuteContext context(pIndex->height, index, fuelRate, pIndex->nTime, prevBlockTime, &cw, &state);
-            if (!pBaseTx->CheckAndExecuteTx(context)) {
+            bool executed;
+            if (pExecutor && pExecutor->IsSpeculated(index)) {
+                executed = pExecutor->Commit(index, blockUndo);
+                // the executed copy takes the place of the tx, as the serial execution updates the tx itself
+                pBaseTx = speculatedTxs[index];
+                if (!executed)
+                    state = speculatedStates[index];
+            } else {
+                CTxExecuteContext context(pIndex->height, index, fuelRate, pIndex->nTime, prevBlockTime, &cw, &state);
+                executed = pBaseTx->CheckAndExecuteTx(context);
+            }
+            if (!executed) {
                 pCdMan->pLogCache->SetExecuteFail(pIndex->height, pBaseTx->GetHash(), state.GetRejectCode(), state.GetRejectReason());
                 return state.DoS(100, ERRORMSG("ConnectBlock() : txid=%s check/execute failed, in detail: %s",
                                  pBaseTx->GetHash().GetHex(), pBaseTx->ToString(cw.accountCache)), REJECT_INVALID, "tx-execute-failed");
@@ -1121,6 +1272,9 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
             LogPrint(BCLog::DEBUG, "total fuel fee:%d, tx fuel fee:%d runStep:%d fuelRate:%d txid:%s\n", totalFuel,
                      fuel, pBaseTx->nRunStep, fuelRate, pBaseTx->GetHash().GetHex());
         }
+
+        if (pExecutor && SysCfg().IsBenchmark())
+            LogPrint(BCLog::INFO, "- Parallel execution: %u txs executed again\n", pExecutor->GetReexecutedCount());
     }
 
     // Verify total fuel
@@ -1203,16 +1357,21 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
         }
 
         if (nullptr != pMatureIndex) {
-            CBlock matureBlock;
-            if (!ReadBlockFromDisk(pMatureIndex, matureBlock)) {
-                return state.Abort(_("ConnectBlock() : read mature block error"));
+            // the reward tx of the mature block is mostly kept in memory since the block was connected
+            std::shared_ptr<CBaseTx> pMatureRewardTx = rewardTxQueue.Get(pMatureIndex->GetBlockHash());
+            if (!pMatureRewardTx) {
+                CBlock matureBlock;
+                if (!ReadBlockFromDisk(pMatureIndex, matureBlock)) {
+                    return state.Abort(_("ConnectBlock() : read mature block error"));
+                }
+                pMatureRewardTx = matureBlock.vptx[0];
             }
 
             uint32_t prevBlockTime = pIndex->pprev != nullptr ? pIndex->pprev->GetBlockTime() : pIndex->GetBlockTime();
             CTxExecuteContext context(pIndex->height, -1, pIndex->nFuelRate, pIndex->nTime, prevBlockTime, &cw, &state);
             CTxUndoOpLogger rewardOpLogger(cw, block.vptx[0]->GetHash(), blockUndo);
-            if (!matureBlock.vptx[0]->ExecuteFullTx(context)) {
-                pCdMan->pLogCache->SetExecuteFail(pIndex->height, matureBlock.vptx[0]->GetHash(), state.GetRejectCode(),
+            if (!pMatureRewardTx->ExecuteFullTx(context)) {
+                pCdMan->pLogCache->SetExecuteFail(pIndex->height, pMatureRewardTx->GetHash(), state.GetRejectCode(),
                                                   state.GetRejectReason());
                 return state.DoS(100, ERRORMSG("ConnectBlock() : execute mature block reward tx error"));
             }
@@ -1230,7 +1389,7 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
     if (pIndex->GetUndoPos().IsNull() || (pIndex->nStatus & BLOCK_VALID_MASK) < BLOCK_VALID_SCRIPTS) {
         if (pIndex->GetUndoPos().IsNull()) {
             CDiskBlockPos pos;
-            if (!FindUndoPos(state, pIndex->nFile, pos, ::GetSerializeSize(blockUndo, SER_DISK, CLIENT_VERSION) + 40))
+            if (!FindUndoPos(state, pIndex->nFile, pos, blockUndo.GetDataSize() + 40))
                 return state.Abort(_("ConnectBlock() : failed to find undo data's position"));
 
             // uint256 preHash;
@@ -1251,7 +1410,7 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
 
             // Update nUndoPos in block index
             pIndex->nUndoPos = pos.nPos;
-            pIndex->nStatus |= BLOCK_HAVE_UNDO;
+            pIndex->nStatus |= BLOCK_HAVE_UNDO | BLOCK_UNDO_JOURNAL;
         }
 
         pIndex->nStatus = (pIndex->nStatus & ~BLOCK_VALID_MASK) | BLOCK_VALID_SCRIPTS;
@@ -1266,22 +1425,13 @@ bool ConnectBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValida
     }
 
     if (pIndex->height > SysCfg().GetTxCacheHeight()) {
-        CBlockIndex *pDeleteBlockIndex = pIndex;
-        int32_t nCacheHeight           = SysCfg().GetTxCacheHeight();
-        while (pDeleteBlockIndex && nCacheHeight-- > 0) {
-            pDeleteBlockIndex = pDeleteBlockIndex->pprev;
-        }
-
-        CBlock deleteBlock;
-        if (!ReadBlockFromDisk(pDeleteBlockIndex, deleteBlock)) {
-            return state.Abort(_("ConnectBlock() : failed to read block"));
-        }
-
-        if (!cw.txCache.RemoveBlockTx(deleteBlock)) {
+        if (!cw.txCache.RemoveBlockTx(pIndex->height - SysCfg().GetTxCacheHeight())) {
             return state.Abort(_("ConnectBlock() : failed delete block from transaction memory cache"));
         }
     }
 
+    rewardTxQueue.Push(block.GetHash(), block.vptx[0]);
+
     if (!cw.ppCache.PushBlock(cw.sysParamCache, pIndex))
         return state.Abort(_("ConnectBlock() : push block to price point memory cache failed"));
 
@@ -1307,8 +1457,10 @@ bool static WriteChainState(CValidationState &state) {
         pCdMan->pLogCache->GetCacheSize() +
         pCdMan->pReceiptCache->GetCacheSize();
 
-    if (!IsInitialBlockDownload() || cacheSize > SysCfg().GetCacheSize() ||
-        GetTimeMicros() > nLastWrite + 60 * 1000000) {
+    // the dirty data is flushed early when it uses more than half of the -dbcache budget
+    bool fFlush = !IsInitialBlockDownload() || cacheSize > DBCacheBudget().GetDirtyLimit() ||
+                  GetTimeMicros() > nLastWrite + 60 * 1000000;
+    if (fFlush) {
         // Typical CCoins structures on disk are around 100 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
@@ -1319,16 +1471,23 @@ bool static WriteChainState(CValidationState &state) {
 
         FlushBlockFile();
         // pCdMan->pBlockCache->Sync();
-        pCdMan->Flush();
+        if (!pCdMan->Flush())
+            return state.Abort(_("Failed to write the chain state"));
+
         mapForkCache.clear();
         nLastWrite = GetTimeMicros();
     }
+
+    // evict the least recently used clean data of the top level caches
+    DBCacheBudget().Evict(fFlush ? 0 : cacheSize);
     return true;
 }
 
 // Update chainActive and related internal data structures.
 void static UpdateTip(CBlockIndex *pIndexNew, const CBlock &block) {
     chainActive.SetTip(pIndexNew);
+    // the block template waiting for the changes is built again on the new tip
+    mempool.NotifyChange();
 
     SyncTransaction(uint256(), nullptr, &block);
 
@@ -1396,6 +1555,7 @@ bool static DisconnectTip(CValidationState &state) {
         return false;
     // Update chainActive and related variables.
     UpdateTip(pIndexDelete->pprev, block);
+    mempool.BlockDisconnected();
     // Resurrect mempool transactions from the disconnected block.
     for (const auto &pTx : block.vptx) {
         list<std::shared_ptr<CBaseTx> > removed;
@@ -1412,6 +1572,57 @@ bool static DisconnectTip(CValidationState &state) {
     return true;
 }
 
+void SetLoadedSnapshot(int32_t height, const uint256 &blockHash) {
+    LOCK(cs_main);
+    loadedSnapshot.height     = height;
+    loadedSnapshot.block_hash = blockHash;
+}
+
+// Connect the block up to the loaded snapshot, its state changes are in the snapshot already. Only the tx index
+// is written, the block has no undo data so it can not be disconnected.
+static bool ConnectSnapshotBlock(CBlock &block, CCacheWrapper &cw, CBlockIndex *pIndex, CValidationState &state) {
+    AssertLockHeld(cs_main);
+
+    if (pIndex->height == loadedSnapshot.height && pIndex->GetBlockHash() != loadedSnapshot.block_hash)
+        return state.Abort(strprintf("ConnectSnapshotBlock() : block [%d]:%s is not the snapshot block %s",
+                                     pIndex->height, pIndex->GetBlockHash().ToString(),
+                                     loadedSnapshot.block_hash.ToString()));
+
+    CDiskTxPos pos(pIndex->GetBlockPos(), GetSizeOfCompactSize(block.vptx.size()));
+    for (const auto &pTx : block.vptx) {
+        if (!SaveTxIndex(pTx->GetHash(), cw, state, pos))
+            return state.Abort(_("ConnectSnapshotBlock() : failed to save tx index"));
+        pos.nTxOffset += ::GetSerializeSize(pTx, SER_DISK, CLIENT_VERSION);
+    }
+
+    pIndex->nStatus = (pIndex->nStatus & ~BLOCK_VALID_MASK) | BLOCK_VALID_SCRIPTS;
+    CDiskBlockIndex blockIndex(pIndex);
+    if (!pCdMan->pBlockIndexDb->WriteBlockIndex(blockIndex))
+        return state.Abort(_("ConnectSnapshotBlock() : failed to write block index"));
+
+    if (pIndex->height == loadedSnapshot.height) {
+        // the memory caches of the latest blocks are rebuilt as on startup, the later blocks are executed
+        int32_t nCacheHeight = SysCfg().GetTxCacheHeight();
+        CBlock cacheBlock;
+        for (CBlockIndex *pCacheIndex = pIndex; pCacheIndex && nCacheHeight-- > 0; pCacheIndex = pCacheIndex->pprev) {
+            if (!ReadBlockFromDisk(pCacheIndex, cacheBlock))
+                return state.Abort(_("ConnectSnapshotBlock() : failed to read block"));
+
+            if (!cw.txCache.AddBlockTx(cacheBlock))
+                return state.Abort(_("ConnectSnapshotBlock() : failed add block into transaction memory cache"));
+        }
+
+        if (!cw.ppCache.ReleadBlocks(cw.sysParamCache, pIndex))
+            return state.Abort(_("ConnectSnapshotBlock() : reload prices of price point memory cache failed"));
+
+        LogPrint(BCLog::INFO, "ConnectSnapshotBlock() : reached the snapshot block [%d]:%s\n", pIndex->height,
+                 pIndex->GetBlockHash().ToString());
+        loadedSnapshot.SetNull();
+    }
+
+    return true;
+}
+
 // Connect a new block to chainActive.
 bool static ConnectTip(CValidationState &state, CBlockIndex *pIndexNew) {
     assert(pIndexNew->pprev == chainActive.Tip());
@@ -1426,7 +1637,10 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pIndexNew) {
         CInv inv(MSG_BLOCK, pIndexNew->GetBlockHash());
 
         auto spCW = std::make_shared<CCacheWrapper>(pCdMan);
-        if (!ConnectBlock(block, *spCW, pIndexNew, state)) {
+        bool fConnected = pIndexNew->height <= loadedSnapshot.height
+                              ? ConnectSnapshotBlock(block, *spCW, pIndexNew, state)
+                              : ConnectBlock(block, *spCW, pIndexNew, state);
+        if (!fConnected) {
             if (state.IsInvalid()) {
                 InvalidBlockFound(pIndexNew, state);
             }
@@ -1453,8 +1667,9 @@ bool static ConnectTip(CValidationState &state, CBlockIndex *pIndexNew) {
     UpdateTip(pIndexNew, block);
 
     for (auto &pTxItem : block.vptx) {
-        mempool.memPoolTxs.erase(pTxItem->GetHash());
+        mempool.Erase(pTxItem->GetHash());
     }
+    mempool.BlockConnected(pIndexNew);
     return true;
 }
 
@@ -1854,20 +2069,34 @@ bool ProcessForkedChain(const CBlock &block, CBlockIndex *pPreBlockIndex, CValid
 }
 
 bool CheckBlock(const CBlock &block, CValidationState &state, CCacheWrapper &cw, bool fCheckTx, bool fCheckMerkleRoot) {
+    // Check timestamp `block interval' + 2 seconds limits, against the current time on every call
+    if (block.GetBlockTime() > GetAdjustedTime() + ::GetBlockInterval(block.GetHeight()) + 2)
+        return state.Invalid(ERRORMSG("CheckBlock() : block timestamp too far in the future"), REJECT_INVALID,
+                             "time-too-new");
+
+    // the checks below do not depend on the chain nor on the time, they are done once per block, ahead on the
+    // block workers for the imported blocks, and not again in ConnectBlock()
+    if (block.fChecked)
+        return true;
+
+    // the sizes of the txs read from a stream are not serialized again
+    int64_t beginTime = GetTimeMicros();
     if (block.vptx.empty() || block.vptx.size() > MAX_BLOCK_SIZE ||
         ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
         return state.DoS(100, ERRORMSG("CheckBlock() : size limits failed"), REJECT_INVALID, "bad-blk-length");
 
+    if (SysCfg().IsBenchmark()) {
+        uint32_t wireSizeCount = std::count_if(block.vptx.begin(), block.vptx.end(),
+                                               [](const std::shared_ptr<CBaseTx> &pTx) { return pTx->serialize_size.size > 0; });
+        LogPrint(BCLog::INFO, "- Check block size: %.2fms (%u of %u tx sizes read)\n",
+                 0.001 * (GetTimeMicros() - beginTime), wireSizeCount, (uint32_t)block.vptx.size());
+    }
+
     if ((block.GetHeight() != 0 || block.GetHash() != SysCfg().GetGenesisBlockHash()) &&
         block.GetVersion() != CBlockHeader::CURRENT_VERSION) {
         return state.Invalid(ERRORMSG("CheckBlock() : block version error"), REJECT_INVALID, "block-version-error");
     }
 
-    // Check timestamp `block interval' + 2 seconds limits
-    if (block.GetBlockTime() > GetAdjustedTime() + ::GetBlockInterval(block.GetHeight()) + 2)
-        return state.Invalid(ERRORMSG("CheckBlock() : block timestamp too far in the future"), REJECT_INVALID,
-                             "time-too-new");
-
     // First transaction must be reward transaction, the rest must not be
     if (block.vptx.empty() || !block.vptx[0]->IsBlockRewardTx())
         return state.DoS(100, ERRORMSG("CheckBlock() : first tx is not coinbase"), REJECT_INVALID, "bad-cb-missing");
@@ -1914,6 +2143,9 @@ bool CheckBlock(const CBlock &block, CValidationState &state, CCacheWrapper &cw,
     if (block.GetNonce() > maxNonce)
         return state.Invalid(ERRORMSG("CheckBlock() : Nonce is larger than maxNonce"), REJECT_INVALID, "Nonce-too-large");
 
+    if (fCheckMerkleRoot)
+        block.fChecked = true;
+
     return true;
 }
 
@@ -2094,6 +2326,26 @@ void CBlockIndex::BuildSkip() {
         pskip = pprev->GetAncestor(GetSkipHeight(height));
 }
 
+CBlockIndex *CBlockIndexArena::Allocate(size_t count) {
+    slabs.emplace_back(std::unique_ptr<CBlockIndex[]>(new CBlockIndex[count]), count);
+    return slabs.back().first.get();
+}
+
+bool CBlockIndexArena::Contains(const CBlockIndex *pIndex) const {
+    for (const auto &slab : slabs) {
+        if (pIndex >= slab.first.get() && pIndex < slab.first.get() + slab.second)
+            return true;
+    }
+    return false;
+}
+
+size_t CBlockIndexArena::GetCount() const {
+    size_t count = 0;
+    for (const auto &slab : slabs)
+        count += slab.second;
+    return count;
+}
+
 void PushGetBlocks(CNode *pNode, CBlockIndex *pIndexBegin, uint256 hashEnd) {
     // Ask this guy to fill in what we're missing
     AssertLockHeld(cs_main);
@@ -2199,7 +2451,9 @@ bool ProcessBlock(CValidationState &state, CNode *pFrom, CBlock *pBlock, CDiskBl
                      pBlock->GetHeight(), pBlock->GetHash().GetHex(), success ? "keep" : "abandon",
                      chainActive.Height(), chainActive.Tip()->GetBlockHash().GetHex(), mapOrphanBlocksByPrev.size());
 
-            PushGetBlocksOnCondition(pFrom, chainActive.Tip(), GetOrphanRoot(blockHash));
+            // the blocks of the header chain in between are requested by the headers-first download
+            if (!headersSync.HasHeader(blockHash))
+                PushGetBlocksOnCondition(pFrom, chainActive.Tip(), GetOrphanRoot(blockHash));
         }
         return true;
     }
@@ -2265,21 +2519,16 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes) {
 }
 
 bool static LoadBlockIndexDB() {
-    if (!pCdMan->pBlockIndexDb->LoadBlockIndexes())
+    int64_t beginTime = GetTimeMillis();
+    vector<CBlockIndex *> vSortedByHeight;
+    if (!pCdMan->pBlockIndexDb->LoadBlockIndexes(pBlockWorkerPool, vSortedByHeight))
         return ERRORMSG("%s(), LoadBlockIndexes from db failed", __FUNCTION__);
 
     boost::this_thread::interruption_point();
+    int64_t loadTime = GetTimeMillis();
 
     // Calculate nChainWork
-    vector<pair<int32_t, CBlockIndex *> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const auto &item : mapBlockIndex) {
-        CBlockIndex *pIndex = item.second;
-        vSortedByHeight.push_back(make_pair(pIndex->height, pIndex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const auto &item : vSortedByHeight) {
-        CBlockIndex *pIndex = item.second;
+    for (CBlockIndex *pIndex : vSortedByHeight) {
         pIndex->nChainWork  = pIndex->height;
         pIndex->nChainTx    = (pIndex->pprev ? pIndex->pprev->nChainTx : 0) + pIndex->nTx;
         if ((pIndex->nStatus & BLOCK_VALID_MASK) >= BLOCK_VALID_TRANSACTIONS && !(pIndex->nStatus & BLOCK_FAILED_MASK))
@@ -2291,6 +2540,14 @@ bool static LoadBlockIndexDB() {
             pIndex->BuildSkip();
     }
 
+    size_t signatureBytes = 0;
+    for (CBlockIndex *pIndex : vSortedByHeight)
+        signatureBytes += pIndex->vSignature.capacity();
+    LogPrint(BCLog::INFO, "LoadBlockIndexDB(): loaded %u block indexes with %u workers, load=%lldms, chain=%lldms, "
+             "slab=%.1fMB, signatures=%.1fMB\n", vSortedByHeight.size(),
+             pBlockWorkerPool != nullptr ? pBlockWorkerPool->GetThreadCount() : 0, loadTime - beginTime,
+             GetTimeMillis() - loadTime, blockIndexArena.GetMemoryUsage() / 1048576.0, signatureBytes / 1048576.0);
+
     // Load block file info
     pCdMan->pBlockCache->ReadLastBlockFile(nLastBlockFile);
     LogPrint(BCLog::INFO, "LoadBlockIndexDB(): last block file = %i\n", nLastBlockFile);
@@ -2327,7 +2584,7 @@ bool static LoadBlockIndexDB() {
     return true;
 }
 
-bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth) {
+bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth, bool fCheckBlocks) {
     LOCK(cs_main);
     if (chainActive.Tip() == nullptr || chainActive.Tip()->pprev == nullptr)
         return true;
@@ -2361,20 +2618,27 @@ bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth) {
                             pIndex->height, pIndex->GetBlockHash().ToString());
 
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, *spCW, false))
+        if (fCheckBlocks && nCheckLevel >= 1 && !CheckBlock(block, state, *spCW, false))
             return ERRORMSG("VerifyDB() : *** found bad block at %d, hash=%s\n",
                             pIndex->height, pIndex->GetBlockHash().ToString());
 
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pIndex) {
+        if (fCheckBlocks && nCheckLevel >= 2 && pIndex) {
             CBlockUndo undo;
             CDiskBlockPos pos = pIndex->GetUndoPos();
             if (!pos.IsNull()) {
-                if (!undo.ReadFromDisk(pos, pIndex->pprev->GetBlockHash()))
+                if (!ReadBlockUndo(pIndex, undo))
                     return ERRORMSG("VerifyDB() : *** found bad undo data at %d, hash=%s\n",
                                     pIndex->height, pIndex->GetBlockHash().ToString());
             }
         }
+        // the blocks up to a loaded snapshot have no undo data
+        if (!(pIndex->nStatus & BLOCK_HAVE_UNDO)) {
+            LogPrint(BCLog::INFO, "VerifyDB() : no undo data below %d, the chain state was loaded from a snapshot\n",
+                     pIndex->height + 1);
+            break;
+        }
+
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && pIndex == pIndexState) {
             bool fClean = true;
@@ -2418,11 +2682,23 @@ bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth) {
     return true;
 }
 
-void UnloadBlockIndex() {
+// Frees the block indexes, the slab loaded ones with the arena and the ones added by the block processing one by one
+static void FreeBlockIndexes() {
+    for (auto &item : mapBlockIndex) {
+        if (!blockIndexArena.Contains(item.second))
+            delete item.second;
+    }
     mapBlockIndex.clear();
+    blockIndexArena.Clear();
+}
+
+void UnloadBlockIndex() {
     setBlockIndexValid.clear();
     chainActive.SetTip(nullptr);
-    pIndexBestInvalid = nullptr;
+    pIndexBestInvalid  = nullptr;
+    pIndexBestForkTip  = nullptr;
+    pIndexBestForkBase = nullptr;
+    FreeBlockIndexes();
 }
 
 bool LoadBlockIndex() {
@@ -2527,71 +2803,87 @@ void PrintBlockTree() {
     }
 }
 
+// the blocks handed over by the block file reader at once
+static const size_t IMPORT_BLOCK_BATCH_SIZE = 16;
+
+// prepare the imported blocks ahead of their processing: read the accounts of the tx signers, which warms
+// the account cache, then run the context-free block checks, which hash the txs and build the merkle trees,
+// and verify the signatures into the signature cache on the block workers. The blocks that pass the checks
+// are marked checked, which spares the checks in ProcessBlock() and ConnectBlock().
+static void PrepareImportBlocks(vector<CBlockFileReader::Item> &items) {
+    if (pBlockWorkerPool == nullptr)
+        return;
+
+    int64_t beginTime = GetTimeMicros();
+    vector<CSigVerifyItem> sigItems;
+    std::shared_ptr<CCacheWrapper> spCW;
+    {
+        LOCK(cs_main);
+        spCW = std::make_shared<CCacheWrapper>(pCdMan);
+        for (const auto &item : items) {
+            const CBlock &block = *item.pBlock;
+            for (size_t index = 1; index < block.vptx.size(); index++)
+                block.vptx[index]->GetSigVerifyItems(*spCW, block.GetHeight(), sigItems);
+        }
+    }
+
+    // CheckBlock() does not touch the cache wrapper without fCheckTx, a failed block is checked again when
+    // processed, which rejects it
+    pBlockWorkerPool->Run(items.size(), [&items, &spCW](size_t i) {
+        CValidationState state;
+        CheckBlock(*items[i].pBlock, state, *spCW, false);
+    });
+    VerifySignatures(*pBlockWorkerPool, signatureCache, sigItems);
+
+    if (SysCfg().IsBenchmark())
+        LogPrint(BCLog::INFO, "- Prepare %u imported blocks, %u signatures: %.2fms\n", (uint32_t)items.size(),
+                 (uint32_t)sigItems.size(), 0.001 * (GetTimeMicros() - beginTime));
+}
+
 bool LoadExternalBlockFile(FILE *fileIn, CDiskBlockPos *dbp) {
     int64_t nStart = GetTimeMillis();
     int32_t nLoaded    = 0;
-    try {
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nStartByte = 0;
-        if (dbp) {
-            // (try to) skip already indexed part
-            CBlockFileInfo info;
-            if (pCdMan->pBlockIndexDb->ReadBlockFileInfo(dbp->nFile, info)) {
-                nStartByte = info.nSize;
-                blkdat.Seek(info.nSize);
-            }
-        }
-        uint64_t nRewind = blkdat.GetPos();
-        while (blkdat.good() && !blkdat.eof()) {
-            boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;          // start one byte further next time, in case of failure
-            blkdat.SetLimit();  // remove former limit
-            uint32_t nSize = 0;
-            try {
-                // locate a header
-                uint8_t buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(SysCfg().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, SysCfg().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (std::exception &e) {
-                // no valid block header found; don't complain
-                break;
-            }
+    uint64_t nStartByte = 0;
+    if (dbp) {
+        // (try to) skip already indexed part
+        CBlockFileInfo info;
+        if (pCdMan->pBlockIndexDb->ReadBlockFileInfo(dbp->nFile, info))
+            nStartByte = info.nSize;
+    }
+
+    // parse the blocks in the reader thread, prepare them in batches and process them in the file order
+    CBlockFileReader reader(fileIn, nStartByte, IMPORT_BLOCK_BATCH_SIZE * 4);
+    reader.Start();
+
+    vector<CBlockFileReader::Item> items;
+    bool isError = false;
+    while (!isError && reader.Take(IMPORT_BLOCK_BATCH_SIZE, items)) {
+        boost::this_thread::interruption_point();
+
+        PrepareImportBlocks(items);
+        for (auto &item : items) {
+            boost::this_thread::interruption_point();
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                blkdat.SetLimit(nBlockPos + nSize);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // process block
-                if (nBlockPos >= nStartByte) {
-                    LOCK(cs_main);
-                    if (dbp)
-                        dbp->nPos = nBlockPos;
-                    CValidationState state;
-                    if (ProcessBlock(state, nullptr, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
+                LOCK(cs_main);
+                if (dbp)
+                    dbp->nPos = item.block_pos;
+                CValidationState state;
+                if (ProcessBlock(state, nullptr, item.pBlock.get(), dbp))
+                    nLoaded++;
+                if (state.IsError()) {
+                    isError = true;
+                    break;
                 }
             } catch (std::exception &e) {
                 LogPrint(BCLog::INFO, "%s : Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
-        fclose(fileIn);
-    } catch (runtime_error &e) {
-        AbortNode(_("Error: system error: ") + e.what());
     }
+    reader.Stop();
+
+    if (!reader.GetError().empty())
+        AbortNode(_("Error: system error: ") + reader.GetError());
     if (nLoaded > 0)
         LogPrint(BCLog::INFO, "Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
     return nLoaded > 0;
@@ -2653,10 +2945,7 @@ class CMainCleanup {
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        map<uint256, CBlockIndex *>::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
+        FreeBlockIndexes();
 
         // orphan blocks
         map<uint256, COrphanBlock *>::iterator it2 = mapOrphanBlocks.begin();
@@ -43,9 +43,13 @@ extern CCriticalSection cs_main;
 /** The currently-connected chain of blocks. */
 extern CChain chainActive;
 extern CSignatureCache signatureCache;
+/** The block validation workers of ConnectBlock, nullptr if -blockworkers=0 */
+extern CWorkerPool *pBlockWorkerPool;
 
 extern CTxMemPool mempool;
 extern map<uint256, CBlockIndex *> mapBlockIndex;
+/** The owner of the block indexes loaded by LoadBlockIndex */
+extern CBlockIndexArena blockIndexArena;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern const string strMessageMagic;
@@ -93,8 +97,13 @@ void UnregisterNodeSignals(CNodeSignals &nodeSignals);
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 
-/** Verify consistency of the block and coin databases */
-bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth);
+/** Verify consistency of the block and coin databases, only the disconnect and reconnect checks (level 3, 4)
+    without fCheckBlocks */
+bool VerifyDB(int32_t nCheckLevel, int32_t nCheckDepth, bool fCheckBlocks = true);
+
+/** The chain state was loaded from the snapshot of the block (-loadsnapshot), the blocks up to it are connected
+    without execution */
+void SetLoadedSnapshot(int32_t height, const uint256 &blockHash);
 
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
@@ -115,9 +124,16 @@ void Misbehaving(NodeId nodeid, int32_t howmuch);
 
 bool VerifySignature(const uint256 &sigHash, const std::vector<uint8_t> &signature, const CPubKey &pubKey);
 
-/** (try to) add transaction to memory pool **/
+/** (try to) add transaction to memory pool, a tx reloaded from the mempool dump keeps its entry time and height **/
 bool AcceptToMemoryPool(CTxMemPool &pool, CValidationState &state, CBaseTx *pBaseTx,
-                        bool fLimitFree, bool fRejectInsaneFee = false);
+                        bool fLimitFree, bool fRejectInsaneFee = false, int64_t entryTime = 0,
+                        uint32_t entryHeight = 0);
+
+/** Dump the mempool to mempool.dat (-persistmempool), once it is loaded */
+bool DumpMemPool();
+/** Reload the mempool from mempool.dat: the txs are decoded and their signatures verified on the workers,
+    then they are executed again in the order they entered the mempool */
+bool LoadMemPool(CWorkerPool *pWorkerPool);
 
 struct CNodeStateStats {
     int32_t nMisbehavior;
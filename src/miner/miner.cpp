@@ -19,6 +19,8 @@
 #include "p2p/protocol.h"
 
 #include <algorithm>
+#include <functional>
+#include <limits>
 #include <boost/circular_buffer.hpp>
 
 extern CWallet *pWalletMain;
@@ -82,25 +84,30 @@ uint32_t GetElementForBurn(CBlockIndex *pIndex) {
     return newFuelRate;
 }
 
-// Sort transactions by priority and fee to decide priority orders to process transactions.
-void GetPriorityTx(int32_t height, set<TxPriority> &txPriorities, const int32_t nFuelRate) {
-    static TokenSymbol feeSymbol;
-    static uint64_t fee    = 0;
-    static uint32_t txSize = 0;
-    static double feePerKb = 0;
-    static double priority = 0;
-
-    for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.memPoolTxs.begin(); mi != mempool.memPoolTxs.end(); ++mi) {
-        CBaseTx *pBaseTx = mi->second.GetTransaction().get();
-        if (!pBaseTx->IsBlockRewardTx() && !pCdMan->pTxCache->HasTx(pBaseTx->GetHash())) {
-            feeSymbol = std::get<0>(mi->second.GetFees());
-            fee       = std::get<1>(mi->second.GetFees());
-            txSize    = mi->second.GetTxSize();
-            feePerKb  = double(fee - pBaseTx->GetFuel(height, nFuelRate)) / txSize * 1000.0;
-            priority  = mi->second.GetPriority();
-
-            txPriorities.emplace(TxPriority(priority, feePerKb, mi->second.GetTransaction()));
+// The transactions in the packing order, by priority and fee rate. The mempool keeps the order as the txs
+// come and go, the caller must hold mempool.cs.
+void GetPriorityTx(vector<TxPriority> &txPriorities) {
+    const CTxMemPool::PriorityIndex &priorityIndex = mempool.GetPriorityIndex();
+    txPriorities.reserve(txPriorities.size() + priorityIndex.size());
+
+    // a tx goes with the earlier txs of its sender, which it may depend on, the chain is packed in order
+    map<CKeyID, CTxMemPool::SenderChain::const_iterator> chainPositions;  // the next tx to pack of the sender
+    auto addTx = [&](const CTxMemPoolEntry &entry) {
+        if (!entry.GetTransaction()->IsBlockRewardTx())
+            txPriorities.emplace_back(entry.GetPriority(), entry.GetFeePerKb(), entry.GetTxSize(), entry.GetTransaction());
+    };
+    for (const auto &item : priorityIndex) {
+        const CTxMemPoolEntry &entry = *item.second;
+        const CTxMemPool::SenderChain *pChain = mempool.GetSenderChain(entry.GetSender());
+        if (entry.GetSender().IsNull() || pChain == nullptr) {
+            addTx(entry);
+            continue;
         }
+
+        auto posIt = chainPositions.emplace(entry.GetSender(), pChain->begin()).first;
+        auto &chainIt = posIt->second;
+        for (; chainIt != pChain->end() && chainIt->first <= entry.GetSequence(); ++chainIt)
+            addTx(*chainIt->second);
     }
 }
 
@@ -310,18 +317,20 @@ static bool CreateNewBlockForPreStableCoinRelease(CCacheWrapper &cwIn, std::uniq
         uint64_t totalFuel      = 0;
         uint64_t reward         = 0;
 
-        // Calculate && sort transactions from memory pool.
-        set<TxPriority> txPriorities;
-        GetPriorityTx(height, txPriorities, fuelRate);
+        // Get the transactions from memory pool, sorted by priority.
+        vector<TxPriority> txPriorities;
+        GetPriorityTx(txPriorities);
 
         LogPrint(BCLog::MINER, "CreateNewBlockForPreStableCoinRelease() : got %lu transaction(s) sorted by priority rules\n",
                  txPriorities.size());
 
         // Collect transactions into the block.
-        for (auto itor = txPriorities.rbegin(); itor != txPriorities.rend(); ++itor) {
+        for (auto itor = txPriorities.begin(); itor != txPriorities.end(); ++itor) {
             CBaseTx *pBaseTx = itor->baseTx.get();
+            if (pCdMan->pTxCache->HasTx(pBaseTx->GetHash()))
+                continue;
 
-            uint32_t txSize = pBaseTx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+            uint32_t txSize = itor->txSize;
             if (totalBlockSize + txSize >= nBlockMaxSize) {
                 LogPrint(BCLog::MINER, "CreateNewBlockForPreStableCoinRelease() : exceed max block size, txid: %s\n",
                          pBaseTx->GetHash().GetHex());
@@ -420,137 +429,328 @@ static bool CreateStableCoinGenesisBlock(std::unique_ptr<CBlock> &pBlock) {
     return true;
 }
 
-static bool CreateNewBlockForStableCoinRelease(int64_t startMiningMs, CCacheWrapper &cwIn, std::unique_ptr<CBlock> &pBlock) {
-    pBlock->vptx.push_back(std::make_shared<CUCoinBlockRewardTx>());
+void CBlockTemplate::SetNull() {
+    prev_hash.SetNull();
+    height          = 0;
+    block_time      = 0;
+    prev_block_time = 0;
+    fuel_rate       = 0;
+    is_active       = false;
+
+    spCW.reset();
+    txs.clear();
+    tried_txids.clear();
+    failed_txs.clear();
+    pending_txs.clear();
+    pending_pos      = 0;
+    scanned_sequence = 0;
+    is_median_packed = false;
+    median_point     = MedianPoint();
+
+    max_block_size   = 0;
+    total_block_size = 0;
+    total_run_step   = 0;
+    total_fees       = 0;
+    total_fuel       = 0;
+    rewards.clear();
+}
+
+bool CBlockTemplate::IsFor(const CBlockIndex *pIndexPrev, int64_t blockTimeIn) const {
+    return !IsNull() && prev_hash == pIndexPrev->GetBlockHash() && block_time == blockTimeIn;
+}
+
+void CBlockTemplate::Reset(CBlockIndex *pIndexPrev, int64_t blockTimeIn, bool isActive) {
+    AssertLockHeld(cs_main);
+    SetNull();
+    prev_hash       = pIndexPrev->GetBlockHash();
+    height          = pIndexPrev->height + 1;
+    block_time      = blockTimeIn;
+    prev_block_time = pIndexPrev->GetBlockTime();
+    fuel_rate       = GetElementForBurn(pIndexPrev);
+    is_active       = isActive;
+    if (!is_active)
+        return;
+
+    spCW = std::make_shared<CCacheWrapper>(pCdMan);
 
     // Largest block you're willing to create:
-    uint32_t nBlockMaxSize = SysCfg().GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    max_block_size = SysCfg().GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
     // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max<uint32_t>(1000, std::min<uint32_t>((MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
+    max_block_size = std::max<uint32_t>(1000, std::min<uint32_t>((MAX_BLOCK_SIZE - 1000), max_block_size));
 
-    // Collect memory pool transactions into the block
-    {
-        LOCK2(cs_main, mempool.cs);
+    CBlock block;
+    block.SetTime(block_time);
+    block.vptx.push_back(std::make_shared<CUCoinBlockRewardTx>());
+    total_block_size = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+    rewards          = { {SYMB::WICC, 0}, {SYMB::WUSD, 0} };
+}
 
-        CBlockIndex *pIndexPrev            = chainActive.Tip();
-        uint32_t blockTime                 = pBlock->GetTime();
-        int32_t height                     = pIndexPrev->height + 1;
-        int32_t index                      = 0; // 0: block reward tx
-        uint32_t fuelRate                  = GetElementForBurn(pIndexPrev);
-        uint64_t totalBlockSize            = ::GetSerializeSize(*pBlock, SER_NETWORK, PROTOCOL_VERSION);
-        uint64_t totalRunStep              = 0;
-        uint64_t totalFees                 = 0;
-        uint64_t totalFuel                 = 0;
-        map<TokenSymbol, uint64_t> rewards = { {SYMB::WICC, 0}, {SYMB::WUSD, 0} };
-
-        // Calculate && sort transactions from memory pool.
-        set<TxPriority> txPriorities;
-        GetPriorityTx(height, txPriorities, fuelRate);
-
-        // Push block price median transaction into queue.
-        txPriorities.emplace(TxPriority(PRICE_MEDIAN_TRANSACTION_PRIORITY, 0, std::make_shared<CBlockPriceMedianTx>(height)));
-
-        LogPrint(BCLog::MINER, "CreateNewBlockForStableCoinRelease() : got %lu trx(s), sorted by priority\n",
-                 txPriorities.size());
+bool CBlockTemplate::PackTxs(uint32_t maxCount, const std::function<bool()> &hasTime, bool &hasMore) {
+    AssertLockHeld(cs_main);
+    AssertLockHeld(mempool.cs);
+    hasMore = false;
+    if (!is_active)
+        return true;
 
-        // Collect transactions into the block.
-        for (auto itor = txPriorities.rbegin(); itor != txPriorities.rend(); ++itor) {
+    // take the txs from the mempool again once the ones taken are tried and new txs entered it
+    if (pending_pos >= pending_txs.size()) {
+        if (is_median_packed && mempool.GetNextSequence() == scanned_sequence)
+            return true;
+
+        pending_txs.clear();
+        pending_pos      = 0;
+        scanned_sequence = mempool.GetNextSequence();
+
+        // Get the transactions from memory pool, sorted by priority.
+        GetPriorityTx(pending_txs);
+        if (!median_point.IsNull() && std::any_of(pending_txs.begin(), pending_txs.end(), [&](const TxPriority &item) {
+                return item.baseTx->IsPriceFeedTx() && tried_txids.count(item.baseTx->GetHash()) == 0;
+            })) {
+            if (!RewindToMedian())
+                return false;
+        }
+        pending_txs.erase(std::remove_if(pending_txs.begin(), pending_txs.end(), [&](const TxPriority &item) {
+            return tried_txids.count(item.baseTx->GetHash()) > 0;
+        }), pending_txs.end());
+
+        // Push block price median transaction into queue, behind the txs of a higher priority.
+        if (!is_median_packed) {
+            auto medianItor = std::find_if(pending_txs.begin(), pending_txs.end(), [](const TxPriority &item) {
+                return item.priority < PRICE_MEDIAN_TRANSACTION_PRIORITY;
+            });
+            auto pMedianTx = std::make_shared<CBlockPriceMedianTx>(height);
+            pending_txs.emplace(medianItor, PRICE_MEDIAN_TRANSACTION_PRIORITY, 0, pMedianTx->GetTxSize(), pMedianTx);
+            is_median_packed = true;
+        }
+
+        LogPrint(BCLog::MINER, "CBlockTemplate::PackTxs() : got %lu trx(s), sorted by priority\n",
+                 pending_txs.size());
+    }
+
+    // Collect transactions into the block.
+    for (uint32_t count = 0; pending_pos < pending_txs.size() && count < maxCount; ++pending_pos, ++count) {
+        if (!hasTime()) {
+            LogPrint(BCLog::MINER, "%s() : no time left to pack more tx, ignore! height=%d, tx_count=%u\n",
+                __FUNCTION__, height, txs.size() + 1);
+            break;
+        }
+
+        const TxPriority &item = pending_txs[pending_pos];
+        CBaseTx *pBaseTx = item.baseTx.get();
+        if (pBaseTx->IsPriceMedianTx()) {
+            median_point.spCW             = spCW;
+            median_point.tx_count         = txs.size();
+            median_point.total_block_size = total_block_size;
+            median_point.total_run_step   = total_run_step;
+            median_point.total_fees       = total_fees;
+            median_point.total_fuel       = total_fuel;
+            median_point.rewards          = rewards;
+            median_point.later_txids.clear();
+            // the median tx and the txs behind it are executed on a layer which can be dropped
+            spCW = std::make_shared<CCacheWrapper>(median_point.spCW.get());
+        } else {
+            if (!tried_txids.insert(pBaseTx->GetHash()).second || pCdMan->pTxCache->HasTx(pBaseTx->GetHash()))
+                continue;
+
+            if (!median_point.IsNull())
+                median_point.later_txids.push_back(pBaseTx->GetHash());
+        }
+
+        uint32_t txSize = item.txSize;
+        if (total_block_size + txSize >= max_block_size) {
+            LogPrint(BCLog::MINER, "CBlockTemplate::PackTxs() : exceed max block size, txid: %s\n",
+                     pBaseTx->GetHash().GetHex());
+
+            continue;
+        }
+
+        auto spTxCW = std::make_shared<CCacheWrapper>(spCW.get());
+
+        try {
+            CValidationState state;
+
+            pBaseTx->nFuelRate = fuel_rate;
 
-            if (!CheckPackBlockTime(startMiningMs, height)) {
-                LogPrint(BCLog::MINER, "%s() : no time left to pack more tx, ignore! height=%d, start_ms=%lld, tx_count=%u\n",
-                    __FUNCTION__, height, startMiningMs, pBlock->vptx.size());
-                break;
+            // Special case for price median tx,
+            if (pBaseTx->IsPriceMedianTx()) {
+                CBlockPriceMedianTx *pPriceMedianTx = (CBlockPriceMedianTx *)item.baseTx.get();
+                if (!spTxCW->ppCache.CalcMedianPrices(*spTxCW, height, pPriceMedianTx->median_prices))
+                    return ERRORMSG("%s(), calculate block median prices error", __func__);
             }
 
-            CBaseTx *pBaseTx = itor->baseTx.get();
+            LogPrint(BCLog::MINER, "CBlockTemplate::PackTxs() : begin to pack trx: %s\n",
+                     pBaseTx->ToString(spTxCW->accountCache));
 
-            uint32_t txSize = pBaseTx->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
-            if (totalBlockSize + txSize >= nBlockMaxSize) {
-                LogPrint(BCLog::MINER, "CreateNewBlockForStableCoinRelease() : exceed max block size, txid: %s\n",
-                         pBaseTx->GetHash().GetHex());
+            CTxExecuteContext context(height, txs.size() + 1, fuel_rate, block_time, prev_block_time, spTxCW.get(),
+                                      &state, TxExecuteContextType::PRODUCE_BLOCK);
+
+            if (!pBaseTx->CheckAndExecuteTx(context)) {
+                LogPrint(BCLog::MINER, "CBlockTemplate::PackTxs() : failed to check/exec tx: %s\n",
+                         pBaseTx->ToString(spTxCW->accountCache));
 
+                failed_txs[pBaseTx->GetHash()] = std::make_pair(state.GetRejectCode(), state.GetRejectReason());
                 continue;
             }
 
-            auto spCW = std::make_shared<CCacheWrapper>(&cwIn);
+            // Run step limits
+            if (total_run_step + pBaseTx->nRunStep >= MAX_BLOCK_RUN_STEP) {
+                LogPrint(BCLog::MINER, "CBlockTemplate::PackTxs() : exceed max block run steps, txid: %s\n",
+                        pBaseTx->GetHash().GetHex());
+                continue;
+            }
+        } catch (std::exception &e) {
+            LogPrint(BCLog::ERROR, "CBlockTemplate::PackTxs() : unexpected exception: %s\n", e.what());
 
-            try {
-                CValidationState state;
+            continue;
+        }
 
-                pBaseTx->nFuelRate = fuelRate;
+        spTxCW->Flush();
 
-                // Special case for price median tx,
-                if (pBaseTx->IsPriceMedianTx()) {
-                    CBlockPriceMedianTx *pPriceMedianTx = (CBlockPriceMedianTx *)itor->baseTx.get();
-                    if (!spCW->ppCache.CalcMedianPrices(*spCW, height, pPriceMedianTx->median_prices))
-                        return ERRORMSG("%s(), calculate block median prices error", __func__);
-                }
+        auto fuel        = pBaseTx->GetFuel(height, fuel_rate);
+        auto fees_symbol = std::get<0>(pBaseTx->GetFees());
+        auto fees        = std::get<1>(pBaseTx->GetFees());
+        assert(fees_symbol == SYMB::WICC || fees_symbol == SYMB::WUSD);
 
-                LogPrint(BCLog::MINER, "CreateNewBlockForStableCoinRelease() : begin to pack trx: %s\n",
-                         pBaseTx->ToString(spCW->accountCache));
+        total_block_size += txSize;
+        total_run_step += pBaseTx->nRunStep;
+        total_fuel += fuel;
+        total_fees += fees;
+        assert(fees >= fuel);
+        rewards[fees_symbol] += (fees - fuel);
 
-                uint32_t prevBlockTime = pIndexPrev->GetBlockTime();
-                CTxExecuteContext context(height, index + 1, fuelRate, blockTime, prevBlockTime, spCW.get(), &state,
-                                        TxExecuteContextType::PRODUCE_BLOCK);
+        txs.push_back(item.baseTx);
 
-                if (!pBaseTx->CheckAndExecuteTx(context)) {
-                    LogPrint(BCLog::MINER, "CreateNewBlockForStableCoinRelease() : failed to check/exec tx: %s\n",
-                             pBaseTx->ToString(spCW->accountCache));
+        LogPrint(BCLog::DEBUG, "miner total fuel fee:%d, tx fuel fee:%d, fuel:%d, fuelRate:%d, txid:%s\n", total_fuel,
+                 pBaseTx->GetFuel(height, fuel_rate), pBaseTx->nRunStep, fuel_rate, pBaseTx->GetHash().GetHex());
+    }
 
-                    pCdMan->pLogCache->SetExecuteFail(height, pBaseTx->GetHash(), state.GetRejectCode(), state.GetRejectReason());
-                    continue;
-                }
+    hasMore = pending_pos < pending_txs.size();
+    return true;
+}
 
-                // Run step limits
-                if (totalRunStep + pBaseTx->nRunStep >= MAX_BLOCK_RUN_STEP) {
-                    LogPrint(BCLog::MINER, "CreateNewBlockForStableCoinRelease() : exceed max block run steps, txid: %s\n",
-                            pBaseTx->GetHash().GetHex());
-                    continue;
-                }
-            } catch (std::exception &e) {
-                LogPrint(BCLog::ERROR, "CreateNewBlockForStableCoinRelease() : unexpected exception: %s\n", e.what());
+bool CBlockTemplate::RewindToMedian() {
+    LogPrint(BCLog::MINER, "CBlockTemplate::RewindToMedian() : a price feed tx arrived, pack again from the median "
+             "tx, height=%d, dropped_tx_count=%u\n", height, txs.size() - median_point.tx_count);
+
+    if (median_point.tx_count > txs.size())
+        return ERRORMSG("%s(), the median tx is behind the packed txs", __func__);
+
+    spCW             = median_point.spCW;
+    total_block_size = median_point.total_block_size;
+    total_run_step   = median_point.total_run_step;
+    total_fees       = median_point.total_fees;
+    total_fuel       = median_point.total_fuel;
+    rewards          = median_point.rewards;
+    txs.resize(median_point.tx_count);
+    for (const auto &txid : median_point.later_txids) {
+        tried_txids.erase(txid);
+        failed_txs.erase(txid);
+    }
 
-                continue;
-            }
+    median_point     = MedianPoint();
+    is_median_packed = false;
+    return true;
+}
 
-            spCW->Flush();
+void CBlockTemplate::GetBlock(CBlock &block) const {
+    block.vptx.clear();
+    block.vptx.reserve(txs.size() + 1);
+    block.vptx.push_back(std::make_shared<CUCoinBlockRewardTx>());
+    block.vptx.insert(block.vptx.end(), txs.begin(), txs.end());
 
-            auto fuel        = pBaseTx->GetFuel(height, fuelRate);
-            auto fees_symbol = std::get<0>(pBaseTx->GetFees());
-            auto fees        = std::get<1>(pBaseTx->GetFees());
-            assert(fees_symbol == SYMB::WICC || fees_symbol == SYMB::WUSD);
+    ((CUCoinBlockRewardTx *)block.vptx[0].get())->reward_fees = rewards;
 
-            totalBlockSize += txSize;
-            totalRunStep += pBaseTx->nRunStep;
-            totalFuel += fuel;
-            totalFees += fees;
-            assert(fees >= fuel);
-            rewards[fees_symbol] += (fees - fuel);
+    // Fill in header
+    block.SetPrevBlockHash(prev_hash);
+    block.SetNonce(0);
+    block.SetHeight(height);
+    block.SetFuel(total_fuel);
+    block.SetFuelRate(fuel_rate);
+
+    nLastBlockTx   = block.vptx.size();
+    nLastBlockSize = total_block_size;
+}
 
-            ++index;
+void CBlockTemplate::LogFailedTxs() const {
+    for (const auto &item : failed_txs)
+        pCdMan->pLogCache->SetExecuteFail(height, item.first, item.second.first, item.second.second);
+}
 
-            pBlock->vptx.push_back(itor->baseTx);
+// the txs packed into the block template at once, cs_main is released between the batches
+static const uint32_t BLOCK_TEMPLATE_BATCH_SIZE = 100;
 
-            LogPrint(BCLog::DEBUG, "miner total fuel fee:%d, tx fuel fee:%d, fuel:%d, fuelRate:%d, txid:%s\n", totalFuel,
-                     pBaseTx->GetFuel(height, fuelRate), pBaseTx->nRunStep, fuelRate, pBaseTx->GetHash().GetHex());
+static bool GetMiner(int64_t startMiningMs, const int32_t blockHeight, Miner &miner, uint32_t& totalDelegateNumOut);
 
-        }
+/**
+ * Keep the block template of the slot up to date until deadlineMs, while the producer waits for the slot. The txs
+ * are packed as they enter the mempool, in between the producer waits for a change of the mempool or the tip, and
+ * returns once the tip changes. Returns false if no template is kept for the slot.
+ */
+static bool UpdateBlockTemplate(CBlockTemplate &blockTemplate, CBlockIndex *pIndexPrev, int64_t slotTime,
+                                int64_t deadlineMs) {
+    int32_t height = pIndexPrev->height + 1;
+    if (height == (int32_t)SysCfg().GetStableCoinGenesisHeight() || GetFeatureForkVersion(height) == MAJOR_VER_R1)
+        return false;
 
-        nLastBlockTx                   = index + 1;
-        nLastBlockSize                 = totalBlockSize;
+    if (!blockTemplate.IsFor(pIndexPrev, slotTime)) {
+        // the block template is built only for the slots of the producer
+        Miner miner;
+        uint32_t totalDelegateNum;
+        bool isOnDuty = GetMiner(slotTime * 1000, height, miner, totalDelegateNum);
 
-        ((CUCoinBlockRewardTx *)pBlock->vptx[0].get())->reward_fees = rewards;
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip() != pIndexPrev)
+            return true;
 
-        // Fill in header
-        pBlock->SetPrevBlockHash(pIndexPrev->GetBlockHash());
-        pBlock->SetNonce(0);
-        pBlock->SetHeight(height);
-        pBlock->SetFuel(totalFuel);
-        pBlock->SetFuelRate(fuelRate);
+        blockTemplate.Reset(pIndexPrev, slotTime, isOnDuty);
+    }
+    if (!blockTemplate.IsActive())
+        return false;
 
-        LogPrint(BCLog::INFO, "CreateNewBlockForStableCoinRelease() : height=%d, tx=%d, totalBlockSize=%llu\n", height, index + 1,
-                 totalBlockSize);
+    auto hasTime = [deadlineMs]() { return GetTimeMillis() < deadlineMs; };
+    while (hasTime()) {
+        // read before the txs are taken, a tx entering the mempool while they are packed ends the wait at once
+        uint64_t changeCount = mempool.GetChangeCount();
+        bool hasMore         = false;
+        {
+            LOCK2(cs_main, mempool.cs);
+            if (chainActive.Tip() != pIndexPrev)
+                return true;
+
+            if (!blockTemplate.PackTxs(BLOCK_TEMPLATE_BATCH_SIZE, hasTime, hasMore)) {
+                blockTemplate.SetNull();
+                return false;
+            }
+        }
+        if (hasMore)
+            boost::this_thread::yield();  // let the threads waiting for cs_main take it
+        else
+            mempool.WaitForChange(changeCount, deadlineMs);
     }
+    return true;
+}
+
+static bool CreateNewBlockForStableCoinRelease(int64_t startMiningMs, CBlockTemplate &blockTemplate,
+                                               std::unique_ptr<CBlock> &pBlock) {
+    // Collect memory pool transactions into the block
+    LOCK2(cs_main, mempool.cs);
+
+    CBlockIndex *pIndexPrev = chainActive.Tip();
+    int32_t height          = pIndexPrev->height + 1;
+    bool fromTemplate       = blockTemplate.IsFor(pIndexPrev, pBlock->GetTime()) && blockTemplate.IsActive();
+    if (!fromTemplate)
+        blockTemplate.Reset(pIndexPrev, pBlock->GetTime(), true);
+
+    // the txs entering the mempool since the last update of the template are packed in the time left
+    bool hasMore = false;
+    if (!blockTemplate.PackTxs(std::numeric_limits<uint32_t>::max(),
+                               [&]() { return CheckPackBlockTime(startMiningMs, height); }, hasMore))
+        return false;
+
+    blockTemplate.GetBlock(*pBlock);
+    blockTemplate.LogFailedTxs();
+    LogPrint(BCLog::INFO, "CreateNewBlockForStableCoinRelease() : height=%d, tx=%d, totalBlockSize=%llu, "
+             "from_template=%d\n", height, pBlock->vptx.size(), nLastBlockSize, fromTemplate);
 
     return true;
 }
@@ -617,7 +817,8 @@ static bool GetMiner(int64_t startMiningMs, const int32_t blockHeight, Miner &mi
 }
 
 
-static bool ProduceBlock(int64_t startMiningMs, CBlockIndex *pPrevIndex, Miner &miner, const uint32_t totalDelegateNum) {
+static bool ProduceBlock(int64_t startMiningMs, CBlockIndex *pPrevIndex, Miner &miner, const uint32_t totalDelegateNum,
+                         CBlockTemplate &blockTemplate) {
     int64_t lastTime    = 0;
     bool success        = false;
     int32_t blockHeight = 0;
@@ -655,7 +856,7 @@ static bool ProduceBlock(int64_t startMiningMs, CBlockIndex *pPrevIndex, Miner &
             success = CreateNewBlockForPreStableCoinRelease(*spCW, pBlock); // pre-stable coin release
 
         } else {
-            success = CreateNewBlockForStableCoinRelease(startMiningMs, *spCW, pBlock);    // stable coin release
+            success = CreateNewBlockForStableCoinRelease(startMiningMs, blockTemplate, pBlock);    // stable coin release
         }
 
         if (!success) {
@@ -733,6 +934,8 @@ void static ThreadProduceBlocks(CWallet *pWallet, int32_t targetHeight) {
     targetHeight += GetCurrHeight();
     bool needSleep = false;
     int64_t nextSlotTime = 0;
+    bool fBlockTemplate = SysCfg().GetBoolArg("-blocktemplate", false);
+    CBlockTemplate blockTemplate;
 
     try {
         SetMinerStatus(true);
@@ -774,7 +977,9 @@ void static ThreadProduceBlocks(CWallet *pWallet, int32_t targetHeight) {
             int64_t curMiningTime = MillisToSecond(startMiningMs);
             int64_t curSlotTime = std::max(nextSlotTime, pIndexPrev->GetBlockTime() + GetBlockInterval(blockHeight));
             if (curMiningTime < curSlotTime) {
-                needSleep = true;
+                // keep the block of the slot up to date while waiting for it, woken up by the tip and mempool changes
+                needSleep = !fBlockTemplate ||
+                            !UpdateBlockTemplate(blockTemplate, pIndexPrev, curSlotTime, curSlotTime * 1000);
                 continue;
             }
 
@@ -791,7 +996,7 @@ void static ThreadProduceBlocks(CWallet *pWallet, int32_t targetHeight) {
 
             mining     = true;
 
-            if (!ProduceBlock(startMiningMs, pIndexPrev, *spMiner,totalDelegateNum))
+            if (!ProduceBlock(startMiningMs, pIndexPrev, *spMiner,totalDelegateNum, blockTemplate))
                 continue;
 
             if (SysCfg().NetworkID() != MAIN_NET && targetHeight <= GetCurrHeight())
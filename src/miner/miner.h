@@ -7,6 +7,7 @@
 #define COIN_MINER_H
 
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -23,6 +24,7 @@ class CWallet;
 class CBaseTx;
 class CAccountDBCache;
 class CAccount;
+class CCacheWrapper;
 
 #include <cmath>
 
@@ -42,22 +44,92 @@ struct Miner {
 struct TxPriority {
     double priority;
     double feePerKb;
+    uint32_t txSize;
     std::shared_ptr<CBaseTx> baseTx;
 
-    TxPriority(const double priorityIn, const double feePerKbIn, const std::shared_ptr<CBaseTx> &baseTxIn)
-        : priority(priorityIn), feePerKb(feePerKbIn), baseTx(baseTxIn) {}
-
-    bool operator<(const TxPriority &other) const {
-        if (fabs(this->priority - other.priority) <= 1000) {
-            if (fabs(this->feePerKb < other.feePerKb) <= 1e-8) {
-                return this->baseTx->GetHash() < other.baseTx->GetHash();
-            } else {
-                return this->feePerKb < other.feePerKb;
-            }
-        } else {
-            return this->priority < other.priority;
-        }
-    }
+    TxPriority(const double priorityIn, const double feePerKbIn, const uint32_t txSizeIn,
+               const std::shared_ptr<CBaseTx> &baseTxIn)
+        : priority(priorityIn), feePerKb(feePerKbIn), txSize(txSizeIn), baseTx(baseTxIn) {}
+};
+
+/**
+ * CBlockTemplate
+ * The block candidate of a slot in the stable coin release: the mempool txs executed in the packing order on the
+ * cache overlay of the candidate, with the block price median tx behind the txs of a higher priority. The txs
+ * entering the mempool later are executed on top of the ones packed already, so the candidate grows while the
+ * producer waits for its slot (-blocktemplate), and at the slot only the block reward tx and the signature are
+ * left. It is built again when the tip or the slot time changes.
+ */
+class CBlockTemplate {
+public:
+    CBlockTemplate() { SetNull(); }
+
+    void SetNull();
+    bool IsNull() const { return prev_hash.IsNull(); }
+    // the candidate is on the tip at the block time, it is built again once either of them changes
+    bool IsFor(const CBlockIndex *pIndexPrev, int64_t blockTimeIn) const;
+    // the candidate is for a slot of another delegate, no tx is packed
+    bool IsActive() const { return is_active; }
+
+    // start the candidate of the block on the tip at the block time, the caller must hold cs_main and mempool.cs
+    void Reset(CBlockIndex *pIndexPrev, int64_t blockTimeIn, bool isActive);
+    /**
+     * Execute at most maxCount mempool txs not tried yet, while hasTime() holds. hasMore is set if the txs taken
+     * from the mempool are not all tried. A price feed tx entering the mempool after the median tx is packed makes
+     * the txs from the median tx on packed again. Returns false if the candidate can not be built, the caller must
+     * hold cs_main and mempool.cs.
+     */
+    bool PackTxs(uint32_t maxCount, const std::function<bool()> &hasTime, bool &hasMore);
+    // fill the block with the txs and the header of the candidate, the reward tx is left for the miner
+    void GetBlock(CBlock &block) const;
+
+    uint32_t GetTxCount() const { return txs.size(); }
+    // write the txs failed to execute to the log db, only once the candidate becomes the produced block
+    void LogFailedTxs() const;
+
+private:
+    // the template is packed again from the median tx once a price feed tx enters the mempool after it, the feeds
+    // go before the median tx of the block
+    bool RewindToMedian();
+
+private:
+    // the state and the totals before the median tx
+    struct MedianPoint {
+        std::shared_ptr<CCacheWrapper> spCW;
+        size_t tx_count           = 0;
+        uint64_t total_block_size = 0;
+        uint64_t total_run_step   = 0;
+        uint64_t total_fees       = 0;
+        uint64_t total_fuel       = 0;
+        map<TokenSymbol, uint64_t> rewards;
+        vector<uint256> later_txids;    // the txs tried behind the median tx
+
+        bool IsNull() const { return spCW == nullptr; }
+    };
+
+    uint256 prev_hash;
+    int32_t height;
+    int64_t block_time;
+    uint32_t prev_block_time;
+    uint32_t fuel_rate;
+    bool is_active;
+
+    std::shared_ptr<CCacheWrapper> spCW;     // the state after the packed txs
+    vector<std::shared_ptr<CBaseTx>> txs;    // the packed txs, without the block reward tx
+    set<uint256> tried_txids;                // the packed txs and the ones which can not be packed
+    map<uint256, std::pair<uint8_t, string>> failed_txs;  // the tried txs failed to execute, kept off the log db
+    vector<TxPriority> pending_txs;          // the txs taken from the mempool, in the packing order
+    size_t pending_pos;
+    uint64_t scanned_sequence;               // the next sequence of the mempool when the txs were taken
+    bool is_median_packed;
+    MedianPoint median_point;
+
+    uint32_t max_block_size;
+    uint64_t total_block_size;
+    uint64_t total_run_step;
+    uint64_t total_fees;
+    uint64_t total_fuel;
+    map<TokenSymbol, uint64_t> rewards;
 };
 
 // mined block info
@@ -93,7 +165,7 @@ bool CheckWork(CBlock *pBlock);
 /** Get burn element */
 uint32_t GetElementForBurn(CBlockIndex *pIndex);
 
-void GetPriorityTx(vector<TxPriority> &vecPriority, int32_t nFuelRate);
+void GetPriorityTx(vector<TxPriority> &txPriorities);
 
 void ShuffleDelegates(const int32_t nCurHeight, const int64_t blockTime,
         VoteDelegateVector &delegates);
@@ -11,6 +11,9 @@
 #include "commons/util/util.h"
 #include "main.h"
 #include "net.h"
+#include "p2p/headersync.h"
+#include "chain/blockdelegates.h"
+#include "miner/miner.h"
 #include "miner/pbftcontext.h"
 #include "miner/pbftmanager.h"
 
@@ -552,7 +555,7 @@ inline bool ProcessGetHeadersMessage(CNode *pFrom, CDataStream &vRecv) {
 
     // We must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
     vector<CBlock> vHeaders;
-    int32_t nLimit = 2000;
+    int32_t nLimit = MAX_HEADERS_RESULTS;
     LogPrint(BCLog::NET, "getheaders %d to %s from peer %s\n", (pIndex ? pIndex->height : -1), hashStop.ToString(),
              pFrom->addr.ToString());
 
@@ -564,11 +567,106 @@ inline bool ProcessGetHeadersMessage(CNode *pFrom, CDataStream &vRecv) {
         if (--nLimit <= 0 || pIndex->GetBlockHash() == hashStop)
             break;
     }
-    pFrom->PushMessage("headers", vHeaders);
+    pFrom->PushMessage(NetMsgType::HEADERS, vHeaders);
 
     return false;
 }
 
+// check the miner signatures of the headers produced by the active delegates of the tip, the signatures of
+// the later ones are checked when their blocks are connected
+inline bool CheckHeadersSignatures(const vector<CBlockHeader> &headers, int32_t forkHeight, string &error) {
+    CCacheWrapper cw(pCdMan);
+    int32_t tipHeight = chainActive.Height();
+    int32_t endHeight = chain::GetActiveDelegatesEndHeight(cw, tipHeight, forkHeight >= 0 ? forkHeight : tipHeight);
+
+    VoteDelegateVector activeDelegates;
+    if (endHeight < 0 || !cw.delegateCache.GetActiveDelegates(activeDelegates) || activeDelegates.empty())
+        return true;
+
+    for (const auto &header : headers) {
+        if ((int32_t)header.GetHeight() > endHeight)
+            break;
+
+        VoteDelegateVector delegates = activeDelegates;
+        ShuffleDelegates(header.GetHeight(), header.GetTime(), delegates);
+        VoteDelegate delegate;
+        GetCurrentDelegate(header.GetTime(), header.GetHeight(), delegates, delegate);
+
+        CAccount account;
+        const uint256 hash = header.GetHash();
+        if (!cw.accountCache.GetAccount(delegate.regid, account)) {
+            error = strprintf("delegate %s of header %d:%s not found", delegate.regid.ToString(), header.GetHeight(),
+                              hash.GetHex());
+            return false;
+        }
+        if (!VerifySignature(hash, header.GetSignature(), account.owner_pubkey) &&
+            !VerifySignature(hash, header.GetSignature(), account.miner_pubkey)) {
+            error = strprintf("header %d:%s is not signed by the delegate %s", header.GetHeight(), hash.GetHex(),
+                              delegate.regid.ToString());
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool ProcessHeadersMessage(CNode *pFrom, CDataStream &vRecv) {
+    // the headers are sent as CBlocks without txs
+    vector<CBlock> vHeaders;
+    vRecv >> vHeaders;
+    if (vHeaders.size() > MAX_HEADERS_RESULTS) {
+        Misbehaving(pFrom->GetId(), 20);
+        return ERRORMSG("message headers size() = %u from peer %s", vHeaders.size(), pFrom->addrName);
+    }
+
+    if (!headersSync.IsHeadersRequested(pFrom->GetId())) {
+        LogPrint(BCLog::NET, "unrequested headers from peer %s, ignore\n", pFrom->addrName);
+        return true;
+    }
+
+    LOCK(cs_main);
+
+    // leave out the headers of the active chain, the rest links to the header chain or forks from the active chain
+    vector<CBlockHeader> headers(vHeaders.begin(), vHeaders.end());
+    int32_t forkHeight = -1;
+    size_t activeCount = 0;
+    for (; activeCount < headers.size(); activeCount++) {
+        auto it = mapBlockIndex.find(headers[activeCount].GetHash());
+        if (it == mapBlockIndex.end() || !chainActive.Contains(it->second))
+            break;
+        forkHeight = it->second->height;
+    }
+    headers.erase(headers.begin(), headers.begin() + activeCount);
+
+    if (!headers.empty()) {
+        if (forkHeight < 0) {
+            auto it = mapBlockIndex.find(headers.front().GetPrevBlockHash());
+            if (it != mapBlockIndex.end() && chainActive.Contains(it->second))
+                forkHeight = it->second->height;
+        }
+
+        const CBlockHeader &last = headers.back();
+        if (last.GetBlockTime() > GetAdjustedTime() + ::GetBlockInterval(last.GetHeight()) + 2) {
+            string error;
+            headersSync.AcceptHeaders(pFrom->GetId(), vector<CBlockHeader>(), -1, error);  // end the request
+            return ERRORMSG("header %d:%s from peer %s is in the future", last.GetHeight(), last.GetHash().GetHex(),
+                            pFrom->addrName);
+        }
+    }
+
+    string error;
+    bool fSigned = headers.empty() || CheckHeadersSignatures(headers, forkHeight, error);
+    if (!fSigned)
+        headers.clear();  // end the request, the peer is not asked again until it announces a block
+    if (!headersSync.AcceptHeaders(pFrom->GetId(), headers, forkHeight, error) || !fSigned) {
+        Misbehaving(pFrom->GetId(), 20);
+        return ERRORMSG("bad headers from peer %s, %s", pFrom->addrName, error);
+    }
+
+    LogPrint(BCLog::NET, "recv %u headers, header_tip=%d, tip=%d, peer=%s\n", vHeaders.size(),
+             headersSync.GetHeaderTipHeight(), chainActive.Height(), pFrom->addrName);
+    return true;
+}
+
 inline void ProcessGetBlocksMessage(CNode *pFrom, CDataStream &vRecv) {
     CBlockLocator locator;
     uint256 hashStop;
@@ -662,7 +760,9 @@ inline bool ProcessInvMessage(CNode *pFrom, CDataStream &vRecv) {
                              "tip_height=%d, tip_hash=%s, peer=%s\n",
                              orphanBlockIt->second->height, inv.hash.GetHex(), chainActive.Height(),
                              chainActive.Tip()->GetBlockHash().GetHex(), pFrom->addrName);
-                    PushGetBlocksOnCondition(pFrom, chainActive.Tip(), GetOrphanRoot(inv.hash));
+                    // the orphans of the window are linked by the headers-first download
+                    if (!headersSync.HasHeader(inv.hash))
+                        PushGetBlocksOnCondition(pFrom, chainActive.Tip(), GetOrphanRoot(inv.hash));
                     // TODO: should get the headmost block of this fork from current peer
                 }
             }
@@ -672,10 +772,14 @@ inline bool ProcessInvMessage(CNode *pFrom, CDataStream &vRecv) {
             LogPrint(BCLog::NET, "recv inv new data! time_ms=%lld, i=%d, msg=%s, hash=%s, peer=%s\n",
                 GetTimeMillis(), i, msgName, inv.ToString(), pFrom->addrName);
             if (!SysCfg().IsImporting() && !SysCfg().IsReindex()) {
-                if (inv.type == MSG_BLOCK)
-                    AddBlockToQueue(inv.hash, pFrom->GetId());
-                else
+                if (inv.type == MSG_BLOCK) {
+                    // the blocks of the header chain are requested by the headers-first download
+                    headersSync.BlockAnnounced(pFrom->GetId(), inv.hash);
+                    if (!headersSync.HasHeader(inv.hash))
+                        AddBlockToQueue(inv.hash, pFrom->GetId());
+                } else {
                     pFrom->AskFor(inv);  // MSG_TX
+                }
             }
         }
 
@@ -725,6 +829,7 @@ inline void ProcessBlockMessage(CNode *pFrom, CDataStream &vRecv) {
         mapBlockSource[inv.hash] = pFrom->GetId();
         MarkBlockAsReceived(inv.hash, pFrom->GetId());
     }
+    headersSync.BlockReceived(pFrom->GetId(), inv.hash, GetTimeMicros());
 
     LOCK(cs_main);
     CValidationState state;
@@ -734,8 +839,12 @@ inline void ProcessBlockMessage(CNode *pFrom, CDataStream &vRecv) {
     if (  block.GetHeight() < (uint32_t)globalfinblock.first){
         LogPrint(BCLog::NET,"ProcessBlock() : this inbound block's height(%d) is irrreversible(%d)",
                                       block.GetHeight(), globalfinblock.first);
+    } else if (!ProcessBlock(state, pFrom, &block)) {
+        int32_t nDoS = 0;
+        if (state.IsInvalid(nDoS) && nDoS > 0)
+            headersSync.BlockInvalid(inv.hash);
     } else {
-        ProcessBlock(state, pFrom, &block);
+        headersSync.UpdatePeerHeight(pFrom->GetId(), block.GetHeight());
     }
 
 }
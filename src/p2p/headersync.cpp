@@ -0,0 +1,358 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headersync.h"
+
+#include "commons/util/util.h"
+#include "config/const.h"
+#include "logging.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static_assert(BLOCK_DOWNLOAD_WINDOW < (int32_t)MAX_ORPHAN_BLOCKS, "the blocks of the window are kept as orphans");
+
+CHeadersSync headersSync;
+
+CHeadersSync::CSyncPeer::CSyncPeer() : window(INITIAL_BLOCKS_IN_TRANSIT_PER_PEER) {}
+
+bool CHeadersSync::AcceptHeaders(NodeId nodeId, const vector<CBlockHeader> &newHeaders, int32_t forkHeight,
+                                 string &error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (headers_node != nodeId) {
+        // the header chain is taken from the replies only, a peer can not push headers to it
+        LogPrint(BCLog::NET, "unrequested headers from peer %d, ignore\n", nodeId);
+        return true;
+    }
+    headers_node = -1;
+
+    CSyncPeer &peer = peers[nodeId];
+    if (newHeaders.size() < MAX_HEADERS_RESULTS)
+        peer.headers_synced = true;
+    if (newHeaders.empty())
+        return true;
+
+    vector<uint256> hashes(newHeaders.size());
+    for (size_t i = 0; i < newHeaders.size(); i++) {
+        const CBlockHeader &header = newHeaders[i];
+        hashes[i]                  = header.GetHash();
+        if (header.GetVersion() != CBlockHeader::CURRENT_VERSION || header.GetSignature().empty()) {
+            error = strprintf("bad header %d:%s", header.GetHeight(), hashes[i].GetHex());
+            return false;
+        }
+        if (i == 0)
+            continue;
+
+        const CBlockHeader &prevHeader = newHeaders[i - 1];
+        if (header.GetPrevBlockHash() != hashes[i - 1] || header.GetHeight() != prevHeader.GetHeight() + 1 ||
+            header.GetBlockTime() < prevHeader.GetBlockTime()) {
+            error = strprintf("header %d:%s does not follow the previous one", header.GetHeight(), hashes[i].GetHex());
+            return false;
+        }
+    }
+
+    // the first header links to the header chain, or to the active chain as a branch
+    const uint256 &prevHash = newHeaders[0].GetPrevBlockHash();
+    int32_t linkHeight      = -1;
+    bool inHeaderChain      = true;
+    auto it                 = header_heights.find(prevHash);
+    if (it != header_heights.end()) {
+        linkHeight = it->second;
+    } else if (base_height >= 0 && prevHash == base_hash) {
+        linkHeight = base_height;
+    } else if (forkHeight >= 0) {
+        linkHeight    = forkHeight;
+        inHeaderChain = false;
+    } else {
+        // the header chain moved on since the request
+        LogPrint(BCLog::NET, "headers from %s of peer %d do not link, ignore\n", hashes[0].GetHex(), nodeId);
+        return true;
+    }
+
+    if ((int32_t)newHeaders[0].GetHeight() != linkHeight + 1) {
+        error = strprintf("header %d:%s links to height %d", newHeaders[0].GetHeight(), hashes[0].GetHex(), linkHeight);
+        return false;
+    }
+
+    // a branch replaces the header chain only if it is longer
+    int32_t endHeight = linkHeight + (int32_t)newHeaders.size();
+    if (!inHeaderChain) {
+        if (endHeight <= GetTipHeightLocked())
+            return true;
+        Reset(linkHeight, prevHash);
+    }
+
+    size_t i = 0;
+    for (; i < newHeaders.size(); i++) {
+        int32_t height = linkHeight + 1 + (int32_t)i;
+        if (height > GetTipHeightLocked())
+            break;
+        if (headers[height - base_height - 1].hash != hashes[i]) {
+            if (endHeight <= GetTipHeightLocked())
+                return true;
+            TruncateFrom(height);
+            break;
+        }
+    }
+    for (; i < newHeaders.size() && (int32_t)headers.size() < MAX_HEADERS_AHEAD; i++) {
+        if (!headers.empty() && newHeaders[i].GetTime() < headers.back().time) {
+            error = strprintf("header %d:%s is earlier than the previous one", newHeaders[i].GetHeight(),
+                              hashes[i].GetHex());
+            return false;
+        }
+
+        CSyncHeader header;
+        header.hash        = hashes[i];
+        header.time        = newHeaders[i].GetTime();
+        header.source_node = nodeId;
+        header_heights[header.hash] = GetTipHeightLocked() + 1;
+        headers.push_back(header);
+    }
+    peer.best_height = std::max(peer.best_height, endHeight);
+
+    return true;
+}
+
+void CHeadersSync::SetTip(int32_t height, const uint256 &hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = header_heights.find(hash);
+    if (it != header_heights.end()) {
+        // drop the connected headers
+        int32_t tipHeight = it->second;
+        while (base_height < tipHeight) {
+            CSyncHeader &front = headers.front();
+            ReleaseRequest(front, false);
+            header_heights.erase(front.hash);
+            base_height++;
+            base_hash = front.hash;
+            headers.pop_front();
+        }
+        return;
+    }
+
+    // the tip is out of the header chain, the header chain is dropped when the tip is not behind it
+    if (hash != base_hash && (headers.empty() || height >= GetTipHeightLocked()))
+        Reset(height, hash);
+}
+
+void CHeadersSync::UpdatePeerHeight(NodeId nodeId, int32_t height) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CSyncPeer &peer  = peers[nodeId];
+    peer.best_height = std::max(peer.best_height, height);
+}
+
+bool CHeadersSync::StartHeadersRequest(NodeId nodeId, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CSyncPeer &peer = peers[nodeId];
+
+    if (headers_node != -1) {
+        if (now - headers_request_time < HEADERS_DOWNLOAD_TIMEOUT * 1000000LL)
+            return false;
+
+        auto it = peers.find(headers_node);
+        if (it != peers.end())
+            it->second.headers_synced = true;
+        headers_node = -1;
+    }
+
+    if (base_height < 0 || peer.headers_synced || peer.best_height <= GetTipHeightLocked() ||
+        (int32_t)headers.size() >= MAX_HEADERS_AHEAD)
+        return false;
+
+    headers_node         = nodeId;
+    headers_request_time = now;
+    return true;
+}
+
+bool CHeadersSync::IsHeadersRequested(NodeId nodeId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return headers_node != -1 && headers_node == nodeId;
+}
+
+vector<uint256> CHeadersSync::GetLocatorHashes() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    vector<uint256> hashes;
+    int32_t step = 1;
+    for (int32_t i = (int32_t)headers.size() - 1; i >= 0; i -= step) {
+        hashes.push_back(headers[i].hash);
+        if (hashes.size() > 10)
+            step *= 2;
+    }
+    if (base_height >= 0)
+        hashes.push_back(base_hash);
+
+    return hashes;
+}
+
+void CHeadersSync::BlockAnnounced(NodeId nodeId, const uint256 &hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CSyncPeer &peer     = peers[nodeId];
+    peer.headers_synced = false;
+
+    auto it = header_heights.find(hash);
+    if (it != header_heights.end())
+        peer.best_height = std::max(peer.best_height, it->second);
+}
+
+void CHeadersSync::GetBlocksToRequest(NodeId nodeId, int64_t now, vector<uint256> &hashes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    CSyncPeer &peer = peers[nodeId];
+
+    int32_t count = std::min<int32_t>(headers.size(), BLOCK_DOWNLOAD_WINDOW);
+    for (int32_t i = 0; i < count && peer.in_flight < peer.window; i++) {
+        if (base_height + 1 + i > peer.best_height)
+            break;
+
+        CSyncHeader &header = headers[i];
+        if (header.node != -1 || header.receive_time != 0 || (header.stalled_node == nodeId && peers.size() > 1))
+            continue;
+
+        header.node         = nodeId;
+        header.request_time = now;
+        peer.in_flight++;
+        hashes.push_back(header.hash);
+    }
+}
+
+bool CHeadersSync::BlockReceived(NodeId nodeId, const uint256 &hash, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = header_heights.find(hash);
+    if (it == header_heights.end())
+        return false;
+
+    CSyncHeader &header = headers[it->second - base_height - 1];
+    CSyncPeer &peer     = peers[nodeId];
+    peer.best_height    = std::max(peer.best_height, it->second);
+    if (header.node == nodeId) {
+        // the window of the peer grows with the blocks it sends in time
+        peer.in_flight--;
+        if (now - header.request_time <= BLOCK_STALLING_TIMEOUT * 1000000LL) {
+            peer.window = std::min(peer.window + 1, MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+            peer.stalls = 0;
+        }
+        header.node = -1;
+    } else {
+        ReleaseRequest(header, false);
+    }
+    header.receive_time = now;
+
+    return true;
+}
+
+void CHeadersSync::BlockInvalid(const uint256 &hash) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = header_heights.find(hash);
+    if (it != header_heights.end()) {
+        LogPrint(BCLog::NET, "block %d:%s is invalid, drop the header chain from it\n", it->second, hash.GetHex());
+        TruncateFrom(it->second);
+    }
+}
+
+bool CHeadersSync::CheckStalls(NodeId nodeId, int64_t now) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // the block next to the tip holds up the window, it is requested from the other peers
+    if (!headers.empty() && peers.size() > 1) {
+        CSyncHeader &front = headers.front();
+        if (front.node != -1 && now - front.request_time > BLOCK_STALLING_TIMEOUT * 1000000LL) {
+            LogPrint(BCLog::NET, "peer %d stalls the download of block %d:%s\n", front.node, base_height + 1,
+                     front.hash.GetHex());
+            ReleaseRequest(front, true);
+        }
+    }
+
+    // the timed out requests, and the received blocks which were not kept as orphans
+    int32_t count = std::min<int32_t>(headers.size(), BLOCK_DOWNLOAD_WINDOW);
+    for (int32_t i = 0; i < count; i++) {
+        CSyncHeader &header = headers[i];
+        if (header.node != -1 && now - header.request_time > BLOCK_DOWNLOAD_TIMEOUT * 1000000LL)
+            ReleaseRequest(header, true);
+        else if (header.receive_time != 0 && now - header.receive_time > BLOCK_DOWNLOAD_TIMEOUT * 1000000LL)
+            header.receive_time = 0;
+    }
+
+    auto it = peers.find(nodeId);
+    return it != peers.end() && it->second.stalls >= MAX_PEER_STALLS &&
+           it->second.window <= MIN_BLOCKS_IN_TRANSIT_PER_PEER;
+}
+
+void CHeadersSync::RemovePeer(NodeId nodeId) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &header : headers) {
+        if (header.node == nodeId)
+            ReleaseRequest(header, false);
+        if (header.stalled_node == nodeId)
+            header.stalled_node = -1;
+    }
+    peers.erase(nodeId);
+    if (headers_node == nodeId)
+        headers_node = -1;
+
+    // the headers the peer supplied may have no blocks, they are taken from the other peers again
+    for (size_t i = 0; i < headers.size(); i++) {
+        if (headers[i].source_node == nodeId && headers[i].receive_time == 0) {
+            TruncateFrom(base_height + 1 + (int32_t)i);
+            break;
+        }
+    }
+}
+
+bool CHeadersSync::HasHeader(const uint256 &hash) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return header_heights.count(hash) > 0;
+}
+
+bool CHeadersSync::IsSyncing() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !headers.empty();
+}
+
+int32_t CHeadersSync::GetHeaderTipHeight() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return GetTipHeightLocked();
+}
+
+int32_t CHeadersSync::GetPeerWindow(NodeId nodeId) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = peers.find(nodeId);
+    return it != peers.end() ? it->second.window : INITIAL_BLOCKS_IN_TRANSIT_PER_PEER;
+}
+
+void CHeadersSync::ReleaseRequest(CSyncHeader &header, bool stalled) {
+    if (header.node == -1)
+        return;
+
+    auto it = peers.find(header.node);
+    if (it != peers.end()) {
+        CSyncPeer &peer = it->second;
+        peer.in_flight--;
+        if (stalled) {
+            peer.window = std::max(peer.window / 2, MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+            // the header of another peer may have no block, the peer is not disconnected for it
+            if (header.source_node == header.node)
+                peer.stalls++;
+        }
+    }
+    if (stalled)
+        header.stalled_node = header.node;
+    header.node         = -1;
+    header.request_time = 0;
+}
+
+void CHeadersSync::TruncateFrom(int32_t height) {
+    size_t index = std::max(height - base_height - 1, 0);
+    for (size_t i = index; i < headers.size(); i++) {
+        ReleaseRequest(headers[i], false);
+        header_heights.erase(headers[i].hash);
+    }
+    if (index < headers.size())
+        headers.resize(index);
+}
+
+void CHeadersSync::Reset(int32_t height, const uint256 &hash) {
+    TruncateFrom(base_height + 1);
+    base_height = height;
+    base_hash   = hash;
+}
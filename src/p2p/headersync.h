@@ -0,0 +1,122 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef P2P_HEADERSYNC_H
+#define P2P_HEADERSYNC_H
+
+#include "commons/uint256.h"
+#include "persistence/block.h"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+typedef int32_t NodeId;
+
+/**
+ * CHeadersSync
+ * The headers-first block download (-headersfirst). The header chain ahead of the active tip is taken from
+ * the replies to the getheaders requests, one peer at a time, up to MAX_HEADERS_AHEAD headers. The headers are
+ * checked here without the chain state: the links, heights, versions and times. The caller checks the miner
+ * signatures of the headers produced by the active delegates of the tip, the later ones are checked when the
+ * blocks are connected, a bad block drops the header chain from it.
+ *
+ * The bodies of the first BLOCK_DOWNLOAD_WINDOW headers are requested from all the peers which have them, by
+ * the heights the peers announced. Every peer has its own window of blocks in flight: it grows by one for
+ * every block received in time and is halved when the peer holds up the block next to the tip, which is
+ * requested from the other peers then. Only the stalls on the headers a peer supplied itself count for its
+ * disconnection, the unreceived headers of a removed peer are dropped.
+ */
+class CHeadersSync {
+public:
+    // the stalls in a row of a peer at the minimum window before it is disconnected
+    static const uint32_t MAX_PEER_STALLS = 3;
+    // timeout in seconds of a getheaders request
+    static const uint32_t HEADERS_DOWNLOAD_TIMEOUT = 30;
+
+public:
+    /**
+     * Take the headers of a "headers" message from the peer, the ones already in the active chain are left
+     * out by the caller. forkHeight is the height of the block of the active chain the first header links
+     * to, -1 if it is not in the active chain. A branch replaces the header chain only if it is longer. The
+     * headers are ignored unless they are the reply to the getheaders request in flight to the peer.
+     */
+    bool AcceptHeaders(NodeId nodeId, const std::vector<CBlockHeader> &headers, int32_t forkHeight,
+                       std::string &error);
+
+    // the active chain moved to the tip, the connected headers are dropped
+    void SetTip(int32_t height, const uint256 &hash);
+
+    // the peer announced it has the blocks up to the height
+    void UpdatePeerHeight(NodeId nodeId, int32_t height);
+    // start a getheaders request to the peer if the header chain is behind it, only one is in flight
+    bool StartHeadersRequest(NodeId nodeId, int64_t now);
+    // the getheaders request in flight is to the peer
+    bool IsHeadersRequested(NodeId nodeId) const;
+    // the hashes of the header chain from the tip down to the base, for the locator of getheaders
+    std::vector<uint256> GetLocatorHashes() const;
+    // the peer announced a block, it may have new headers
+    void BlockAnnounced(NodeId nodeId, const uint256 &hash);
+
+    // the blocks of the window to request from the peer, up to the height it announced
+    void GetBlocksToRequest(NodeId nodeId, int64_t now, std::vector<uint256> &hashes);
+    // the block is received from the peer, false if it is not in the header chain
+    bool BlockReceived(NodeId nodeId, const uint256 &hash, int64_t now);
+    // the block is invalid, the header chain is dropped from it
+    void BlockInvalid(const uint256 &hash);
+    // release the stalled and timed out requests, true if the peer should be disconnected for stalling
+    bool CheckStalls(NodeId nodeId, int64_t now);
+
+    void RemovePeer(NodeId nodeId);
+
+    bool HasHeader(const uint256 &hash) const;
+    // the header chain has blocks to download
+    bool IsSyncing() const;
+    int32_t GetHeaderTipHeight() const;
+    int32_t GetPeerWindow(NodeId nodeId) const;
+
+private:
+    struct CSyncHeader {
+        uint256 hash;
+        uint32_t time        = 0;
+        NodeId source_node   = -1;  // the peer which supplied the header
+        NodeId node          = -1;  // the peer the block is requested from, -1 if it is not in flight
+        NodeId stalled_node  = -1;  // the last peer which stalled the block
+        int64_t request_time = 0;
+        int64_t receive_time = 0;   // 0 if the block is not received
+    };
+
+    struct CSyncPeer {
+        int32_t best_height = -1;
+        int32_t window;
+        int32_t in_flight   = 0;
+        uint32_t stalls     = 0;   // in a row
+        bool headers_synced = false;
+
+        CSyncPeer();
+    };
+
+    int32_t GetTipHeightLocked() const { return base_height + (int32_t)headers.size(); }
+    void ReleaseRequest(CSyncHeader &header, bool stalled);
+    void TruncateFrom(int32_t height);
+    void Reset(int32_t height, const uint256 &hash);
+
+private:
+    mutable std::mutex mutex;
+    // the block of the active chain the header chain links to
+    int32_t base_height = -1;
+    uint256 base_hash;
+    // the headers of the heights base_height + 1...
+    std::deque<CSyncHeader> headers;
+    std::map<uint256, int32_t> header_heights;
+    std::map<NodeId, CSyncPeer> peers;
+    NodeId headers_node          = -1;
+    int64_t headers_request_time = 0;
+};
+
+extern CHeadersSync headersSync;
+
+#endif  // P2P_HEADERSYNC_H
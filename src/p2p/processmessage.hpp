@@ -61,6 +61,11 @@ bool static ProcessMessage(CNode *pFrom, string strCommand, CDataStream &vRecv)
             return true;
     }
 
+    else if (strCommand == NetMsgType::HEADERS &&
+            !SysCfg().IsImporting() && !SysCfg().IsReindex()) {
+        ProcessHeadersMessage(pFrom, vRecv);
+    }
+
     else if (strCommand == NetMsgType::TX) {
         if (!ProcessTxMessage(pFrom, strCommand, vRecv))
             return false;
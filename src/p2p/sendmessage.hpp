@@ -117,11 +117,31 @@ bool SendMessages(CNode *pTo, bool fSendTrickle) {
             }
 
             // Start block sync
+            bool fHeadersFirst = SysCfg().GetBoolArg("-headersfirst", false) && !SysCfg().IsImporting() &&
+                                 !SysCfg().IsReindex();
             if (pTo->fStartSync && !SysCfg().IsImporting() && !SysCfg().IsReindex()) {
                 pTo->fStartSync = false;
                 nSyncTipHeight  = pTo->nStartingHeight;
-                LogPrint(BCLog::NET, "start block sync lead to getblocks\n");
-                PushGetBlocks(pTo, chainActive.Tip(), uint256());
+                if (!fHeadersFirst) {
+                    LogPrint(BCLog::NET, "start block sync lead to getblocks\n");
+                    PushGetBlocks(pTo, chainActive.Tip(), uint256());
+                }
+            }
+
+            // Message: getheaders, the header chain goes on from its tip
+            if (fHeadersFirst) {
+                headersSync.SetTip(chainActive.Height(), chainActive.Tip()->GetBlockHash());
+                // the height of the version message, the later announcements raise it
+                headersSync.UpdatePeerHeight(pTo->GetId(), pTo->nStartingHeight);
+                if (headersSync.StartHeadersRequest(pTo->GetId(), GetTimeMicros())) {
+                    CBlockLocator locator = chainActive.GetLocator();
+                    vector<uint256> vHave = headersSync.GetLocatorHashes();
+                    vHave.insert(vHave.end(), locator.vHave.begin(), locator.vHave.end());
+                    locator.vHave = vHave;
+                    LogPrint(BCLog::NET, "send getheaders from header_tip=%d, peer=%s\n",
+                             headersSync.GetHeaderTipHeight(), pTo->addrName);
+                    pTo->PushMessage(NetMsgType::GETHEADERS, locator, uint256());
+                }
             }
 
             // Resend wallet transactions that haven't gotten in a block yet
@@ -231,6 +251,26 @@ bool SendMessages(CNode *pTo, bool fSendTrickle) {
             }
         }
 
+        // the blocks of the header chain, in the download window of the peer
+        if (!pTo->fDisconnect && headersSync.CheckStalls(pTo->GetId(), nNow)) {
+            LogPrint(BCLog::INFO, "Peer %s keeps stalling the headers-first download, disconnecting\n", state.name);
+            pTo->fDisconnect = true;
+        }
+        if (!pTo->fDisconnect) {
+            vector<uint256> vHashes;
+            headersSync.GetBlocksToRequest(pTo->GetId(), nNow, vHashes);
+            for (const auto &hash : vHashes) {
+                vGetData.push_back(CInv(MSG_BLOCK, hash));
+                if (vGetData.size() >= 1000) {
+                    pTo->PushMessage(NetMsgType::GETDATA, vGetData);
+                    vGetData.clear();
+                }
+            }
+            if (!vHashes.empty())
+                LogPrint(BCLog::NET, "send MSG_BLOCK msg of the header chain! count=%u, window=%d, peer=%s\n",
+                         vHashes.size(), headersSync.GetPeerWindow(pTo->GetId()), state.name);
+        }
+
         //
         // Message: getdata (non-blocks)
         //
@@ -110,12 +110,14 @@ public:
 public:
 /*  CCompositeKVCache     prefixType            key              value           variable           */
 /*  -------------------- --------------------   --------------  -------------   --------------------- */
-    // <prefix$RegID -> KeyID>
-    CCompositeKVCache< dbk::REGID_KEYID,          CRegIDKey,       CKeyID >         regId2KeyIdCache;
+    // <prefix$RegID -> KeyID>, point lookups only, use the flat map
+    CCompositeKVCache< dbk::REGID_KEYID,          CRegIDKey,       CKeyID,
+                       CDBFlatMap<CRegIDKey, CKeyID> >                          regId2KeyIdCache;
     // <prefix$NickID -> KeyID>
     CCompositeKVCache< dbk::NICKID_KEYID,         CVarIntValue<uint64_t>,      std::pair<CVarIntValue<uint32_t>,CKeyID>>   nickId2KeyIdCache;
-    // <prefix$KeyID -> Account>
-    CCompositeKVCache< dbk::KEYID_ACCOUNT,        CKeyID,       CAccount>        accountCache;
+    // <prefix$KeyID -> Account>, point lookups only, use the flat map
+    CCompositeKVCache< dbk::KEYID_ACCOUNT,        CKeyID,       CAccount,
+                       CDBFlatMap<CKeyID, CAccount> >                           accountCache;
 
 };
 
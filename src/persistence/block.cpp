@@ -5,6 +5,7 @@
 
 #include "block.h"
 
+#include "chain/merkletree.h"
 #include "entities/account.h"
 #include "tx/blockpricemediantx.h"
 #include "main.h"
@@ -25,19 +26,14 @@ uint256 CBlockHeader::ComputeSignatureHash() const {
 }
 
 uint256 CBlock::BuildMerkleTree() const {
+    // the txs may have changed, the block has to be checked again
+    fChecked = false;
     vMerkleTree.clear();
+    vMerkleTree.reserve(vptx.size() * 2 + 16);
     for (const auto& ptx : vptx) {
         vMerkleTree.push_back(ptx->GetHash());
     }
-    int32_t j = 0;
-    for (int32_t nSize = vptx.size(); nSize > 1; nSize = (nSize + 1) / 2) {
-        for (int32_t i = 0; i < nSize; i += 2) {
-            int32_t i2 = min(i + 1, nSize - 1);
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j + i]), END(vMerkleTree[j + i]),
-                                       BEGIN(vMerkleTree[j + i2]), END(vMerkleTree[j + i2])));
-        }
-        j += nSize;
-    }
+    BuildMerkleTreeLevels(vMerkleTree);
     return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
@@ -161,14 +157,23 @@ bool WriteBlockToDisk(CBlock &block, CDiskBlockPos &pos) {
 bool ReadBlockFromDisk(const CDiskBlockPos &pos, CBlock &block) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    // Open history file to read, at the block size of the index header
+    CDiskBlockPos sizePos(pos.nFile, pos.nPos - sizeof(uint32_t));
+    CAutoFile filein = CAutoFile(OpenBlockFile(sizePos, true), SER_DISK, CLIENT_VERSION);
     if (!filein)
         return ERRORMSG("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
+    // Read block at once, its txs keep the sizes read from the stream for the positions of the tx index
     try {
-        filein >> block;
+        uint32_t nSize = 0;
+        filein >> nSize;
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+            return ERRORMSG("%s : bad block size %u at %s", __func__, nSize, pos.ToString());
+
+        CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+        ssBlock.resize(nSize);
+        filein.read((char *)&ssBlock[0], nSize);
+        ssBlock >> block;
     } catch (std::exception &e) {
         return ERRORMSG("%s : Deserialize or I/O error - %s", __func__, e.what());
     }
@@ -201,3 +206,107 @@ bool ReadBaseTxFromDisk(const CTxCord txCord, std::shared_ptr<CBaseTx> &pTx) {
     pTx = pBlock->vptx.at(txCord.GetIndex())->GetNewInstance();
     return true;
 }
+
+CBlockFileReader::CBlockFileReader(FILE *fileIn, uint64_t startPosIn, size_t maxQueueSizeIn)
+    : file(fileIn), start_pos(startPosIn), max_queue_size(maxQueueSizeIn) {
+    assert(max_queue_size > 0);
+}
+
+CBlockFileReader::~CBlockFileReader() {
+    Stop();
+    fclose(file);
+}
+
+void CBlockFileReader::Start() {
+    assert(!readThread.joinable());
+    is_reading = true;
+    readThread = std::thread(&CBlockFileReader::ThreadRead, this);
+}
+
+void CBlockFileReader::Stop() {
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex);
+        is_stopping = true;
+    }
+    queue_cond.notify_all();
+    if (readThread.joinable())
+        readThread.join();
+}
+
+bool CBlockFileReader::Take(size_t maxCount, vector<Item> &items) {
+    items.clear();
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cond.wait(lock, [this] { return !queue.empty() || !is_reading; });
+    while (!queue.empty() && items.size() < maxCount) {
+        items.push_back(std::move(queue.front()));
+        queue.pop_front();
+    }
+    queue_cond.notify_all();
+    return !items.empty();
+}
+
+void CBlockFileReader::Push(Item &&item) {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cond.wait(lock, [this] { return queue.size() < max_queue_size || is_stopping; });
+    queue.push_back(std::move(item));
+    queue_cond.notify_all();
+}
+
+void CBlockFileReader::ThreadRead() {
+    RenameThread("coin-blkreader");
+
+    try {
+        CBufferedFile blkdat(file, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
+        if (start_pos > 0)
+            blkdat.Seek(start_pos);
+
+        uint64_t nRewind = blkdat.GetPos();
+        while (blkdat.good() && !blkdat.eof()) {
+            {
+                std::unique_lock<std::mutex> lock(queue_mutex);
+                if (is_stopping)
+                    break;
+            }
+
+            blkdat.SetPos(nRewind);
+            nRewind++;          // start one byte further next time, in case of failure
+            blkdat.SetLimit();  // remove former limit
+            uint32_t nSize = 0;
+            try {
+                // locate a header
+                uint8_t buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(SysCfg().MessageStart()[0]);
+                nRewind = blkdat.GetPos() + 1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, SysCfg().MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                    continue;
+            } catch (std::exception &e) {
+                // no valid block header found; don't complain
+                break;
+            }
+            try {
+                // read block
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                auto pBlock = std::make_shared<CBlock>();
+                blkdat >> *pBlock;
+                nRewind = blkdat.GetPos();
+
+                if (nBlockPos >= start_pos)
+                    Push({pBlock, nBlockPos});
+            } catch (std::exception &e) {
+                LogPrint(BCLog::INFO, "%s : Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (runtime_error &e) {
+        error = e.what();
+    }
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    is_reading = false;
+    queue_cond.notify_all();
+}
@@ -21,7 +21,11 @@
 
 
 #include <stdint.h>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 class CBlockDBCache;
 class CDiskBlockPos;
@@ -42,7 +46,9 @@ enum BlockStatus {
 
     BLOCK_FAILED_VALID          = 32,  // stage after last reached validness failed     0010 0000
     BLOCK_FAILED_CHILD          = 64,  // descends from failed block                    0100 0000
-    BLOCK_FAILED_MASK           = 96   // BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD       0110 0000
+    BLOCK_FAILED_MASK           = 96,  // BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD       0110 0000
+
+    BLOCK_UNDO_JOURNAL          = 128  // undo data in rev*.dat is CBlockUndoJournal     1000 0000
 };
 
 
@@ -129,6 +135,7 @@ public:
 
     // memory only
     mutable vector<uint256> vMerkleTree;
+    mutable bool fChecked;  // the context-free checks of CheckBlock() passed
 
     CBlock() { SetNull(); }
 
@@ -146,6 +153,7 @@ public:
         CBlockHeader::SetNull();
         vptx.clear();
         vMerkleTree.clear();
+        fChecked = false;
     }
 
     void GetBlockHeader(CBlockHeader &header) {
@@ -372,6 +380,27 @@ public:
     const CBlockIndex *GetAncestor(int32_t heightIn) const;
 };
 
+/**
+ * CBlockIndexArena
+ * Owns the block indexes loaded from the block index db. Every load allocates them as one contiguous
+ * height-ordered slab instead of one heap object per block; the indexes added later by the block
+ * processing are still new'ed one by one, so the owner of mapBlockIndex must only delete the others.
+ */
+class CBlockIndexArena {
+public:
+    CBlockIndex *Allocate(size_t count);
+    bool Contains(const CBlockIndex *pIndex) const;
+
+    size_t GetCount() const;
+    // the memory of the slabs, without the heap data of the indexes
+    size_t GetMemoryUsage() const { return GetCount() * sizeof(CBlockIndex); }
+
+    void Clear() { slabs.clear(); }
+
+private:
+    std::vector<std::pair<std::unique_ptr<CBlockIndex[]>, size_t>> slabs;
+};
+
 
 /** Used to marshal pointers into hashes for db storage. */
 class CDiskBlockIndex : public CBlockIndex {
@@ -465,6 +494,48 @@ bool WriteBlockToDisk(CBlock &block, CDiskBlockPos &pos);
 bool ReadBlockFromDisk(const CDiskBlockPos &pos, CBlock &block);
 bool ReadBlockFromDisk(const CBlockIndex *pIndex, CBlock &block);
 
+/**
+ * CBlockFileReader
+ * Parse the blocks of a block file (-loadblock, -reindex) in its own thread, ahead of the block
+ * processing. The parsed blocks are handed over in the file order through a bounded queue.
+ * The reader owns the file and closes it when destroyed.
+ */
+class CBlockFileReader {
+public:
+    struct Item {
+        std::shared_ptr<CBlock> pBlock;
+        uint64_t block_pos;  // position of the block in the file
+    };
+
+public:
+    // the blocks before startPos are skipped, they have been indexed already
+    CBlockFileReader(FILE *fileIn, uint64_t startPosIn, size_t maxQueueSizeIn);
+    ~CBlockFileReader();
+
+    void Start();
+    void Stop();
+    // take up to maxCount parsed blocks, wait for one at least, return false at the end of the file
+    bool Take(size_t maxCount, vector<Item> &items);
+    // the system error which stopped the reading, empty if none
+    const string &GetError() const { return error; }
+
+private:
+    void ThreadRead();
+    void Push(Item &&item);
+
+private:
+    FILE *file;
+    uint64_t start_pos;
+    size_t max_queue_size;
+    std::thread readThread;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::deque<Item> queue;
+    bool is_reading  = false;
+    bool is_stopping = false;
+    string error;
+};
 
 bool ReadBaseTxFromDisk(const CTxCord txCord, std::shared_ptr<CBaseTx> &pTx);
 
@@ -8,8 +8,14 @@
 #include "commons/uint256.h"
 #include "commons/util/util.h"
 #include "main.h"
+#include "chain/chainverifier.h"
+#include "commons/util/workerpool.h"
 
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 using namespace std;
 
@@ -22,55 +28,145 @@ bool CBlockIndexDB::EraseBlockIndex(const uint256 &blockHash) {
     return Erase(dbk::GenDbKey(dbk::BLOCK_INDEX, blockHash));
 }
 
-bool CBlockIndexDB::LoadBlockIndexes() {
-    leveldb::Iterator *pCursor = NewIterator();
+// read the block indexes of the key range [keyBegin, keyEnd), keyEnd empty means to the end of the prefix
+bool CBlockIndexDB::ReadBlockIndexRange(const string &keyBegin, const string &keyEnd,
+                                        vector<CBlockIndexLoadItem> &items) {
     const std::string &prefix = dbk::GetKeyPrefix(dbk::BLOCK_INDEX);
+    std::unique_ptr<leveldb::Iterator> pCursor(NewIterator());
+    try {
+        for (pCursor->Seek(keyBegin); pCursor->Valid(); pCursor->Next()) {
+            boost::this_thread::interruption_point();
+            leveldb::Slice slKey = pCursor->key();
+            if (!slKey.starts_with(prefix) || (!keyEnd.empty() && slKey.compare(keyEnd) >= 0))
+                break;
 
-    pCursor->Seek(prefix);
+            leveldb::Slice slValue = pCursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            items.emplace_back();
+            ssValue >> items.back().disk_index;
+            items.back().block_hash = items.back().disk_index.GetBlockHash();
+        }
+    } catch (std::exception &e) {
+        return ERRORMSG("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    if (!pCursor->status().ok())
+        return ERRORMSG("%s : I/O error - %s", __func__, pCursor->status().ToString());
 
-    // Load mapBlockIndex
-    while (pCursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pCursor->key();
-            if (slKey.starts_with(prefix)) {
-                leveldb::Slice slValue = pCursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskIndex;
-                ssValue >> diskIndex;
-
-                // Construct block index object
-                CBlockIndex *pIndexNew    = InsertBlockIndex(diskIndex.GetBlockHash());
-                pIndexNew->pprev          = InsertBlockIndex(diskIndex.hashPrev);
-                pIndexNew->height         = diskIndex.height;
-                pIndexNew->nFile          = diskIndex.nFile;
-                pIndexNew->nDataPos       = diskIndex.nDataPos;
-                pIndexNew->nUndoPos       = diskIndex.nUndoPos;
-                pIndexNew->nVersion       = diskIndex.nVersion;
-                pIndexNew->merkleRootHash = diskIndex.merkleRootHash;
-                pIndexNew->hashPos        = diskIndex.hashPos;
-                pIndexNew->nTime          = diskIndex.nTime;
-                pIndexNew->nBits          = diskIndex.nBits;
-                pIndexNew->nNonce         = diskIndex.nNonce;
-                pIndexNew->nStatus        = diskIndex.nStatus;
-                pIndexNew->nTx            = diskIndex.nTx;
-                pIndexNew->nFuel          = diskIndex.nFuel;
-                pIndexNew->nFuelRate      = diskIndex.nFuelRate;
-                pIndexNew->vSignature     = diskIndex.vSignature;
-                pIndexNew->miner          = diskIndex.miner ;
-
-                if (!pIndexNew->CheckIndex())
-                    return ERRORMSG("LoadBlockIndex() : CheckIndex failed: %s", pIndexNew->ToString());
-
-                pCursor->Next();
-            } else {
-                break;  // if shutdown requested or finished loading block index
-            }
-        } catch (std::exception &e) {
-            return ERRORMSG("%s : Deserialize or I/O error - %s", __func__, e.what());
+    return true;
+}
+
+// run task(0) .. task(count - 1) on the workers, a batch of indexes per worker task
+static void RunLoadTasks(CWorkerPool *pWorkerPool, size_t count, const std::function<void(size_t)> &task) {
+    if (pWorkerPool == nullptr) {
+        for (size_t i = 0; i < count; i++)
+            task(i);
+        return;
+    }
+
+    const size_t batchSize = CBlockIndexDB::LOAD_BATCH_SIZE;
+    pWorkerPool->Run((count + batchSize - 1) / batchSize, [&](size_t batch) {
+        size_t end = std::min(count, (batch + 1) * batchSize);
+        for (size_t i = batch * batchSize; i < end; i++)
+            task(i);
+    });
+}
+
+bool CBlockIndexDB::LoadBlockIndexes(CWorkerPool *pWorkerPool, vector<CBlockIndex *> &vSortedByHeight) {
+    const std::string &prefix = dbk::GetKeyPrefix(dbk::BLOCK_INDEX);
+
+    // Read the key ranges by the first byte of the block hash, the block hashes are even over them
+    vector<vector<CBlockIndexLoadItem>> rangeItems(pWorkerPool != nullptr ? LOAD_KEY_RANGE_COUNT : 1);
+    std::atomic<bool> failed{false};
+    auto readRange = [&](size_t i) {
+        string keyBegin = prefix, keyEnd;
+        if (i > 0)
+            keyBegin.push_back((char)(i * 256 / rangeItems.size()));
+        if (i + 1 < rangeItems.size())
+            keyEnd = prefix + (char)((i + 1) * 256 / rangeItems.size());
+        if (!ReadBlockIndexRange(keyBegin, keyEnd, rangeItems[i]))
+            failed = true;
+    };
+    if (pWorkerPool != nullptr)
+        pWorkerPool->Run(rangeItems.size(), readRange);
+    else
+        readRange(0);
+    if (failed)
+        return false;
+
+    // Allocate the block indexes in one height-ordered slab
+    vector<CBlockIndexLoadItem *> vItems;
+    for (auto &items : rangeItems) {
+        for (auto &item : items)
+            vItems.push_back(&item);
+    }
+    std::stable_sort(vItems.begin(), vItems.end(), [](const CBlockIndexLoadItem *pA, const CBlockIndexLoadItem *pB) {
+        return pA->disk_index.height < pB->disk_index.height;
+    });
+
+    CBlockIndex *pSlab = vItems.empty() ? nullptr : blockIndexArena.Allocate(vItems.size());
+    auto fillIndex = [&](size_t i) {
+        CDiskBlockIndex &diskIndex = vItems[i]->disk_index;
+        CBlockIndex *pIndexNew     = &pSlab[i];
+        pIndexNew->height          = diskIndex.height;
+        pIndexNew->nFile           = diskIndex.nFile;
+        pIndexNew->nDataPos        = diskIndex.nDataPos;
+        pIndexNew->nUndoPos        = diskIndex.nUndoPos;
+        pIndexNew->nVersion        = diskIndex.nVersion;
+        pIndexNew->merkleRootHash  = diskIndex.merkleRootHash;
+        pIndexNew->hashPos         = diskIndex.hashPos;
+        pIndexNew->nTime           = diskIndex.nTime;
+        pIndexNew->nBits           = diskIndex.nBits;
+        pIndexNew->nNonce          = diskIndex.nNonce;
+        pIndexNew->nStatus         = diskIndex.nStatus;
+        pIndexNew->nTx             = diskIndex.nTx;
+        pIndexNew->nFuel           = diskIndex.nFuel;
+        pIndexNew->nFuelRate       = diskIndex.nFuelRate;
+        pIndexNew->vSignature      = std::move(diskIndex.vSignature);
+        pIndexNew->miner           = diskIndex.miner;
+        if (!pIndexNew->CheckIndex()) {
+            LogPrint(BCLog::ERROR, "LoadBlockIndex() : CheckIndex failed: %s\n", pIndexNew->ToString());
+            failed = true;
+        }
+    };
+    RunLoadTasks(pWorkerPool, vItems.size(), fillIndex);
+    if (failed)
+        return false;
+
+    for (size_t i = 0; i < vItems.size(); i++) {
+        auto ret = mapBlockIndex.emplace(vItems[i]->block_hash, &pSlab[i]);
+        if (!ret.second)
+            return ERRORMSG("%s : duplicated block index %s", __func__, vItems[i]->block_hash.GetHex());
+        pSlab[i].pBlockHash = &ret.first->first;
+    }
+
+    // Link the predecessors, the map is read only here
+    vector<size_t> vMissingPrev;
+    std::mutex missingMutex;
+    auto linkPrev = [&](size_t i) {
+        const uint256 &hashPrev = vItems[i]->disk_index.hashPrev;
+        if (hashPrev.IsNull())
+            return;
+        auto it = mapBlockIndex.find(hashPrev);
+        if (it != mapBlockIndex.end()) {
+            pSlab[i].pprev = it->second;
+        } else {
+            std::lock_guard<std::mutex> lock(missingMutex);
+            vMissingPrev.push_back(i);
         }
+    };
+    RunLoadTasks(pWorkerPool, vItems.size(), linkPrev);
+
+    // the predecessor not in the db gets an empty index as before, it goes before the loaded ones
+    vSortedByHeight.clear();
+    vSortedByHeight.reserve(vItems.size() + vMissingPrev.size());
+    for (size_t i : vMissingPrev) {
+        pSlab[i].pprev = InsertBlockIndex(vItems[i]->disk_index.hashPrev);
+        vSortedByHeight.push_back(pSlab[i].pprev);
     }
-    delete pCursor;
+    std::sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    vSortedByHeight.erase(std::unique(vSortedByHeight.begin(), vSortedByHeight.end()), vSortedByHeight.end());
+    for (size_t i = 0; i < vItems.size(); i++)
+        vSortedByHeight.push_back(&pSlab[i]);
 
     return true;
 }
@@ -82,6 +178,13 @@ bool CBlockIndexDB::ReadBlockFileInfo(int32_t nFile, CBlockFileInfo &info) {
     return Read(dbk::GenDbKey(dbk::BLOCKFILE_NUM_INFO, nFile), info);
 }
 
+bool CBlockIndexDB::ReadVerifyProgress(CVerifyDBProgress &progress) {
+    return Read(dbk::GetKeyPrefix(dbk::VERIFY_PROGRESS), progress);
+}
+bool CBlockIndexDB::WriteVerifyProgress(const CVerifyDBProgress &progress) {
+    return Write(dbk::GetKeyPrefix(dbk::VERIFY_PROGRESS), progress);
+}
+
 CBlockIndex *InsertBlockIndex(uint256 hash) {
     if (hash.IsNull())
         return nullptr;
@@ -16,6 +16,15 @@
 
 #include <map>
 
+class CVerifyDBProgress;
+class CWorkerPool;
+
+// a block index read from the db, with the block hash computed by the reading worker
+struct CBlockIndexLoadItem {
+    CDiskBlockIndex disk_index;
+    uint256 block_hash;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockIndexDB : public CLevelDBWrapper {
 private:
@@ -24,17 +33,35 @@ private:
 
 public:
     CBlockIndexDB(bool fMemory = false, bool fWipe = false) :
-        CLevelDBWrapper(GetDataDir() / "blocks" / "index", 2 << 20 /* 2MB */, fMemory, fWipe) {}
+        CLevelDBWrapper(GetDataDir() / "blocks" / "index", 2 << 20 /* 2MB */, fMemory, fWipe,
+                        GetDBProfileType("index", DB_PROFILE_APPEND)) {}
 
     // CBlockIndexDB(const std::string &name, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
+public:
+    // the key ranges of the block indexes read in parallel, split by the first byte of the block hash
+    static const uint32_t LOAD_KEY_RANGE_COUNT = 16;
+    // the block indexes of one worker task when they are built and linked
+    static const uint32_t LOAD_BATCH_SIZE = 4096;
+
 public:
     bool WriteBlockIndex(const CDiskBlockIndex &blockindex);
     bool EraseBlockIndex(const uint256 &blockHash);
-    bool LoadBlockIndexes();
+    /**
+     * Load all the block indexes into mapBlockIndex, allocated in one height-ordered slab of
+     * blockIndexArena. The key ranges are read and the indexes built by the workers if pWorkerPool
+     * is not nullptr. vSortedByHeight returns the loaded indexes, every one after its predecessor.
+     */
+    bool LoadBlockIndexes(CWorkerPool *pWorkerPool, vector<CBlockIndex *> &vSortedByHeight);
 
     bool ReadBlockFileInfo(int32_t nFile, CBlockFileInfo &fileinfo);
     bool WriteBlockFileInfo(int32_t nFile, const CBlockFileInfo &fileinfo);
+
+    bool ReadVerifyProgress(CVerifyDBProgress &progress);
+    bool WriteVerifyProgress(const CVerifyDBProgress &progress);
+
+private:
+    bool ReadBlockIndexRange(const string &keyBegin, const string &keyEnd, vector<CBlockIndexLoadItem> &items);
 };
 
 
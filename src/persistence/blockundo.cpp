@@ -6,6 +6,12 @@
 #include "blockundo.h"
 #include "main.h"
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /** Open an undo file (rev?????.dat) */
 FILE *OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
@@ -106,6 +112,204 @@ string CBlockUndo::ToString() const {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+// class CBlockUndoJournal
+
+CBlockUndoJournal::CBlockUndoJournal(): journal(SER_DISK, CLIENT_VERSION) {
+    journal << tx_count;
+}
+
+CBlockUndoJournal::~CBlockUndoJournal() {
+    Unmap();
+}
+
+void CBlockUndoJournal::BeginTx(const TxID &txid) {
+    assert(p_mapped == nullptr && mapped_data.empty());
+    journal << txid;
+    log_count_pos = journal.size();
+    tx_log_count  = 0;
+    journal << tx_log_count;
+}
+
+void CBlockUndoJournal::EndTx() {
+    tx_count++;
+    memcpy(&journal[log_count_pos], &tx_log_count, sizeof(tx_log_count));
+    memcpy(&journal[0], &tx_count, sizeof(tx_count));
+}
+
+void CBlockUndoJournal::AddOpLog(dbk::PrefixType prefixType, const CDbOpLog &dbOpLog) {
+    assert(prefixType != dbk::EMPTY);
+    journal << dbk::GetKeyPrefix(prefixType) << dbOpLog;
+    tx_log_count++;
+}
+
+leveldb::Slice CBlockUndoJournal::GetData() const {
+    if (!mapped_data.empty())
+        return mapped_data;
+    return leveldb::Slice(&journal[0], journal.size());
+}
+
+static uint256 CalcUndoJournalChecksum(const uint256 &blockHash, const leveldb::Slice &data) {
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << blockHash;
+    hasher.write(data.data(), data.size());
+    return hasher.GetHash();
+}
+
+bool CBlockUndoJournal::WriteToDisk(CDiskBlockPos &pos, const uint256 &blockHash) {
+    // Open history file to append
+    CAutoFile fileout = CAutoFile(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return ERRORMSG("CBlockUndoJournal::WriteToDisk : OpenUndoFile failed");
+
+    // Write index header
+    leveldb::Slice data = GetData();
+    uint32_t nSize      = data.size();
+    fileout << FLATDATA(SysCfg().MessageStart()) << nSize;
+
+    // Write undo data
+    long fileOutPos = ftell(fileout);
+    if (fileOutPos < 0)
+        return ERRORMSG("CBlockUndoJournal::WriteToDisk : ftell failed");
+    pos.nPos = (uint32_t)fileOutPos;
+    fileout.write(data.data(), data.size());
+    fileout << CalcUndoJournalChecksum(blockHash, data);
+
+    // Flush stdio buffers and commit to disk before returning
+    fflush(fileout);
+    if (!IsInitialBlockDownload())
+        FileCommit(fileout);
+
+    return true;
+}
+
+bool CBlockUndoJournal::ReadFromDisk(const CDiskBlockPos &pos, const uint256 &blockHash) {
+    Unmap();
+
+    // the size of the journal is in the header before pos
+    const uint32_t headerSize = sizeof(SysCfg().MessageStart()) + sizeof(uint32_t);
+    if (pos.nPos < headerSize)
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : invalid undo pos=%u", pos.nPos);
+
+    FILE *file = OpenUndoFile(CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t)), true);
+    if (!file)
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : OpenUndoFile failed");
+
+    uint32_t nSize = 0;
+    if (fread(&nSize, sizeof(nSize), 1, file) != 1 || nSize < sizeof(uint32_t) || nSize > MAX_SIZE) {
+        fclose(file);
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : read undo size failed, pos=%u", pos.nPos);
+    }
+    const size_t dataSize = nSize + sizeof(uint256);
+
+#ifndef WIN32
+    struct stat fileStat;
+    if (fstat(fileno(file), &fileStat) != 0 || (uint64_t)fileStat.st_size < (uint64_t)pos.nPos + dataSize) {
+        fclose(file);
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : undo data out of file range, pos=%u, size=%u",
+                        pos.nPos, nSize);
+    }
+
+    size_t pageOffset = pos.nPos % sysconf(_SC_PAGESIZE);
+    mapped_size       = pageOffset + dataSize;
+    p_mapped          = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fileno(file), pos.nPos - pageOffset);
+    fclose(file);
+    if (p_mapped == MAP_FAILED) {
+        p_mapped = nullptr;
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : mmap failed, errno=%d", errno);
+    }
+    const char *pData = (const char *)p_mapped + pageOffset;
+#else
+    journal.resize(dataSize);
+    size_t readSize = fread(&journal[0], 1, dataSize, file);
+    fclose(file);
+    if (readSize != dataSize)
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : read undo data failed, pos=%u", pos.nPos);
+    const char *pData = &journal[0];
+#endif
+
+    mapped_data = leveldb::Slice(pData, nSize);
+    uint256 hashChecksum;
+    memcpy((char *)&hashChecksum, pData + nSize, sizeof(hashChecksum));
+    if (hashChecksum != CalcUndoJournalChecksum(blockHash, mapped_data)) {
+        Unmap();
+        return ERRORMSG("CBlockUndoJournal::ReadFromDisk : Checksum mismatch");
+    }
+    memcpy(&tx_count, pData, sizeof(tx_count));
+    return true;
+}
+
+void CBlockUndoJournal::Unmap() {
+#ifndef WIN32
+    if (p_mapped != nullptr)
+        munmap(p_mapped, mapped_size);
+#endif
+    p_mapped    = nullptr;
+    mapped_size = 0;
+    mapped_data = leveldb::Slice();
+}
+
+bool CBlockUndoJournal::GetOpLogs(vector<OpLog> &opLogs, vector<TxID> *pTxids) const {
+    try {
+        dbk::CDBKeyReader reader(GetData());
+        uint32_t txCount = 0;
+        reader >> txCount;
+        for (uint32_t txIndex = 0; txIndex < txCount; txIndex++) {
+            TxID txid;
+            uint32_t logCount = 0;
+            reader >> txid >> logCount;
+            if (pTxids != nullptr)
+                pTxids->push_back(txid);
+
+            for (uint32_t i = 0; i < logCount; i++) {
+                OpLog opLog;
+                opLog.tx_index    = txIndex;
+                leveldb::Slice prefix = reader.ReadSlice(ReadCompactSize(reader));
+                opLog.prefix_type = dbk::ParseKeyPrefixType(prefix.ToString());
+                if (opLog.prefix_type == dbk::EMPTY)
+                    return ERRORMSG("%s(), unkown prefix! prefix=%s", __func__, prefix.ToString());
+                opLog.key   = reader.ReadSlice(ReadCompactSize(reader));
+                opLog.value = reader.ReadSlice(ReadCompactSize(reader));
+                opLogs.push_back(opLog);
+            }
+        }
+        if (!reader.empty())
+            return ERRORMSG("%s(), %u bytes left after the last op log", __func__, reader.size());
+    } catch (std::exception &e) {
+        return ERRORMSG("%s(), decode undo journal error: %s", __func__, e.what());
+    }
+    return true;
+}
+
+bool CBlockUndoJournal::ToBlockUndo(CBlockUndo &blockUndo) const {
+    vector<OpLog> opLogs;
+    vector<TxID> txids;
+    if (!GetOpLogs(opLogs, &txids))
+        return false;
+
+    blockUndo.vtxundo.clear();
+    for (const auto &txid : txids) {
+        blockUndo.vtxundo.emplace_back(txid);
+    }
+    for (const auto &opLog : opLogs) {
+        blockUndo.vtxundo[opLog.tx_index].dbOpLogMap.AddOpLog(
+            opLog.prefix_type, CDbOpLog(opLog.key.ToString(), opLog.value.ToString()));
+    }
+    return true;
+}
+
+bool ReadBlockUndo(const CBlockIndex *pIndex, CBlockUndo &blockUndo) {
+    CDiskBlockPos pos = pIndex->GetUndoPos();
+    if (pos.IsNull())
+        return ERRORMSG("%s(), no undo data available! block=%d", __func__, pIndex->height);
+
+    if (pIndex->nStatus & BLOCK_UNDO_JOURNAL) {
+        CBlockUndoJournal journal;
+        return journal.ReadFromDisk(pos, pIndex->pprev->GetBlockHash()) && journal.ToBlockUndo(blockUndo);
+    }
+    return blockUndo.ReadFromDisk(pos, pIndex->pprev->GetBlockHash());
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // class CBlockUndoExecutor
 
@@ -114,7 +318,26 @@ bool CBlockUndoExecutor::Execute() {
     // RegisterUndoFunc();
     const UndoDataFuncMap &undoDataFuncMap = cw.GetUndoDataFuncMap();
 
-    for (auto it = block_undo.vtxundo.rbegin(); it != block_undo.vtxundo.rend(); it++) {
+    if (p_journal != nullptr) {
+        vector<CBlockUndoJournal::OpLog> opLogs;
+        if (!p_journal->GetOpLogs(opLogs))
+            return false;
+
+        // the op logs of different prefixes are independent, undo all of them in the reverse order
+        vector<const std::function<UndoDataFunc> *> undoFuncs(dbk::PREFIX_COUNT, nullptr);
+        for (const auto &item : undoDataFuncMap) {
+            undoFuncs[item.first] = &item.second;
+        }
+        for (auto it = opLogs.rbegin(); it != opLogs.rend(); it++) {
+            if (undoFuncs[it->prefix_type] == nullptr)
+                return ERRORMSG("%s(), unfound prefix in db! prefix_type=%s", __FUNCTION__,
+                                dbk::GetKeyPrefix(it->prefix_type));
+            (*undoFuncs[it->prefix_type])(it->key, it->value);
+        }
+        return true;
+    }
+
+    for (auto it = p_block_undo->vtxundo.rbegin(); it != p_block_undo->vtxundo.rend(); it++) {
         for (const auto &opLogPair : it->dbOpLogMap.GetMap()) {
             dbk::PrefixType prefixType = dbk::ParseKeyPrefixType(opLogPair.first);
             if (prefixType == dbk::EMPTY)
@@ -125,8 +348,11 @@ bool CBlockUndoExecutor::Execute() {
                 return ERRORMSG("%s(), unfound prefix in db! prefix_type=%s", __FUNCTION__,
                                 opLogPair.first);
             }
-            funcMapIt->second(opLogPair.second);
+            const CDbOpLogs &opLogs = opLogPair.second;
+            for (auto logIt = opLogs.rbegin(); logIt != opLogs.rend(); logIt++) {
+                funcMapIt->second(logIt->GetKey(), logIt->GetValue());
+            }
         }
     }
     return true;
-}
\ No newline at end of file
+}
@@ -15,6 +15,8 @@
 #include <stdint.h>
 #include <memory>
 
+class CBlockIndex;
+
 class CTxUndo {
 public:
     uint256     txid;
@@ -58,20 +60,96 @@ public:
     string ToString() const;
 };
 
+/**
+ * CBlockUndoJournal
+ * Undo data of a block in the compact binary format. The op logs are appended to the journal when
+ * they are produced, without the undo object of every tx. The layout is
+ *   {tx count}{tx}..{tx}, tx = {txid}{op log count}{op log}..{op log}
+ *   op log = {db prefix}{key}{old value}, the key and old value are serialized already.
+ * The journal read from disk is mapped into memory, the op logs are decoded in place.
+ */
+class CBlockUndoJournal: public CDBOpLogMap {
+public:
+    struct OpLog {
+        uint32_t tx_index;
+        dbk::PrefixType prefix_type;
+        leveldb::Slice key;
+        leveldb::Slice value;
+    };
+
+public:
+    CBlockUndoJournal();
+    CBlockUndoJournal(const CBlockUndoJournal &) = delete;
+    CBlockUndoJournal &operator=(const CBlockUndoJournal &) = delete;
+    ~CBlockUndoJournal();
+
+    void BeginTx(const TxID &txid);
+    void EndTx();
+    void AddOpLog(dbk::PrefixType prefixType, const CDbOpLog &dbOpLog) override;
+
+    uint32_t GetTxCount() const { return tx_count; }
+    // size of the journal data on disk, exclude the header and checksum
+    uint32_t GetDataSize() const { return GetData().size(); }
+
+    bool WriteToDisk(CDiskBlockPos &pos, const uint256 &blockHash);
+    bool ReadFromDisk(const CDiskBlockPos &pos, const uint256 &blockHash);
+
+    // the op logs in the order they were produced
+    bool GetOpLogs(vector<OpLog> &opLogs, vector<TxID> *pTxids = nullptr) const;
+    bool ToBlockUndo(CBlockUndo &blockUndo) const;
+
+private:
+    leveldb::Slice GetData() const;
+    void Unmap();
+
+private:
+    CDataStream journal;
+    uint32_t tx_count       = 0;
+    size_t log_count_pos    = 0;  // position of the op log count of the current tx
+    uint32_t tx_log_count   = 0;
+
+    // the journal read from disk
+    void *p_mapped          = nullptr;
+    size_t mapped_size      = 0;
+    leveldb::Slice mapped_data;
+};
+
+/**
+ * CTxOpLogRecorder
+ * The op logs of a tx executed on its own cache (-parallelexec), in the order they were produced.
+ * They are replayed into the block undo journal when the tx is committed.
+ */
+class CTxOpLogRecorder: public CDBOpLogMap {
+public:
+    void AddOpLog(dbk::PrefixType prefixType, const CDbOpLog &dbOpLog) override {
+        opLogs.emplace_back(prefixType, dbOpLog);
+    }
+
+    void ReplayTo(CDBOpLogMap &opLogMap) const {
+        for (const auto &item : opLogs) {
+            opLogMap.AddOpLog(item.first, item.second);
+        }
+    }
+
+    void Reset() { opLogs.clear(); }
+
+private:
+    vector<pair<dbk::PrefixType, CDbOpLog>> opLogs;
+};
+
 class CTxUndoOpLogger {
 public:
     CCacheWrapper &cw;
-    CBlockUndo &block_undo;
-    CTxUndo tx_undo;
+    CBlockUndoJournal &journal;
 
-    CTxUndoOpLogger(CCacheWrapper& cwIn, const TxID& txidIn, CBlockUndo& blockUndoIn)
-        : cw(cwIn), block_undo(blockUndoIn) {
+    CTxUndoOpLogger(CCacheWrapper& cwIn, const TxID& txidIn, CBlockUndoJournal& journalIn)
+        : cw(cwIn), journal(journalIn) {
 
-        tx_undo.SetTxID(txidIn);
-        cw.SetDbOpLogMap(&tx_undo.dbOpLogMap);
+        journal.BeginTx(txidIn);
+        cw.SetDbOpLogMap(&journal);
     }
     ~CTxUndoOpLogger() {
-        block_undo.vtxundo.push_back(tx_undo);
+        journal.EndTx();
         cw.SetDbOpLogMap(nullptr);
     }
 };
@@ -79,13 +157,19 @@ public:
 class CBlockUndoExecutor {
 public:
     CCacheWrapper &cw;
-    CBlockUndo &block_undo;
+    CBlockUndo *p_block_undo        = nullptr;
+    CBlockUndoJournal *p_journal    = nullptr;
 
     CBlockUndoExecutor(CCacheWrapper &cwIn, CBlockUndo &blockUndoIn)
-        : cw(cwIn), block_undo(blockUndoIn) {}
+        : cw(cwIn), p_block_undo(&blockUndoIn) {}
+    CBlockUndoExecutor(CCacheWrapper &cwIn, CBlockUndoJournal &journalIn)
+        : cw(cwIn), p_journal(&journalIn) {}
     bool Execute();
 };
 
+// read the undo data of the block in either format, see BLOCK_UNDO_JOURNAL
+bool ReadBlockUndo(const CBlockIndex *pIndex, CBlockUndo &blockUndo);
+
 /** Open an undo file (rev?????.dat) */
 FILE *OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
@@ -7,6 +7,9 @@
 #include "main.h"
 #include "logging.h"
 
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
 ////////////////////////////////////////////////////////////////////////////////
 // class CCacheWrapper
 
@@ -19,6 +22,10 @@ std::shared_ptr<CCacheWrapper>CCacheWrapper::NewCopyFrom(CCacheDBManager* pCdMan
 CCacheWrapper::CCacheWrapper() {}
 
 CCacheWrapper::CCacheWrapper(CCacheWrapper *cwIn) {
+    SetBaseViewPtr(cwIn);
+}
+
+void CCacheWrapper::SetBaseViewPtr(CCacheWrapper *cwIn) {
     sysParamCache.SetBaseViewPtr(&cwIn->sysParamCache);
     blockCache.SetBaseViewPtr(&cwIn->blockCache);
     accountCache.SetBaseViewPtr(&cwIn->accountCache);
@@ -36,7 +43,6 @@ CCacheWrapper::CCacheWrapper(CCacheWrapper *cwIn) {
     ppCache.SetBaseViewPtr(&cwIn->ppCache);
     sysGovernCache.SetBaseViewPtr(&cwIn->sysGovernCache);
     priceFeedCache.SetBaseViewPtr(&cwIn->priceFeedCache);
-
 }
 
 CCacheWrapper::CCacheWrapper(CCacheDBManager* pCdMan) {
@@ -159,66 +165,234 @@ UndoDataFuncMap CCacheWrapper::GetUndoDataFuncMap() {
     return undoDataFuncMap;
 }
 
+void CCacheWrapper::DropData(const std::unordered_set<string> &dbKeys) {
+    if (dbKeys.empty())
+        return;
+
+    // no key prefix is the beginning of another one, the prefix of the key tells its cache
+    UndoDataFuncMap undoDataFuncMap = GetUndoDataFuncMap();
+    for (const auto &dbKey : dbKeys) {
+        for (const auto &item : undoDataFuncMap) {
+            const string &prefix = dbk::GetKeyPrefix(item.first);
+            if (prefix.empty() || dbKey.compare(0, prefix.size(), prefix) != 0)
+                continue;
+
+            item.second(leveldb::Slice(dbKey.data() + prefix.size(), dbKey.size() - prefix.size()), leveldb::Slice());
+            break;
+        }
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // class CCacheDBManager
 
 CCacheDBManager::CCacheDBManager(bool fReIndex, bool fMemory) {
     const boost::filesystem::path& dbDir = GetDataDir() / "blocks";
-    pSysParamDb     = new CDBAccess(dbDir, DBNameType::SYSPARAM, false, fReIndex);
+    OpenSharedStore(dbDir, fReIndex);
+
+    pSysParamDb     = NewDbAccess(dbDir, DBNameType::SYSPARAM, fReIndex);
     pSysParamCache  = new CSysParamDBCache(pSysParamDb);
 
-    pAccountDb      = new CDBAccess(dbDir, DBNameType::ACCOUNT, false, fReIndex);
+    pAccountDb      = NewDbAccess(dbDir, DBNameType::ACCOUNT, fReIndex);
     pAccountCache   = new CAccountDBCache(pAccountDb);
 
-    pAssetDb        = new CDBAccess(dbDir, DBNameType::ASSET, false, fReIndex);
+    pAssetDb        = NewDbAccess(dbDir, DBNameType::ASSET, fReIndex);
     pAssetCache     = new CAssetDbCache(pAssetDb);
 
-    pContractDb     = new CDBAccess(dbDir, DBNameType::CONTRACT, false, fReIndex);
+    pContractDb     = NewDbAccess(dbDir, DBNameType::CONTRACT, fReIndex);
     pContractCache  = new CContractDBCache(pContractDb);
 
-    pDelegateDb     = new CDBAccess(dbDir, DBNameType::DELEGATE, false, fReIndex);
+    pDelegateDb     = NewDbAccess(dbDir, DBNameType::DELEGATE, fReIndex);
     pDelegateCache  = new CDelegateDBCache(pDelegateDb);
 
-    pCdpDb          = new CDBAccess(dbDir, DBNameType::CDP, false, fReIndex);
+    pCdpDb          = NewDbAccess(dbDir, DBNameType::CDP, fReIndex);
     pCdpCache       = new CCdpDBCache(pCdpDb);
 
-    pClosedCdpDb    = new CDBAccess(dbDir, DBNameType::CLOSEDCDP, false, fReIndex);
+    pClosedCdpDb    = NewDbAccess(dbDir, DBNameType::CLOSEDCDP, fReIndex);
     pClosedCdpCache = new CClosedCdpDBCache(pClosedCdpDb);
 
-    pDexDb          = new CDBAccess(dbDir, DBNameType::DEX, false, fReIndex);
+    pDexDb          = NewDbAccess(dbDir, DBNameType::DEX, fReIndex);
     pDexCache       = new CDexDBCache(pDexDb);
 
 
     pBlockIndexDb   = new CBlockIndexDB(false, fReIndex);
 
-    pBlockDb        = new CDBAccess(dbDir, DBNameType::BLOCK, false, fReIndex);
+    pBlockDb        = NewDbAccess(dbDir, DBNameType::BLOCK, fReIndex);
     pBlockCache     = new CBlockDBCache(pBlockDb);
 
-    pLogDb          = new CDBAccess(dbDir, DBNameType::LOG, false, fReIndex);
+    pLogDb          = NewDbAccess(dbDir, DBNameType::LOG, fReIndex);
     pLogCache       = new CLogDBCache(pLogDb);
 
-    pReceiptDb      = new CDBAccess(dbDir, DBNameType::RECEIPT, false, fReIndex);
+    pReceiptDb      = NewDbAccess(dbDir, DBNameType::RECEIPT, fReIndex);
     pReceiptCache   = new CTxReceiptDBCache(pReceiptDb);
 
-    pUtxoDb         = new CDBAccess(dbDir, DBNameType::UTXO, false, fReIndex);
+    pUtxoDb         = NewDbAccess(dbDir, DBNameType::UTXO, fReIndex);
     pUtxoCache      = new CTxUTXODBCache(pUtxoDb);
 
-    pAxcDb          = new CDBAccess(dbDir, DBNameType::AXC, false, fReIndex);
+    pAxcDb          = NewDbAccess(dbDir, DBNameType::AXC, fReIndex);
     pAxcCache       = new CAxcDBCache(pAxcDb);
 
-    pSysGovernDb    = new CDBAccess(dbDir, DBNameType::SYSGOVERN, false, fReIndex);
+    pSysGovernDb    = NewDbAccess(dbDir, DBNameType::SYSGOVERN, fReIndex);
     pSysGovernCache = new CSysGovernDBCache(pSysGovernDb);
 
-    pPriceFeedDb    = new CDBAccess(dbDir, DBNameType::PRICEFEED, false, fReIndex);
+    pPriceFeedDb    = NewDbAccess(dbDir, DBNameType::PRICEFEED, fReIndex);
     pPriceFeedCache = new CPriceFeedCache(pPriceFeedDb);
 
 
     // memory-only cache
     pTxCache        = new CTxMemCache();
     pPpCache        = new CPricePointMemCache();
+
+    // the block db has the best block hash, it must be written last
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+        if (i != DBNameType::BLOCK)
+            commitDbs.push_back(GetDbAccess((DBNameType)i));
+    }
+    commitDbs.push_back(pBlockDb);
+
+    if (pSharedStore)
+        compactThread = std::thread(&CCacheDBManager::ThreadCompact, this);
+
+    pAsyncWriter    = nullptr;
+    if (SysCfg().GetBoolArg("-asyncdbflush", false)) {
+        std::function<void()> postWrite = nullptr;
+        if (pSharedStore)
+            postWrite = [this]() { RequestCompaction(); };
+        pAsyncWriter = new CDBAsyncWriter(commitDbs, flushStats, postWrite);
+    } else if (pSharedStore) {
+        // stage the writes of all dbs, Flush() writes them as one atomic batch
+        for (auto pDbAccess : commitDbs) {
+            pDbAccess->SetStagedWrite(true);
+        }
+    }
+}
+
+CDBAccess* CCacheDBManager::NewDbAccess(const boost::filesystem::path &dbDir, DBNameType dbNameType, bool fReIndex) {
+    if (pSharedStore)
+        return new CDBAccess(dbNameType, pSharedStore);
+
+    return new CDBAccess(dbDir, dbNameType, false, fReIndex);
+}
+
+void CCacheDBManager::OpenSharedStore(const boost::filesystem::path &dbDir, bool fReIndex) {
+    const boost::filesystem::path storePath = dbDir / SHARED_STORE_NAME;
+    bool fSingleStore = SysCfg().GetBoolArg("-singledbstore", false);
+
+    // the chain state of the other layout is never deleted here, -reindex only wipes the chosen layout, so
+    // the user has to delete it. It may be the only copy of the chain state, e.g. after a mistyped option
+    string otherLayoutDirs;
+    if (fSingleStore) {
+        for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+            const boost::filesystem::path dbPath = dbDir / GetDbName((DBNameType)i);
+            if (boost::filesystem::exists(dbPath))
+                otherLayoutDirs += (otherLayoutDirs.empty() ? "" : ", ") + dbPath.string();
+        }
+    } else if (boost::filesystem::exists(storePath)) {
+        otherLayoutDirs = storePath.string();
+    }
+    if (!otherLayoutDirs.empty())
+        throw runtime_error(strprintf("The chain state in %s does not match -singledbstore=%d, delete it and start "
+                                      "with -reindex to rebuild the chain state, or change -singledbstore back",
+                                      otherLayoutDirs, fSingleStore));
+
+    if (!fSingleStore)
+        return;
+
+    // one block cache shared by all the dbs
+    size_t cacheSize = 0;
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++)
+        cacheSize += DBCacheSize[i];
+
+    pSharedStore = make_shared<CLevelDBWrapper>(storePath, cacheSize, false, fReIndex,
+                                                GetDBProfileType(SHARED_STORE_NAME, DB_PROFILE_DEFAULT));
+}
+
+void CCacheDBManager::RequestCompaction() {
+    {
+        std::lock_guard<std::mutex> lock(compact_mutex);
+        compact_requested = true;
+    }
+    compact_cond.notify_all();
+}
+
+void CCacheDBManager::ThreadCompact() {
+    RenameThread("coin-dbcompact");
+
+    std::unique_lock<std::mutex> lock(compact_mutex);
+    while (true) {
+        compact_cond.wait(lock, [this]() { return compact_requested || compact_stopping; });
+        if (compact_stopping)
+            break;
+
+        compact_requested = false;
+        lock.unlock();
+        CompactSharedStore();
+        lock.lock();
+
+        // at most one round per MIN_COMPACT_INTERVAL_MS, the requests in between are served by the next round
+        compact_cond.wait_for(lock, std::chrono::milliseconds(MIN_COMPACT_INTERVAL_MS),
+                              [this]() { return compact_stopping; });
+        if (compact_stopping)
+            break;
+    }
+}
+
+void CCacheDBManager::StopCompaction() {
+    if (!compactThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(compact_mutex);
+        compact_stopping = true;
+    }
+    compact_cond.notify_all();
+    compactThread.join();
+}
+
+bool CCacheDBManager::IsCompactionStopping() {
+    std::lock_guard<std::mutex> lock(compact_mutex);
+    return compact_stopping;
+}
+
+void CCacheDBManager::CompactSharedStore() {
+    // the db with the smaller compact size has the higher priority
+    vector<DBNameType> dbNameTypes;
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++)
+        dbNameTypes.push_back((DBNameType)i);
+    std::stable_sort(dbNameTypes.begin(), dbNameTypes.end(),
+                     [](DBNameType a, DBNameType b) { return DBCompactSize[a] < DBCompactSize[b]; });
+
+    for (auto dbNameType : dbNameTypes) {
+        if (IsCompactionStopping())
+            return;
+
+        uint64_t writtenBytes = GetDbAccess(dbNameType)->GetWrittenBytes();
+        if (writtenBytes - compactedBytes[dbNameType] < (uint64_t)DBCompactSize[dbNameType])
+            continue;
+
+        int64_t beginTime = GetTimeMillis();
+        for (int32_t i = dbk::EMPTY + 1; i < dbk::PREFIX_COUNT; i++) {
+            if (dbk::GetDbNameEnumByPrefix((dbk::PrefixType)i) != dbNameType)
+                continue;
+
+            const string &prefix = dbk::GetKeyPrefix((dbk::PrefixType)i);
+            string end           = prefix;
+            end.back()++;
+            pSharedStore->CompactRange(prefix, end);
+        }
+        compactedBytes[dbNameType] = writtenBytes;
+        LogPrint(BCLog::LDB, "%s, compacted db %s, took %lldms\n", __func__, GetDbName(dbNameType),
+                 GetTimeMillis() - beginTime);
+    }
 }
 
 CCacheDBManager::~CCacheDBManager() {
+    // write all the pending flushes before closing the dbs
+    delete pAsyncWriter;    pAsyncWriter = nullptr;
+    StopCompaction();
+    if (pSharedStore)
+        CommitStagedWrites();
+
     delete pSysParamCache;  pSysParamCache = nullptr;
     delete pAccountCache;   pAccountCache = nullptr;
     delete pAssetCache;     pAssetCache = nullptr;
@@ -251,12 +425,16 @@ CCacheDBManager::~CCacheDBManager() {
     delete pUtxoDb;         pUtxoDb = nullptr;
     delete pAxcDb;          pAxcDb = nullptr;
     delete pPriceFeedDb;    pPriceFeedDb = nullptr;
+    pSharedStore = nullptr;
     // memory-only cache
     delete pTxCache;        pTxCache = nullptr;
     delete pPpCache;        pPpCache = nullptr;
 }
 
 bool CCacheDBManager::Flush() {
+    int64_t beginTime   = GetTimeMillis();
+    uint64_t beginBytes = GetWrittenBytes();
+
     if (pSysParamCache) pSysParamCache->Flush();
 
     if (pAccountCache) pAccountCache->Flush();
@@ -275,8 +453,6 @@ bool CCacheDBManager::Flush() {
 
     if (pBlockIndexDb) pBlockIndexDb->Flush();
 
-    if (pBlockCache) pBlockCache->Flush();
-
     if (pLogCache) pLogCache->Flush();
 
     if (pReceiptCache) pReceiptCache->Flush();
@@ -289,11 +465,102 @@ bool CCacheDBManager::Flush() {
 
     if (pPriceFeedCache) pPriceFeedCache->Flush();
 
+    // the block cache has the best block hash, it is flushed after all the chain state
+    if (pBlockCache) pBlockCache->Flush();
+
     // Memory only cache, not bother to flush.
     // if (pTxCache)
     //     pTxCache->Flush();
     // if (pPpCache)
     //     pPpCache->Flush();
 
+    if (pAsyncWriter) {
+        // the staged writes are written by the writer thread, which records the flush stats
+        if (!pAsyncWriter->Commit())
+            return ERRORMSG("%s, write chain state failed: %s", __func__, pAsyncWriter->GetError());
+    } else {
+        if (pSharedStore)
+            CommitStagedWrites();
+
+        flushStats.Add(GetTimeMillis() - beginTime, GetWrittenBytes() - beginBytes);
+
+        if (pSharedStore)
+            RequestCompaction();
+    }
+
+    return true;
+}
+
+void CCacheDBManager::CommitStagedWrites() {
+    CDBPendingBatchList batches;
+    for (auto pDbAccess : commitDbs) {
+        auto spBatch = pDbAccess->FreezePendingBatch();
+        if (spBatch)
+            batches.emplace_back(pDbAccess, spBatch);
+    }
+    WritePendingBatches(batches);
+}
+
+uint64_t CCacheDBManager::GetWrittenBytes() const {
+    uint64_t bytes = 0;
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+        CDBAccess *pDbAccess = GetDbAccess((DBNameType)i);
+        if (pDbAccess != nullptr)
+            bytes += pDbAccess->GetWrittenBytes();
+    }
+    return bytes;
+}
+
+Object CCacheDBManager::GetFlushStatsJson() {
+    Object obj = flushStats.ToJson();
+    obj.push_back(Pair("async", pAsyncWriter != nullptr));
+    obj.push_back(Pair("single_store", pSharedStore != nullptr));
+    if (pAsyncWriter)
+        obj.push_back(Pair("pending_flushes", (uint64_t)pAsyncWriter->GetPendingFlushes()));
+    return obj;
+}
+
+CDBAccess* CCacheDBManager::GetDbAccess(DBNameType dbNameType) const {
+    switch (dbNameType) {
+        case DBNameType::SYSPARAM:  return pSysParamDb;
+        case DBNameType::ACCOUNT:   return pAccountDb;
+        case DBNameType::ASSET:     return pAssetDb;
+        case DBNameType::BLOCK:     return pBlockDb;
+        case DBNameType::CONTRACT:  return pContractDb;
+        case DBNameType::DELEGATE:  return pDelegateDb;
+        case DBNameType::CDP:       return pCdpDb;
+        case DBNameType::CLOSEDCDP: return pClosedCdpDb;
+        case DBNameType::DEX:       return pDexDb;
+        case DBNameType::LOG:       return pLogDb;
+        case DBNameType::RECEIPT:   return pReceiptDb;
+        case DBNameType::UTXO:      return pUtxoDb;
+        case DBNameType::SYSGOVERN: return pSysGovernDb;
+        case DBNameType::PRICEFEED: return pPriceFeedDb;
+        case DBNameType::AXC:       return pAxcDb;
+        default:                    return nullptr;
+    }
+}
+
+int32_t CCacheDBManager::GetMaxOpenFiles() {
+    // the block index db
+    int32_t openFiles = GetDBOpenFiles(GetDBProfileType("index", DB_PROFILE_APPEND));
+    if (SysCfg().GetBoolArg("-singledbstore", false))
+        return openFiles + GetDBOpenFiles(GetDBProfileType(SHARED_STORE_NAME, DB_PROFILE_DEFAULT));
+
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++)
+        openFiles += GetDBOpenFiles(GetDBProfileType(GetDbName((DBNameType)i), DBProfileTypes[i]));
+    return openFiles;
+}
+
+bool CCacheDBManager::InitBloomFilters() {
+    for (const auto &prefixStr : SysCfg().GetMultiArgs("-dbbloomfilter")) {
+        dbk::PrefixType prefixType = dbk::ParseKeyPrefixType(prefixStr);
+        if (prefixType == dbk::EMPTY)
+            return ERRORMSG("%s, unsupported db key prefix type=%s", __func__, prefixStr);
+
+        CDBAccess *pDbAccess = GetDbAccess(dbk::GetDbNameEnumByPrefix(prefixType));
+        if (pDbAccess == nullptr || !pDbAccess->EnableBloomFilter(prefixType))
+            return ERRORMSG("%s, enable bloom filter of prefix type=%s failed", __func__, prefixStr);
+    }
     return true;
 }
@@ -12,6 +12,7 @@
 #include "cdpdb.h"
 #include "commons/uint256.h"
 #include "contractdb.h"
+#include "dbasyncwriter.h"
 #include "delegatedb.h"
 #include "dexdb.h"
 #include "pricefeeddb.h"
@@ -23,6 +24,8 @@
 #include "sysgoverndb.h"
 #include "logdb.h"
 
+#include <unordered_set>
+
 class CCacheDBManager;
 
 class CCacheWrapper {
@@ -57,10 +60,14 @@ public:
     CCacheWrapper& operator=(CCacheWrapper& other);
 
     void CopyFrom(CCacheDBManager* pCdMan);
+    // move the caches onto the caches of cwIn, the data written to them stays over the new base
+    void SetBaseViewPtr(CCacheWrapper *cwIn);
 
     void Flush();
 
     UndoDataFuncMap GetUndoDataFuncMap();
+    // drop the data of the db keys (prefix + key) from the db caches, their values are read from the base again
+    void DropData(const std::unordered_set<string> &dbKeys);
 
     void SetDbOpLogMap(CDBOpLogMap *pDbOpLogMap);
 
@@ -122,12 +129,63 @@ public:
     CTxMemCache         *pTxCache;
     CPricePointMemCache *pPpCache;
 
+    // writer thread of the -asyncdbflush mode
+    CDBAsyncWriter      *pAsyncWriter;
+    CDBFlushStats       flushStats;
+
+    // the store of all dbs in the -singledbstore mode, nullptr means one store per db
+    std::shared_ptr<CLevelDBWrapper> pSharedStore;
+
 public:
     CCacheDBManager(bool fReIndex, bool fMemory);
 
     ~CCacheDBManager();
 
     bool Flush();
+
+    CDBAccess* GetDbAccess(DBNameType dbNameType) const;
+
+    uint64_t GetWrittenBytes() const;
+    Object GetFlushStatsJson();
+
+    // the files all the dbs may keep open with their profiles, the file descriptors are reserved at startup
+    static int32_t GetMaxOpenFiles();
+
+    // build the bloom filters of the prefix types configured by -dbbloomfilter, called by the owner
+    // after construction so that an invalid prefix type fails the init
+    bool InitBloomFilters();
+
+private:
+    static constexpr const char* SHARED_STORE_NAME = "chainstate";
+
+    void OpenSharedStore(const boost::filesystem::path &dbDir, bool fReIndex);
+    CDBAccess* NewDbAccess(const boost::filesystem::path &dbDir, DBNameType dbNameType, bool fReIndex);
+
+    // write the staged writes of all dbs in the shared store as one atomic batch
+    void CommitStagedWrites();
+    // compact the key ranges of the dbs which have written more than DBCompactSize since the last compaction,
+    // only called in the compaction thread
+    void CompactSharedStore();
+
+    // the flushes wake up the compaction thread of the shared store, which compacts outside cs_main
+    void RequestCompaction();
+    void ThreadCompact();
+    void StopCompaction();
+    bool IsCompactionStopping();
+
+private:
+    // the shortest time between two compaction rounds of the shared store
+    static const int64_t MIN_COMPACT_INTERVAL_MS = 60 * 1000;
+
+    // the dbs in the order of writing a flush
+    vector<CDBAccess*> commitDbs;
+    uint64_t compactedBytes[DBNameType::DB_NAME_COUNT] = {0};
+
+    std::mutex compact_mutex;
+    std::condition_variable compact_cond;
+    bool compact_requested = false;
+    bool compact_stopping  = false;
+    std::thread compactThread;
 };  // CCacheDBManager
 
 #endif //PERSIST_CACHEWRAPPER_H
\ No newline at end of file
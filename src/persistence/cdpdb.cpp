@@ -102,12 +102,25 @@ bool CCdpDBCache::EraseCDPFromRatioDB(const CUserCDP &userCdp) {
 bool CCdpDBCache::GetCdpListByCollateralRatio(const CCdpCoinPair &cdpCoinPair,
         const uint64_t collateralRatio, const uint64_t bcoinMedianPrice,
         CdpRatioSortedCache::Map &userCdps) {
+    auto spIt = CreateCdpRatioIterator(cdpCoinPair, collateralRatio, bcoinMedianPrice);
+    for (spIt->First(); spIt->IsValid(); spIt->Next()) {
+        userCdps.emplace(spIt->GetKey(), spIt->GetValue());
+    }
+    return true;
+}
+
+shared_ptr<CCdpRatioIterator> CCdpDBCache::CreateCdpRatioIterator(const CCdpCoinPair &cdpCoinPair,
+        const uint64_t collateralRatio, const uint64_t bcoinMedianPrice) {
+    return make_shared<CCdpRatioIterator>(cdpRatioSortedCache,
+                                          MakeCdpRatioEndKey(cdpCoinPair, collateralRatio, bcoinMedianPrice));
+}
+
+CdpRatioSortedCache::KeyType CCdpDBCache::MakeCdpRatioEndKey(const CCdpCoinPair &cdpCoinPair,
+        const uint64_t collateralRatio, const uint64_t bcoinMedianPrice) {
     double ratio = (double(collateralRatio) / RATIO_BOOST) / (double(bcoinMedianPrice) / PRICE_BOOST);
     assert(uint64_t(ratio * CDP_BASE_RATIO_BOOST) < UINT64_MAX);
     uint64_t ratioBoost = uint64_t(ratio * CDP_BASE_RATIO_BOOST) + 1;
-    CdpRatioSortedCache::KeyType endKey(cdpCoinPair, ratioBoost, 0, uint256());
-
-    return cdpRatioSortedCache.GetAllElements(endKey, userCdps);
+    return CdpRatioSortedCache::KeyType(cdpCoinPair, ratioBoost, 0, uint256());
 }
 
 CCdpGlobalData CCdpDBCache::GetCdpGlobalData(const CCdpCoinPair &cdpCoinPair) const {
@@ -25,6 +25,8 @@ using namespace std;
 // height: allows data of the same ratio to be sorted by height
 typedef CCompositeKVCache<dbk::CDP_RATIO, tuple<CCdpCoinPair, CFixedUInt64, CFixedUInt64, uint256>, CUserCDP>      CdpRatioSortedCache;
 
+using CCdpRatioIterator = CDBRangeIterator<CdpRatioSortedCache>;
+
 class CCdpDBCache {
 public:
     CCdpDBCache() {}
@@ -41,6 +43,9 @@ public:
 
     bool GetCdpListByCollateralRatio(const CCdpCoinPair &cdpCoinPair, const uint64_t collateralRatio,
             const uint64_t bcoinMedianPrice, CdpRatioSortedCache::Map &userCdps);
+    // iterate the same cdps as GetCdpListByCollateralRatio() lazily, the caller can stop after N cdps
+    shared_ptr<CCdpRatioIterator> CreateCdpRatioIterator(const CCdpCoinPair &cdpCoinPair,
+            const uint64_t collateralRatio, const uint64_t bcoinMedianPrice);
 
     inline uint64_t GetGlobalStakedBcoins() const;
     inline uint64_t GetGlobalOwedScoins() const;
@@ -76,6 +81,8 @@ private:
     bool EraseCDPFromRatioDB(const CUserCDP &userCdp);
 
     CdpRatioSortedCache::KeyType MakeCdpRatioSortedKey(const CUserCDP &cdp);
+    CdpRatioSortedCache::KeyType MakeCdpRatioEndKey(const CCdpCoinPair &cdpCoinPair, const uint64_t collateralRatio,
+            const uint64_t bcoinMedianPrice);
 public:
     /*  CCompositeKVCache  prefixType       key                            value             variable  */
     /*  ---------------- --------------   ------------                --------------    ----- --------*/
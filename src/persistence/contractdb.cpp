@@ -38,10 +38,6 @@ bool CContractDBCache::GetContract(const CRegID &contractRegId, CUniversalContra
     return contractCache.GetData(contractRegId, contract);
 }
 
-bool CContractDBCache::GetContracts(map<CRegIDKey, CUniversalContract> &contracts) {
-    return contractCache.GetAllElements(contracts);
-}
-
 bool CContractDBCache::SaveContract(const CRegID &contractRegId, const CUniversalContract &contract) {
     return contractCache.SetData(contractRegId, contract);
 }
@@ -109,4 +105,8 @@ shared_ptr<CDBContractDataIterator> CContractDBCache::CreateContractDataIterator
         return nullptr;
     }
     return make_shared<CDBContractDataIterator>(contractDataCache, contractRegid, contractKeyPrefix);
+}
+
+shared_ptr<CDBContractIterator> CContractDBCache::CreateContractIterator() {
+    return make_shared<CDBContractIterator>(contractCache);
 }
\ No newline at end of file
@@ -0,0 +1,442 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dbaccess.h"
+
+#include "commons/util/util.h"
+
+Object CDBReadStats::ToJson() const {
+    Object obj;
+    obj.push_back(Pair("db_reads",              (uint64_t)db_reads));
+    obj.push_back(Pair("db_read_misses",        (uint64_t)db_read_misses));
+    obj.push_back(Pair("negative_hits",         (uint64_t)negative_hits));
+    obj.push_back(Pair("bloom_filtered",        (uint64_t)bloom_filtered));
+    obj.push_back(Pair("bloom_false_positives", (uint64_t)bloom_false_positives));
+    return obj;
+}
+
+bool CDBAccess::EnableBloomFilter(const dbk::PrefixType prefixType) {
+    assert(prefixType != dbk::EMPTY && prefixType < dbk::PREFIX_COUNT);
+    if (dbk::GetDbNameEnumByPrefix(prefixType) != dbNameType)
+        return ERRORMSG("%s, prefix type %s does not belong to db %s", __func__,
+                        dbk::GetKeyPrefixMemo(prefixType), GetDbName(dbNameType));
+
+    BuildBloomFilter(prefixType);
+    return true;
+}
+
+void CDBAccess::BuildBloomFilter(const dbk::PrefixType prefixType) {
+    const string &prefix = dbk::GetKeyPrefix(prefixType);
+    int64_t beginTime    = GetTimeMillis();
+
+    uint64_t keyCount = 0;
+    shared_ptr<leveldb::Iterator> pCursor = NewIterator(prefix);
+    for (pCursor->Seek(prefix); pCursor->Valid() && pCursor->key().starts_with(prefix); pCursor->Next()) {
+        keyCount++;
+    }
+
+    // reserve room for the keys written later
+    std::unique_ptr<CDBKeyBloomFilter> pFilter(new CDBKeyBloomFilter(keyCount * 2));
+    for (pCursor->Seek(prefix); pCursor->Valid() && pCursor->key().starts_with(prefix); pCursor->Next()) {
+        pFilter->Insert(pCursor->key());
+    }
+
+    LogPrint(BCLog::INFO, "%s, built bloom filter of %s, keys=%llu, mem=%lluKB, took %lldms\n", __func__,
+             dbk::GetKeyPrefixMemo(prefixType), keyCount, pFilter->GetMemorySize() >> 10,
+             GetTimeMillis() - beginTime);
+    bloomFilters[prefixType].store(pFilter.get(), std::memory_order_release);
+    ownedBloomFilters.push_back(std::move(pFilter));
+}
+
+Object CDBAccess::GetStatsJson() const {
+    Object obj;
+    for (int32_t i = dbk::EMPTY + 1; i < dbk::PREFIX_COUNT; i++) {
+        const CDBReadStats &stats        = readStats[i];
+        const CDBKeyBloomFilter *pFilter = bloomFilters[i].load(std::memory_order_acquire);
+        if (stats.IsEmpty() && !pFilter)
+            continue;
+
+        Object prefixObj = stats.ToJson();
+        if (pFilter) {
+            Object filterObj;
+            filterObj.push_back(Pair("inserted_keys",   pFilter->GetInsertedCount()));
+            filterObj.push_back(Pair("capacity",        pFilter->GetCapacity()));
+            filterObj.push_back(Pair("memory_size",     pFilter->GetMemorySize()));
+            prefixObj.push_back(Pair("bloom_filter",    filterObj));
+        }
+        obj.push_back(Pair(dbk::GetKeyPrefixMemo((dbk::PrefixType)i), prefixObj));
+    }
+    return obj;
+}
+
+namespace {
+// collect the writes of a leveldb batch into the pending batch
+class CPendingBatchHandler: public leveldb::WriteBatch::Handler {
+public:
+    CPendingBatchHandler(CDBPendingBatch &batchIn): batch(batchIn) {}
+
+    void Put(const leveldb::Slice &key, const leveldb::Slice &value) override {
+        batch.writes[key.ToString()] = value.ToString();
+        batch.bytes += key.size() + value.size();
+    }
+
+    void Delete(const leveldb::Slice &key) override {
+        batch.writes[key.ToString()] = std::nullopt;
+        batch.bytes += key.size();
+    }
+
+private:
+    CDBPendingBatch &batch;
+};
+
+class CBatchSizeHandler: public leveldb::WriteBatch::Handler {
+public:
+    void Put(const leveldb::Slice &key, const leveldb::Slice &value) override { bytes += key.size() + value.size(); }
+    void Delete(const leveldb::Slice &key) override { bytes += key.size(); }
+
+    uint64_t bytes = 0;
+};
+
+// the key pSkipKey is not added to the batch
+void MakeLevelDBBatch(const CDBPendingBatch &pendingBatch, CLevelDBBatch &batch, const string *pSkipKey = nullptr) {
+    for (const auto &item : pendingBatch.writes) {
+        if (pSkipKey != nullptr && item.first == *pSkipKey)
+            continue;
+
+        if (item.second)
+            batch.WriteSerialized(item.first, *item.second);
+        else
+            batch.Erase(item.first);
+    }
+}
+
+/**
+ * The iterator of the db merged with a copy of the pending writes, the pending writes shadow the
+ * db data, the erased ones are skipped.
+ */
+class CPendingMergeIterator: public leveldb::Iterator {
+public:
+    typedef std::vector<std::pair<string, std::optional<string>>> PendingList;
+
+    CPendingMergeIterator(leveldb::Iterator *pDbIterIn, PendingList &&pendingIn)
+        : pDbIter(pDbIterIn), pending(std::move(pendingIn)) {}
+    ~CPendingMergeIterator() override { delete pDbIter; }
+
+    bool Valid() const override { return current != NONE; }
+
+    void SeekToFirst() override {
+        pDbIter->SeekToFirst();
+        pendingPos = 0;
+        FindNextVisible();
+    }
+
+    void SeekToLast() override {
+        pDbIter->SeekToLast();
+        pendingPos = (int64_t)pending.size() - 1;
+        FindPrevVisible();
+    }
+
+    void Seek(const leveldb::Slice &target) override {
+        pDbIter->Seek(target);
+        pendingPos = LowerBound(target);
+        FindNextVisible();
+    }
+
+    void Next() override {
+        assert(Valid());
+        if (!forward) {
+            // the sources are behind the current key, move them after it
+            string curKey = key().ToString();
+            pDbIter->Seek(curKey);
+            if (pDbIter->Valid() && pDbIter->key() == curKey)
+                pDbIter->Next();
+            pendingPos = LowerBound(curKey);
+            if (pendingPos < (int64_t)pending.size() && pending[pendingPos].first == curKey)
+                pendingPos++;
+        } else if (current == PENDING) {
+            pendingPos++;
+        } else {
+            pDbIter->Next();
+        }
+        FindNextVisible();
+    }
+
+    void Prev() override {
+        assert(Valid());
+        if (forward) {
+            // the sources are at or after the current key, move them before it
+            string curKey = key().ToString();
+            pDbIter->Seek(curKey);
+            if (pDbIter->Valid())
+                pDbIter->Prev();
+            else
+                pDbIter->SeekToLast();
+            pendingPos = LowerBound(curKey) - 1;
+        } else if (current == PENDING) {
+            pendingPos--;
+        } else {
+            pDbIter->Prev();
+        }
+        FindPrevVisible();
+    }
+
+    leveldb::Slice key() const override {
+        assert(Valid());
+        return current == PENDING ? leveldb::Slice(pending[pendingPos].first) : pDbIter->key();
+    }
+
+    leveldb::Slice value() const override {
+        assert(Valid());
+        return current == PENDING ? leveldb::Slice(*pending[pendingPos].second) : pDbIter->value();
+    }
+
+    leveldb::Status status() const override { return pDbIter->status(); }
+
+private:
+    enum Source { NONE, DB, PENDING };
+
+    int64_t LowerBound(const leveldb::Slice &target) const {
+        auto it = std::lower_bound(pending.begin(), pending.end(), target,
+            [](const PendingList::value_type &item, const leveldb::Slice &k) {
+                return leveldb::Slice(item.first).compare(k) < 0;
+            });
+        return it - pending.begin();
+    }
+
+    void FindNextVisible() {
+        forward = true;
+        while (true) {
+            bool dbValid      = pDbIter->Valid();
+            bool pendingValid = pendingPos < (int64_t)pending.size();
+            if (!pendingValid) {
+                current = dbValid ? DB : NONE;
+                return;
+            }
+            int cmp = dbValid ? leveldb::Slice(pending[pendingPos].first).compare(pDbIter->key()) : -1;
+            if (cmp > 0) {
+                current = DB;
+                return;
+            }
+            if (cmp == 0)
+                pDbIter->Next(); // shadowed by the pending write
+            if (pending[pendingPos].second) {
+                current = PENDING;
+                return;
+            }
+            pendingPos++; // erased
+        }
+    }
+
+    void FindPrevVisible() {
+        forward = false;
+        while (true) {
+            bool dbValid      = pDbIter->Valid();
+            bool pendingValid = pendingPos >= 0;
+            if (!pendingValid) {
+                current = dbValid ? DB : NONE;
+                return;
+            }
+            int cmp = dbValid ? leveldb::Slice(pending[pendingPos].first).compare(pDbIter->key()) : 1;
+            if (cmp < 0) {
+                current = DB;
+                return;
+            }
+            if (cmp == 0)
+                pDbIter->Prev(); // shadowed by the pending write
+            if (pending[pendingPos].second) {
+                current = PENDING;
+                return;
+            }
+            pendingPos--; // erased
+        }
+    }
+
+private:
+    leveldb::Iterator *pDbIter;
+    PendingList pending;        // sorted by key
+    int64_t pendingPos = 0;
+    Source current     = NONE;
+    bool forward       = true;
+};
+}  // namespace
+
+int64_t CDBAccess::GetDbCount() const {
+    if (!shared_store && !has_pending)
+        return pDb->GetDbCount();
+
+    int64_t count = 0;
+    if (!shared_store) {
+        shared_ptr<leveldb::Iterator> pCursor = NewIterator();
+        for (pCursor->SeekToFirst(); pCursor->Valid(); pCursor->Next()) {
+            count++;
+        }
+        return count;
+    }
+
+    // the shared store has the keys of other dbs, count the keys of the own prefix types
+    for (int32_t i = dbk::EMPTY + 1; i < dbk::PREFIX_COUNT; i++) {
+        if (dbk::GetDbNameEnumByPrefix((dbk::PrefixType)i) != dbNameType)
+            continue;
+
+        const string &prefix = dbk::GetKeyPrefix((dbk::PrefixType)i);
+        shared_ptr<leveldb::Iterator> pCursor = NewIterator(prefix);
+        for (pCursor->Seek(prefix); pCursor->Valid() && pCursor->key().starts_with(prefix); pCursor->Next()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+std::shared_ptr<leveldb::Iterator> CDBAccess::NewIterator(const string &prefix) const {
+    if (!has_pending)
+        return std::shared_ptr<leveldb::Iterator>(pDb->NewIterator());
+
+    // the writer thread releases a frozen batch only after it is in db, so the pending writes copied together
+    // with the creation of the db iterator (which reads an implicit snapshot) are never missing in the view
+    std::map<string, std::optional<string>, std::less<>> merged;
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    auto mergeBatch = [&](const CDBPendingBatch &batch) {
+        for (auto it = batch.writes.lower_bound(prefix);
+             it != batch.writes.end() && std::string_view(it->first).substr(0, prefix.size()) == prefix; it++) {
+            merged[it->first] = it->second;
+        }
+    };
+    for (const auto &spBatch : frozenBatches) {
+        mergeBatch(*spBatch);
+    }
+    if (spStagedBatch)
+        mergeBatch(*spStagedBatch);
+
+    CPendingMergeIterator::PendingList pending(std::make_move_iterator(merged.begin()),
+                                               std::make_move_iterator(merged.end()));
+    return std::make_shared<CPendingMergeIterator>(pDb->NewIterator(), std::move(pending));
+}
+
+void CDBAccess::SetStagedWrite(bool enabled) {
+    if (!enabled)
+        SyncPendingWrites();
+    staged_write = enabled;
+}
+
+void CDBAccess::WriteBatch(CLevelDBBatch &batch) {
+    if (!staged_write) {
+        CBatchSizeHandler handler;
+        batch.Iterate(&handler);
+        pDb->WriteBatch(batch, true);
+        written_bytes += handler.bytes;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    if (!spStagedBatch)
+        spStagedBatch = make_shared<CDBPendingBatch>();
+    CPendingBatchHandler handler(*spStagedBatch);
+    batch.Iterate(&handler);
+    has_pending = true;
+}
+
+bool CDBAccess::FindPendingLocked(const Slice &slKey, std::optional<string> &value) const {
+    std::string_view keyStr(slKey.data(), slKey.size());
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    if (spStagedBatch) {
+        auto it = spStagedBatch->writes.find(keyStr);
+        if (it != spStagedBatch->writes.end()) {
+            value = it->second;
+            return true;
+        }
+    }
+    for (auto batchIt = frozenBatches.rbegin(); batchIt != frozenBatches.rend(); batchIt++) {
+        auto it = (*batchIt)->writes.find(keyStr);
+        if (it != (*batchIt)->writes.end()) {
+            value = it->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::shared_ptr<CDBPendingBatch> CDBAccess::FreezePendingBatch() {
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    if (!spStagedBatch || spStagedBatch->writes.empty())
+        return nullptr;
+
+    auto spBatch = spStagedBatch;
+    frozenBatches.push_back(spBatch);
+    spStagedBatch = nullptr;
+    return spBatch;
+}
+
+void CDBAccess::ReleasePendingBatch(const std::shared_ptr<CDBPendingBatch> &spBatch) {
+    written_bytes += spBatch->bytes;
+
+    std::lock_guard<std::mutex> lock(pending_mutex);
+    assert(!frozenBatches.empty() && frozenBatches.front() == spBatch);
+    frozenBatches.pop_front();
+    has_pending = spStagedBatch != nullptr || !frozenBatches.empty();
+    pending_cond.notify_all();
+}
+
+void CDBAccess::SyncPendingWrites() const {
+    if (!has_pending)
+        return;
+
+    std::unique_lock<std::mutex> lock(pending_mutex);
+    pending_cond.wait(lock, [this] { return frozenBatches.empty(); });
+    if (spStagedBatch) {
+        CLevelDBBatch batch;
+        MakeLevelDBBatch(*spStagedBatch, batch);
+        pDb->WriteBatch(batch, true);
+        written_bytes += spStagedBatch->bytes;
+        spStagedBatch = nullptr;
+    }
+    has_pending = false;
+}
+
+void WritePendingBatches(const CDBPendingBatchList &batches) {
+    bool multiStore = false;
+    for (const auto &item : batches) {
+        if (item.first->GetStore() != batches.front().first->GetStore())
+            multiStore = true;
+    }
+
+    // the best block hash is the commit marker of the flush. When the dbs are in several stores, it is
+    // held back and written alone after the synced writes of all the stores, so a crash at any point
+    // never leaves the best block ahead of the state on disk
+    const string &markerKey = dbk::GetKeyPrefix(dbk::BEST_BLOCKHASH);
+    const string *pSkipKey  = multiStore ? &markerKey : nullptr;
+    CDBAccess *pMarkerDb    = nullptr;
+    std::optional<string> markerValue;
+
+    for (auto begin = batches.begin(); begin != batches.end();) {
+        const auto &pStore = begin->first->GetStore();
+        auto end           = begin;
+        CLevelDBBatch batch;
+        for (; end != batches.end() && end->first->GetStore() == pStore; end++) {
+            MakeLevelDBBatch(*end->second, batch, pSkipKey);
+            if (pSkipKey != nullptr) {
+                auto it = end->second->writes.find(markerKey);
+                if (it != end->second->writes.end()) {
+                    pMarkerDb   = end->first;
+                    markerValue = it->second;
+                }
+            }
+        }
+        pStore->WriteBatch(batch, true);
+        begin = end;
+    }
+
+    if (pMarkerDb != nullptr) {
+        CLevelDBBatch batch;
+        if (markerValue)
+            batch.WriteSerialized(markerKey, *markerValue);
+        else
+            batch.Erase(markerKey);
+        pMarkerDb->GetStore()->WriteBatch(batch, true);
+    }
+
+    // the batches are readable from db only after all of them are written
+    for (const auto &item : batches) {
+        item.first->ReleasePendingBatch(item.second);
+    }
+}
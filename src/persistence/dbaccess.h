@@ -7,13 +7,22 @@
 #define PERSIST_DB_ACCESS_H
 
 #include "commons/uint256.h"
+#include "dbaccesstracker.h"
+#include "dbbloomfilter.h"
+#include "dbcachebudget.h"
 #include "dbconf.h"
+#include "dbflatmap.h"
 #include "leveldbwrapper.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <string>
 #include <tuple>
 #include <vector>
 #include <optional>
+#include <string_view>
 
 using namespace std;
 
@@ -261,38 +270,71 @@ namespace db_util {
     }
 };
 
-typedef void(UndoDataFunc)(const CDbOpLogs &pDbOpLogs);
+// undo the op log of one key, the key and old value are serialized
+typedef void(UndoDataFunc)(const leveldb::Slice &key, const leveldb::Slice &oldValue);
 typedef std::map<dbk::PrefixType, std::function<UndoDataFunc>> UndoDataFuncMap;
 
+// read statistics of one prefix type
+struct CDBReadStats {
+    std::atomic<uint64_t> db_reads{0};              // reads which touched the leveldb
+    std::atomic<uint64_t> db_read_misses{0};        // leveldb reads which found nothing
+    std::atomic<uint64_t> negative_hits{0};         // misses answered by the negative cache of the top-level cache
+    std::atomic<uint64_t> bloom_filtered{0};        // definite misses answered by the bloom filter
+    std::atomic<uint64_t> bloom_false_positives{0}; // bloom filter said maybe, but leveldb found nothing
+
+    bool IsEmpty() const {
+        return db_reads == 0 && negative_hits == 0 && bloom_filtered == 0;
+    }
+
+    Object ToJson() const;
+};
+
+// the serialized writes which are not written to db yet, std::nullopt means erased
+struct CDBPendingBatch {
+    // std::less<> allows to find the key by string_view without copying it
+    std::map<string, std::optional<string>, std::less<>> writes;
+    uint64_t bytes = 0;
+};
+
+class CDBAccess;
+typedef std::vector<std::pair<CDBAccess*, std::shared_ptr<CDBPendingBatch>>> CDBPendingBatchList;
+
+// write the frozen batches in order, the adjacent batches of the dbs in one store are written as one atomic batch
+void WritePendingBatches(const CDBPendingBatchList &batches);
+
 class CDBAccess {
 public:
     CDBAccess(const boost::filesystem::path& dir, DBNameType dbNameTypeIn, bool fMemory, bool fWipe) :
               dbNameType(dbNameTypeIn),
-              db( dir / ::GetDbName(dbNameTypeIn), DBCacheSize[dbNameTypeIn], fMemory, fWipe ) {}
+              pDb(std::make_shared<CLevelDBWrapper>(dir / ::GetDbName(dbNameTypeIn), DBCacheSize[dbNameTypeIn],
+                                                    fMemory, fWipe, GetDBProfileType(::GetDbName(dbNameTypeIn),
+                                                    DBProfileTypes[dbNameTypeIn]))),
+              shared_store(false) {}
+
+    // the db shares the store with other dbs (-singledbstore), the prefix types of the dbs never overlap
+    CDBAccess(DBNameType dbNameTypeIn, const std::shared_ptr<CLevelDBWrapper> &pSharedDb) :
+              dbNameType(dbNameTypeIn), pDb(pSharedDb), shared_store(true) {}
 
-    int64_t GetDbCount() const { return db.GetDbCount(); }
+    int64_t GetDbCount() const;
     template<typename KeyType, typename ValueType>
     bool GetData(const dbk::PrefixType prefixType, const KeyType &key, ValueType &value) const {
-        string keyStr = dbk::GenDbKey(prefixType, key);
-        return db.Read(keyStr, value);
+        dbk::CDBKey<KeyType> dbKey(prefixType, key);
+        return ReadData(prefixType, dbKey.GetSlice(), value);
     }
 
     template<typename ValueType>
     bool GetData(const dbk::PrefixType prefixType, ValueType &value) const {
-        const string prefix = dbk::GetKeyPrefix(prefixType);
-        return db.Read(prefix, value);
+        const string &prefix = dbk::GetKeyPrefix(prefixType);
+        return ReadData(prefixType, prefix, value);
     }
 
     template <typename KeyType, typename ValueType>
     bool GetAllElements(const dbk::PrefixType prefixType, map<KeyType, ValueType> &elements) {
         KeyType key;
         ValueType value;
-        shared_ptr<leveldb::Iterator> pCursor = NewIterator();
-
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         const string &prefix = dbk::GetKeyPrefix(prefixType);
-        ssKey.write(prefix.c_str(), prefix.size());
-        pCursor->Seek(ssKey.str());
+        shared_ptr<leveldb::Iterator> pCursor = NewIterator(prefix);
+        pCursor->Seek(prefix);
 
         for (; pCursor->Valid(); pCursor->Next()) {
             boost::this_thread::interruption_point();
@@ -326,8 +368,8 @@ public:
 
         KeyType key;
         ValueType value;
-        shared_ptr<leveldb::Iterator> pCursor = NewIterator();
         const string &prefixStr = dbk::GetKeyPrefix(prefixType);
+        shared_ptr<leveldb::Iterator> pCursor = NewIterator(prefixStr);
 
         for (pCursor->Seek(prefixStr); pCursor->Valid(); pCursor->Next()) {
             boost::this_thread::interruption_point();
@@ -365,11 +407,9 @@ public:
                         map<KeyType, ValueType> &elements) {
         KeyType key;
         ValueType value;
-        shared_ptr<leveldb::Iterator> pCursor = NewIterator();
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         const string &prefix = dbk::GetKeyPrefix(prefixType);
-        ssKey.write(prefix.c_str(), prefix.size());
-        pCursor->Seek(ssKey.str());
+        shared_ptr<leveldb::Iterator> pCursor = NewIterator(prefix);
+        pCursor->Seek(prefix);
 
         for (; pCursor->Valid(); pCursor->Next()) {
             boost::this_thread::interruption_point();
@@ -404,56 +444,208 @@ public:
 
     template<typename KeyType, typename ValueType>
     bool HasData(const dbk::PrefixType prefixType, const KeyType &key) const {
-        string keyStr = dbk::GenDbKey(prefixType, key);
-        return db.Exists(keyStr);
+        dbk::CDBKey<KeyType> dbKey(prefixType, key);
+        const Slice &slKey = dbKey.GetSlice();
+        std::optional<string> pendingValue;
+        if (FindPending(slKey, pendingValue))
+            return pendingValue.has_value();
+
+        if (!MayContain(prefixType, slKey))
+            return false;
+
+        return ProcessReadResult(prefixType, pDb->Exists(slKey));
     }
 
-    template<typename KeyType, typename ValueType>
-    void BatchWrite(const dbk::PrefixType prefixType, const map<KeyType, ValueType> &mapData) {
+    template<typename KeyType, typename ValueType, typename MapType = map<KeyType, ValueType>>
+    void BatchWrite(const dbk::PrefixType prefixType, const MapType &mapData) {
         CLevelDBBatch batch;
-        for (auto item : mapData) {
-            string key = dbk::GenDbKey(prefixType, item.first);
+        CDBKeyBloomFilter *pFilter = bloomFilters[prefixType].load(std::memory_order_acquire);
+        for (const auto &item : mapData) {
+            dbk::CDBKey<KeyType> dbKey(prefixType, item.first);
+            const Slice &slKey = dbKey.GetSlice();
             if (db_util::IsEmpty(item.second)) {
-                batch.Erase(key);
+                batch.Erase(slKey);
             } else {
-                batch.Write(key, item.second);
+                batch.Write(slKey, item.second);
+                if (pFilter)
+                    pFilter->Insert(slKey);
             }
         }
-        db.WriteBatch(batch, true);
+        WriteBatch(batch);
+        writeGenerations[prefixType]++;
+        if (pFilter && pFilter->IsOverloaded())
+            BuildBloomFilter(prefixType);
     }
 
     template<typename ValueType>
     void BatchWrite(const dbk::PrefixType prefixType, ValueType &value) {
         CLevelDBBatch batch;
-        const string prefix = dbk::GetKeyPrefix(prefixType);
+        const string &prefix = dbk::GetKeyPrefix(prefixType);
+        CDBKeyBloomFilter *pFilter = bloomFilters[prefixType].load(std::memory_order_acquire);
 
         if (db_util::IsEmpty(value)) {
             batch.Erase(prefix);
         } else {
             batch.Write(prefix, value);
+            if (pFilter)
+                pFilter->Insert(prefix);
         }
-        db.WriteBatch(batch, true);
+        WriteBatch(batch);
+        writeGenerations[prefixType]++;
     }
 
     DBNameType GetDbNameType() const { return dbNameType; }
 
-    std::shared_ptr<leveldb::Iterator> NewIterator() {
-        return std::shared_ptr<leveldb::Iterator>(db.NewIterator());
+    // the iterator of the db merged with the pending writes of the keys starting with prefix, it never waits
+    // for the writer thread. The pending writes out of the prefix are not visible, so the iteration must stop
+    // at the end of the prefix
+    std::shared_ptr<leveldb::Iterator> NewIterator(const string &prefix = "") const;
+
+    const std::shared_ptr<CLevelDBWrapper>& GetStore() const { return pDb; }
+    bool IsSharedStore() const { return shared_store; }
+
+    /**
+     * Staged write mode: BatchWrite() only stages the writes in memory, they are readable at once.
+     * FreezePendingBatch() takes the staged writes as an immutable batch, which is written to db
+     * by WritePendingBatches() (in the writer thread of -asyncdbflush), in the order of freezing.
+     */
+    void SetStagedWrite(bool enabled);
+    bool IsStagedWrite() const { return staged_write; }
+
+    std::shared_ptr<CDBPendingBatch> FreezePendingBatch();
+    // the frozen batch has been written to db by WritePendingBatches()
+    void ReleasePendingBatch(const std::shared_ptr<CDBPendingBatch> &spBatch);
+
+    // wait for the frozen batches and write the staged writes synchronously
+    void SyncPendingWrites() const;
+
+    uint64_t GetWrittenBytes() const { return written_bytes; }
+
+    // build the bloom filter of the prefix type from all keys in db
+    bool EnableBloomFilter(const dbk::PrefixType prefixType);
+
+    // count of the BatchWrite() of the prefix type, the cached misses must be dropped when it changed
+    uint64_t GetWriteGeneration(const dbk::PrefixType prefixType) const {
+        return writeGenerations[prefixType];
     }
+
+    void AddNegativeHit(const dbk::PrefixType prefixType) const {
+        readStats[prefixType].negative_hits++;
+    }
+
+    Object GetStatsJson() const;
+
+private:
+    template<typename ValueType>
+    bool ReadData(const dbk::PrefixType prefixType, const Slice &slKey, ValueType &value) const {
+        std::optional<string> pendingValue;
+        if (FindPending(slKey, pendingValue)) {
+            if (!pendingValue)
+                return false;
+
+            try {
+                CDataStream ssValue(pendingValue->data(), pendingValue->data() + pendingValue->size(),
+                                    SER_DISK, CLIENT_VERSION);
+                ssValue >> value;
+            } catch (std::exception &e) {
+                return false;
+            }
+            return true;
+        }
+
+        if (!MayContain(prefixType, slKey))
+            return false;
+
+        return ProcessReadResult(prefixType, pDb->Read(slKey, value));
+    }
+
+    inline bool MayContain(const dbk::PrefixType prefixType, const Slice &slKey) const {
+        const CDBKeyBloomFilter *pFilter = bloomFilters[prefixType].load(std::memory_order_acquire);
+        if (pFilter && !pFilter->Contains(slKey)) {
+            readStats[prefixType].bloom_filtered++;
+            return false;
+        }
+        return true;
+    }
+
+    // find the key in the staged and frozen writes, the newest first
+    inline bool FindPending(const Slice &slKey, std::optional<string> &value) const {
+        if (!has_pending)
+            return false;
+        return FindPendingLocked(slKey, value);
+    }
+
+    bool FindPendingLocked(const Slice &slKey, std::optional<string> &value) const;
+
+    void WriteBatch(CLevelDBBatch &batch);
+
+    // build the bloom filter of the prefix type from all keys in db and the pending writes, it replaces the
+    // current one, which is kept since the readers may still use it
+    void BuildBloomFilter(const dbk::PrefixType prefixType);
+
+    inline bool ProcessReadResult(const dbk::PrefixType prefixType, bool found) const {
+        CDBReadStats &stats = readStats[prefixType];
+        stats.db_reads++;
+        if (!found) {
+            stats.db_read_misses++;
+            if (bloomFilters[prefixType].load(std::memory_order_relaxed))
+                stats.bloom_false_positives++;
+        }
+        return found;
+    }
+
 private:
     DBNameType dbNameType;
-    mutable CLevelDBWrapper db; // // TODO: remove the mutable declare
+    std::shared_ptr<CLevelDBWrapper> pDb;
+    bool shared_store;
+    std::atomic<CDBKeyBloomFilter*> bloomFilters[dbk::PREFIX_COUNT] = {};
+    // the built bloom filters, the replaced ones included, only changed by the writer
+    std::vector<std::unique_ptr<CDBKeyBloomFilter>> ownedBloomFilters;
+    uint64_t writeGenerations[dbk::PREFIX_COUNT] = {0};
+    mutable CDBReadStats readStats[dbk::PREFIX_COUNT];
+
+    std::atomic<bool> staged_write{false};
+    mutable std::atomic<bool> has_pending{false};
+    mutable std::atomic<uint64_t> written_bytes{0};
+    mutable std::mutex pending_mutex;
+    mutable std::condition_variable pending_cond;
+    mutable std::shared_ptr<CDBPendingBatch> spStagedBatch;
+    mutable std::deque<std::shared_ptr<CDBPendingBatch>> frozenBatches;
 };
 
-template<int32_t PREFIX_TYPE_VALUE, typename __KeyType, typename __ValueType>
-class CCompositeKVCache {
+/**
+ * CCompositeKVCache
+ * __MapType is the container of the cached data, std::map by default. It can be replaced by
+ * CDBFlatMap<KeyType, ValueType> for the hot caches which only do point lookups, see dbflatmap.h
+ *
+ * The top level cache (with db access) keeps the modified data in mapData and the data which is
+ * same as the db in cleanData. The clean data survives the flush and is evicted by the shared
+ * memory budget, see dbcachebudget.h
+ */
+template<int32_t PREFIX_TYPE_VALUE, typename __KeyType, typename __ValueType,
+         typename __MapType = std::map<__KeyType, __ValueType>>
+class CCompositeKVCache: public CDBCacheEvictable {
 public:
     static const dbk::PrefixType PREFIX_TYPE = (dbk::PrefixType)PREFIX_TYPE_VALUE;
+    static const uint32_t MAX_MISSING_KEYS   = 100000;
+    // the memory of a map node besides the key and the value: the tree links, the color and the allocator header
+    static const uint32_t MAP_NODE_OVERHEAD  = 4 * sizeof(void *) + 16;
 public:
     typedef __KeyType   KeyType;
     typedef __ValueType ValueType;
+    typedef __MapType   DataMap;
     typedef typename std::map<KeyType, ValueType> Map;
-    typedef typename std::map<KeyType, ValueType>::iterator Iterator;
+    typedef typename DataMap::iterator Iterator;
+
+    // the data same as the db, kept after read or flush, see GetCleanSize()
+    struct CleanItem {
+        ValueType value;
+        bool referenced;  // accessed again since the hand of the clock passed it
+        uint32_t size;
+    };
+    typedef std::map<KeyType, CleanItem> CleanMap;
+    // the missing key to whether it is referenced, see CleanItem
+    typedef std::map<KeyType, bool> MissingKeyMap;
 
 public:
     /**
@@ -470,11 +662,43 @@ public:
         pDbAccess(pDbAccessIn), is_calc_size(true) {
         assert(pDbAccessIn != nullptr);
         assert(pDbAccess->GetDbNameType() == GetDbNameEnumByPrefix(PREFIX_TYPE));
+        DBCacheBudget().Register(this);
     };
 
+    CCompositeKVCache(const CCompositeKVCache &other) {
+        operator=(other);
+    }
+
+    CCompositeKVCache& operator=(const CCompositeKVCache &other) {
+        if (this == &other)
+            return *this;
+
+        if (pDbAccess != nullptr && other.pDbAccess == nullptr)
+            DBCacheBudget().Unregister(this);
+        else if (pDbAccess == nullptr && other.pDbAccess != nullptr)
+            DBCacheBudget().Register(this);
+
+        pBase        = other.pBase;
+        pDbAccess    = other.pDbAccess;
+        mapData      = other.mapData;
+        pDbOpLogMap  = other.pDbOpLogMap;
+        is_calc_size = other.is_calc_size;
+        size         = other.size;
+        // the clean data and the missing keys are not copied, they can be read from db again
+        ClearCleanData();
+        ClearMissingKeys();
+        return *this;
+    }
+
+    virtual ~CCompositeKVCache() {
+        if (pDbAccess != nullptr)
+            DBCacheBudget().Unregister(this);
+    }
+
+    // a cache on a base holds the data written to it only, it may be moved onto another base of the same view
     void SetBase(CCompositeKVCache *pBaseIn) {
         assert(pDbAccess == nullptr);
-        assert(mapData.empty());
+        assert(mapData.empty() || pBase != nullptr);
         pBase = pBaseIn;
     };
 
@@ -484,12 +708,35 @@ public:
 
     bool IsCalcSize() const { return is_calc_size; }
 
+    // size of the modified data
     uint32_t GetCacheSize() const {
         return size;
     }
 
+    // the memory of the clean data and the missing keys
+    uint64_t GetCleanSize() const override { return clean_size + missing_size; }
+
+    size_t GetCleanCount() const { return cleanData.size() + missingKeys.size(); }
+
+    uint64_t EvictCleanData(uint64_t sizeToFree) override {
+        // the clean data and the missing keys free the shares of their sizes
+        uint64_t cleanShare = GetCleanSize() > 0 ? (uint64_t)((double)sizeToFree * clean_size / GetCleanSize()) : 0;
+        uint64_t freedSize  = SweepClock(cleanData, clean_hand, cleanShare,
+                                         [](const typename CleanMap::value_type &item) { return item.second.size; });
+        clean_size = clean_size > freedSize ? clean_size - freedSize : 0;
+
+        uint64_t missingShare     = sizeToFree > freedSize ? sizeToFree - freedSize : 0;
+        uint64_t freedMissingSize = SweepClock(missingKeys, missing_hand, missingShare,
+                                               [this](const typename MissingKeyMap::value_type &item) {
+                                                   return CalcMissingKeySize(item.first);
+                                               });
+        missing_size = missing_size > freedMissingSize ? missing_size - freedMissingSize : 0;
+        return freedSize + freedMissingSize;
+    }
+
     // map<string, ValueType>
     bool GetAllElements(const KeyType &endKey, Map &elements) {
+        CDBTrackedAccess trackedAccess;
         set<KeyType> expiredKeys;
         if (!GetAllElements(endKey, elements, expiredKeys)) {
             // TODO: log
@@ -500,6 +747,7 @@ public:
     }
 
     bool GetAllElements(map<KeyType, ValueType> &elements) {
+        CDBTrackedAccess trackedAccess;
         set<KeyType> expiredKeys;
         if (!GetAllElements(expiredKeys, elements)) {
             // TODO: log
@@ -513,9 +761,10 @@ public:
         if (db_util::IsEmpty(key)) {
             return false;
         }
-        auto it = GetDataIt(key);
-        if (it != mapData.end() && !db_util::IsEmpty(it->second)) {
-            value = it->second;
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, key, false);
+        const ValueType *pValue = FindData(key);
+        if (pValue != nullptr && !db_util::IsEmpty(*pValue)) {
+            value = *pValue;
             return true;
         }
         return false;
@@ -525,6 +774,7 @@ public:
         if (db_util::IsEmpty(key)) {
             return false;
         }
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, key, true);
         auto it = GetDataIt(key);
         if (it == mapData.end()) {
             auto pEmptyValue = db_util::MakeEmptyValue<ValueType>();
@@ -542,14 +792,16 @@ public:
         if (db_util::IsEmpty(key)) {
             return false;
         }
-        auto it = GetDataIt(key);
-        return it != mapData.end() && !db_util::IsEmpty(it->second);
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, key, false);
+        const ValueType *pValue = FindData(key);
+        return pValue != nullptr && !db_util::IsEmpty(*pValue);
     }
 
     bool EraseData(const KeyType &key) {
         if (db_util::IsEmpty(key)) {
             return false;
         }
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, key, true);
         Iterator it = GetDataIt(key);
         if (it != mapData.end() && !db_util::IsEmpty(it->second)) {
             DecDataSize(it->second);
@@ -569,21 +821,41 @@ public:
         assert(pBase != nullptr || pDbAccess != nullptr);
         if (pBase != nullptr) {
             assert(pDbAccess == nullptr);
-            for (auto it : mapData) {
-                pBase->mapData[it.first] = it.second;
-            }
+            if (pBase->pDbAccess != nullptr)
+                pBase->PrepareMerge(mapData);
+            MergeMapData(pBase->mapData, mapData);
         } else if (pDbAccess != nullptr) {
             assert(pBase == nullptr);
-            pDbAccess->BatchWrite<KeyType, ValueType>(PREFIX_TYPE, mapData);
+            bool isCacheValid = db_generation == pDbAccess->GetWriteGeneration(PREFIX_TYPE);
+            pDbAccess->BatchWrite<KeyType, ValueType, DataMap>(PREFIX_TYPE, mapData);
+            if (isCacheValid) {
+                // keep the negative cache valid after our own write, the written data becomes clean
+                for (auto &item : mapData) {
+                    EraseMissingKey(item.first);
+                    if (!db_util::IsEmpty(item.second))
+                        AddCleanData(item.first, std::move(item.second));
+                }
+                db_generation = pDbAccess->GetWriteGeneration(PREFIX_TYPE);
+            }
         }
 
         Clear();
     }
 
-    void UndoData(const CDbOpLog &dbOpLog) {
+    // the empty value drops the data of the key from this cache, it is read from the base again
+    void UndoData(const leveldb::Slice &slKey, const leveldb::Slice &slValue) {
         KeyType key;
         ValueType value;
-        dbOpLog.Get(key, value);
+        dbk::CDBKeyReader(slKey) >> key;
+        if (slValue.empty()) {
+            auto it = mapData.find(key);
+            if (it != mapData.end()) {
+                DecDataSize(it->first, it->second);
+                mapData.erase(it);
+            }
+            return;
+        }
+        dbk::CDBKeyReader(slValue) >> value;
         auto it = mapData.find(key);
         if (it != mapData.end()) {
             UpdateDataSize(it->second, value);
@@ -593,14 +865,9 @@ public:
         }
     }
 
-    void UndoDataList(const CDbOpLogs &dbOpLogs) {
-        for (auto it = dbOpLogs.rbegin(); it != dbOpLogs.rend(); it++) {
-            UndoData(*it);
-        }
-    }
-
     void RegisterUndoFunc(UndoDataFuncMap &undoDataFuncMap) {
-        undoDataFuncMap[GetPrefixType()] = std::bind(&CCompositeKVCache::UndoDataList, this, std::placeholders::_1);
+        undoDataFuncMap[GetPrefixType()] = std::bind(&CCompositeKVCache::UndoData, this, std::placeholders::_1,
+                                                     std::placeholders::_2);
     }
 
     dbk::PrefixType GetPrefixType() const { return PREFIX_TYPE; }
@@ -613,45 +880,274 @@ public:
         return pRet;
     }
 
-    CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType>* GetBasePtr() { return pBase; }
+    CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType, DataMap>* GetBasePtr() { return pBase; }
 
-    map<KeyType, ValueType>& GetMapData() { return mapData; };
+    // the data map is accessed without key, it can not be tracked
+    DataMap& GetMapData() {
+        CDBTrackedAccess trackedAccess;
+        return mapData;
+    };
 private:
+    // splice the nodes of from into to, only the values of the existing keys are moved
+    template<typename K, typename V, typename C, typename A>
+    static void MergeMapData(std::map<K, V, C, A> &to, std::map<K, V, C, A> &from) {
+        while (!from.empty()) {
+            auto node = from.extract(from.begin());
+            auto it   = to.lower_bound(node.key());
+            if (it != to.end() && !to.key_comp()(node.key(), it->first)) {
+                it->second = std::move(node.mapped());
+            } else {
+                to.insert(it, std::move(node));
+            }
+        }
+    }
+
+    template<typename K, typename V, uint32_t N>
+    static void MergeMapData(CDBFlatMap<K, V, N> &to, CDBFlatMap<K, V, N> &from) {
+        to.Merge(std::move(from));
+    }
+
+    /**
+     * Copy on write: the read only access does not copy the value of base cache into this cache,
+     * only the top level cache keeps the value read from db. The returned pointer is valid until
+     * the key is erased or undone from the cache which holds it, or the clean data is evicted.
+     */
+    const ValueType* FindData(const KeyType &key) const {
+        if (pDbAccess != nullptr && CDBAccessTracker::Current() != nullptr)
+            return FindTrackedData(key);
+
+        if (pDbAccess != nullptr)
+            CheckDbGeneration();
+
+        auto it = mapData.find(key);
+        if (it != mapData.end())
+            return &it->second;
+        else if (pBase != nullptr)
+            return pBase->FindData(key);
+        else if (pDbAccess != nullptr) {
+            auto cleanIt = cleanData.find(key);
+            if (cleanIt != cleanData.end()) {
+                cleanIt->second.referenced = true;
+                return &cleanIt->second.value;
+            }
+
+            auto pDbValue = db_util::MakeEmptyValue<ValueType>();
+            if (ReadDbData(key, *pDbValue))
+                return &AddCleanData(key, std::move(*pDbValue))->second.value;
+        }
+
+        return nullptr;
+    }
+
+    /**
+     * The tracked accessors of the speculative txs (-parallelexec) read the top level cache from many threads,
+     * the base caches between are only read. The clean data and the missing keys are changed under the lock,
+     * the db is read outside of it. The clean data is neither evicted nor dropped while the txs are executed,
+     * so the returned pointer stays valid.
+     */
+    const ValueType* FindTrackedData(const KeyType &key) const {
+        {
+            std::lock_guard<std::mutex> lock(tracked_mutex);
+            CheckDbGeneration();
+            auto it = mapData.find(key);
+            if (it != mapData.end())
+                return &it->second;
+
+            auto cleanIt = cleanData.find(key);
+            if (cleanIt != cleanData.end()) {
+                cleanIt->second.referenced = true;
+                return &cleanIt->second.value;
+            }
+            if (IsMissingKey(key))
+                return nullptr;
+        }
+
+        auto pDbValue = db_util::MakeEmptyValue<ValueType>();
+        bool found    = pDbAccess->GetData(PREFIX_TYPE, key, *pDbValue);
+
+        std::lock_guard<std::mutex> lock(tracked_mutex);
+        if (!found) {
+            AddMissingKey(key);
+            return nullptr;
+        }
+        // another thread may have read the same key meanwhile
+        auto cleanIt = cleanData.find(key);
+        if (cleanIt != cleanData.end())
+            return &cleanIt->second.value;
+        return &AddCleanData(key, std::move(*pDbValue))->second.value;
+    }
+
+    // the value is copied into this cache before it is modified
     Iterator GetDataIt(const KeyType &key) const {
+        if (pDbAccess != nullptr)
+            CheckDbGeneration();
+
         Iterator it = mapData.find(key);
         if (it != mapData.end()) {
             return it;
         } else if (pBase != nullptr) {
             // find key-value at base cache
-            auto baseIt = pBase->GetDataIt(key);
-            if (baseIt != pBase->mapData.end()) {
+            const ValueType *pBaseValue = pBase->FindData(key);
+            if (pBaseValue != nullptr) {
                 // the found key-value add to current mapData
-                return AddDataToMap(key, baseIt->second);
+                return AddDataToMap(key, *pBaseValue);
             }
-        } else if (pDbAccess != NULL) {
-            // TODO: need to save the empty value to mapData for search performance?
+        } else if (pDbAccess != nullptr) {
+            auto cleanIt = cleanData.find(key);
+            if (cleanIt != cleanData.end()) {
+                // the clean value moves to mapData, it will be modified
+                ValueType value = std::move(cleanIt->second.value);
+                EraseCleanData(cleanIt);
+                return AddDataToMap(key, value);
+            }
+
             auto pDbValue = db_util::MakeEmptyValue<ValueType>();
-            if (pDbAccess->GetData(PREFIX_TYPE, key, *pDbValue)) {
+            if (ReadDbData(key, *pDbValue))
                 return AddDataToMap(key, *pDbValue);
-            }
         }
 
         return mapData.end();
     }
 
+    bool ReadDbData(const KeyType &key, ValueType &value) const {
+        if (IsMissingKey(key))
+            return false;
+
+        if (pDbAccess->GetData(PREFIX_TYPE, key, value))
+            return true;
+
+        AddMissingKey(key);
+        return false;
+    }
+
+    // the negative cache and the clean data are dropped when the db is written by others
+    inline void CheckDbGeneration() const {
+        uint64_t generation = pDbAccess->GetWriteGeneration(PREFIX_TYPE);
+        if (db_generation != generation) {
+            ClearMissingKeys();
+            ClearCleanData();
+            db_generation = generation;
+        }
+    }
+
+    // the negative cache of the top-level cache, the missing keys are evicted with the clean data
+    inline bool IsMissingKey(const KeyType &key) const {
+        auto it = missingKeys.find(key);
+        if (it == missingKeys.end())
+            return false;
+
+        it->second = true;
+        pDbAccess->AddNegativeHit(PREFIX_TYPE);
+        return true;
+    }
+
+    inline void AddMissingKey(const KeyType &key) const {
+        if (missingKeys.size() >= MAX_MISSING_KEYS)
+            ClearMissingKeys();
+        if (missingKeys.emplace(key, false).second)
+            missing_size += CalcMissingKeySize(key);
+    }
+
+    inline void EraseMissingKey(const KeyType &key) const {
+        auto it = missingKeys.find(key);
+        if (it == missingKeys.end())
+            return;
+
+        uint32_t sz  = CalcMissingKeySize(key);
+        missing_size = missing_size > sz ? missing_size - sz : 0;
+        missingKeys.erase(it);
+    }
+
+    inline void ClearMissingKeys() const {
+        missingKeys.clear();
+        missing_size = 0;
+    }
+
     inline Iterator AddDataToMap(const KeyType &keyIn, const ValueType &valueIn) const {
         auto newRet = mapData.emplace(keyIn, valueIn);
         if (!newRet.second)
             throw runtime_error(strprintf("%s :  %s, alloc new cache item failed", __FUNCTION__, __LINE__));
         IncDataSize(keyIn, valueIn);
+        if (!cleanData.empty()) {
+            auto cleanIt = cleanData.find(keyIn);
+            if (cleanIt != cleanData.end())
+                EraseCleanData(cleanIt);
+        }
         return newRet.first;
     }
 
-    inline void IncDataSize(const KeyType &keyIn, const ValueType &valueIn) const {
-        if (is_calc_size) {
-            size += CalcDataSize(keyIn);
-            size += CalcDataSize(valueIn);
+    // the data of child cache will be merged into this top level cache, update the size and clean data
+    void PrepareMerge(const DataMap &childData) {
+        for (const auto &item : childData) {
+            if (!cleanData.empty()) {
+                auto cleanIt = cleanData.find(item.first);
+                if (cleanIt != cleanData.end())
+                    EraseCleanData(cleanIt);
+            }
+            auto it = mapData.find(item.first);
+            if (it != mapData.end())
+                UpdateDataSize(it->second, item.second);
+            else
+                IncDataSize(item.first, item.second);
+        }
+    }
+
+    static bool &ReferencedOf(CleanItem &item) { return item.referenced; }
+    static bool &ReferencedOf(bool &referenced) { return referenced; }
+
+    // the clock of the cache: the hand goes on from the key where it stopped, a referenced item is unmarked
+    // and kept for one more round, an unmarked one is evicted, until the size is freed or every item is swept
+    // twice. The new items are unmarked, so the items read once go before the ones read again.
+    template <typename ItemMap, typename SizeFunc>
+    static uint64_t SweepClock(ItemMap &items, std::pair<bool, KeyType> &hand, uint64_t sizeToFree,
+                               SizeFunc sizeOf) {
+        if (items.empty() || sizeToFree == 0)
+            return 0;
+
+        uint64_t freedSize = 0;
+        auto it            = hand.first ? items.lower_bound(hand.second) : items.begin();
+        for (size_t steps = items.size() * 2; steps > 0 && freedSize < sizeToFree && !items.empty(); steps--) {
+            if (it == items.end())
+                it = items.begin();
+            bool &referenced = ReferencedOf(it->second);
+            if (referenced) {
+                referenced = false;
+                it++;
+            } else {
+                freedSize += sizeOf(*it);
+                it = items.erase(it);
+            }
         }
+        hand = (it == items.end()) ? std::make_pair(false, KeyType()) : std::make_pair(true, it->first);
+        return freedSize;
+    }
+
+    inline typename CleanMap::iterator AddCleanData(const KeyType &key, ValueType &&value) const {
+        uint32_t sz = CalcNodeSize<typename CleanMap::value_type>(CalcDataSize(key) + CalcDataSize(value));
+        auto it     = cleanData.find(key);
+        if (it != cleanData.end()) {
+            clean_size -= it->second.size;
+            it->second = CleanItem{std::move(value), false, sz};
+        } else {
+            it = cleanData.emplace(key, CleanItem{std::move(value), false, sz}).first;
+        }
+        clean_size += sz;
+        return it;
+    }
+
+    inline void EraseCleanData(typename CleanMap::iterator it) const {
+        clean_size = clean_size > it->second.size ? clean_size - it->second.size : 0;
+        cleanData.erase(it);
+    }
+
+    inline void ClearCleanData() const {
+        cleanData.clear();
+        clean_size = 0;
+    }
+
+    inline void IncDataSize(const KeyType &keyIn, const ValueType &valueIn) const {
+        if (is_calc_size)
+            size += CalcNodeSize<typename Map::value_type>(CalcDataSize(keyIn) + CalcDataSize(valueIn));
     }
 
     inline void IncDataSize(const ValueType &valueIn) const {
@@ -659,6 +1155,13 @@ private:
             size += CalcDataSize(valueIn);
     }
 
+    inline void DecDataSize(const KeyType &keyIn, const ValueType &valueIn) const {
+        if (is_calc_size) {
+            uint32_t sz = CalcNodeSize<typename Map::value_type>(CalcDataSize(keyIn) + CalcDataSize(valueIn));
+            size = size > sz ? size - sz : 0;
+        }
+    }
+
     inline void DecDataSize(const ValueType &valueIn) const {
         if (is_calc_size) {
             uint32_t sz = CalcDataSize(valueIn);
@@ -679,6 +1182,20 @@ private:
         return ::GetSerializeSize(d, SER_DISK, CLIENT_VERSION);
     }
 
+    /**
+     * The estimated memory of a map node: the node with the key and the value in place, plus the serialized
+     * size standing for the heap data owned by them (strings, vectors, maps). The fixed fields are counted in
+     * both, so the estimate errs on the side of the budget.
+     */
+    template <typename NodeValue>
+    inline uint32_t CalcNodeSize(uint32_t dataSize) const {
+        return MAP_NODE_OVERHEAD + sizeof(NodeValue) + dataSize;
+    }
+
+    inline uint32_t CalcMissingKeySize(const KeyType &key) const {
+        return CalcNodeSize<typename MissingKeyMap::value_type>(CalcDataSize(key));
+    }
+
     // map<string, ValueType>
     bool GetAllElements(const KeyType &endKey, Map &mapDataOut, set<KeyType> &expiredKeys) {
         if (!mapData.empty()) {
@@ -742,12 +1259,23 @@ private:
 
     }
 private:
-    mutable CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType> *pBase = nullptr;
+    mutable CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType, DataMap> *pBase = nullptr;
     CDBAccess *pDbAccess = nullptr;
-    mutable map<KeyType, ValueType> mapData;
+    mutable DataMap mapData;
     CDBOpLogMap *pDbOpLogMap = nullptr;
     bool is_calc_size = false;
     mutable uint32_t size = 0;
+    mutable MissingKeyMap missingKeys;
+    mutable uint64_t missing_size = 0;
+    mutable CleanMap cleanData;
+    mutable uint64_t clean_size = 0;
+    // the keys where the hands of the clocks stopped, false means the beginning
+    std::pair<bool, KeyType> clean_hand   = {false, KeyType()};
+    std::pair<bool, KeyType> missing_hand = {false, KeyType()};
+    // write generation of the db when the missing keys and clean data are valid
+    mutable uint64_t db_generation = 0;
+    // the top level cache read by the tracked accessors of the speculative txs, see FindTrackedData()
+    mutable std::mutex tracked_mutex;
 };
 
 
@@ -791,7 +1319,7 @@ public:
 
     void SetBase(CSimpleKVCache *pBaseIn) {
         assert(pDbAccess == nullptr);
-        assert(!ptrData && "Must SetBase before have any data");
+        assert((!ptrData || pBase != nullptr) && "Must SetBase before have any data");
         pBase = pBaseIn;
     }
 
@@ -808,6 +1336,7 @@ public:
     }
 
     bool GetData(ValueType &value) const {
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, false);
         auto ptr = GetDataPtr();
         if (ptr && !db_util::IsEmpty(*ptr)) {
             value = *ptr;
@@ -817,6 +1346,7 @@ public:
     }
 
     bool SetData(const ValueType &value) {
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, true);
         if (!ptrData) {
             ptrData = db_util::MakeEmptyValue<ValueType>();
         }
@@ -826,11 +1356,13 @@ public:
     }
 
     bool HasData() const {
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, false);
         auto ptr = GetDataPtr();
         return ptr && !db_util::IsEmpty(*ptr);
     }
 
     bool EraseData() {
+        CDBTrackedAccess trackedAccess(PREFIX_TYPE, true);
         auto ptr = GetDataPtr();
         if (ptr && !db_util::IsEmpty(*ptr)) {
             AddOpLog(*ptr);
@@ -857,26 +1389,28 @@ public:
         }
     }
 
-    void UndoData(const CDbOpLog &dbOpLog) {
+    // the empty value drops the data from this cache, it is read from the base again
+    void UndoData(const leveldb::Slice &slKey, const leveldb::Slice &slValue) {
+        if (slValue.empty()) {
+            ptrData = nullptr;
+            return;
+        }
         if (!ptrData) {
             ptrData = db_util::MakeEmptyValue<ValueType>();
         }
-        dbOpLog.Get(*ptrData);
-    }
-
-    void UndoDataList(const CDbOpLogs &dbOpLogs) {
-        for (auto it = dbOpLogs.rbegin(); it != dbOpLogs.rend(); it++) {
-            UndoData(*it);
-        }
+        dbk::CDBKeyReader(slValue) >> *ptrData;
     }
 
     void RegisterUndoFunc(UndoDataFuncMap &undoDataFuncMap) {
-        undoDataFuncMap[GetPrefixType()] = std::bind(&CSimpleKVCache::UndoDataList, this, std::placeholders::_1);
+        undoDataFuncMap[GetPrefixType()] = std::bind(&CSimpleKVCache::UndoData, this, std::placeholders::_1,
+                                                     std::placeholders::_2);
     }
 
     dbk::PrefixType GetPrefixType() const { return PREFIX_TYPE; }
 
     std::shared_ptr<ValueType> GetDataPtr() const {
+        if (CDBAccessTracker::Current() != nullptr)
+            return GetTrackedDataPtr();
 
         if (ptrData) {
             return ptrData;
@@ -899,6 +1433,35 @@ public:
     }
 
 private:
+    /**
+     * The tracked accessors of the speculative txs (-parallelexec) run in many threads over the shared base
+     * caches, which are only read. The data read from the bases is kept in this cache and in the top level
+     * cache, which is changed under the lock.
+     */
+    std::shared_ptr<ValueType> GetTrackedDataPtr() const {
+        if (pDbAccess != nullptr) {
+            std::lock_guard<std::mutex> lock(tracked_mutex);
+            if (!ptrData) {
+                auto ptrDbData = db_util::MakeEmptyValue<ValueType>();
+                if (pDbAccess->GetData(PREFIX_TYPE, *ptrDbData))
+                    ptrData = ptrDbData;
+            }
+            return ptrData;
+        }
+
+        if (ptrData)
+            return ptrData;
+
+        for (auto pCache = pBase; pCache != nullptr; pCache = pCache->pBase) {
+            auto ptr = pCache->pDbAccess != nullptr ? pCache->GetTrackedDataPtr() : pCache->ptrData;
+            if (ptr) {
+                ptrData = std::make_shared<ValueType>(*ptr);
+                return ptrData;
+            }
+        }
+        return nullptr;
+    }
+
     inline void AddOpLog(const ValueType &oldValue) {
         if (pDbOpLogMap != nullptr) {
             CDbOpLog dbOpLog;
@@ -912,6 +1475,8 @@ private:
     CDBAccess *pDbAccess;
     mutable std::shared_ptr<ValueType> ptrData = nullptr;
     CDBOpLogMap *pDbOpLogMap                   = nullptr;
+    // the top level cache read by the tracked accessors of the speculative txs, see GetTrackedDataPtr()
+    mutable std::mutex tracked_mutex;
 };
 
 #endif  // PERSIST_DB_ACCESS_H
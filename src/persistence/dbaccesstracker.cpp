@@ -0,0 +1,24 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dbaccesstracker.h"
+
+thread_local CDBAccessTracker *CDBAccessTracker::pCurrent = nullptr;
+
+bool CDBAccessTracker::HasReadAny(const KeySet &keys) const {
+    const KeySet &smaller = readKeys.size() <= keys.size() ? readKeys : keys;
+    const KeySet &larger  = readKeys.size() <= keys.size() ? keys : readKeys;
+    for (const auto &key : smaller) {
+        if (larger.count(key))
+            return true;
+    }
+    return false;
+}
+
+void CDBAccessTracker::Clear() {
+    readKeys.clear();
+    writeKeys.clear();
+    is_unsafe      = false;
+    is_speculative = false;
+}
@@ -0,0 +1,125 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_ACCESS_TRACKER_H
+#define PERSIST_DB_ACCESS_TRACKER_H
+
+#include "dbconf.h"
+
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+/**
+ * CDBAccessTracker
+ * The db keys read and written by a tx which is executed speculatively (-parallelexec).
+ * The tracker is active in the executing thread only. While it is active, every accessor of the
+ * db caches records its key. The accesses which can not be tracked by key (range scans) mark the
+ * tracker unsafe, the tx must be executed again.
+ * The speculative tx runs on its own cache over the base caches shared by all the executing
+ * threads. The shared caches are only read while the txs are executed, except the top level
+ * caches, which keep the data read from db under their own lock. The untracked access of a
+ * speculative tx reads the shared caches without key, it aborts the execution instead.
+ */
+class CDBAccessTracker {
+public:
+    typedef std::unordered_set<std::string> KeySet;
+
+public:
+    // the active tracker of the current thread, nullptr if none
+    static CDBAccessTracker* Current() { return pCurrent; }
+
+    void AddRead(std::string &&key) { readKeys.insert(std::move(key)); }
+    // the old value is read before written, so the written key is a read key too
+    void AddWrite(std::string &&key) {
+        readKeys.insert(key);
+        writeKeys.insert(std::move(key));
+    }
+    void MarkUnsafe() { is_unsafe = true; }
+
+    // the tx runs in parallel with other txs over the shared base caches
+    void SetSpeculative(bool speculative) { is_speculative = speculative; }
+
+    bool IsUnsafe() const { return is_unsafe; }
+    bool IsSpeculative() const { return is_speculative; }
+    const KeySet& GetReadKeys() const { return readKeys; }
+    const KeySet& GetWriteKeys() const { return writeKeys; }
+
+    // whether the tx read any of the keys
+    bool HasReadAny(const KeySet &keys) const;
+
+    void Clear();
+
+private:
+    friend class CDBAccessTrackerScope;
+
+    static thread_local CDBAccessTracker *pCurrent;
+
+    KeySet readKeys;
+    KeySet writeKeys;
+    bool is_unsafe      = false;
+    bool is_speculative = false;
+};
+
+// activate the tracker in the current thread within the scope
+class CDBAccessTrackerScope {
+public:
+    CDBAccessTrackerScope(CDBAccessTracker &tracker) {
+        assert(CDBAccessTracker::pCurrent == nullptr);
+        CDBAccessTracker::pCurrent = &tracker;
+    }
+    ~CDBAccessTrackerScope() { CDBAccessTracker::pCurrent = nullptr; }
+};
+
+// thrown by the untracked access of a speculative tx, the tx is executed again after the earlier txs
+class CDBUnsafeAccessError : public std::runtime_error {
+public:
+    CDBUnsafeAccessError() : std::runtime_error("untracked db access in speculative execution") {}
+};
+
+/**
+ * CDBTrackedAccess
+ * Put at the beginning of the db cache accessors, nothing is done without an active tracker.
+ */
+class CDBTrackedAccess {
+public:
+    // the accessor of the key-value cache
+    template<typename KeyType>
+    CDBTrackedAccess(dbk::PrefixType prefixType, const KeyType &key, bool isWrite) {
+        CDBAccessTracker *pTracker = CDBAccessTracker::Current();
+        if (pTracker != nullptr) {
+            if (isWrite)
+                pTracker->AddWrite(dbk::GenDbKey(prefixType, key));
+            else
+                pTracker->AddRead(dbk::GenDbKey(prefixType, key));
+        }
+    }
+
+    // the accessor of the single value cache
+    CDBTrackedAccess(dbk::PrefixType prefixType, bool isWrite) {
+        CDBAccessTracker *pTracker = CDBAccessTracker::Current();
+        if (pTracker != nullptr) {
+            if (isWrite)
+                pTracker->AddWrite(std::string(dbk::GetKeyPrefix(prefixType)));
+            else
+                pTracker->AddRead(std::string(dbk::GetKeyPrefix(prefixType)));
+        }
+    }
+
+    // the accessor which can not be tracked by key
+    CDBTrackedAccess() {
+        CDBAccessTracker *pTracker = CDBAccessTracker::Current();
+        if (pTracker != nullptr) {
+            pTracker->MarkUnsafe();
+            if (pTracker->IsSpeculative())
+                throw CDBUnsafeAccessError();
+        }
+    }
+
+    CDBTrackedAccess(const CDBTrackedAccess &) = delete;
+    CDBTrackedAccess &operator=(const CDBTrackedAccess &) = delete;
+};
+
+#endif  // PERSIST_DB_ACCESS_TRACKER_H
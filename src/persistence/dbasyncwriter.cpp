@@ -0,0 +1,164 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dbasyncwriter.h"
+
+#include "commons/json/json_spirit_utils.h"
+#include "commons/util/util.h"
+#include "logging.h"
+
+////////////////////////////////////////////////////////////////////////////////
+// class CDBFlushStats
+
+void CDBFlushStats::Add(int64_t durationMs, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    flush_count++;
+    last_ms     = durationMs;
+    max_ms      = std::max(max_ms, durationMs);
+    total_ms    += durationMs;
+    last_bytes  = bytes;
+    total_bytes += bytes;
+}
+
+Object CDBFlushStats::ToJson() const {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    Object obj;
+    obj.push_back(Pair("flush_count",   flush_count));
+    obj.push_back(Pair("last_ms",       last_ms));
+    obj.push_back(Pair("max_ms",        max_ms));
+    obj.push_back(Pair("avg_ms",        flush_count > 0 ? total_ms / (int64_t)flush_count : 0));
+    obj.push_back(Pair("last_bytes",    last_bytes));
+    obj.push_back(Pair("total_bytes",   total_bytes));
+    return obj;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class CDBAsyncWriter
+
+CDBAsyncWriter::CDBAsyncWriter(const std::vector<CDBAccess*> &dbsIn, CDBFlushStats &statsIn,
+                               std::function<void()> postWriteIn)
+    : dbs(dbsIn), stats(statsIn), postWrite(postWriteIn) {
+    for (auto pDbAccess : dbs) {
+        pDbAccess->SetStagedWrite(true);
+    }
+    writerThread = std::thread(&CDBAsyncWriter::ThreadWrite, this);
+}
+
+CDBAsyncWriter::~CDBAsyncWriter() {
+    // write the staged and queued flushes before stopping
+    bool fWritten = Commit() && WaitForIdle();
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        is_stopping = true;
+    }
+    queue_cond.notify_all();
+    writerThread.join();
+
+    if (!fWritten) {
+        // the unwritten batches are lost, the node has been aborted and the chain state on disk is never
+        // ahead of the best block, so it can be reloaded at the next start
+        LogPrint(BCLog::ERROR, "%s, the chain state of the last flushes is not written: %s\n", __func__,
+                 GetError());
+        return;
+    }
+
+    for (auto pDbAccess : dbs) {
+        pDbAccess->SetStagedWrite(false);
+    }
+}
+
+bool CDBAsyncWriter::Commit() {
+    if (HasFailed())
+        return false;
+
+    CDBPendingBatchList job;
+    for (auto pDbAccess : dbs) {
+        auto spBatch = pDbAccess->FreezePendingBatch();
+        if (spBatch)
+            job.emplace_back(pDbAccess, spBatch);
+    }
+    if (job.empty())
+        return true;
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cond.wait(lock, [this] { return flushQueue.size() < MAX_PENDING_FLUSHES || has_failed; });
+    // the job is queued even when the writer failed, its batches stay readable in memory
+    flushQueue.push_back(std::move(job));
+    queue_cond.notify_all();
+    return !has_failed;
+}
+
+bool CDBAsyncWriter::WaitForIdle() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    queue_cond.wait(lock, [this] { return (flushQueue.empty() && !is_writing) || has_failed; });
+    return !has_failed;
+}
+
+uint32_t CDBAsyncWriter::GetPendingFlushes() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return flushQueue.size() + (is_writing ? 1 : 0);
+}
+
+bool CDBAsyncWriter::HasFailed() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return has_failed;
+}
+
+std::string CDBAsyncWriter::GetError() {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return writeError;
+}
+
+void CDBAsyncWriter::ThreadWrite() {
+    RenameThread("coin-dbwriter");
+
+    while (true) {
+        CDBPendingBatchList job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_cond.wait(lock, [this] { return !flushQueue.empty() || is_stopping; });
+            // the flushes after a failed one must not be written, the state on disk would skip a flush
+            if (flushQueue.empty() || has_failed)
+                return;
+
+            job = std::move(flushQueue.front());
+            flushQueue.pop_front();
+            is_writing = true;
+        }
+        queue_cond.notify_all();
+
+        int64_t beginTime = GetTimeMillis();
+        uint64_t bytes    = 0;
+        try {
+            WritePendingBatches(job);
+            for (const auto &item : job) {
+                bytes += item.second->bytes;
+            }
+        } catch (std::exception &e) {
+            // the frozen batches can not be dropped, the chain state on disk would be inconsistent. Stop
+            // writing and report the failure to the next flush, which aborts the node
+            LogPrint(BCLog::ERROR, "%s, write chain state failed: %s\n", __func__, e.what());
+            {
+                std::lock_guard<std::mutex> lock(queue_mutex);
+                has_failed = true;
+                writeError = e.what();
+                is_writing = false;
+            }
+            queue_cond.notify_all();
+            return;
+        }
+        stats.Add(GetTimeMillis() - beginTime, bytes);
+        LogPrint(BCLog::LDB, "%s, wrote %u dbs, bytes=%llu, took %lldms\n", __func__, job.size(), bytes,
+                 GetTimeMillis() - beginTime);
+
+        if (postWrite)
+            postWrite();
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            is_writing = false;
+        }
+        queue_cond.notify_all();
+    }
+}
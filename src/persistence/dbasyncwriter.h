@@ -0,0 +1,87 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_ASYNC_WRITER_H
+#define PERSIST_DB_ASYNC_WRITER_H
+
+#include "dbaccess.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * CDBFlushStats
+ * Duration and written bytes of the chain state flushes.
+ */
+class CDBFlushStats {
+public:
+    void Add(int64_t durationMs, uint64_t bytes);
+    Object ToJson() const;
+
+private:
+    mutable std::mutex stats_mutex;
+    uint64_t flush_count  = 0;
+    int64_t last_ms       = 0;
+    int64_t max_ms        = 0;
+    int64_t total_ms      = 0;
+    uint64_t last_bytes   = 0;
+    uint64_t total_bytes  = 0;
+};
+
+/**
+ * CDBAsyncWriter
+ * The dedicated writer thread of the chain state. Commit() freezes the staged writes of all dbs
+ * as one flush, the block processing goes on while the writer thread writes the flushes in order.
+ * In every flush the dbs are written in the given order, the last one (block db, which has the
+ * best block hash) is written after all the others, so the state is never behind the best block.
+ * The dbs in one store (-singledbstore) are written as one atomic batch.
+ * When a write fails, the writer thread stops and keeps the failed flush in memory, Commit() and
+ * WaitForIdle() return false and GetError() tells the reason, the caller must abort the node.
+ */
+class CDBAsyncWriter {
+public:
+    // Commit() waits when the writer thread is so slow
+    static const uint32_t MAX_PENDING_FLUSHES = 2;
+
+public:
+    // postWrite is called in the writer thread after every flush is written
+    CDBAsyncWriter(const std::vector<CDBAccess*> &dbsIn, CDBFlushStats &statsIn,
+                   std::function<void()> postWriteIn = nullptr);
+    ~CDBAsyncWriter();
+
+    // return false when a flush failed to be written
+    bool Commit();
+
+    // wait for all the committed flushes are written, return false when a flush failed to be written
+    bool WaitForIdle();
+
+    uint32_t GetPendingFlushes();
+
+    bool HasFailed();
+    std::string GetError();
+
+private:
+    void ThreadWrite();
+
+private:
+    std::vector<CDBAccess*> dbs;
+    CDBFlushStats &stats;
+    std::function<void()> postWrite;
+
+    std::mutex queue_mutex;
+    std::condition_variable queue_cond;
+    std::deque<CDBPendingBatchList> flushQueue;
+    bool is_writing = false;
+    bool is_stopping = false;
+    bool has_failed = false;
+    std::string writeError;
+    std::thread writerThread;
+};
+
+#endif  // PERSIST_DB_ASYNC_WRITER_H
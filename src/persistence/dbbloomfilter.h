@@ -0,0 +1,92 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_BLOOM_FILTER_H
+#define PERSIST_DB_BLOOM_FILTER_H
+
+#include <leveldb/slice.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * CDBKeyBloomFilter
+ * In-memory bloom filter of the db keys of one prefix type. All the keys written to the db
+ * must be inserted, so Contains() == false means the key is definitely not in the db.
+ * The erased keys can not be removed from the filter, they only raise the false positive rate.
+ * Insert() may run concurrently with Contains() of the readers, so the bits are atomic words set and
+ * tested with relaxed ordering. A reader racing with the write of a key may miss it, as if it read
+ * before the write.
+ */
+class CDBKeyBloomFilter {
+public:
+    static const uint32_t DEFAULT_BITS_PER_KEY = 10;
+    static const uint64_t MIN_ELEMENTS         = 100000;
+
+public:
+    CDBKeyBloomFilter(uint64_t nElements, uint32_t nBitsPerKey = DEFAULT_BITS_PER_KEY) {
+        nElements    = std::max(nElements, (uint64_t)MIN_ELEMENTS);
+        nBits        = nElements * nBitsPerKey;
+        // k = ln(2) * bits/key is the optimal hash func count
+        nHashFuncs   = std::min<uint32_t>(std::max<uint32_t>(nBitsPerKey * 69 / 100, 1), 30);
+        nCapacity    = nElements;
+        nWords       = (nBits + 63) / 64;
+        vData.reset(new std::atomic<uint64_t>[nWords]());
+    }
+
+    void Insert(const leveldb::Slice &key) {
+        uint64_t h     = Hash(key);
+        uint64_t delta = (h >> 33) | (h << 31);
+        for (uint32_t i = 0; i < nHashFuncs; i++) {
+            uint64_t pos = h % nBits;
+            vData[pos / 64].fetch_or((uint64_t)1 << (pos % 64), std::memory_order_relaxed);
+            h += delta;
+        }
+        nInserted.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool Contains(const leveldb::Slice &key) const {
+        uint64_t h     = Hash(key);
+        uint64_t delta = (h >> 33) | (h << 31);
+        for (uint32_t i = 0; i < nHashFuncs; i++) {
+            uint64_t pos = h % nBits;
+            if ((vData[pos / 64].load(std::memory_order_relaxed) & ((uint64_t)1 << (pos % 64))) == 0)
+                return false;
+            h += delta;
+        }
+        return true;
+    }
+
+    uint64_t GetInsertedCount() const { return nInserted.load(std::memory_order_relaxed); }
+    uint64_t GetCapacity() const { return nCapacity; }
+    // the false positive rate rises above the designed one, the filter should be built again
+    bool IsOverloaded() const { return GetInsertedCount() > nCapacity; }
+    uint64_t GetMemorySize() const { return nWords * sizeof(uint64_t); }
+
+private:
+    // FNV-1a with the splitmix64 finalizer
+    static uint64_t Hash(const leveldb::Slice &key) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < key.size(); i++) {
+            h ^= (uint8_t)key[i];
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+        h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+        h ^= h >> 31;
+        return h;
+    }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> vData;
+    uint64_t nWords     = 0;
+    uint64_t nBits      = 0;
+    uint32_t nHashFuncs = 0;
+    uint64_t nCapacity  = 0;
+    std::atomic<uint64_t> nInserted{0};
+};
+
+#endif  // PERSIST_DB_BLOOM_FILTER_H
@@ -0,0 +1,76 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dbcachebudget.h"
+
+#include "commons/json/json_spirit_utils.h"
+#include "commons/util/util.h"
+#include "logging.h"
+
+#include <algorithm>
+
+CDBCacheBudget& DBCacheBudget() {
+    static CDBCacheBudget budget;
+    return budget;
+}
+
+void CDBCacheBudget::Register(CDBCacheEvictable *pCache) {
+    LOCK(cs_caches);
+    caches.insert(pCache);
+}
+
+void CDBCacheBudget::Unregister(CDBCacheEvictable *pCache) {
+    LOCK(cs_caches);
+    caches.erase(pCache);
+}
+
+uint64_t CDBCacheBudget::GetCleanSize() {
+    LOCK(cs_caches);
+    uint64_t cleanSize = 0;
+    for (auto pCache : caches) {
+        cleanSize += pCache->GetCleanSize();
+    }
+    return cleanSize;
+}
+
+uint64_t CDBCacheBudget::Evict(uint64_t dirtySize) {
+    LOCK(cs_caches);
+    uint64_t cleanSize = 0;
+    for (auto pCache : caches) {
+        cleanSize += pCache->GetCleanSize();
+    }
+    if (cleanSize + dirtySize <= limit)
+        return 0;
+
+    int64_t beginTime = GetTimeMillis();
+    uint64_t lowWater = limit * LOW_WATER_PERCENT / 100;
+    uint64_t toFree   = cleanSize + dirtySize - std::min(lowWater, cleanSize + dirtySize);
+    toFree            = std::min(toFree, cleanSize);
+
+    // every cache frees the share of its clean size, rounded up
+    uint64_t freedSize = 0;
+    for (auto pCache : caches) {
+        uint64_t cacheCleanSize = pCache->GetCleanSize();
+        if (cacheCleanSize == 0)
+            continue;
+        uint64_t share = (uint64_t)((double)toFree * cacheCleanSize / cleanSize) + 1;
+        freedSize += pCache->EvictCleanData(std::min(share, cacheCleanSize));
+    }
+
+    evicted_size += freedSize;
+    evict_count++;
+    LogPrint(BCLog::DEBUG, "%s, clean_size=%llu, dirty_size=%llu, limit=%llu, freed=%llu, took %lldms\n", __func__,
+             cleanSize, dirtySize, GetLimit(), freedSize, GetTimeMillis() - beginTime);
+    return freedSize;
+}
+
+Object CDBCacheBudget::ToJson() {
+    LOCK(cs_caches);
+    Object obj;
+    obj.push_back(Pair("limit",         GetLimit()));
+    obj.push_back(Pair("clean_size",    GetCleanSize()));
+    obj.push_back(Pair("evicted_size",  evicted_size));
+    obj.push_back(Pair("evict_count",   evict_count));
+    return obj;
+}
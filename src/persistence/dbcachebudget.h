@@ -0,0 +1,75 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_CACHE_BUDGET_H
+#define PERSIST_DB_CACHE_BUDGET_H
+
+#include "commons/json/json_spirit_value.h"
+#include "sync.h"
+
+#include <atomic>
+#include <cstdint>
+#include <set>
+
+using namespace json_spirit;
+
+/**
+ * CDBCacheEvictable
+ * The top level db cache which keeps the clean data (same as the db) after read or flush, and the
+ * keys missing in the db. The clean items and missing keys are evicted by a clock of the cache (an
+ * approximate LRU): an item is marked referenced when it is accessed again, the hand of the clock
+ * sweeps the items from where it stopped, clears the marks and evicts the unmarked items. The sizes
+ * are the estimated memory of the items, map nodes included.
+ */
+class CDBCacheEvictable {
+public:
+    virtual ~CDBCacheEvictable() {}
+
+    virtual uint64_t GetCleanSize() const = 0;
+    // evict the clean items by the clock until the size is freed or every item is swept twice, return the
+    // freed size
+    virtual uint64_t EvictCleanData(uint64_t sizeToFree) = 0;
+};
+
+/**
+ * CDBCacheBudget
+ * One memory budget (-dbcache) shared by all the top level db caches.
+ * The dirty data is flushed in the background when it uses more than half of the budget, the clean
+ * data is evicted when the total size exceeds the budget, every cache frees its share by its clean size.
+ */
+class CDBCacheBudget {
+public:
+    // evict the clean data to the low water mark, so the eviction does not run for every block
+    static const uint32_t LOW_WATER_PERCENT = 75;
+
+public:
+    CDBCacheBudget(): limit(DEFAULT_LIMIT) {}
+
+    void SetLimit(uint64_t limitIn) { limit = limitIn; }
+    uint64_t GetLimit() const { return limit; }
+    uint64_t GetDirtyLimit() const { return limit / 2; }
+
+    void Register(CDBCacheEvictable *pCache);
+    void Unregister(CDBCacheEvictable *pCache);
+
+    uint64_t GetCleanSize();
+
+    // evict the clean data by the clocks of the caches if clean + dirty data exceeds the limit
+    uint64_t Evict(uint64_t dirtySize);
+
+    Object ToJson();
+
+private:
+    static const uint64_t DEFAULT_LIMIT = 100 << 20;
+
+    CCriticalSection cs_caches;
+    std::set<CDBCacheEvictable*> caches;
+    std::atomic<uint64_t> limit;
+    uint64_t evicted_size  = 0;
+    uint64_t evict_count   = 0;
+};
+
+CDBCacheBudget& DBCacheBudget();
+
+#endif  // PERSIST_DB_CACHE_BUDGET_H
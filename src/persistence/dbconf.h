@@ -11,34 +11,42 @@
 
 #include "config/version.h"
 #include "commons/serialize.h"
+#include "dbkeycodec.h"
+#include "dbprofile.h"
 
 typedef leveldb::Slice Slice;
 
-#define DEF_DB_NAME_ENUM(enumType, enumName, cacheSize) enumType,
-#define DEF_DB_NAME_ARRAY(enumType, enumName, cacheSize) enumName,
-#define DEF_CACHE_SIZE_ARRAY(enumType, enumName, cacheSize) cacheSize,
-
-//         DBNameType            DBName             DBCacheSize           description
-//         ----------           --------------    --------------     ----------------------------
-#define DB_NAME_LIST(DEFINE)                                                                                    \
-    DEFINE( SYSPARAM,           "params",         (50  << 10) )      /* 50KB:   system params */                \
-    DEFINE( ACCOUNT,            "accounts",       (50  << 20) )      /* 50MB:   accounts & account assets */    \
-    DEFINE( ASSET,              "assets",         (100 << 10) )      /* 100KB:  asset registry */               \
-    DEFINE( BLOCK,              "blocks",         (500 << 10) )      /* 500KB:  block & tx indexes */           \
-    DEFINE( CONTRACT,           "contracts",      (50  << 20) )      /* 50MB:   contract */                     \
-    DEFINE( DELEGATE,           "delegates",      (100 << 10) )      /* 100KB:  delegates */                    \
-    DEFINE( CDP,                "cdps",           (50  << 20) )      /* 50MB:   cdp */                          \
-    DEFINE( CLOSEDCDP,          "closedcdps",     (1   << 20) )      /* 1MB:    closed cdp */                   \
-    DEFINE( DEX,                "dexes",          (50  << 20) )      /* 50MB:   dex */                          \
-    DEFINE( LOG,                "logs",           (100 << 10) )      /* 100KB:  log */                          \
-    DEFINE( RECEIPT,            "receipts",       (100 << 10) )      /* 100KB:  tx receipt */                   \
-    DEFINE( UTXO,               "utxo",           (50  << 20) )      /* 50MB:   utxo tx track db */             \
-    DEFINE( SYSGOVERN,          "governs",        (100 << 10) )      /* 100KB:  governors */                    \
-    DEFINE( PRICEFEED,          "pricefeed",      (50  << 10) )      /* 50KB:   price feeds*/                   \
-    DEFINE( AXC,                "axc",            (50  << 10) )      /* 50KB:   cross-chain */                  \
-    /*                                                                  */                                      \
-    /* Add new Enum elements above, DB_NAME_COUNT Must be the last one */                                       \
-    DEFINE( DB_NAME_COUNT,        "",               0)                  /* enum count, must be the last one */
+#define DEF_DB_NAME_ENUM(enumType, enumName, cacheSize, compactSize, profile) enumType,
+#define DEF_DB_NAME_ARRAY(enumType, enumName, cacheSize, compactSize, profile) enumName,
+#define DEF_CACHE_SIZE_ARRAY(enumType, enumName, cacheSize, compactSize, profile) cacheSize,
+#define DEF_COMPACT_SIZE_ARRAY(enumType, enumName, cacheSize, compactSize, profile) compactSize,
+#define DEF_DB_PROFILE_TYPE_ARRAY(enumType, enumName, cacheSize, compactSize, profile) DB_PROFILE_##profile,
+
+// DBCompactSize: only for the single store mode (-singledbstore), the key ranges of the db are compacted
+// after so many bytes are written to it, the smaller the size the higher the compaction priority.
+// DBProfile: the default leveldb option profile of the db, see DB_PROFILE_LIST
+//
+//         DBNameType            DBName             DBCacheSize     DBCompactSize   DBProfile          description
+//         ----------           --------------    --------------   --------------  --------------   ----------------------------
+#define DB_NAME_LIST(DEFINE)                                                                                                                      \
+    DEFINE( SYSPARAM,           "params",         (50  << 10),    (16  << 20),    DEFAULT     )      /* 50KB:   system params */              \
+    DEFINE( ACCOUNT,            "accounts",       (50  << 20),    (32  << 20),    RANDOM_READ )      /* 50MB:   accounts & account assets */  \
+    DEFINE( ASSET,              "assets",         (100 << 10),    (16  << 20),    RANDOM_READ )      /* 100KB:  asset registry */             \
+    DEFINE( BLOCK,              "blocks",         (500 << 10),    (128 << 20),    APPEND      )      /* 500KB:  block & tx indexes */         \
+    DEFINE( CONTRACT,           "contracts",      (50  << 20),    (32  << 20),    RANDOM_READ )      /* 50MB:   contract */                   \
+    DEFINE( DELEGATE,           "delegates",      (100 << 10),    (16  << 20),    DEFAULT     )      /* 100KB:  delegates */                  \
+    DEFINE( CDP,                "cdps",           (50  << 20),    (32  << 20),    RANDOM_READ )      /* 50MB:   cdp */                        \
+    DEFINE( CLOSEDCDP,          "closedcdps",     (1   << 20),    (256 << 20),    WRITE_ONCE  )      /* 1MB:    closed cdp */                 \
+    DEFINE( DEX,                "dexes",          (50  << 20),    (32  << 20),    RANDOM_READ )      /* 50MB:   dex */                        \
+    DEFINE( LOG,                "logs",           (100 << 10),    (256 << 20),    WRITE_ONCE  )      /* 100KB:  log */                        \
+    DEFINE( RECEIPT,            "receipts",       (100 << 10),    (256 << 20),    WRITE_ONCE  )      /* 100KB:  tx receipt */                 \
+    DEFINE( UTXO,               "utxo",           (50  << 20),    (64  << 20),    RANDOM_READ )      /* 50MB:   utxo tx track db */           \
+    DEFINE( SYSGOVERN,          "governs",        (100 << 10),    (16  << 20),    DEFAULT     )      /* 100KB:  governors */                  \
+    DEFINE( PRICEFEED,          "pricefeed",      (50  << 10),    (16  << 20),    DEFAULT     )      /* 50KB:   price feeds*/                 \
+    DEFINE( AXC,                "axc",            (50  << 10),    (16  << 20),    DEFAULT     )      /* 50KB:   cross-chain */                \
+    /*                                                                  */                                                                    \
+    /* Add new Enum elements above, DB_NAME_COUNT Must be the last one */                                                                     \
+    DEFINE( DB_NAME_COUNT,        "",               0,               0,            DEFAULT     )      /* enum count, must be the last one */
 
 enum DBNameType {
     DB_NAME_LIST(DEF_DB_NAME_ENUM)
@@ -51,6 +59,14 @@ static const int32_t DBCacheSize[DBNameType::DB_NAME_COUNT + 1] {
     DB_NAME_LIST(DEF_CACHE_SIZE_ARRAY)
 };
 
+static const int64_t DBCompactSize[DBNameType::DB_NAME_COUNT + 1] {
+    DB_NAME_LIST(DEF_COMPACT_SIZE_ARRAY)
+};
+
+static const DBProfileType DBProfileTypes[DBNameType::DB_NAME_COUNT + 1] {
+    DB_NAME_LIST(DEF_DB_PROFILE_TYPE_ARRAY)
+};
+
 static const std::string kDbNames[DBNameType::DB_NAME_COUNT + 1] {
     DB_NAME_LIST(DEF_DB_NAME_ARRAY)
 };
@@ -91,6 +107,7 @@ namespace dbk {
         DEFINE( REINDEX,              "ridx",   BLOCK )         /* [prefix] --> $Reindex = 1 | 0 */ \
         DEFINE( FINALITY_BLOCK,       "finb",   BLOCK )         /* [prefix] --> &globalfinblock height and hash */ \
         DEFINE( FLAG,                 "flag",   BLOCK )         /* [prefix] --> $Flag = 1 | 0 */ \
+        DEFINE( VERIFY_PROGRESS,      "vfyp",   BLOCK )         /* [prefix] --> $VerifyDBProgress */ \
         DEFINE( BEST_BLOCKHASH,       "bbkh",   BLOCK )         /* [prefix] --> $BestBlockHash */ \
         DEFINE( TXID_DISKINDEX,       "tidx",   BLOCK )         /* tidx{$txid} --> $DiskTxPos */ \
         /**** account db                                                                      */ \
@@ -194,14 +211,21 @@ namespace dbk {
         return EMPTY;
     };
 
+    // the encoded db key (prefix + key element) on the stack, see dbkeycodec.h
+    template<typename KeyElement>
+    class CDBKey: public CDBKeyWriter<CDBKeyInlineSize<KeyElement>::SIZE> {
+    public:
+        CDBKey(PrefixType keyPrefixType, const KeyElement &keyElement) {
+            assert(keyPrefixType != EMPTY);
+            const string &prefix = GetKeyPrefix(keyPrefixType);
+            this->write(prefix.data(), prefix.size()); // write buffer only, exclude size prefix
+            *this << keyElement;
+        }
+    };
+
     template<typename KeyElement>
     std::string GenDbKey(PrefixType keyPrefixType, const KeyElement &keyElement) {
-        CDataStream ssKeyTemp(SER_DISK, CLIENT_VERSION);
-        assert(keyPrefixType != EMPTY);
-        const string &prefix = GetKeyPrefix(keyPrefixType);
-        ssKeyTemp.write(prefix.c_str(), prefix.size()); // write buffer only, exclude size prefix
-        ssKeyTemp << keyElement;
-        return std::string(ssKeyTemp.begin(), ssKeyTemp.end());
+        return CDBKey<KeyElement>(keyPrefixType, keyElement).ToString();
     }
 
     template<typename KeyElement>
@@ -212,9 +236,10 @@ namespace dbk {
             return false;
         }
 
-        CDataStream ssKeyTemp(slice.data(), slice.data() + slice.size(), SER_DISK, CLIENT_VERSION);
-        ssKeyTemp.ignore(prefix.size());
-        ssKeyTemp >> keyElement;
+        // decode in place, the slice is not copied
+        CDBKeyReader reader(slice);
+        reader.ignore(prefix.size());
+        reader >> keyElement;
 
         return true;
     }
@@ -251,11 +276,13 @@ namespace dbk {
             return key.size();
         }
 
-        void Serialize(CDataStream &s, int nType, int nVersion) const {
+        template<typename Stream>
+        void Serialize(Stream &s, int nType, int nVersion) const {
             s.write(key.data(), key.size());
         }
 
-        void Unserialize(CDataStream &s, int nType, int nVersion) {
+        template<typename Stream>
+        void Unserialize(Stream &s, int nType, int nVersion) {
             if (s.size() > MAX_KEY_SIZE) {
                 throw ios_base::failure("CDBTailKey::Unserialize size excceded max size");
             }
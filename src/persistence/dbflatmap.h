@@ -0,0 +1,317 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_FLAT_MAP_H
+#define PERSIST_DB_FLAT_MAP_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/**
+ * CDBFlatMap
+ * An ordered key-value container for the db caches, which can replace the std::map of
+ * CCompositeKVCache. The items live in an arena (a deque with a free list) and never move, an
+ * index of pointers to them is kept flat: a sorted part followed by a small unsorted insert buffer.
+ * The buffer is merged into the sorted part when it is full, or when an ordered access (the
+ * non-const begin, lower_bound, upper_bound) is requested. The merges only move the pointers.
+ * The buffer grows with the square root of the sorted part (at least MIN_INSERT_BUFFER_SIZE),
+ * which balances the linear merges against the linear scans of the buffer: building n items
+ * costs O(n * sqrt(n)) instead of O(n * n / MIN_INSERT_BUFFER_SIZE) of a fixed buffer.
+ *
+ * Like std::map, the references and pointers to the items stay valid until the item is erased.
+ * Unlike std::map, an insertion or an ordered access may invalidate the iterators. The const
+ * accessors never reorder the index, so the const iteration visits the items in the order of the
+ * index, which is sorted only after an ordered access or Normalize().
+ */
+template<typename K, typename V, uint32_t MIN_INSERT_BUFFER_SIZE = 32>
+class CDBFlatMap {
+public:
+    typedef K                                           key_type;
+    typedef V                                           mapped_type;
+    typedef std::pair<K, V>                             value_type;
+    typedef size_t                                      size_type;
+
+private:
+    typedef std::vector<value_type*>                    Index;
+
+public:
+    // the iterator over the index, it is dereferenced to the item in the arena
+    template<typename IndexIt, typename Value>
+    class CIndexIterator {
+    public:
+        typedef std::bidirectional_iterator_tag         iterator_category;
+        typedef Value                                   value_type;
+        typedef std::ptrdiff_t                          difference_type;
+        typedef Value*                                  pointer;
+        typedef Value&                                  reference;
+
+        CIndexIterator() {}
+        explicit CIndexIterator(IndexIt itIn) : it(itIn) {}
+        // iterator to const_iterator
+        template<typename OtherIt, typename OtherValue>
+        CIndexIterator(const CIndexIterator<OtherIt, OtherValue> &other) : it(other.it) {}
+
+        reference operator*() const { return **it; }
+        pointer operator->() const { return *it; }
+
+        CIndexIterator& operator++() { ++it; return *this; }
+        CIndexIterator operator++(int) { CIndexIterator ret = *this; ++it; return ret; }
+        CIndexIterator& operator--() { --it; return *this; }
+        CIndexIterator operator--(int) { CIndexIterator ret = *this; --it; return ret; }
+
+        template<typename OtherIt, typename OtherValue>
+        bool operator==(const CIndexIterator<OtherIt, OtherValue> &other) const { return it == other.it; }
+        template<typename OtherIt, typename OtherValue>
+        bool operator!=(const CIndexIterator<OtherIt, OtherValue> &other) const { return it != other.it; }
+
+        IndexIt it;
+    };
+
+    typedef CIndexIterator<typename Index::iterator, value_type>               iterator;
+    typedef CIndexIterator<typename Index::const_iterator, const value_type>   const_iterator;
+
+public:
+    CDBFlatMap() {}
+
+    CDBFlatMap(const CDBFlatMap &other) { CopyFrom(other); }
+
+    CDBFlatMap(CDBFlatMap &&other) { Swap(other); }
+
+    CDBFlatMap& operator=(const CDBFlatMap &other) {
+        if (this != &other) {
+            clear();
+            CopyFrom(other);
+        }
+        return *this;
+    }
+
+    CDBFlatMap& operator=(CDBFlatMap &&other) {
+        if (this != &other) {
+            clear();
+            Swap(other);
+        }
+        return *this;
+    }
+
+    iterator begin() { Normalize(); return iterator(index.begin()); }
+    iterator end() { return iterator(index.end()); }
+    const_iterator begin() const { return const_iterator(index.begin()); }
+    const_iterator end() const { return const_iterator(index.end()); }
+
+    bool empty() const { return index.empty(); }
+    size_type size() const { return index.size(); }
+
+    void clear() {
+        index.clear();
+        arena.clear();
+        free_slots.clear();
+        sorted_count = 0;
+    }
+
+    void reserve(size_type n) { index.reserve(n); }
+
+    iterator find(const K &key) {
+        return iterator(index.begin() + FindIndex(key));
+    }
+
+    const_iterator find(const K &key) const {
+        return const_iterator(index.begin() + FindIndex(key));
+    }
+
+    size_type count(const K &key) const {
+        return FindIndex(key) != index.size() ? 1 : 0;
+    }
+
+    iterator lower_bound(const K &key) {
+        Normalize();
+        return iterator(std::lower_bound(index.begin(), index.end(), key, KeyLess()));
+    }
+
+    iterator upper_bound(const K &key) {
+        Normalize();
+        return iterator(std::upper_bound(index.begin(), index.end(), key, KeyLess()));
+    }
+
+    std::pair<iterator, bool> emplace(const K &key, const V &value) {
+        size_t pos = FindIndex(key);
+        if (pos != index.size())
+            return std::make_pair(iterator(index.begin() + pos), false);
+
+        return std::make_pair(Append(key, value), true);
+    }
+
+    std::pair<iterator, bool> insert(const value_type &item) {
+        return emplace(item.first, item.second);
+    }
+
+    // the sorted part stays sorted, the iterators after it are invalidated, the item goes to the free list
+    iterator erase(iterator it) {
+        size_t pos = it.it - index.begin();
+        if (pos < sorted_count)
+            sorted_count--;
+        FreeSlot(*it.it);
+        return iterator(index.erase(it.it));
+    }
+
+    V& operator[](const K &key) {
+        size_t pos = FindIndex(key);
+        if (pos != index.size())
+            return index[pos]->second;
+
+        return Append(key, V())->second;
+    }
+
+    // merge the unsorted insert buffer into the sorted part, only the pointers of the index move
+    void Normalize() {
+        if (sorted_count == index.size())
+            return;
+
+        auto sortedEnd = index.begin() + sorted_count;
+        std::sort(sortedEnd, index.end(), KeyLess());
+        std::inplace_merge(index.begin(), sortedEnd, index.end(), KeyLess());
+        sorted_count = index.size();
+    }
+
+    /**
+     * Merge all items of other into this, the items of other override the same keys of this.
+     * A small other (a child cache flushed per tx) is merged item by item: the existing keys are
+     * overridden in place and the new ones go to the insert buffer. Otherwise both indexes are
+     * sorted first and rebuilt in one linear merge, instead of one search per item.
+     * The values of the existing keys are assigned in place, so their references stay valid.
+     * The items of other are moved, other is empty after the merge.
+     */
+    void Merge(CDBFlatMap &&other) {
+        if (other.empty())
+            return;
+
+        if (empty()) {
+            clear();
+            Swap(other);
+            return;
+        }
+
+        if (other.index.size() * MERGE_REBUILD_RATIO < index.size()) {
+            for (auto pItem : other.index) {
+                size_t pos = FindIndex(pItem->first);
+                if (pos != index.size())
+                    index[pos]->second = std::move(pItem->second);
+                else
+                    Append(pItem->first, std::move(pItem->second));
+            }
+            other.clear();
+            return;
+        }
+
+        other.Normalize();
+        Normalize();
+
+        Index merged;
+        merged.reserve(index.size() + other.index.size());
+        auto it = index.begin(), otherIt = other.index.begin();
+        while (it != index.end() && otherIt != other.index.end()) {
+            if ((*it)->first < (*otherIt)->first) {
+                merged.push_back(*it++);
+            } else if ((*otherIt)->first < (*it)->first) {
+                merged.push_back(NewSlot((*otherIt)->first, std::move((*otherIt)->second)));
+                otherIt++;
+            } else {
+                (*it)->second = std::move((*otherIt)->second);
+                merged.push_back(*it++);
+                otherIt++;
+            }
+        }
+        merged.insert(merged.end(), it, index.end());
+        for (; otherIt != other.index.end(); otherIt++) {
+            merged.push_back(NewSlot((*otherIt)->first, std::move((*otherIt)->second)));
+        }
+
+        index.swap(merged);
+        sorted_count = index.size();
+        other.clear();
+    }
+
+private:
+    // the merge rebuilds the sorted index only if other has more than 1/MERGE_REBUILD_RATIO of the items of this
+    static const size_t MERGE_REBUILD_RATIO = 16;
+
+    struct KeyLess {
+        bool operator()(const value_type *pItem, const K &key) const { return pItem->first < key; }
+        bool operator()(const K &key, const value_type *pItem) const { return key < pItem->first; }
+        bool operator()(const value_type *a, const value_type *b) const { return a->first < b->first; }
+    };
+
+    // return index.size() if not found
+    size_t FindIndex(const K &key) const {
+        auto sortedEnd = index.begin() + sorted_count;
+        auto it = std::lower_bound(index.begin(), sortedEnd, key, KeyLess());
+        if (it != sortedEnd && !(key < (*it)->first))
+            return it - index.begin();
+
+        for (size_t i = sorted_count; i < index.size(); i++) {
+            if (!(index[i]->first < key) && !(key < index[i]->first))
+                return i;
+        }
+        return index.size();
+    }
+
+    value_type* NewSlot(const K &key, V value) {
+        if (free_slots.empty()) {
+            arena.emplace_back(key, std::move(value));
+            return &arena.back();
+        }
+
+        value_type *pSlot = free_slots.back();
+        free_slots.pop_back();
+        pSlot->first  = key;
+        pSlot->second = std::move(value);
+        return pSlot;
+    }
+
+    // release the memory owned by the item, the slot is reused by the next insertion
+    void FreeSlot(value_type *pSlot) {
+        *pSlot = value_type();
+        free_slots.push_back(pSlot);
+    }
+
+    iterator Append(const K &key, V value) {
+        index.push_back(NewSlot(key, std::move(value)));
+        size_t bufferSize = std::max<size_t>(MIN_INSERT_BUFFER_SIZE, std::sqrt((double)sorted_count));
+        if (index.size() - sorted_count <= bufferSize)
+            return iterator(index.end() - 1);
+
+        Normalize();
+        return iterator(std::lower_bound(index.begin(), index.end(), key, KeyLess()));
+    }
+
+    void CopyFrom(const CDBFlatMap &other) {
+        index.reserve(other.index.size());
+        for (auto pItem : other.index) {
+            arena.push_back(*pItem);
+            index.push_back(&arena.back());
+        }
+        sorted_count = other.sorted_count;
+    }
+
+    // the deques swap their blocks, the items do not move
+    void Swap(CDBFlatMap &other) {
+        arena.swap(other.arena);
+        free_slots.swap(other.free_slots);
+        index.swap(other.index);
+        std::swap(sorted_count, other.sorted_count);
+    }
+
+private:
+    std::deque<value_type> arena;
+    std::vector<value_type*> free_slots;
+    Index index;
+    size_t sorted_count = 0;
+};
+
+#endif  // PERSIST_DB_FLAT_MAP_H
@@ -58,7 +58,7 @@ private:
 public:
     CDBAccessIterator(CacheType &dbCache)
         : Base(dbCache), p_db_it(nullptr) {
-        p_db_it = this->db_cache.GetDbAccessPtr()->NewIterator();
+        p_db_it = this->db_cache.GetDbAccessPtr()->NewIterator(dbk::GetKeyPrefix(CacheType::PREFIX_TYPE));
     }
 
     bool First() {
@@ -70,9 +70,10 @@ public:
     bool SeekUpper(const KeyType *pKey) {
         if (pKey == nullptr || db_util::IsEmpty(*pKey))
             return First();
-        string lastKeyStr = dbk::GenDbKey(CacheType::PREFIX_TYPE, *pKey);
-        p_db_it->Seek(lastKeyStr);
-        if (p_db_it->Valid() && p_db_it->key() == Slice(lastKeyStr)) {
+        dbk::CDBKey<KeyType> lastKey(CacheType::PREFIX_TYPE, *pKey);
+        const Slice &slLastKey = lastKey.GetSlice();
+        p_db_it->Seek(slLastKey);
+        if (p_db_it->Valid() && p_db_it->key() == slLastKey) {
             p_db_it->Next(); // skip the last key
         }
 
@@ -89,9 +90,10 @@ private:
         this->is_valid = false;
         if (!p_db_it->Valid() || !p_db_it->key().starts_with(prefixStr)) return false;
 
+        // the key is decoded in place from the iterator slice
         const leveldb::Slice &slKey = p_db_it->key();
         const leveldb::Slice &slValue = p_db_it->value();
-        if (!ParseDbKey(slKey, CacheType::PREFIX_TYPE, *this->sp_key)) {
+        if (!dbk::ParseDbKey(slKey, CacheType::PREFIX_TYPE, *this->sp_key)) {
             throw runtime_error(strprintf("CDBAccessIterator::ProcessData db key error! key=%s", HexStr(slKey.ToString())));
         }
 
@@ -427,4 +429,31 @@ public:
     }
 };
 
+/**
+ * CDBRangeIterator
+ * Iterate the keys which are less than the end key, the data of all cache layers and db are merged
+ * lazily, the erased (empty) data of the upper layers hides the data of the lower layers.
+ * The caller can stop at any time, only the current element of each layer is kept in memory.
+ */
+template<typename CacheType>
+class CDBRangeIterator: public CDbIterator<CacheType> {
+private:
+    typedef CDbIterator<CacheType> Base;
+    typedef typename CacheType::KeyType KeyType;
+    typedef typename CacheType::ValueType ValueType;
+protected:
+    KeyType end_key;
+public:
+    CDBRangeIterator(CacheType &dbCache, const KeyType &endKeyIn)
+        : Base(dbCache), end_key(endKeyIn) {}
+
+    virtual bool IsValid() const {
+        return Base::IsValid() && this->GetKey() < end_key;
+    }
+
+    const KeyType& GetEndKey() const {
+        return end_key;
+    }
+};
+
 #endif //PERSIST_DB_ITERATOR_H
\ No newline at end of file
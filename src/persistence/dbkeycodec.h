@@ -0,0 +1,166 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_KEY_CODEC_H
+#define PERSIST_DB_KEY_CODEC_H
+
+#include "commons/leb128.h"
+#include "commons/serialize.h"
+#include "commons/uint256.h"
+#include "config/version.h"
+
+#include <leveldb/slice.h>
+
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace dbk {
+
+    // max size of the key prefix, see DBK_PREFIX_LIST
+    static const uint32_t MAX_KEY_PREFIX_SIZE = 4;
+    // inline buffer size of the variable size keys, the longer keys go to the heap
+    static const uint32_t DEFAULT_KEY_INLINE_SIZE = 64;
+
+    /**
+     * CDBKeySize<T>::SIZE is the serialized size of the fixed size key element, known at compile time,
+     * 0 means variable size. The custom key type declares its fixed size by static member KEY_SIZE.
+     */
+    template<typename T, typename Enable = void>
+    struct CDBKeySize { static const uint32_t SIZE = 0; };
+
+    template<typename T>
+    struct CDBKeySize<T, typename std::enable_if<std::is_arithmetic<T>::value>::type> {
+        static const uint32_t SIZE = sizeof(T);
+    };
+
+    template<typename T>
+    struct CDBKeySize<T, std::void_t<decltype(T::KEY_SIZE)>> { static const uint32_t SIZE = T::KEY_SIZE; };
+
+    template<typename I, typename U>
+    struct CDBKeySize<CFixedLeb128<I, U>> { static const uint32_t SIZE = CFixedLeb128<I, U>::SIZE; };
+
+    template<> struct CDBKeySize<uint160> { static const uint32_t SIZE = uint160::WIDTH; };
+    template<> struct CDBKeySize<uint256> { static const uint32_t SIZE = uint256::WIDTH; };
+
+    template<typename... Ts>
+    struct CDBKeySizeSum { static const uint32_t SIZE = 0; };
+
+    template<typename T, typename... Ts>
+    struct CDBKeySizeSum<T, Ts...> {
+        static const uint32_t SIZE = (CDBKeySize<T>::SIZE == 0 || (sizeof...(Ts) > 0 && CDBKeySizeSum<Ts...>::SIZE == 0))
+                                         ? 0 : CDBKeySize<T>::SIZE + CDBKeySizeSum<Ts...>::SIZE;
+    };
+
+    template<typename T0, typename T1>
+    struct CDBKeySize<std::pair<T0, T1>> { static const uint32_t SIZE = CDBKeySizeSum<T0, T1>::SIZE; };
+
+    template<typename... Ts>
+    struct CDBKeySize<std::tuple<Ts...>> { static const uint32_t SIZE = CDBKeySizeSum<Ts...>::SIZE; };
+
+    /**
+     * CDBKeyWriter
+     * Serialize stream of the db key on the stack buffer, without heap allocation unless the key
+     * is longer than INLINE_SIZE. The encoded key is passed to leveldb as a Slice.
+     */
+    template<uint32_t INLINE_SIZE>
+    class CDBKeyWriter {
+    public:
+        CDBKeyWriter(): nType(SER_DISK), nVersion(CLIENT_VERSION) {}
+
+        void write(const char *pch, size_t size) {
+            if (!is_on_heap) {
+                if (len + size <= INLINE_SIZE) {
+                    memcpy(buf + len, pch, size);
+                    len += size;
+                    return;
+                }
+                heap.assign(buf, len);
+                is_on_heap = true;
+            }
+            heap.append(pch, size);
+        }
+
+        template<typename T>
+        CDBKeyWriter& operator<<(const T &obj) {
+            ::Serialize(*this, obj, nType, nVersion);
+            return *this;
+        }
+
+        leveldb::Slice GetSlice() const { return is_on_heap ? leveldb::Slice(heap) : leveldb::Slice(buf, len); }
+        std::string ToString() const { return GetSlice().ToString(); }
+
+        int GetType() const { return nType; }
+        int GetVersion() const { return nVersion; }
+
+    private:
+        char buf[INLINE_SIZE];
+        size_t len      = 0;
+        bool is_on_heap = false;
+        std::string heap;
+        int nType;
+        int nVersion;
+    };
+
+    /**
+     * CDBKeyReader
+     * Unserialize stream which reads the db key (or any serialized data) in place from the leveldb Slice.
+     */
+    class CDBKeyReader {
+    public:
+        CDBKeyReader(const leveldb::Slice &slice)
+            : pCur(slice.data()), pEnd(slice.data() + slice.size()), nType(SER_DISK), nVersion(CLIENT_VERSION) {}
+
+        void read(char *pch, size_t size) {
+            if (size > this->size())
+                throw std::ios_base::failure("CDBKeyReader::read : end of data");
+            memcpy(pch, pCur, size);
+            pCur += size;
+        }
+
+        void ignore(size_t size) {
+            if (size > this->size())
+                throw std::ios_base::failure("CDBKeyReader::ignore : end of data");
+            pCur += size;
+        }
+
+        // the next size bytes in place, without copy
+        leveldb::Slice ReadSlice(size_t size) {
+            if (size > this->size())
+                throw std::ios_base::failure("CDBKeyReader::ReadSlice : end of data");
+            leveldb::Slice slice(pCur, size);
+            pCur += size;
+            return slice;
+        }
+
+        template<typename T>
+        CDBKeyReader& operator>>(T &obj) {
+            ::Unserialize(*this, obj, nType, nVersion);
+            return *this;
+        }
+
+        // size of the unread data
+        size_t size() const { return pEnd - pCur; }
+        bool empty() const { return pCur == pEnd; }
+
+        int GetType() const { return nType; }
+        int GetVersion() const { return nVersion; }
+
+    private:
+        const char *pCur;
+        const char *pEnd;
+        int nType;
+        int nVersion;
+    };
+
+    template<typename KeyElement>
+    struct CDBKeyInlineSize {
+        static const uint32_t SIZE = MAX_KEY_PREFIX_SIZE +
+            (CDBKeySize<KeyElement>::SIZE > 0 ? CDBKeySize<KeyElement>::SIZE : DEFAULT_KEY_INLINE_SIZE);
+    };
+}
+
+#endif  // PERSIST_DB_KEY_CODEC_H
@@ -0,0 +1,195 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "dbprofile.h"
+
+#include "commons/random.h"
+#include "commons/util/util.h"
+#include "config/chainparams.h"
+#include "leveldbwrapper.h"
+#include "logging.h"
+
+#include <boost/filesystem.hpp>
+
+bool ParseDBProfile(const std::string &name, DBProfileType &profileType) {
+    for (int32_t i = 0; i < DB_PROFILE_COUNT; i++) {
+        if (name == kDBProfiles[i].name) {
+            profileType = (DBProfileType)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+DBProfileType GetDBProfileType(const std::string &dbName, DBProfileType defaultType) {
+    DBProfileType profileType = defaultType;
+    // the later args win, -dbprofile=<profile> applies to all the dbs
+    for (const auto &arg : SysCfg().GetMultiArgs("-dbprofile")) {
+        std::string::size_type pos = arg.find(':');
+        std::string profileName    = arg;
+        if (pos != std::string::npos) {
+            if (arg.substr(0, pos) != dbName)
+                continue;
+            profileName = arg.substr(pos + 1);
+        }
+        if (!ParseDBProfile(profileName, profileType))
+            LogPrint(BCLog::ERROR, "%s, unknown db profile %s of -dbprofile=%s\n", __func__, profileName, arg);
+    }
+    return profileType;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class CDBTraceWriter
+
+CDBTraceWriter::~CDBTraceWriter() {
+    if (file)
+        fclose(file);
+}
+
+std::shared_ptr<CDBTraceWriter> CDBTraceWriter::Create(const std::string &dbName) {
+    if (!SysCfg().GetBoolArg("-dbtrace", false))
+        return nullptr;
+
+    boost::filesystem::path traceDir = GetDataDir() / "dbtraces";
+    TryCreateDirectory(traceDir);
+    boost::filesystem::path tracePath = traceDir / (dbName + ".trace");
+    FILE *file = fopen(tracePath.string().c_str(), "ab");
+    if (!file) {
+        LogPrint(BCLog::ERROR, "%s, open db trace %s failed\n", __func__, tracePath.string());
+        return nullptr;
+    }
+    LogPrint(BCLog::INFO, "%s, tracing db %s to %s\n", __func__, dbName, tracePath.string());
+    return std::make_shared<CDBTraceWriter>(file);
+}
+
+void CDBTraceWriter::Add(OpType op, const leveldb::Slice &key, uint32_t valueSize) {
+    uint32_t keySize = key.size();
+    std::lock_guard<std::mutex> lock(trace_mutex);
+    fwrite(&op, sizeof(op), 1, file);
+    fwrite(&keySize, sizeof(keySize), 1, file);
+    if (keySize > 0)
+        fwrite(key.data(), 1, keySize, file);
+    fwrite(&valueSize, sizeof(valueSize), 1, file);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// replay of the db trace
+
+static bool ReadTraceRecord(FILE *file, uint8_t &op, std::string &key, uint32_t &valueSize) {
+    uint32_t keySize = 0;
+    if (fread(&op, sizeof(op), 1, file) != 1 || fread(&keySize, sizeof(keySize), 1, file) != 1)
+        return false;
+    key.resize(keySize);
+    if (keySize > 0 && fread(&key[0], 1, keySize, file) != keySize)
+        return false;
+    return fread(&valueSize, sizeof(valueSize), 1, file) == 1;
+}
+
+static uint64_t GetDirSize(const boost::filesystem::path &dir) {
+    uint64_t size = 0;
+    for (boost::filesystem::recursive_directory_iterator it(dir), end; it != end; it++) {
+        if (boost::filesystem::is_regular_file(it->path()))
+            size += boost::filesystem::file_size(it->path());
+    }
+    return size;
+}
+
+bool ReplayDBTrace(const boost::filesystem::path &traceFile, const boost::filesystem::path &dbDir,
+                   DBProfileType profileType, size_t cacheSize, CDBBenchResult &result) {
+    FILE *file = fopen(traceFile.string().c_str(), "rb");
+    if (!file)
+        return ERRORMSG("%s, open db trace %s failed", __func__, traceFile.string());
+
+    // the values are not traced, replay them with the random bytes of the traced size
+    std::string valueBuf = GetRandHash().GetHex();
+    while (valueBuf.size() < (1 << 16))
+        valueBuf += valueBuf;
+
+    {
+        CLevelDBWrapper db(dbDir, cacheSize, false, true, profileType);
+        CLevelDBBatch batch;
+        std::unique_ptr<leveldb::Iterator> pCursor;
+        uint8_t op;
+        std::string key;
+        uint32_t valueSize;
+        while (ReadTraceRecord(file, op, key, valueSize)) {
+            if (op == 0 || op > CDBTraceWriter::NEXT) {
+                fclose(file);
+                return ERRORMSG("%s, bad op %d in db trace %s", __func__, op, traceFile.string());
+            }
+            result.op_counts[op]++;
+
+            int64_t beginTime = GetTimeMicros();
+            switch (op) {
+                case CDBTraceWriter::GET:
+                    db.Exists(key);
+                    result.read_us += GetTimeMicros() - beginTime;
+                    break;
+                case CDBTraceWriter::PUT:
+                    while (valueBuf.size() < valueSize)
+                        valueBuf += valueBuf;
+                    batch.WriteSerialized(key, valueBuf.substr(0, valueSize));
+                    break;
+                case CDBTraceWriter::ERASE:
+                    batch.Erase(key);
+                    break;
+                case CDBTraceWriter::WRITE:
+                    db.WriteBatch(batch, valueSize != 0);
+                    batch.Clear();
+                    result.write_us += GetTimeMicros() - beginTime;
+                    break;
+                case CDBTraceWriter::SEEK:
+                    pCursor.reset(db.NewIterator());
+                    if (key.empty())
+                        pCursor->SeekToFirst();
+                    else
+                        pCursor->Seek(key);
+                    result.read_us += GetTimeMicros() - beginTime;
+                    break;
+                case CDBTraceWriter::NEXT:
+                    if (pCursor && pCursor->Valid())
+                        pCursor->Next();
+                    result.read_us += GetTimeMicros() - beginTime;
+                    break;
+            }
+        }
+    }
+    fclose(file);
+
+    result.disk_bytes = GetDirSize(dbDir);
+    return true;
+}
+
+bool BenchDBProfiles(const std::string &traceFile) {
+    if (SysCfg().GetBoolArg("-dbtrace", false))
+        return ERRORMSG("%s, -dbbench can not be used with -dbtrace", __func__);
+
+    // the trace file is named by the db, bench with the cache size of the db
+    const std::string dbName = boost::filesystem::path(traceFile).stem().string();
+    size_t cacheSize         = 8 << 20;
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+        if (dbName == GetDbName((DBNameType)i))
+            cacheSize = DBCacheSize[i];
+    }
+
+    printf("replay %s, cache=%lluKB\n", traceFile.c_str(), (unsigned long long)(cacheSize >> 10));
+    printf("%-12s %10s %10s %10s %10s %10s %12s %12s %12s\n", "profile", "gets", "puts", "erases", "writes", "seeks",
+           "read_ms", "write_ms", "disk_kb");
+    for (int32_t i = 0; i < DB_PROFILE_COUNT; i++) {
+        boost::filesystem::path dbDir = GetDataDir() / "dbbench" / kDBProfiles[i].name;
+        CDBBenchResult result;
+        if (!ReplayDBTrace(traceFile, dbDir, (DBProfileType)i, cacheSize, result))
+            return false;
+
+        printf("%-12s %10llu %10llu %10llu %10llu %10llu %12.3f %12.3f %12llu\n", kDBProfiles[i].name,
+               (unsigned long long)result.op_counts[CDBTraceWriter::GET],
+               (unsigned long long)result.op_counts[CDBTraceWriter::PUT],
+               (unsigned long long)result.op_counts[CDBTraceWriter::ERASE],
+               (unsigned long long)result.op_counts[CDBTraceWriter::WRITE],
+               (unsigned long long)result.op_counts[CDBTraceWriter::SEEK], result.read_us / 1000.0,
+               result.write_us / 1000.0, (unsigned long long)(result.disk_bytes >> 10));
+        boost::filesystem::remove_all(dbDir);
+    }
+    return true;
+}
@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_DB_PROFILE_H
+#define PERSIST_DB_PROFILE_H
+
+#include <leveldb/slice.h>
+#include <boost/filesystem/path.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#define DEF_DB_PROFILE_ENUM(enumType, name, blockSize, bloomBits, cachePercent, writeBufferPercent, compression, maxOpenFiles, iterFillCache) \
+    DB_PROFILE_##enumType,
+#define DEF_DB_PROFILE_ARRAY(enumType, name, blockSize, bloomBits, cachePercent, writeBufferPercent, compression, maxOpenFiles, iterFillCache) \
+    { name, blockSize, bloomBits, cachePercent, writeBufferPercent, compression, maxOpenFiles, iterFillCache },
+
+// leveldb keeps up to 10 files other than the tables open, and raises a smaller max_open_files to this
+static const int32_t DB_MIN_OPEN_FILES = 64 + 10;
+
+// The leveldb option profiles. The default profile of every db is in DB_NAME_LIST, -dbprofile=<db>:<profile>
+// overrides it. Cache% and WriteBuffer% are the shares of the db cache size, up to two write buffers may be
+// held in memory simultaneously. The compressed blocks are stored uncompressed if leveldb is built without snappy.
+// MaxOpenFiles can not be below DB_MIN_OPEN_FILES.
+//
+//          ProfileType    name           BlockSize   BloomBits  Cache%  WriteBuffer%  Compression  MaxOpenFiles        IterFillCache
+#define DB_PROFILE_LIST(DEFINE)                                                                                                          \
+    DEFINE( DEFAULT,       "default",     (4  << 10),  10,        50,     25,           false,       DB_MIN_OPEN_FILES,  false )         \
+    DEFINE( RANDOM_READ,   "randomread",  (4  << 10),  16,        75,     12,           false,       256,                true  )         \
+    DEFINE( APPEND,        "append",      (16 << 10),  10,        25,     50,           false,       DB_MIN_OPEN_FILES,  false )         \
+    DEFINE( WRITE_ONCE,    "writeonce",   (32 << 10),  10,        12,     50,           true,        DB_MIN_OPEN_FILES,  false )
+
+// DEFAULT:      mixed access
+// RANDOM_READ:  hot random reads and repeated scans of the hot ranges, e.g. accounts
+// APPEND:       append mostly, the recent keys are read, e.g. block index
+// WRITE_ONCE:   written once and rarely read, e.g. receipts & logs
+enum DBProfileType {
+    DB_PROFILE_LIST(DEF_DB_PROFILE_ENUM)
+    DB_PROFILE_COUNT
+};
+
+struct CDBProfile {
+    const char *name;
+    uint32_t block_size;            // uncompressed bytes per block
+    uint32_t bloom_bits_per_key;    // 0: no bloom filter
+    uint32_t block_cache_percent;
+    uint32_t write_buffer_percent;
+    bool compression;
+    int32_t max_open_files;
+    bool iter_fill_cache;           // put the blocks read by the iterators into the block cache
+};
+
+static const CDBProfile kDBProfiles[DB_PROFILE_COUNT] = {
+    DB_PROFILE_LIST(DEF_DB_PROFILE_ARRAY)
+};
+
+// the files a db of the profile may keep open
+inline int32_t GetDBOpenFiles(DBProfileType profileType) {
+    return kDBProfiles[profileType].max_open_files;
+}
+
+bool ParseDBProfile(const std::string &name, DBProfileType &profileType);
+
+// the profile of the db, -dbprofile overrides the default one, the db name is the dir name of the db
+DBProfileType GetDBProfileType(const std::string &dbName, DBProfileType defaultType);
+
+/**
+ * CDBTraceWriter
+ * Record the reads, writes and iterator moves of a db (-dbtrace), the trace can be replayed against
+ * every profile by -dbbench. A record is {op}{key size}{key}{value size}, the values are not kept.
+ */
+class CDBTraceWriter {
+public:
+    enum OpType: uint8_t {
+        GET     = 1,
+        PUT     = 2,
+        ERASE   = 3,
+        WRITE   = 4,    // write the batch of the PUT and ERASE before, value size is 1 for the sync write
+        SEEK    = 5,    // create an iterator and seek it to the key
+        NEXT    = 6,
+    };
+
+public:
+    CDBTraceWriter(FILE *fileIn): file(fileIn) {}
+    ~CDBTraceWriter();
+
+    // nullptr if -dbtrace is not set
+    static std::shared_ptr<CDBTraceWriter> Create(const std::string &dbName);
+
+    void Add(OpType op, const leveldb::Slice &key = leveldb::Slice(), uint32_t valueSize = 0);
+
+private:
+    std::mutex trace_mutex;
+    FILE *file;
+};
+
+struct CDBBenchResult {
+    uint64_t op_counts[CDBTraceWriter::NEXT + 1] = {0};
+    int64_t read_us     = 0;    // GET, SEEK and NEXT
+    int64_t write_us    = 0;
+    uint64_t disk_bytes = 0;
+};
+
+// replay the trace against an empty db of the profile in dbDir
+bool ReplayDBTrace(const boost::filesystem::path &traceFile, const boost::filesystem::path &dbDir,
+                   DBProfileType profileType, size_t cacheSize, CDBBenchResult &result);
+
+// -dbbench: replay the trace against every profile and print the results
+bool BenchDBProfiles(const std::string &traceFile);
+
+#endif  // PERSIST_DB_PROFILE_H
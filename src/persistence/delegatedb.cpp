@@ -146,10 +146,6 @@ bool CDelegateDBCache::GetCandidateVotes(const CRegID &regId, vector<CCandidateR
     return regId2VoteCache.GetData(regId, candidateVotes);
 }
 
-bool CDelegateDBCache::GetVoterList(map<CRegIDKey, vector<CCandidateReceivedVote>> &regId2Vote) {
-    return regId2VoteCache.GetAllElements(regId2Vote);
-}
-
 bool CDelegateDBCache::Flush() {
     voteRegIdCache.Flush();
     regId2VoteCache.Flush();
@@ -178,4 +174,8 @@ void CDelegateDBCache::Clear() {
 
 shared_ptr<CTopDelegatesIterator> CDelegateDBCache::CreateTopDelegateIterator() {
     return make_shared<CTopDelegatesIterator>(voteRegIdCache);
+}
+
+shared_ptr<CVoterIterator> CDelegateDBCache::CreateVoterIterator() {
+    return make_shared<CVoterIterator>(regId2VoteCache);
 }
\ No newline at end of file
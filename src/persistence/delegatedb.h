@@ -25,6 +25,10 @@ using namespace std;
     // {vote(MAX - $votedBcoins)}{$RegId} -> 1
     // vote(MAX - $votedBcoins) save as CFixedUInt64 to ensure that the keys are sorted by vote value from big to small
 typedef CCompositeKVCache<dbk::VOTE,  std::pair<CFixedUInt64, CRegIDKey>,  uint8_t>         CVoteRegIdCache;
+    // {$RegId} -> received votes of the candidates which the voter voted
+typedef CCompositeKVCache<dbk::REGID_VOTE, CRegIDKey,         vector<CCandidateReceivedVote>> CRegIdVoteCache;
+
+using CVoterIterator = CDbIterator<CRegIdVoteCache>;
 
 class CTopDelegatesIterator: public CDbIterator<CVoteRegIdCache> {
 public:
@@ -75,7 +79,6 @@ public:
     bool GetCandidateVotes(const CRegID &regid, vector<CCandidateReceivedVote> &candidateVotes);
 
     // There’s no reason to worry about performance issues as it will used only in stable coin genesis height.
-    bool GetVoterList(map<CRegIDKey, vector<CCandidateReceivedVote>> &regId2Vote);
 
     bool Flush();
     uint32_t GetCacheSize() const;
@@ -106,6 +109,8 @@ public:
     }
 
     shared_ptr<CTopDelegatesIterator> CreateTopDelegateIterator();
+    // iterate all voters in the order of regid
+    shared_ptr<CVoterIterator> CreateVoterIterator();
 public:
 /*  CCompositeKVCache  prefixType     key                              value                   variable       */
 /*  -------------------- -------------- --------------------------  ----------------------- -------------- */
@@ -113,7 +118,7 @@ public:
     // vote(MAX - $votedBcoins) save as CFixedUInt64 to ensure that the keys are sorted by vote value from big to small
     CVoteRegIdCache voteRegIdCache;
 
-    CCompositeKVCache<dbk::REGID_VOTE, CRegIDKey,         vector<CCandidateReceivedVote>> regId2VoteCache;
+    CRegIdVoteCache regId2VoteCache;
 
     CSimpleKVCache<dbk::LAST_VOTE_HEIGHT, CVarIntValue<uint32_t>> last_vote_height_cache;
     CSimpleKVCache<dbk::PENDING_DELEGATES, PendingDelegates> pending_delegates_cache;
@@ -94,8 +94,8 @@ public:
     using CDexOrderIt::CDexOrderIt;
 
     bool First(DEXBlockOrdersCache::KeyType lastPosKey) {
-        p_db_it = db_cache.GetDbAccessPtr()->NewIterator();
         prefix = dbk::GetKeyPrefix(DEXBlockOrdersCache::PREFIX_TYPE);
+        p_db_it = db_cache.GetDbAccessPtr()->NewIterator(prefix);
         last_pos_key = dbk::GenDbKey(DEXBlockOrdersCache::PREFIX_TYPE, lastPosKey);
         p_db_it->Seek(last_pos_key);
         if (p_db_it->Valid() && p_db_it->key() == last_pos_key) {
@@ -258,8 +258,8 @@ public:
     CDBDexSysOrderIt(CDBAccess &dbAccess, const CFixedUInt32 &heightIn)
         : key(), value(), height(heightIn), is_valid(false) {
 
-        p_db_it = dbAccess.NewIterator();
         prefix = dbk::GenDbKey(DEXBlockOrdersCache::PREFIX_TYPE, make_pair(height, (uint8_t)SYSTEM_GEN_ORDER));
+        p_db_it = dbAccess.NewIterator(prefix);
     }
 
     bool First() {
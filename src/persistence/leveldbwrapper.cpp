@@ -40,23 +40,74 @@ std::string CDBOpLogMap::ToString() const {
     return str;
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize) {
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBProfile &profile) {
     leveldb::Options options;
-    options.block_cache       = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4;  // up to two write buffers may be held in memory simultaneously
-    options.filter_policy     = leveldb::NewBloomFilterPolicy(10);
-    options.compression       = leveldb::kNoCompression;
-    options.max_open_files    = 64;
+    options.block_cache       = leveldb::NewLRUCache(nCacheSize * profile.block_cache_percent / 100);
+    options.write_buffer_size = nCacheSize * profile.write_buffer_percent / 100;
+    options.block_size        = profile.block_size;
+    options.filter_policy     = profile.bloom_bits_per_key > 0 ?
+                                leveldb::NewBloomFilterPolicy(profile.bloom_bits_per_key) : nullptr;
+    options.compression       = profile.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files    = profile.max_open_files;
     return options;
 }
 
-CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory, bool fWipe) {
+namespace {
+// record the seeks and moves of the iterator to the trace
+class CTraceIterator: public leveldb::Iterator {
+public:
+    CTraceIterator(leveldb::Iterator *pIterIn, const std::shared_ptr<CDBTraceWriter> &spTraceIn)
+        : pIter(pIterIn), spTrace(spTraceIn) {}
+    ~CTraceIterator() override { delete pIter; }
+
+    bool Valid() const override { return pIter->Valid(); }
+    void SeekToFirst() override {
+        spTrace->Add(CDBTraceWriter::SEEK);
+        pIter->SeekToFirst();
+    }
+    void SeekToLast() override { pIter->SeekToLast(); }
+    void Seek(const leveldb::Slice &target) override {
+        spTrace->Add(CDBTraceWriter::SEEK, target);
+        pIter->Seek(target);
+    }
+    void Next() override {
+        spTrace->Add(CDBTraceWriter::NEXT);
+        pIter->Next();
+    }
+    void Prev() override { pIter->Prev(); }
+    leveldb::Slice key() const override { return pIter->key(); }
+    leveldb::Slice value() const override { return pIter->value(); }
+    leveldb::Status status() const override { return pIter->status(); }
+
+private:
+    leveldb::Iterator *pIter;
+    std::shared_ptr<CDBTraceWriter> spTrace;
+};
+
+class CTraceBatchHandler: public leveldb::WriteBatch::Handler {
+public:
+    CTraceBatchHandler(CDBTraceWriter &traceIn): trace(traceIn) {}
+
+    void Put(const leveldb::Slice &key, const leveldb::Slice &value) override {
+        trace.Add(CDBTraceWriter::PUT, key, value.size());
+    }
+    void Delete(const leveldb::Slice &key) override { trace.Add(CDBTraceWriter::ERASE, key); }
+
+private:
+    CDBTraceWriter &trace;
+};
+}  // namespace
+
+CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory, bool fWipe,
+                                 DBProfileType profileType) {
+    assert(profileType < DB_PROFILE_COUNT);
+    const CDBProfile &profile    = kDBProfiles[profileType];
     penv                         = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
-    iteroptions.fill_cache       = false;
+    iteroptions.fill_cache       = profile.iter_fill_cache;
     syncoptions.sync             = true;
-    options                      = GetOptions(nCacheSize);
+    options                      = GetOptions(nCacheSize, profile);
     options.create_if_missing    = true;
     if (fMemory) {
         penv        = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -67,7 +118,8 @@ CLevelDBWrapper::CLevelDBWrapper(const boost::filesystem::path &path, size_t nCa
             leveldb::DestroyDB(path.string(), options);
         }
         TryCreateDirectory(path);
-        LogPrint(BCLog::INFO, "Opening LevelDB in %s\n", path.string());
+        LogPrint(BCLog::INFO, "Opening LevelDB in %s, profile=%s\n", path.string(), profile.name);
+        spTrace = CDBTraceWriter::Create(path.filename().string());
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     ThrowError(status);
@@ -86,11 +138,30 @@ CLevelDBWrapper::~CLevelDBWrapper() {
 }
 
 bool CLevelDBWrapper::WriteBatch(CLevelDBBatch &batch, bool fSync) {
+    if (spTrace) {
+        CTraceBatchHandler handler(*spTrace);
+        batch.Iterate(&handler);
+        spTrace->Add(CDBTraceWriter::WRITE, leveldb::Slice(), fSync ? 1 : 0);
+    }
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     ThrowError(status);
     return true;
 }
 
+leveldb::Iterator *CLevelDBWrapper::NewIterator() {
+    leveldb::Iterator *pIter = pdb->NewIterator(iteroptions);
+    if (spTrace)
+        return new CTraceIterator(pIter, spTrace);
+    return pIter;
+}
+
+leveldb::Iterator *CLevelDBWrapper::NewIterator(const leveldb::Snapshot *pSnapshot) {
+    leveldb::ReadOptions options = iteroptions;
+    options.snapshot             = pSnapshot;
+    options.fill_cache           = false;
+    return pdb->NewIterator(options);
+}
+
 int64_t CLevelDBWrapper::GetDbCount() {
     leveldb::Iterator *pCursor = NewIterator();
     int64_t ret                = 0;
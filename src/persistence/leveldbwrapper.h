@@ -15,6 +15,7 @@
 #include <boost/filesystem/path.hpp>
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
+#include <memory>
 
 using namespace json_spirit;
 
@@ -24,6 +25,8 @@ private:
     string value;
 public:
     CDbOpLog() {}
+    // the key and value are serialized already
+    CDbOpLog(const string &keyIn, const string &valueIn): key(keyIn), value(valueIn) {}
 
     // for key-value
     template<typename K, typename V>
@@ -86,6 +89,8 @@ typedef vector<CDbOpLog> CDbOpLogs;
 
 class CDBOpLogMap {
 public:
+    virtual ~CDBOpLogMap() {}
+
     map<string, CDbOpLogs>& GetMap() { return mapDbOpLogs; }
 
     const CDbOpLogs* GetDbOpLogsPtr(dbk::PrefixType prefixType) const {
@@ -98,7 +103,7 @@ public:
         return nullptr;
     }
 
-    void AddOpLog(dbk::PrefixType prefixType, const CDbOpLog& dbOpLogIn) {
+    virtual void AddOpLog(dbk::PrefixType prefixType, const CDbOpLog& dbOpLogIn) {
         assert(prefixType != dbk::EMPTY);
         const string& prefix = dbk::GetKeyPrefix(prefixType);
         mapDbOpLogs[prefix].push_back(dbOpLogIn);
@@ -132,19 +137,30 @@ private:
 
 public:
     template<typename V>
-    void Write(const std::string &key, const V& value) {
-    	leveldb::Slice slKey(key);
+    void Write(const leveldb::Slice &key, const V& value) {
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(ssValue.GetSerializeSize(value));
         ssValue << value;
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
-        batch.Put(slKey, slValue);
+        batch.Put(key, slValue);
     }
 
-    void Erase(const std::string &key) {
+    void Erase(const leveldb::Slice &key) {
         batch.Delete(key);
     }
 
+    // the value is serialized already
+    void WriteSerialized(const std::string &key, const std::string &value) {
+        batch.Put(key, value);
+    }
+
+    leveldb::Status Iterate(leveldb::WriteBatch::Handler *pHandler) const {
+        return batch.Iterate(pHandler);
+    }
+
+    void Clear() {
+        batch.Clear();
+    }
  };
 
 class CLevelDBWrapper {
@@ -170,16 +186,20 @@ private:
     // the database itself
     leveldb::DB *pdb;
 
+    // the access trace of the database, only for -dbtrace
+    std::shared_ptr<CDBTraceWriter> spTrace;
+
 public:
-    CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    CLevelDBWrapper(const boost::filesystem::path &path, size_t nCacheSize, bool fMemory = false, bool fWipe = false,
+                    DBProfileType profileType = DB_PROFILE_DEFAULT);
     ~CLevelDBWrapper();
 
     template<typename V>
-    bool Read(std::string key, V &value) {
-    	leveldb::Slice slKey(key);
-
+    bool Read(const leveldb::Slice &key, V &value) {
+        if (spTrace)
+            spTrace->Add(CDBTraceWriter::GET, key);
         string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(readoptions, key, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -202,10 +222,11 @@ public:
         return WriteBatch(batch, fSync);
     }
 
-    bool Exists(const std::string &key) {
-    	leveldb::Slice slKey(key);
+    bool Exists(const leveldb::Slice &key) {
+        if (spTrace)
+            spTrace->Add(CDBTraceWriter::GET, key);
         string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(readoptions, key, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -234,10 +255,26 @@ public:
     }
 
     // not exactly clean encapsulation, but it's easiest for now
-    leveldb::Iterator *NewIterator() {
-        return pdb->NewIterator(iteroptions);
-    }
+    leveldb::Iterator *NewIterator();
+    // iterate the db as it was when the snapshot was taken, the blocks read are not cached
+    leveldb::Iterator *NewIterator(const leveldb::Snapshot *pSnapshot);
+
+    // the consistent read view of the db, must be released by ReleaseSnapshot()
+    const leveldb::Snapshot *GetSnapshot() { return pdb->GetSnapshot(); }
+    void ReleaseSnapshot(const leveldb::Snapshot *pSnapshot) { pdb->ReleaseSnapshot(pSnapshot); }
     int64_t GetDbCount();
+
+    bool IsEmpty() {
+        std::unique_ptr<leveldb::Iterator> pCursor(NewIterator());
+        pCursor->SeekToFirst();
+        return !pCursor->Valid();
+    }
+
+    // compact the keys in [begin, end)
+    void CompactRange(const std::string &begin, const std::string &end) {
+        leveldb::Slice slBegin(begin), slEnd(end);
+        pdb->CompactRange(&slBegin, &slEnd);
+    }
    // Object ToJsonObj();
 };
 
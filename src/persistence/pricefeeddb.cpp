@@ -140,6 +140,27 @@ bool CPricePointMemCache::AddPrice(const HeightType blockHeight, const CRegID &r
     return true;
 }
 
+void CPricePointMemCache::DropPrice(const HeightType blockHeight, const CRegID &regId,
+                                    const vector<CPricePoint> &pps) {
+    for (const auto &pp : pps) {
+        auto iter = mapCoinPricePointCache.find(pp.GetCoinPricePair());
+        if (iter == mapCoinPricePointCache.end())
+            continue;
+
+        auto &mapBlockUserPrices = iter->second.mapBlockUserPrices;
+        auto blockIter           = mapBlockUserPrices.find(blockHeight);
+        if (blockIter == mapBlockUserPrices.end())
+            continue;
+
+        // an empty height means the prices of the height are deleted, so the height is erased instead
+        blockIter->second.erase(regId);
+        if (blockIter->second.empty())
+            mapBlockUserPrices.erase(blockIter);
+        if (mapBlockUserPrices.empty())
+            mapCoinPricePointCache.erase(iter);
+    }
+}
+
 bool CPricePointMemCache::ExistBlockUserPrice(const HeightType blockHeight, const CRegID &regId,
                                               const PriceCoinPair &coinPricePair) {
     if (mapCoinPricePointCache.count(coinPricePair) &&
@@ -50,6 +50,8 @@ public:
     bool PushBlock(CSysParamDBCache &sysParamCache, CBlockIndex *pTipBlockIdx);
     bool UndoBlock(CSysParamDBCache &sysParamCache, CBlockIndex *pTipBlockIdx);
     bool AddPrice(const HeightType blockHeight, const CRegID &regId, const vector<CPricePoint> &pps);
+    // drop the price points added by AddPrice() to this level, e.g. the price feed tx left the mempool
+    void DropPrice(const HeightType blockHeight, const CRegID &regId, const vector<CPricePoint> &pps);
 
     bool CalcMedianPrices(CCacheWrapper &cw, const HeightType blockHeight, PriceMap &medianPrices);
     bool CalcMedianPriceDetails(CCacheWrapper &cw, const HeightType blockHeight, PriceDetailMap &medianPrices);
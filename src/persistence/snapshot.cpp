@@ -0,0 +1,308 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "snapshot.h"
+
+#include "cachewrapper.h"
+#include "commons/util/util.h"
+#include "commons/util/workerpool.h"
+#include "config/chainparams.h"
+#include "crypto/hash.h"
+#include "logging.h"
+
+#include <boost/filesystem.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <functional>
+
+// the record type of the snapshot end, the chunks start with their db name type
+static const uint8_t SNAPSHOT_END = 0xff;
+
+uint256 CChainSnapshotChunk::ComputeChecksum() const {
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << db_name_type << entry_count << data;
+    return hasher.GetHash();
+}
+
+Object CChainSnapshotStats::ToJson() const {
+    Object obj;
+    obj.push_back(Pair("chunks",        (uint64_t)chunk_count));
+    obj.push_back(Pair("entries",       entry_count));
+    obj.push_back(Pair("data_bytes",    data_bytes));
+    obj.push_back(Pair("state_hash",    state_hash.GetHex()));
+    obj.push_back(Pair("elapsed_ms",    elapsed_ms));
+    return obj;
+}
+
+bool IsSnapshotExcludedPrefix(dbk::PrefixType prefixType) {
+    switch (prefixType) {
+        case dbk::BLOCK_INDEX:
+        case dbk::BLOCKFILE_NUM_INFO:
+        case dbk::LAST_BLOCKFILE:
+        case dbk::REINDEX:
+        case dbk::FLAG:
+        case dbk::VERIFY_PROGRESS:
+        case dbk::TXID_DISKINDEX:
+            return true;
+        default:
+            return false;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// class CChainSnapshotWriter
+
+CChainSnapshotWriter::CChainSnapshotWriter(CCacheDBManager &cdManIn, int32_t height, const uint256 &blockHash)
+    : cdMan(cdManIn) {
+    header.height     = height;
+    header.block_hash = blockHash;
+
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+        CDBAccess *pDbAccess = cdMan.GetDbAccess((DBNameType)i);
+        pDbAccess->SyncPendingWrites();
+        const auto &spStore = pDbAccess->GetStore();
+        if (!dbSnapshots.count(spStore))
+            dbSnapshots[spStore] = spStore->GetSnapshot();
+    }
+}
+
+CChainSnapshotWriter::~CChainSnapshotWriter() {
+    for (const auto &item : dbSnapshots)
+        item.first->ReleaseSnapshot(item.second);
+}
+
+bool CChainSnapshotWriter::WriteToFile(const boost::filesystem::path &path, CChainSnapshotStats &stats) {
+    int64_t beginTime = GetTimeMillis();
+    boost::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+
+    CAutoFile fileout(fopen(tmpPath.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return ERRORMSG("%s, open snapshot file %s failed", __func__, tmpPath.string());
+
+    CHashWriter stateHasher(SER_GETHASH, PROTOCOL_VERSION);
+    try {
+        fileout << FLATDATA(SysCfg().MessageStart()) << header;
+        stateHasher << header;
+
+        CChainSnapshotChunk chunk;
+        auto writeChunk = [&]() {
+            if (chunk.entry_count == 0)
+                return;
+            chunk.checksum = chunk.ComputeChecksum();
+            fileout << chunk;
+            stateHasher << chunk.checksum;
+
+            stats.chunk_count++;
+            stats.entry_count += chunk.entry_count;
+            stats.data_bytes += chunk.data.size();
+            chunk.entry_count = 0;
+            chunk.data.clear();
+        };
+
+        for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+            const auto &spStore = cdMan.GetDbAccess((DBNameType)i)->GetStore();
+            std::unique_ptr<leveldb::Iterator> pCursor(spStore->NewIterator(dbSnapshots[spStore]));
+            chunk.db_name_type = i;
+
+            for (int32_t prefixType = dbk::EMPTY + 1; prefixType < dbk::PREFIX_COUNT; prefixType++) {
+                if (dbk::GetDbNameEnumByPrefix((dbk::PrefixType)prefixType) != i ||
+                    IsSnapshotExcludedPrefix((dbk::PrefixType)prefixType))
+                    continue;
+
+                const string &prefix = dbk::GetKeyPrefix((dbk::PrefixType)prefixType);
+                for (pCursor->Seek(prefix); pCursor->Valid() && pCursor->key().starts_with(prefix); pCursor->Next()) {
+                    boost::this_thread::interruption_point();
+
+                    CDataStream ssEntry(SER_DISK, CLIENT_VERSION);
+                    ssEntry << pCursor->key().ToString() << pCursor->value().ToString();
+                    chunk.data.append(ssEntry.begin(), ssEntry.end());
+                    chunk.entry_count++;
+                    if (chunk.data.size() >= CHUNK_SIZE)
+                        writeChunk();
+                }
+                if (!pCursor->status().ok())
+                    return ERRORMSG("%s, iterate db %s failed, %s", __func__, GetDbName((DBNameType)i),
+                                    pCursor->status().ToString());
+            }
+            writeChunk();
+        }
+
+        stats.state_hash = stateHasher.GetHash();
+        fileout << SNAPSHOT_END << stats.chunk_count << stats.state_hash;
+    } catch (std::exception &e) {
+        return ERRORMSG("%s, write snapshot file %s failed, %s", __func__, tmpPath.string(), e.what());
+    }
+
+    fflush(fileout);
+    FileCommit(fileout);
+    fileout.fclose();
+    if (!RenameOver(tmpPath, path))
+        return ERRORMSG("%s, rename snapshot file to %s failed", __func__, path.string());
+
+    stats.elapsed_ms = GetTimeMillis() - beginTime;
+    LogPrint(BCLog::INFO, "%s, wrote snapshot of block %d:%s to %s, chunks=%u, entries=%llu, state_hash=%s, took %lldms\n",
+             __func__, header.height, header.block_hash.GetHex(), path.string(), stats.chunk_count,
+             stats.entry_count, stats.state_hash.GetHex(), stats.elapsed_ms);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// loading of the snapshot
+
+// verify the chunk and decode its entries into the batch, must not throw
+static bool DecodeSnapshotChunk(const CChainSnapshotChunk &chunk, CLevelDBBatch &batch) {
+    if (chunk.ComputeChecksum() != chunk.checksum)
+        return ERRORMSG("%s, checksum mismatch of the chunk of db %s", __func__,
+                        GetDbName((DBNameType)chunk.db_name_type));
+
+    try {
+        CDataStream ssData(chunk.data.data(), chunk.data.data() + chunk.data.size(), SER_DISK, CLIENT_VERSION);
+        string key, value;
+        for (uint32_t i = 0; i < chunk.entry_count; i++) {
+            ssData >> key >> value;
+            batch.WriteSerialized(key, value);
+        }
+        if (!ssData.empty())
+            return ERRORMSG("%s, the chunk of db %s has extra data", __func__, GetDbName((DBNameType)chunk.db_name_type));
+    } catch (std::exception &e) {
+        return ERRORMSG("%s, decode the chunk of db %s failed, %s", __func__, GetDbName((DBNameType)chunk.db_name_type),
+                        e.what());
+    }
+    return true;
+}
+
+// verify the chunk and write its entries to the store of its db, must not throw
+static bool WriteSnapshotChunk(CCacheDBManager &cdMan, const CChainSnapshotChunk &chunk) {
+    CLevelDBBatch batch;
+    if (!DecodeSnapshotChunk(chunk, batch))
+        return false;
+
+    try {
+        cdMan.GetDbAccess((DBNameType)chunk.db_name_type)->GetStore()->WriteBatch(batch);
+    } catch (std::exception &e) {
+        return ERRORMSG("%s, write the chunk of db %s failed, %s", __func__, GetDbName((DBNameType)chunk.db_name_type),
+                        e.what());
+    }
+    return true;
+}
+
+/**
+ * Read the snapshot file, the chunks read ahead are handed to processChunk at once, on the workers. The stats
+ * are of the whole file, its state hash is checked against the chunks read.
+ */
+static bool ReadSnapshotFile(const boost::filesystem::path &path, CWorkerPool *pWorkerPool,
+                             const std::function<bool(const CChainSnapshotChunk &)> &processChunk,
+                             CChainSnapshotHeader &header, CChainSnapshotStats &stats) {
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return ERRORMSG("%s, open snapshot file %s failed", __func__, path.string());
+
+    // two chunks per worker
+    size_t batchSize = pWorkerPool != nullptr ? pWorkerPool->GetThreadCount() * 2 : 1;
+    vector<CChainSnapshotChunk> chunks;
+    std::atomic<bool> failed{false};
+    auto processChunks = [&]() {
+        auto task = [&](size_t i) {
+            if (!processChunk(chunks[i]))
+                failed = true;
+        };
+        if (pWorkerPool != nullptr) {
+            pWorkerPool->Run(chunks.size(), task);
+        } else {
+            for (size_t i = 0; i < chunks.size(); i++)
+                task(i);
+        }
+        chunks.clear();
+        return !failed;
+    };
+
+    stats = CChainSnapshotStats();
+    CHashWriter stateHasher(SER_GETHASH, PROTOCOL_VERSION);
+    uint32_t chunkCount = 0;
+    try {
+        MessageStartChars magic;
+        filein >> FLATDATA(magic) >> header;
+        if (memcmp(magic, SysCfg().MessageStart(), sizeof(magic)) != 0)
+            return ERRORMSG("%s, the snapshot %s is not of this network", __func__, path.string());
+        if (header.version != CChainSnapshotHeader::CURRENT_VERSION)
+            return ERRORMSG("%s, unsupported snapshot version %u", __func__, header.version);
+        stateHasher << header;
+
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            uint8_t recordType;
+            filein >> recordType;
+            if (recordType == SNAPSHOT_END)
+                break;
+            if (recordType >= DBNameType::DB_NAME_COUNT)
+                return ERRORMSG("%s, bad db name type %u of the snapshot chunk", __func__, recordType);
+
+            chunks.emplace_back();
+            CChainSnapshotChunk &chunk = chunks.back();
+            chunk.db_name_type         = recordType;
+            filein >> chunk.entry_count >> chunk.checksum >> chunk.data;
+            stateHasher << chunk.checksum;
+
+            stats.chunk_count++;
+            stats.entry_count += chunk.entry_count;
+            stats.data_bytes += chunk.data.size();
+            if (chunks.size() >= batchSize && !processChunks())
+                return false;
+        }
+        if (!processChunks())
+            return false;
+
+        filein >> chunkCount >> stats.state_hash;
+    } catch (std::exception &e) {
+        return ERRORMSG("%s, read snapshot file %s failed, %s", __func__, path.string(), e.what());
+    }
+
+    if (chunkCount != stats.chunk_count || stateHasher.GetHash() != stats.state_hash)
+        return ERRORMSG("%s, the state hash of the snapshot %s mismatches", __func__, path.string());
+
+    return true;
+}
+
+bool LoadChainSnapshot(CCacheDBManager &cdMan, const boost::filesystem::path &path, CWorkerPool *pWorkerPool,
+                       const uint256 &expectedStateHash, CChainSnapshotHeader &header, CChainSnapshotStats &stats) {
+    int64_t beginTime = GetTimeMillis();
+
+    // all the chunks and the state hash are verified before any of them is written, a bad snapshot leaves the
+    // dbs empty
+    auto verifyChunk = [](const CChainSnapshotChunk &chunk) {
+        CLevelDBBatch batch;
+        return DecodeSnapshotChunk(chunk, batch);
+    };
+    if (!ReadSnapshotFile(path, pWorkerPool, verifyChunk, header, stats))
+        return ERRORMSG("%s, verify snapshot file %s failed", __func__, path.string());
+
+    if (!expectedStateHash.IsNull() && stats.state_hash != expectedStateHash)
+        return ERRORMSG("%s, the state hash %s of the snapshot is not the expected %s", __func__,
+                        stats.state_hash.GetHex(), expectedStateHash.GetHex());
+    int64_t verifyTime = GetTimeMillis();
+
+    CChainSnapshotHeader loadedHeader;
+    CChainSnapshotStats loadedStats;
+    auto writeChunk = [&cdMan](const CChainSnapshotChunk &chunk) { return WriteSnapshotChunk(cdMan, chunk); };
+    if (!ReadSnapshotFile(path, pWorkerPool, writeChunk, loadedHeader, loadedStats))
+        return ERRORMSG("%s, load snapshot file %s failed", __func__, path.string());
+
+    // the file is read twice, it must not change between
+    if (loadedStats.state_hash != stats.state_hash || loadedHeader.block_hash != header.block_hash)
+        return ERRORMSG("%s, the snapshot file %s changed while loading", __func__, path.string());
+
+    if (cdMan.pBlockCache->GetBestBlockHash() != header.block_hash)
+        return ERRORMSG("%s, the best block of the loaded state is not the snapshot block %s", __func__,
+                        header.block_hash.GetHex());
+
+    stats.elapsed_ms = GetTimeMillis() - beginTime;
+    LogPrint(BCLog::INFO, "%s, loaded snapshot of block %d:%s from %s, chunks=%u, entries=%llu, state_hash=%s, "
+             "verify: %lldms, took %lldms\n", __func__, header.height, header.block_hash.GetHex(), path.string(),
+             stats.chunk_count, stats.entry_count, stats.state_hash.GetHex(), verifyTime - beginTime,
+             stats.elapsed_ms);
+    return true;
+}
@@ -0,0 +1,123 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_SNAPSHOT_H
+#define PERSIST_SNAPSHOT_H
+
+#include "commons/json/json_spirit_value.h"
+#include "commons/serialize.h"
+#include "commons/uint256.h"
+#include "dbconf.h"
+
+#include <boost/filesystem/path.hpp>
+#include <leveldb/db.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+class CCacheDBManager;
+class CLevelDBWrapper;
+class CWorkerPool;
+
+using namespace json_spirit;
+
+/**
+ * Chain state snapshot
+ * All the chain state dbs of CCacheDBManager at a block, streamed into one file. The layout is
+ *   {header}{chunk}..{chunk}{end}
+ *   header = {network magic}{version}{height}{block hash}
+ *   chunk  = {db name type}{entry count}{checksum}{data}, data = {key}{value}..{key}{value}
+ *   end    = {SNAPSHOT_END}{chunk count}{state hash}, state hash = hash of the header and
+ *            the checksums of all chunks, so the pinned state hash pins the height and the block hash too
+ * The keys and values are kept as they are in the dbs. The node-local keys (block file info, tx disk
+ * positions, reindex flag) are left out, they are rebuilt when the blocks are connected again.
+ * Every chunk holds the keys of one db, so the chunks are verified and written to the dbs in parallel.
+ */
+class CChainSnapshotHeader {
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    uint32_t version = CURRENT_VERSION;
+    int32_t height   = -1;
+    uint256 block_hash;
+
+public:
+    bool IsNull() const { return height < 0; }
+    void SetNull() { height = -1; block_hash.SetNull(); }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(version);
+        READWRITE(height);
+        READWRITE(block_hash);
+    )
+};
+
+class CChainSnapshotChunk {
+public:
+    uint8_t db_name_type  = DBNameType::DB_NAME_COUNT;
+    uint32_t entry_count  = 0;
+    uint256 checksum;
+    std::string data;
+
+public:
+    uint256 ComputeChecksum() const;
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(db_name_type);
+        READWRITE(entry_count);
+        READWRITE(checksum);
+        READWRITE(data);
+    )
+};
+
+struct CChainSnapshotStats {
+    uint32_t chunk_count    = 0;
+    uint64_t entry_count    = 0;
+    uint64_t data_bytes     = 0;
+    uint256 state_hash;
+    int64_t elapsed_ms      = 0;
+
+    Object ToJson() const;
+};
+
+/**
+ * CChainSnapshotWriter
+ * Takes the read views of all the chain state dbs at once, then streams them to the file. The chain state
+ * must be flushed and locked when it is created, it can change again while the file is being written.
+ */
+class CChainSnapshotWriter {
+public:
+    // the data size of a chunk, the last chunk of a db is smaller
+    static const uint32_t CHUNK_SIZE = 4 << 20;
+
+public:
+    CChainSnapshotWriter(CCacheDBManager &cdMan, int32_t height, const uint256 &blockHash);
+    ~CChainSnapshotWriter();
+
+    CChainSnapshotWriter(const CChainSnapshotWriter &) = delete;
+    CChainSnapshotWriter &operator=(const CChainSnapshotWriter &) = delete;
+
+    bool WriteToFile(const boost::filesystem::path &path, CChainSnapshotStats &stats);
+
+private:
+    CCacheDBManager &cdMan;
+    CChainSnapshotHeader header;
+    // the read view of every store, the dbs of -singledbstore share one
+    std::map<std::shared_ptr<CLevelDBWrapper>, const leveldb::Snapshot *> dbSnapshots;
+};
+
+// the keys of the prefix type are node-local, they are not in the snapshot
+bool IsSnapshotExcludedPrefix(dbk::PrefixType prefixType);
+
+/**
+ * Load the snapshot into the empty chain state dbs (-loadsnapshot with -reindex). All the chunks and the state
+ * hash, against expectedStateHash unless it is null, are verified by the workers before any chunk is written, so a
+ * bad snapshot leaves the dbs empty. The file is read again to write the chunks. The chunks are written to the
+ * stores directly, so the bloom filters of the dbs must be built after the load.
+ */
+bool LoadChainSnapshot(CCacheDBManager &cdMan, const boost::filesystem::path &path, CWorkerPool *pWorkerPool,
+                       const uint256 &expectedStateHash, CChainSnapshotHeader &header, CChainSnapshotStats &stats);
+
+#endif  // PERSIST_SNAPSHOT_H
@@ -0,0 +1,116 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef PERSIST_SPECULATIVE_EXEC_H
+#define PERSIST_SPECULATIVE_EXEC_H
+
+#include "blockundo.h"
+#include "dbaccesstracker.h"
+#include "commons/util/workerpool.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * CSpeculativeExecutor
+ * Execute a run of txs in parallel, each on its own cache over the shared base cache, then commit
+ * them in order (-parallelexec). The keys read and written by each tx are tracked. A tx which read
+ * a key written by an earlier tx of the run, which failed or which accessed the cache untracked is
+ * executed again on top of the committed txs, so the result is the same as the serial execution,
+ * including the order of the undo op logs.
+ * CacheType is CCacheWrapper or a single db cache, constructed with the pointer of its base.
+ */
+template<typename CacheType>
+class CSpeculativeExecutor {
+public:
+    // execute the tx of index on the cache, it may be called twice for the same index
+    typedef std::function<bool(size_t index, CacheType &cache)> ExecuteFunc;
+
+public:
+    CSpeculativeExecutor(CWorkerPool &poolIn, CacheType &baseIn): pool(poolIn), base(baseIn) {}
+
+    // execute the txs of [beginIn, endIn) in parallel on the pool
+    void Speculate(size_t beginIn, size_t endIn, const ExecuteFunc &executeIn) {
+        assert(beginIn <= endIn);
+        begin   = beginIn;
+        execute = executeIn;
+        writtenKeys.clear();
+        slots.clear();
+        slots.resize(endIn - beginIn);
+        pool.Run(slots.size(), [this](size_t i) { Execute(i, true); });
+    }
+
+    bool IsSpeculated(size_t index) const { return index >= begin && index < begin + slots.size(); }
+
+    /**
+     * Commit the tx of index, the txs must be committed in order. The writes of the tx are flushed into
+     * the base cache and its op logs are replayed into opLogMap.
+     * Return whether the tx was executed successfully, the failed tx is not committed.
+     */
+    bool Commit(size_t index, CDBOpLogMap &opLogMap) {
+        assert(IsSpeculated(index));
+        size_t i   = index - begin;
+        Slot &slot = slots[i];
+        if (!slot.executed || slot.tracker.IsUnsafe() || slot.tracker.HasReadAny(writtenKeys)) {
+            // the state the tx was executed on is stale, execute it again on the committed txs
+            Execute(i, false);
+            reexecuted_count++;
+        }
+        if (!slot.executed)
+            return false;
+
+        slot.opLogs.ReplayTo(opLogMap);
+        slot.pCache->Flush();
+        writtenKeys.insert(slot.tracker.GetWriteKeys().begin(), slot.tracker.GetWriteKeys().end());
+        slot.pCache.reset();
+        return true;
+    }
+
+    uint32_t GetReexecutedCount() const { return reexecuted_count; }
+
+private:
+    struct Slot {
+        std::unique_ptr<CacheType> pCache;
+        CTxOpLogRecorder opLogs;
+        CDBAccessTracker tracker;
+        bool executed = false;
+    };
+
+    void Execute(size_t i, bool isSpeculative) {
+        Slot &slot = slots[i];
+        slot.pCache.reset(new CacheType(&base));
+        slot.opLogs.Reset();
+        slot.tracker.Clear();
+        // the workers share the base cache, the committing thread executes the tx alone
+        slot.tracker.SetSpeculative(isSpeculative);
+        slot.pCache->SetDbOpLogMap(&slot.opLogs);
+        {
+            CDBAccessTrackerScope trackerScope(slot.tracker);
+            if (!isSpeculative) {
+                slot.executed = execute(begin + i, *slot.pCache);
+            } else {
+                try {
+                    slot.executed = execute(begin + i, *slot.pCache);
+                } catch (...) {
+                    // the worker must not throw, the tx which threw or did an untracked access
+                    // (CDBUnsafeAccessError) is executed again in Commit()
+                    slot.executed = false;
+                }
+            }
+        }
+        slot.pCache->SetDbOpLogMap(nullptr);
+    }
+
+private:
+    CWorkerPool &pool;
+    CacheType &base;
+    ExecuteFunc execute;
+    size_t begin = 0;
+    std::vector<Slot> slots;
+    CDBAccessTracker::KeySet writtenKeys;  // the keys written by the committed txs
+    uint32_t reexecuted_count = 0;
+};
+
+#endif  // PERSIST_SPECULATIVE_EXEC_H
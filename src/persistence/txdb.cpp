@@ -10,60 +10,126 @@
 #include "main.h"
 #include "persistence/block.h"
 #include "commons/util/util.h"
+#include "tx/txserializer.h"
 #include "vm/luavm/luavmrunenv.h"
 
 #include <algorithm>
 
 bool CTxMemCache::AddBlockTx(const CBlock &block) {
+    vector<uint256> blockTxids;
+    blockTxids.reserve(block.vptx.size());
     for (auto &ptx : block.vptx) {
-        txids.insert(ptx->GetHash());
+        blockTxids.push_back(ptx->GetHash());
     }
+    SetBlockTxids(block.GetHeight(), std::move(blockTxids));
     return true;
 }
 
-bool CTxMemCache::RemoveBlockTx(const CBlock &block) {
-    for (auto &ptx : block.vptx) {
-        txids.erase(ptx->GetHash());
+bool CTxMemCache::RemoveBlockTx(int32_t height) {
+    if (pBase == nullptr) {
+        EraseBlockTxids(height);
+    } else {
+        // shadow the block of the base
+        SetBlockTxids(height, vector<uint256>());
     }
     return true;
 }
 
 bool CTxMemCache::HasTx(const uint256 &txid) {
-    bool found = txids.count(txid) > 0;
-    if (found)
+    int32_t height;
+    return FindTx(txid, height);
+}
+
+bool CTxMemCache::FindTx(const uint256 &txid, int32_t &height) const {
+    auto it = txidHeights.find(txid);
+    if (it != txidHeights.end()) {
+        height = it->second;
         return true;
-    else if (pBase == nullptr) {
-        return false;
-    } else
-        return pBase->HasTx(txid);
+    }
+    // the block of the base is replaced or removed in this cache
+    return pBase != nullptr && pBase->FindTx(txid, height) && heightTxids.count(height) == 0;
+}
+
+void CTxMemCache::SetBlockTxids(int32_t height, vector<uint256> &&blockTxids) {
+    EraseBlockTxids(height);
+    for (const auto &txid : blockTxids) {
+        txidHeights[txid] = height;
+    }
+    heightTxids[height] = std::move(blockTxids);
 }
 
-void CTxMemCache::BatchWrite(const UnorderedHashSet &txidsIn) {
-    txids.clear();
+void CTxMemCache::EraseBlockTxids(int32_t height) {
+    auto it = heightTxids.find(height);
+    if (it == heightTxids.end())
+        return;
 
-    for (const auto &txid : txidsIn) {
-        txids.insert(txid);
+    for (const auto &txid : it->second) {
+        auto txidIt = txidHeights.find(txid);
+        if (txidIt != txidHeights.end() && txidIt->second == height)
+            txidHeights.erase(txidIt);
     }
+    heightTxids.erase(it);
 }
 
 void CTxMemCache::Flush() {
     assert(pBase);
 
-    pBase->BatchWrite(txids);
-    txids.clear();
+    for (auto &item : heightTxids) {
+        if (item.second.empty())
+            pBase->RemoveBlockTx(item.first);
+        else
+            pBase->SetBlockTxids(item.first, std::move(item.second));
+    }
+    Clear();
 }
 
-void CTxMemCache::Clear() { txids.clear(); }
+void CTxMemCache::Clear() {
+    heightTxids.clear();
+    txidHeights.clear();
+}
 
-uint64_t CTxMemCache::GetSize() { return txids.size(); }
+uint64_t CTxMemCache::GetSize() { return txidHeights.size(); }
 
 Object CTxMemCache::ToJsonObj() const {
     Array txArray;
-    for (auto &txid : txids) {
-        txArray.push_back(txid.ToString());
+    for (auto &item : heightTxids) {
+        for (auto &txid : item.second) {
+            txArray.push_back(txid.ToString());
+        }
     }
 
     Object txCacheObj;
     txCacheObj.push_back(Pair("tx_cache", txArray));
     return txCacheObj;
 }
+
+void CRewardTxQueue::Push(const uint256 &blockHash, const std::shared_ptr<CBaseTx> &pRewardTx) {
+    if (rewardTxs.count(blockHash))
+        return;
+
+    // the tx may have been executed, keep the copy of what was read from disk
+    CDataStream ds(SER_DISK, CLIENT_VERSION);
+    ds << pRewardTx;
+    std::shared_ptr<CBaseTx> pCopy;
+    ds >> pCopy;
+
+    rewardTxs.emplace(blockHash, pCopy);
+    blockHashes.push_back(blockHash);
+    while (blockHashes.size() > max_size) {
+        rewardTxs.erase(blockHashes.front());
+        blockHashes.pop_front();
+    }
+}
+
+std::shared_ptr<CBaseTx> CRewardTxQueue::Get(const uint256 &blockHash) const {
+    auto it = rewardTxs.find(blockHash);
+    if (it == rewardTxs.end())
+        return nullptr;
+
+    return it->second->GetNewInstance();
+}
+
+void CRewardTxQueue::Clear() {
+    rewardTxs.clear();
+    blockHashes.clear();
+}
@@ -14,12 +14,21 @@
 #include "dbconf.h"
 #include "block.h"
 
+#include <deque>
 #include <map>
+#include <unordered_map>
 #include <vector>
 
 using namespace std;
 using namespace json_spirit;
 
+/**
+ * CTxMemCache
+ * The txids of the latest GetTxCacheHeight() blocks by block height, for the duplicated tx check.
+ * The block which falls out of the window is removed by height, without reading it from disk.
+ * A child cache keeps the blocks added and removed on it, an empty txid list means removed, they
+ * are merged into the base on Flush().
+ */
 class CTxMemCache {
 public:
     CTxMemCache() : pBase(nullptr) {}
@@ -29,7 +38,7 @@ public:
     bool HasTx(const uint256 &txid);
 
     bool AddBlockTx(const CBlock &block);
-    bool RemoveBlockTx(const CBlock &block);
+    bool RemoveBlockTx(int32_t height);
 
     void Clear();
     void SetBaseViewPtr(CTxMemCache *pBaseIn) { pBase = pBaseIn; }
@@ -39,13 +48,37 @@ public:
     uint64_t GetSize();
 
 private:
-    bool HaveBlock(const uint256 &blockHash) const;
-    bool HaveBlock(const CBlock &block);
-    void BatchWrite(const UnorderedHashSet &mapBlockTxHashSetIn);
+    // find the height of the block which contains the txid
+    bool FindTx(const uint256 &txid, int32_t &height) const;
+    void SetBlockTxids(int32_t height, vector<uint256> &&blockTxids);
+    void EraseBlockTxids(int32_t height);
 
 private:
-    UnorderedHashSet txids;
+    map<int32_t, vector<uint256>> heightTxids;  // height -> txids of the block
+    unordered_map<uint256, int32_t, CUint256Hasher> txidHeights;  // txid -> height, of this cache only
     CTxMemCache *pBase;
 };
 
+/**
+ * CRewardTxQueue
+ * The reward txs of the latest blocks by block hash. When a block is connected, the reward tx of the
+ * block BLOCK_REWARD_MATURITY blocks before is executed again, it is taken from here instead of
+ * reading that block from disk. The oldest ones are dropped when the queue is full.
+ */
+class CRewardTxQueue {
+public:
+    CRewardTxQueue(uint32_t maxSizeIn) : max_size(maxSizeIn) {}
+
+    // keep an unexecuted copy of the reward tx
+    void Push(const uint256 &blockHash, const std::shared_ptr<CBaseTx> &pRewardTx);
+    // a copy of the reward tx to execute, nullptr if not found
+    std::shared_ptr<CBaseTx> Get(const uint256 &blockHash) const;
+    void Clear();
+
+private:
+    unordered_map<uint256, std::shared_ptr<CBaseTx>, CUint256Hasher> rewardTxs;
+    deque<uint256> blockHashes;  // in the order pushed
+    uint32_t max_size;
+};
+
 #endif // PERSIST_TXDB_H
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "init.h"
 #include "main.h"
 #include "rpcserver.h"
+#include "tx/txadmission.h"
 #include "vm/luavm/luavmrunenv.h"
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
@@ -223,7 +224,74 @@ bool ParseRpcInputMoney(const string &comboMoneyStr, ComboMoney &comboMoney, con
 }
 
 
-Object SubmitTx(const CKeyID &keyid, CBaseTx &tx) {
+Object CommitTx(CBaseTx &tx, bool async, const string &errorPrefix) {
+    Object obj;
+    if (pTxAdmission == nullptr) {
+        // the wallet takes cs_main and cs_wallet for the commit
+        string retMsg;
+        if (!pWalletMain->CommitTx(&tx, retMsg))
+            throw JSONRPCError(RPC_WALLET_ERROR, errorPrefix + retMsg);
+
+        obj.push_back(Pair("txid", retMsg));
+        if (async)
+            obj.push_back(Pair("status", CTxAdmission::GetStatusName(CTxAdmission::ACCEPTED)));
+        return obj;
+    }
+
+    std::shared_future<CTxAdmission::CResult> future = pTxAdmission->Submit(tx.GetNewInstance());
+    if (async && future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        obj.push_back(Pair("txid", tx.GetHash().GetHex()));
+        obj.push_back(Pair("status", CTxAdmission::GetStatusName(CTxAdmission::QUEUED)));
+        return obj;
+    }
+
+    if (!async && CRPCAdmissionScope::Defer(future, errorPrefix)) {
+        obj.push_back(Pair("txid", tx.GetHash().GetHex()));
+        return obj;
+    }
+
+    const CTxAdmission::CResult &result = future.get();
+    if (result.status != CTxAdmission::ACCEPTED)
+        throw JSONRPCError(RPC_WALLET_ERROR, errorPrefix + result.message);
+
+    obj.push_back(Pair("txid", result.message));
+    if (async)
+        obj.push_back(Pair("status", CTxAdmission::GetStatusName(result.status)));
+    return obj;
+}
+
+static thread_local CRPCAdmissionScope *pCurrentAdmissionScope = nullptr;
+
+CRPCAdmissionScope::CRPCAdmissionScope() : pPrevScope(pCurrentAdmissionScope) {
+    pCurrentAdmissionScope = this;
+}
+
+CRPCAdmissionScope::~CRPCAdmissionScope() {
+    pCurrentAdmissionScope = pPrevScope;
+}
+
+void CRPCAdmissionScope::Wait() {
+    if (pCurrentAdmissionScope == this)
+        pCurrentAdmissionScope = pPrevScope;
+
+    vector<std::pair<std::shared_future<CTxAdmission::CResult>, string>> waits;
+    waits.swap(deferred);
+    for (auto &item : waits) {
+        const CTxAdmission::CResult &result = item.first.get();
+        if (result.status != CTxAdmission::ACCEPTED)
+            throw JSONRPCError(RPC_WALLET_ERROR, item.second + result.message);
+    }
+}
+
+bool CRPCAdmissionScope::Defer(const std::shared_future<CTxAdmission::CResult> &future, const string &errorPrefix) {
+    if (pCurrentAdmissionScope == nullptr)
+        return false;
+
+    pCurrentAdmissionScope->deferred.emplace_back(future, errorPrefix);
+    return true;
+}
+
+Object SubmitTx(const CKeyID &keyid, CBaseTx &tx, bool async) {
     if (!pWalletMain->HasKey(keyid)) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Sender address not found in wallet");
     }
@@ -232,14 +300,7 @@ Object SubmitTx(const CKeyID &keyid, CBaseTx &tx) {
         throw JSONRPCError(RPC_WALLET_ERROR, "Sign failed");
     }
 
-    string retMsg;
-    if (!pWalletMain->CommitTx((CBaseTx *)&tx, retMsg))
-        throw JSONRPCError(RPC_WALLET_ERROR, strprintf("SubmitTx failed: txid=%s, %s", tx.GetHash().GetHex(), retMsg));
-
-    Object obj;
-    obj.push_back(Pair("txid", retMsg));
-
-    return obj;
+    return CommitTx(tx, async, strprintf("SubmitTx failed: txid=%s, ", tx.GetHash().GetHex()));
 }
 
 string RegIDToAddress(CUserID &userId) {
@@ -14,6 +14,7 @@
 #include "entities/asset.h"
 #include "entities/account.h"
 #include "tx/tx.h"
+#include "tx/txadmission.h"
 #include "persistence/dexdb.h"
 
 using namespace std;
@@ -23,7 +24,35 @@ string RegIDToAddress(CUserID &userId);
 Object GetTxDetailJSON(const uint256& txid);
 Array GetTxAddressDetail(std::shared_ptr<CBaseTx> pBaseTx);
 
-Object SubmitTx(const CKeyID &keyid, CBaseTx &tx);
+// commit the tx by the wallet, through the staged admission if it is running (-admissionworkers). An async
+// commit returns once the tx is queued, its result is queried by gettxadmission. It must not be called under
+// cs_main or cs_wallet unless a CRPCAdmissionScope is active, the admission thread needs cs_main.
+Object CommitTx(CBaseTx &tx, bool async, const string &errorPrefix);
+Object SubmitTx(const CKeyID &keyid, CBaseTx &tx, bool async = false);
+
+/**
+ * The RPCs which are not thread-safe run under cs_main and cs_wallet, they can not wait for the admission of
+ * their txs. In the scope the txs committed by the current thread are queued only, the RPC server waits for
+ * them by Wait() after releasing the locks.
+ */
+class CRPCAdmissionScope {
+public:
+    CRPCAdmissionScope();
+    ~CRPCAdmissionScope();
+
+    // wait for the queued txs, throws the reject reason of the first rejected one
+    void Wait();
+
+    // queue the wait of the tx to the scope of the current thread, false if there is no scope
+    static bool Defer(const std::shared_future<CTxAdmission::CResult> &future, const string &errorPrefix);
+
+private:
+    CRPCAdmissionScope(const CRPCAdmissionScope &) = delete;
+    CRPCAdmissionScope &operator=(const CRPCAdmissionScope &) = delete;
+
+    vector<std::pair<std::shared_future<CTxAdmission::CResult>, string>> deferred;
+    CRPCAdmissionScope *pPrevScope;
+};
 
 namespace JSON {
     const Value& GetObjectFieldValue(const Value &jsonObj, const string &fieldName);
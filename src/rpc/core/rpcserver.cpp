@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "rpcserver.h"
+#include "rpccommons.h"
 #include "rpc/rpcapiconf.h"
 
 #include "logging.h"
@@ -467,25 +468,31 @@ json_spirit::Value CRPCTable::execute(const string& strMethod,
 
     try {
         // Execute
-        Value result;
-        {
-            if (pcmd->threadSafe)
-                result = pcmd->actor(params, false);
-            else if (!pWalletMain) {
-                LOCK(cs_main);
-                result = pcmd->actor(params, false);
-            } else {
-                LOCK2(cs_main, pWalletMain->cs_wallet);
-                result = pcmd->actor(params, false);
-            }
-        }
-
-        return result;
+        return CallRPCActor(*pcmd, params);
     } catch (std::exception& e) {
         throw JSONRPCError(RPC_MISC_ERROR, e.what());
     }
 }
 
+Value CallRPCActor(const CRPCCommand &cmd, const Array &params) {
+    if (cmd.threadSafe)
+        return cmd.actor(params, false);
+
+    Value result;
+    CRPCAdmissionScope admissionScope;
+    if (!pWalletMain) {
+        LOCK(cs_main);
+        result = cmd.actor(params, false);
+    } else {
+        LOCK2(cs_main, pWalletMain->cs_wallet);
+        result = cmd.actor(params, false);
+    }
+    // the admission of the committed txs needs cs_main
+    admissionScope.Wait();
+
+    return result;
+}
+
 string HelpExampleCli(string methodname, string args) {
     return "> ./coind " + methodname + " " + args + "\n";
 }
@@ -91,6 +91,9 @@ public:
 
 extern const CRPCTable tableRPC;
 
+// call the actor of the command, under cs_main and cs_wallet unless it is thread-safe
+json_spirit::Value CallRPCActor(const CRPCCommand &cmd, const json_spirit::Array &params);
+
 //
 // Utilities: convert hex-encoded Values
 // (throws error if not hex).
@@ -162,6 +162,7 @@ extern Value signmessage(const Array& params, bool fHelp);
 extern Value getcontractassets(const  Array& params, bool fHelp);
 extern Value submitsendtx(const Array& params, bool fHelp);
 extern Value submittxraw(const Array& params, bool fHelp);
+extern Value gettxadmission(const Array& params, bool fHelp);
 
 extern Value decodetxraw(const Array& params, bool fHelp);
 
@@ -170,6 +171,7 @@ extern Value getblockcount(const Array& params, bool fHelp);
 extern Value getrawmempool(const Array& params, bool fHelp);
 extern Value getblock(const Array& params, bool fHelp);
 extern Value verifychain(const Array& params, bool fHelp);
+extern Value getverifychaininfo(const Array& params, bool fHelp);
 extern Value getcontractregid(const Array& params, bool fHelp);
 extern Value invalidateblock(const Array& params, bool fHelp);
 extern Value reconsiderblock(const Array& params, bool fHelp);
@@ -204,6 +206,8 @@ extern Value submitaxcinproposal(const Array& params, bool fHelp);
 extern Value submitaxcoutproposal(const Array& params, bool fHelp);
 // debug
 Value dumpdb(const Array& params, bool fHelp);
+extern Value getdbstats(const Array& params, bool fHelp);
+extern Value dumpsnapshot(const Array& params, bool fHelp);
 
 extern Value genrawtx(const Array& params, bool fHelp);
 
@@ -38,6 +38,7 @@ static const CRPCCommand vRPCCommands[] =
     { "getblock",                       &getblock,                          true,      false,       false   },
     { "getrawmempool",                  &getrawmempool,                     true,      false,       false   },
     { "verifychain",                    &verifychain,                       true,      false,       false   },
+    { "getverifychaininfo",             &getverifychaininfo,                true,      true,        false   },
     { "getblockundo",                   &getblockundo,                      true,      false,       false   },
     { "getswapcoindetail",              &getswapcoindetail,                 true,      false,        false   },
 
@@ -85,9 +86,10 @@ static const CRPCCommand vRPCCommands[] =
     { "listdelegates",                  &listdelegates,                     true,      false,       true    },
     { "decodetxraw",                    &decodetxraw,                       true,       false,      false   },
     /* submit raw tx */
-    { "submittxraw",                    &submittxraw,                       true,       false,      false   },
+    { "submittxraw",                    &submittxraw,                       true,       true,       false   },
+    { "gettxadmission",                 &gettxadmission,                    true,       true,       false   },
     /* basic tx */
-    { "submitsendtx",                   &submitsendtx,                      false,      false,      true    },
+    { "submitsendtx",                   &submitsendtx,                      false,      true,       true    },
     { "submitsendmultitx",              &submitsendmultitx,                 false,      false,      true    },
     { "submitpasswordprooftx",          &submitpasswordprooftx,             false,      false,      true    },
     { "submitutxotransfertx",           &submitutxotransfertx,              false,      false,      true    },
@@ -178,6 +180,8 @@ static const CRPCCommand vRPCCommands[] =
     { "vmexecutescript",                &vmexecutescript,                   true,       true,       true    },
     /* debug */
     { "dumpdb",                         &dumpdb,                            true,       true,       true    },
+    { "getdbstats",                     &getdbstats,                        true,       false,      false   },
+    { "dumpsnapshot",                   &dumpsnapshot,                      true,       true,       false   },
     { "genutxomultiinputcondhash",      &genutxomultiinputcondhash,         true,       true,       false   },
     { "genutxomultisignaddr",           &genutxomultisignaddr,              true,       true,       false   },
     { "genutxomultisignature",          &genutxomultisignature,             true,       true,       false   },
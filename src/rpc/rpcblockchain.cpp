@@ -10,6 +10,7 @@
 #include "commons/messagequeue.h"
 #include "commons/uint256.h"
 #include "commons/util/util.h"
+#include "chain/chainverifier.h"
 #include "config/configuration.h"
 #include "init.h"
 #include "main.h"
@@ -270,6 +271,34 @@ Value verifychain(const Array& params, bool fHelp) {
     return VerifyDB(nCheckLevel, nCheckDepth);
 }
 
+Value getverifychaininfo(const Array& params, bool fHelp) {
+    if (fHelp || params.size() != 0) {
+        throw runtime_error(
+            "getverifychaininfo\n"
+            "\nGet the progress and throughput of the background block verification of -backgroundverify.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"state\": \"xxx\",            (string) idle, verifying blocks, verifying state, finished or failed\n"
+            "  \"check_level\": n,          (numeric) the check level of -checklevel\n"
+            "  \"tip_height\": n,           (numeric) the tip when the run started\n"
+            "  \"tip_hash\": \"xxx\",         (string) the hash of the tip\n"
+            "  \"stop_height\": n,          (numeric) the lowest height to verify\n"
+            "  \"next_height\": n,          (numeric) the next height to verify, the blocks above it are verified\n"
+            "  \"verified_blocks\": n,      (numeric) the verified blocks of the run\n"
+            "  \"verified_txs\": n,         (numeric) the transactions of the verified blocks\n"
+            "  \"resumed\": true|false,     (boolean) whether the run went on from a run before the restart\n"
+            "  \"error\": \"xxx\",            (string, optional) the error which stopped the run\n"
+            "  \"elapsed_ms\": n,           (numeric) the time of the run since startup\n"
+            "  \"blocks_per_sec\": n,       (numeric) the verified blocks per second since startup\n"
+            "  \"mb_per_sec\": n            (numeric) the verified block data per second since startup\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getverifychaininfo", "") + "\nAs json rpc\n" + HelpExampleRpc("getverifychaininfo", ""));
+    }
+
+    return chainVerifier.GetInfo();
+}
+
 Value getcontractregid(const Array& params, bool fHelp) {
     if (fHelp || params.size() != 1) {
         throw runtime_error(
@@ -759,7 +788,7 @@ Value getblockundo(const Array& params, bool fHelp) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("no undo data available! block=%d:%s",
             pBlockIndex->height, pBlockIndex->GetBlockHash().ToString()));
 
-    if (!blockUndo.ReadFromDisk(pos, pBlockIndex->pprev->GetBlockHash()))
+    if (!ReadBlockUndo(pBlockIndex, blockUndo))
         throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("read undo data failed! block=%d:%s",
             pBlockIndex->height, pBlockIndex->GetBlockHash().ToString()));
 
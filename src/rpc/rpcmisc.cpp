@@ -9,6 +9,7 @@
 #include "net.h"
 #include "netbase.h"
 #include "miner/pbftmanager.h"
+#include "persistence/snapshot.h"
 #include "rpc/core/rpccommons.h"
 #include "rpc/core/rpcserver.h"
 #include "commons/util/util.h"
@@ -259,10 +260,10 @@ Value verifymessage(const Array& params, bool fHelp) {
     DEFINE(GOVN_APPROVAL_LIST,    pSysGovernCache, approvals_cache)      \
 
 
-template<int32_t PREFIX_TYPE, typename KeyType, typename ValueType>
-string DbCacheToString(CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType> &cache) {
+template<int32_t PREFIX_TYPE, typename KeyType, typename ValueType, typename MapType>
+string DbCacheToString(CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType, MapType> &cache) {
     string str;
-    CDbIterator< CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType> > it(cache);
+    CDbIterator< CCompositeKVCache<PREFIX_TYPE, KeyType, ValueType, MapType> > it(cache);
     for(it.First(); it.IsValid(); it.Next()) {
         str += strprintf("%s={%s},\n", db_util::ToString(it.GetKey()), db_util::ToString(it.GetValue()));
     }
@@ -357,3 +358,84 @@ Value dumpdb(const Array& params, bool fHelp) {
 
     return Object();
 }
+
+Value getdbstats(const Array& params, bool fHelp) {
+    if (fHelp || params.size() > 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nget the read and write statistics of all dbs, include the negative cache and bloom filter hits,\n"
+            "the memory budget of the db caches and the chain state flushes\n"
+            "\nArguments:\n"
+            "\nResult:\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "") + "\nAs json rpc\n" + HelpExampleRpc("getdbstats", "")
+        );
+
+    Object obj;
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+        CDBAccess *pDbAccess = pCdMan->GetDbAccess((DBNameType)i);
+        if (pDbAccess != nullptr) {
+            Object dbObj;
+            dbObj.push_back(Pair("written_bytes",   pDbAccess->GetWrittenBytes()));
+            dbObj.push_back(Pair("read_stats",      pDbAccess->GetStatsJson()));
+            obj.push_back(Pair(GetDbName((DBNameType)i), dbObj));
+        }
+    }
+    obj.push_back(Pair("cache_budget", DBCacheBudget().ToJson()));
+    obj.push_back(Pair("flush_stats", pCdMan->GetFlushStatsJson()));
+    return obj;
+}
+
+Value dumpsnapshot(const Array& params, bool fHelp) {
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "dumpsnapshot \"[file_path]\"\n"
+            "\ndump all the chain state dbs at the tip block into one snapshot file, a new node started with\n"
+            "-reindex -loadsnapshot=<file> loads it and executes the blocks after the tip block only\n"
+            "\nArguments:\n"
+            "1. \"file_path\"       (string, optional) the snapshot file path, default is <datadir>/snapshots/snapshot-<height>.dat\n"
+            "\nResult:\n"
+            "{\"height\", \"block_hash\", \"file\", \"chunks\", \"entries\", \"data_bytes\", \"state_hash\", \"elapsed_ms\"}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumpsnapshot", "") + "\nAs json rpc\n" + HelpExampleRpc("dumpsnapshot", "")
+        );
+
+    std::unique_ptr<CChainSnapshotWriter> pWriter;
+    int32_t height;
+    uint256 blockHash;
+    {
+        // the read views of the dbs are taken with the flushed chain state, the chain goes on while writing
+        LOCK(cs_main);
+        if (chainActive.Tip() == nullptr)
+            throw JSONRPCError(RPC_MISC_ERROR, "the chain has no tip block");
+
+        pCdMan->Flush();
+        height    = chainActive.Height();
+        blockHash = chainActive.Tip()->GetBlockHash();
+        if (pCdMan->pBlockCache->GetBestBlockHash() != blockHash)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "the best block of the chain state is not the tip block");
+
+        pWriter.reset(new CChainSnapshotWriter(*pCdMan, height, blockHash));
+    }
+
+    boost::filesystem::path filePath;
+    if (params.size() > 0) {
+        filePath = params[0].get_str();
+    } else {
+        filePath = GetDataDir() / "snapshots";
+        TryCreateDirectory(filePath);
+        filePath /= strprintf("snapshot-%d.dat", height);
+    }
+
+    CChainSnapshotStats stats;
+    if (!pWriter->WriteToFile(filePath, stats))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("write snapshot file %s failed", filePath.string()));
+
+    Object obj;
+    obj.push_back(Pair("height",        height));
+    obj.push_back(Pair("block_hash",    blockHash.GetHex()));
+    obj.push_back(Pair("file",          filePath.string()));
+    for (const auto &item : stats.ToJson())
+        obj.push_back(item);
+    return obj;
+}
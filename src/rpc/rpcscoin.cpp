@@ -330,8 +330,11 @@ Object GetCdpInfoJson(const CCdpCoinPair &cdpCoinPair, uint64_t price) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Acquire cdp force liquidate ratio error");
     }
 
-    CdpRatioSortedCache::Map forceLiquidateCdps;
-    pCdMan->pCdpCache->GetCdpListByCollateralRatio(cdpCoinPair, forceLiquidateRatio, price, forceLiquidateCdps);
+    uint32_t forceLiquidateCdpAmount = 0;
+    auto spCdpIt = pCdMan->pCdpCache->CreateCdpRatioIterator(cdpCoinPair, forceLiquidateRatio, price);
+    for (spCdpIt->First(); spCdpIt->IsValid(); spCdpIt->Next()) {
+        forceLiquidateCdpAmount++;
+    }
 
     Object obj;
 
@@ -348,7 +351,7 @@ Object GetCdpInfoJson(const CCdpCoinPair &cdpCoinPair, uint64_t price) {
     obj.push_back(Pair("global_collateral_ratio_floor_reached", globalCollateralRatioFloorReached));
 
     obj.push_back(Pair("force_liquidate_ratio",                 strprintf("%.2f%%", (double)forceLiquidateRatio / RATIO_BOOST * 100)));
-    obj.push_back(Pair("force_liquidate_cdp_amount",            (uint32_t) forceLiquidateCdps.size()));
+    obj.push_back(Pair("force_liquidate_cdp_amount",            forceLiquidateCdpAmount));
     return obj;
 }
 
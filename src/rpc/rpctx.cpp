@@ -21,6 +21,7 @@
 #include "tx/nickidregtx.h"
 #include "tx/accountregtx.h"
 #include "tx/dextx.h"
+#include "tx/txadmission.h"
 #include "tx/txserializer.h"
 #include "config/scoin.h"
 #include <boost/assign/list_of.hpp>
@@ -756,17 +757,13 @@ Value listcontracts(const Array& params, bool fHelp) {
 
     bool showDetail = params[0].get_bool();
 
-    map<CRegIDKey, CUniversalContract> contracts;
-    if (!pCdMan->pContractCache->GetContracts(contracts)) {
-        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to acquire contracts from db.");
-    }
-
     Object obj;
     Array contractArray;
-    for (const auto &item : contracts) {
+    auto spContractIt = pCdMan->pContractCache->CreateContractIterator();
+    for (spContractIt->First(); spContractIt->IsValid(); spContractIt->Next()) {
         Object contractObject;
-        const CUniversalContract &contract = item.second;
-        contractObject.push_back(Pair("contract_regid", item.first.regid.ToString()));
+        const CUniversalContract &contract = spContractIt->GetValue();
+        contractObject.push_back(Pair("contract_regid", spContractIt->GetKey().regid.ToString()));
         contractObject.push_back(Pair("memo",           contract.memo));
 
         if (showDetail) {
@@ -779,7 +776,7 @@ Value listcontracts(const Array& params, bool fHelp) {
         contractArray.push_back(contractObject);
     }
 
-    obj.push_back(Pair("count",     contracts.size()));
+    obj.push_back(Pair("count",     contractArray.size()));
     obj.push_back(Pair("contracts", contractArray));
 
     return obj;
@@ -949,12 +946,14 @@ Value saveblocktofile(const Array& params, bool fHelp) {
 }
 
 Value submittxraw(const Array& params, bool fHelp) {
-    if (fHelp || params.size() != 1) {
+    if (fHelp || params.size() < 1 || params.size() > 2) {
         throw runtime_error(
-            "submittxraw \"rawtx\" \n"
+            "submittxraw \"rawtx\" [async]\n"
             "\nsubmit raw transaction (hex format)\n"
             "\nArguments:\n"
             "1.\"rawtx\":   (string, required) The raw transaction\n"
+            "2.\"async\":   (bool, optional) return once the transaction is queued for the admission, with its status,"
+            " see gettxadmission, default is false\n"
             "\nExamples:\n" +
             HelpExampleCli("submittxraw",
                            "\"0b01848908020001145e3550cfae2422dce90a778b0954409b1c6ccc3a045749434382dbea93000457494343c"
@@ -977,12 +976,39 @@ Value submittxraw(const Array& params, bool fHelp) {
     std::shared_ptr<CBaseTx> tx;
     stream >> tx;
 
-    string retMsg;
-    if (!pWalletMain->CommitTx((CBaseTx *) tx.get(), retMsg))
-        throw JSONRPCError(RPC_WALLET_ERROR, "Submittxraw error: " + retMsg);
+    bool async = params.size() > 1 && params[1].get_bool();
+    return CommitTx(*tx, async, "Submittxraw error: ");
+}
+
+Value gettxadmission(const Array& params, bool fHelp) {
+    if (fHelp || params.size() != 1) {
+        throw runtime_error(
+            "gettxadmission \"txid\"\n"
+            "\nget the admission result of a transaction submitted with async\n"
+            "\nArguments:\n"
+            "1.\"txid\":    (string, required) The transaction id\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"xxx\",      (string) The transaction id\n"
+            "  \"status\": \"xxx\",    (string) unknown, queued, accepted or rejected\n"
+            "  \"message\": \"xxx\"    (string, optional) The result of the commit, or the reject reason\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("gettxadmission", "\"c5287324b89793fdf7fa97b6203dfd814b8358cfa31114078ea5981916d7a8ac\"") +
+            "\nAs json rpc call\n" +
+            HelpExampleRpc("gettxadmission", "\"c5287324b89793fdf7fa97b6203dfd814b8358cfa31114078ea5981916d7a8ac\""));
+    }
+
+    uint256 txid(uint256S(params[0].get_str()));
+    CTxAdmission::CResult result;
+    if (pTxAdmission != nullptr)
+        result = pTxAdmission->GetResult(txid);
 
     Object obj;
-    obj.push_back( Pair("txid", retMsg) );
+    obj.push_back(Pair("txid",      txid.GetHex()));
+    obj.push_back(Pair("status",    CTxAdmission::GetStatusName(result.status)));
+    if (!result.message.empty())
+        obj.push_back(Pair("message", result.message));
     return obj;
 }
 
@@ -282,9 +282,9 @@ Value signmessage(const Array& params, bool fHelp) {
 
 
 Value submitsendtx(const Array& params, bool fHelp) {
-    if (fHelp || (params.size() != 4 && params.size() != 5))
+    if (fHelp || params.size() < 4 || params.size() > 6)
         throw runtime_error(
-                "submitsendtx \"from\" \"to\" \"symbol:coin:unit\" \"symbol:fee:unit\" [\"memo\"]\n"
+                "submitsendtx \"from\" \"to\" \"symbol:coin:unit\" \"symbol:fee:unit\" [\"memo\"] [async]\n"
                 "\nSend coins to a given address.\n" +
                 HelpRequiringPassphrase() +
                 "\nArguments:\n"
@@ -293,6 +293,8 @@ Value submitsendtx(const Array& params, bool fHelp) {
                 "3.\"symbol:coin:unit\":    (symbol:amount:unit, required) transferred coins\n"
                 "4.\"symbol:fee:unit\":     (symbol:amount:unit, required) fee paid to miner, default is WICC:10000:sawi\n"
                 "5.\"memo\":                (string, optional)\n"
+                "6.\"async\":               (bool, optional) return once the transaction is queued for the admission,"
+                " with its status, see gettxadmission, default is false\n"
                 "\nResult:\n"
                 "\"txid\"                   (string) The transaction id.\n"
                 "\nExamples:\n" +
@@ -304,47 +306,52 @@ Value submitsendtx(const Array& params, bool fHelp) {
                                "\"wLKf2NqwtHk3BfzK5wMDfbKYN1SC3weyR4\", \"wNDue1jHcgRSioSDL4o1AzXz3D72gCMkP6\", "
                                "\"WICC:1000000:sawi\", \"WICC:10000:sawi\", \"Hello, WaykiChain!\""));
 
-    EnsureWalletIsUnlocked();
-
-    CUserID sendUserId = RPC_PARAM::GetUserId(params[0], true);
-    CUserID recvUserId = RPC_PARAM::GetUserId(params[1]);
-    ComboMoney cmCoin  = RPC_PARAM::GetComboMoney(params[2], SYMB::WICC);
-    ComboMoney cmFee   = RPC_PARAM::GetFee(params, 3, UCOIN_TRANSFER_TX);
-
-    if (!pCdMan->pAssetCache->CheckAsset(cmCoin.symbol))
-        throw JSONRPCError(REJECT_INVALID, strprintf("Invalid coin symbol=%s!", cmCoin.symbol));
-
-    if (cmCoin.amount == 0)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Coins is zero!");
-
-    CAccount account = RPC_PARAM::GetUserAccount(*pCdMan->pAccountCache, sendUserId);
-    RPC_PARAM::CheckAccountBalance(account, cmCoin.symbol, SUB_FREE, cmCoin.GetAmountInSawi());
-    RPC_PARAM::CheckAccountBalance(account, cmFee.symbol, SUB_FREE, cmFee.GetAmountInSawi());
+    string memo = params.size() > 4 ? params[4].get_str() : "";
+    bool async  = params.size() > 5 && params[5].get_bool();
 
-    string memo    = params.size() == 5 ? params[4].get_str() : "";
-    int32_t height = chainActive.Height();
+    // thread-safe, the locks are not held while the tx is committed
+    CKeyID keyid;
+    std::shared_ptr<CBaseTx> pTx;
+    {
+        LOCK2(cs_main, pWalletMain->cs_wallet);
+        EnsureWalletIsUnlocked();
 
-    Object obj;
-    if (GetFeatureForkVersion(height) >= MAJOR_VER_R2) {
+        CUserID sendUserId = RPC_PARAM::GetUserId(params[0], true);
+        CUserID recvUserId = RPC_PARAM::GetUserId(params[1]);
+        ComboMoney cmCoin  = RPC_PARAM::GetComboMoney(params[2], SYMB::WICC);
+        ComboMoney cmFee   = RPC_PARAM::GetFee(params, 3, UCOIN_TRANSFER_TX);
 
-        CCoinTransferTx tx(sendUserId, recvUserId, height, cmCoin.symbol,
-                        cmCoin.GetAmountInSawi(), cmFee.symbol, cmFee.GetAmountInSawi(), memo);
-        obj = SubmitTx(account.keyid, tx);
-    } else { // MAJOR_VER_R1
-        if (cmCoin.symbol != SYMB::WICC || cmFee.symbol != SYMB::WICC)
-            throw JSONRPCError(REJECT_INVALID, strprintf("Only support WICC for coin symbol or fee symbol before "
-                                                         "height=%u! current height=%d", SysCfg().GetFeatureForkHeight(), height));
+        if (!pCdMan->pAssetCache->CheckAsset(cmCoin.symbol))
+            throw JSONRPCError(REJECT_INVALID, strprintf("Invalid coin symbol=%s!", cmCoin.symbol));
 
-        if (sendUserId.is<CKeyID>())
-            throw JSONRPCError(REJECT_INVALID, strprintf("%s is unregistered, should register first",
-                                                         sendUserId.get<CKeyID>().ToAddress()));
+        if (cmCoin.amount == 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Coins is zero!");
 
-        CBaseCoinTransferTx tx(sendUserId, recvUserId, height, cmCoin.GetAmountInSawi(),
+        CAccount account = RPC_PARAM::GetUserAccount(*pCdMan->pAccountCache, sendUserId);
+        RPC_PARAM::CheckAccountBalance(account, cmCoin.symbol, SUB_FREE, cmCoin.GetAmountInSawi());
+        RPC_PARAM::CheckAccountBalance(account, cmFee.symbol, SUB_FREE, cmFee.GetAmountInSawi());
+
+        keyid          = account.keyid;
+        int32_t height = chainActive.Height();
+        if (GetFeatureForkVersion(height) >= MAJOR_VER_R2) {
+            pTx = std::make_shared<CCoinTransferTx>(sendUserId, recvUserId, height, cmCoin.symbol,
+                                                    cmCoin.GetAmountInSawi(), cmFee.symbol, cmFee.GetAmountInSawi(),
+                                                    memo);
+        } else { // MAJOR_VER_R1
+            if (cmCoin.symbol != SYMB::WICC || cmFee.symbol != SYMB::WICC)
+                throw JSONRPCError(REJECT_INVALID, strprintf("Only support WICC for coin symbol or fee symbol before "
+                                                             "height=%u! current height=%d", SysCfg().GetFeatureForkHeight(), height));
+
+            if (sendUserId.is<CKeyID>())
+                throw JSONRPCError(REJECT_INVALID, strprintf("%s is unregistered, should register first",
+                                                             sendUserId.get<CKeyID>().ToAddress()));
+
+            pTx = std::make_shared<CBaseCoinTransferTx>(sendUserId, recvUserId, height, cmCoin.GetAmountInSawi(),
                                                         cmFee.GetAmountInSawi(), memo);
-        obj = SubmitTx(account.keyid, tx);
+        }
     }
 
-    return obj;
+    return SubmitTx(keyid, *pTx, async);
 }
 
 
@@ -48,3 +48,25 @@ void CSignatureCache::Set(const uint256& sigHash, const std::vector<unsigned cha
 
     setValid.insert(entry);
 }
+
+void CSignatureCache::Clear() {
+    std::unique_lock<std::mutex> lock(mtx);
+    setValid.clear();
+}
+
+static void VerifySignature(CSignatureCache& cache, const CSigVerifyItem& item) {
+    const std::vector<unsigned char>& signature = *item.pSignature;
+    for (const auto& pubKey : item.pubKeys) {
+        if (cache.Get(item.sigHash, signature, pubKey))
+            return;
+
+        if (pubKey.Verify(item.sigHash, signature)) {
+            cache.Set(item.sigHash, signature, pubKey);
+            return;
+        }
+    }
+}
+
+void VerifySignatures(CWorkerPool& pool, CSignatureCache& cache, const std::vector<CSigVerifyItem>& items) {
+    pool.Run(items.size(), [&](size_t index) { VerifySignature(cache, items[index]); });
+}
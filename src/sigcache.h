@@ -16,6 +16,7 @@
 #include "commons/random.h"
 #include "commons/uint256.h"
 #include "commons/util/util.h"
+#include "commons/util/workerpool.h"
 
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -35,10 +36,29 @@ public:
              const CPubKey& pubKey);
     void Set(const uint256& sigHash, const std::vector<unsigned char>& vchSig,
              const CPubKey& pubKey);
+    void Clear();
 
 private:
     void ComputeEntry(uint256& entry, const uint256& sigHash,
                       const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
 };
 
+/**
+ * A signature of a tx to be verified ahead of the tx execution. The pubkeys are tried in the
+ * order the tx execution tries them, the first matching one is put into the signature cache.
+ */
+struct CSigVerifyItem {
+    uint256 sigHash;
+    const std::vector<unsigned char>* pSignature;  // points into the tx, the tx must outlive the item
+    std::vector<CPubKey> pubKeys;
+
+    CSigVerifyItem(const uint256& sigHashIn, const std::vector<unsigned char>& signatureIn,
+                   const std::vector<CPubKey>& pubKeysIn)
+        : sigHash(sigHashIn), pSignature(&signatureIn), pubKeys(pubKeysIn) {}
+};
+
+// verify the items on the pool, the valid signatures are put into the cache. The invalid ones are
+// only skipped, the tx execution still rejects them.
+void VerifySignatures(CWorkerPool& pool, CSignatureCache& cache, const std::vector<CSigVerifyItem>& items);
+
 #endif  // COIN_SIGCACHE_H
\ No newline at end of file
@@ -0,0 +1,139 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "persistence/block.h"
+#include "persistence/cachewrapper.h"
+
+using namespace std;
+
+struct FBlockImportTests {
+    FBlockImportTests() {
+        file_path = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("blk-%%%%-%%%%.dat");
+    }
+    ~FBlockImportTests() { boost::filesystem::remove(file_path); }
+
+    // append the raw bytes to the block file
+    void Append(const string &data) {
+        FILE *file = fopen(file_path.string().c_str(), "ab");
+        BOOST_REQUIRE(file != nullptr);
+        BOOST_REQUIRE_EQUAL(fwrite(data.data(), 1, data.size(), file), data.size());
+        fclose(file);
+        file_size += data.size();
+    }
+
+    // append the record of the block like WriteBlockToDisk(), return the position of the block, truncate the
+    // record to its first truncateSize bytes if not 0
+    uint64_t AppendBlock(const CBlock &block, size_t truncateSize = 0) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        uint32_t nSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(SysCfg().MessageStart()) << nSize << block;
+        uint64_t blockPos = file_size + MESSAGE_START_SIZE + sizeof(nSize);
+        string record = ss.str();
+        Append(truncateSize > 0 ? record.substr(0, truncateSize) : record);
+        return blockPos;
+    }
+
+    // all the blocks parsed by the reader, taken in small batches
+    vector<CBlockFileReader::Item> ReadAll(uint64_t startPos) {
+        FILE *file = fopen(file_path.string().c_str(), "rb");
+        BOOST_REQUIRE(file != nullptr);
+        CBlockFileReader reader(file, startPos, 2);
+        reader.Start();
+        vector<CBlockFileReader::Item> items, batch;
+        while (reader.Take(3, batch))
+            items.insert(items.end(), batch.begin(), batch.end());
+        reader.Stop();
+        BOOST_CHECK(reader.GetError().empty());
+        return items;
+    }
+
+    boost::filesystem::path file_path;
+    uint64_t file_size = 0;
+};
+
+static CBlock MakeBlock(int32_t height) {
+    CBlock block;
+    block.SetHeight(height);
+    block.SetTime(1500000000 + height * 3);
+    block.SetSignature(vector<unsigned char>(64, 's'));
+    return block;
+}
+
+BOOST_FIXTURE_TEST_SUITE(block_import_tests, FBlockImportTests)
+
+BOOST_AUTO_TEST_CASE(block_file_reader_test)
+{
+    // the garbage, a record with a bad size and a truncated record are skipped
+    vector<CBlock> blocks;
+    vector<uint64_t> blockPositions;
+    Append("garbage before the first block");
+    for (int32_t height = 1; height <= 10; height++) {
+        blocks.push_back(MakeBlock(height));
+        blockPositions.push_back(AppendBlock(blocks.back()));
+        if (height == 3)
+            Append(string((const char *)SysCfg().MessageStart(), MESSAGE_START_SIZE) + string(4, '\x01'));
+        if (height == 6)
+            Append(string(17, '\0'));
+    }
+    AppendBlock(MakeBlock(11), MESSAGE_START_SIZE + 4 + 40);
+
+    // the reader keeps the file order with a queue shorter than the file
+    vector<CBlockFileReader::Item> items = ReadAll(0);
+    BOOST_REQUIRE_EQUAL(items.size(), blocks.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        BOOST_CHECK(items[i].pBlock->GetHash() == blocks[i].GetHash());
+        BOOST_CHECK_EQUAL(items[i].pBlock->GetHeight(), blocks[i].GetHeight());
+        BOOST_CHECK_EQUAL(items[i].block_pos, blockPositions[i]);
+    }
+
+    // the blocks before the start position (the end of the indexed part) are skipped
+    uint64_t startPos = blockPositions[4] - MESSAGE_START_SIZE - sizeof(uint32_t);
+    items = ReadAll(startPos);
+    BOOST_REQUIRE_EQUAL(items.size(), blocks.size() - 4);
+    BOOST_CHECK(items.front().pBlock->GetHash() == blocks[4].GetHash());
+    BOOST_CHECK_EQUAL(items.front().block_pos, blockPositions[4]);
+    BOOST_CHECK_EQUAL(items.back().block_pos, blockPositions.back());
+}
+
+BOOST_AUTO_TEST_CASE(block_file_reader_stop_test)
+{
+    for (int32_t height = 1; height <= 20; height++)
+        AppendBlock(MakeBlock(height));
+
+    // the reader blocked on the full queue stops without the rest of the blocks taken
+    FILE *file = fopen(file_path.string().c_str(), "rb");
+    BOOST_REQUIRE(file != nullptr);
+    CBlockFileReader reader(file, 0, 2);
+    reader.Start();
+    vector<CBlockFileReader::Item> items;
+    BOOST_CHECK(reader.Take(1, items) && items.size() == 1);
+    BOOST_CHECK_EQUAL(items[0].pBlock->GetHeight(), 1);
+    reader.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(checkblock_future_time_test)
+{
+    // a block checked once is still checked against the current time on every call
+    CBlock block;
+    block.SetHeight(1);
+    block.fChecked = true;
+    CCacheWrapper cw;
+    CValidationState state;
+    block.SetTime(GetAdjustedTime() + 3600);
+    BOOST_CHECK(!CheckBlock(block, state, cw, false, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "time-too-new");
+
+    block.SetTime(GetAdjustedTime());
+    CValidationState laterState;
+    BOOST_CHECK(CheckBlock(block, laterState, cw, false, true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
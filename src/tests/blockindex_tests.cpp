@@ -0,0 +1,104 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <map>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+#include "persistence/blockdb.h"
+
+using namespace std;
+
+// write a chain of count block indexes into the db, the hashes by the height
+static void WriteBlockIndexChain(CBlockIndexDB &blockIndexDb, int32_t count, vector<uint256> &hashes) {
+    uint256 hashPrev;
+    for (int32_t height = 0; height < count; height++) {
+        CDiskBlockIndex diskIndex;
+        diskIndex.height   = height;
+        diskIndex.nTime    = height;
+        diskIndex.nStatus  = BLOCK_VALID_SCRIPTS;
+        diskIndex.nTx      = 1;
+        diskIndex.hashPrev = hashPrev;
+        BOOST_CHECK(blockIndexDb.WriteBlockIndex(diskIndex));
+        hashPrev = diskIndex.GetBlockHash();
+        hashes.push_back(hashPrev);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(blockindex_tests)
+
+BOOST_AUTO_TEST_CASE(block_index_load_test)
+{
+    const int32_t count = 2000;
+    CBlockIndexDB blockIndexDb(true, true);
+    vector<uint256> hashes;
+    WriteBlockIndexChain(blockIndexDb, count, hashes);
+    // a fork block and a block of which the predecessor is not in the db
+    CDiskBlockIndex forkIndex;
+    forkIndex.height   = 2;
+    forkIndex.nTime    = 1000000;
+    forkIndex.hashPrev = hashes[1];
+    BOOST_CHECK(blockIndexDb.WriteBlockIndex(forkIndex));
+    CDiskBlockIndex orphanIndex;
+    orphanIndex.height   = 5;
+    orphanIndex.hashPrev = uint256S("0x1234");
+    BOOST_CHECK(blockIndexDb.WriteBlockIndex(orphanIndex));
+
+    CWorkerPool workerPool("test", 4);
+    for (CWorkerPool *pWorkerPool : {(CWorkerPool *)nullptr, &workerPool}) {
+        UnloadBlockIndex();
+
+        vector<CBlockIndex *> vSortedByHeight;
+        BOOST_CHECK(blockIndexDb.LoadBlockIndexes(pWorkerPool, vSortedByHeight));
+
+        // the loaded ones and the empty predecessor of the orphan
+        BOOST_CHECK(mapBlockIndex.size() == (size_t)count + 3);
+        BOOST_CHECK(vSortedByHeight.size() == mapBlockIndex.size());
+        BOOST_CHECK(blockIndexArena.GetCount() == (size_t)count + 2);
+        // every index goes after its predecessor
+        map<CBlockIndex *, size_t> positions;
+        for (size_t i = 0; i < vSortedByHeight.size(); i++) {
+            CBlockIndex *pIndex = vSortedByHeight[i];
+            BOOST_CHECK(mapBlockIndex[pIndex->GetBlockHash()] == pIndex);
+            BOOST_CHECK(pIndex->pprev == nullptr || positions.count(pIndex->pprev));
+            positions[pIndex] = i;
+        }
+        for (int32_t height = 1; height < count; height++)
+            BOOST_CHECK(mapBlockIndex[hashes[height]]->pprev == mapBlockIndex[hashes[height - 1]]);
+        BOOST_CHECK(mapBlockIndex[forkIndex.GetBlockHash()]->pprev == mapBlockIndex[hashes[1]]);
+        CBlockIndex *pOrphanPrev = mapBlockIndex[orphanIndex.GetBlockHash()]->pprev;
+        BOOST_CHECK(pOrphanPrev != nullptr && !blockIndexArena.Contains(pOrphanPrev));
+    }
+    // the unload frees the slab and the index of the orphan predecessor
+    UnloadBlockIndex();
+    BOOST_CHECK(mapBlockIndex.empty() && blockIndexArena.GetCount() == 0);
+}
+
+// the load of 200k block indexes, run it by --run_test=blockindex_tests/block_index_load_bench_test
+BOOST_AUTO_TEST_CASE(block_index_load_bench_test, *boost::unit_test::disabled())
+{
+    const int32_t count = 200000;
+    CBlockIndexDB blockIndexDb(true, true);
+    vector<uint256> hashes;
+    WriteBlockIndexChain(blockIndexDb, count, hashes);
+
+    CWorkerPool workerPool("test", 4);
+    for (CWorkerPool *pWorkerPool : {(CWorkerPool *)nullptr, &workerPool}) {
+        UnloadBlockIndex();
+
+        int64_t beginTime = GetTimeMicros();
+        vector<CBlockIndex *> vSortedByHeight;
+        BOOST_CHECK(blockIndexDb.LoadBlockIndexes(pWorkerPool, vSortedByHeight));
+        BOOST_TEST_MESSAGE(strprintf("load %d block indexes with %d workers: %.2fms, slab=%.1fMB", count,
+                                     pWorkerPool ? pWorkerPool->GetThreadCount() : 0,
+                                     0.001 * (GetTimeMicros() - beginTime),
+                                     blockIndexArena.GetMemoryUsage() / 1048576.0));
+        BOOST_CHECK(vSortedByHeight.size() == (size_t)count);
+    }
+    UnloadBlockIndex();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
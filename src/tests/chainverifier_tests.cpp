@@ -0,0 +1,204 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "chain/chainverifier.h"
+#include "persistence/block.h"
+#include "persistence/blockdb.h"
+#include "persistence/cachewrapper.h"
+#include "tx/blockpricemediantx.h"
+#include "tx/blockrewardtx.h"
+
+using namespace std;
+
+// a small active chain of checked blocks written to the block file of a temp datadir
+struct FChainVerifierTests {
+    static const int32_t TIP_HEIGHT = 40;
+
+    FChainVerifierTests() {
+        data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("chainverifier-%%%%-%%%%");
+        boost::filesystem::create_directories(data_dir);
+        saved_args = CBaseParams::GetMapArgs();
+        CBaseParams::SoftSetArgCover("-datadir", data_dir.string());
+        ClearDatadirCache();
+        pCdMan = new CCacheDBManager(true, false);
+
+        blocks.resize(TIP_HEIGHT + 1);
+        hashes.resize(TIP_HEIGHT + 1);
+        indexes.reserve(TIP_HEIGHT + 1);
+        for (int32_t height = 0; height <= TIP_HEIGHT; height++) {
+            CBlock &block = blocks[height];
+            block.SetHeight(height);
+            block.SetTime(1500000000 + height * 3);
+            if (height > 0)
+                block.SetPrevBlockHash(hashes[height - 1]);
+            block.vptx.push_back(std::make_shared<CUCoinBlockRewardTx>());
+            if (GetFeatureForkVersion(height) >= MAJOR_VER_R2)
+                block.vptx.push_back(std::make_shared<CBlockPriceMedianTx>(height));
+            block.SetMerkleRootHash(block.BuildMerkleTree());
+            block.SetSignature(vector<unsigned char>(64, 's'));
+            hashes[height] = block.GetHash();
+
+            indexes.emplace_back(block);
+            CBlockIndex &index = indexes.back();
+            index.pBlockHash   = &hashes[height];
+            index.pprev        = height > 0 ? &indexes[height - 1] : nullptr;
+            index.height       = height;
+            index.nTx          = block.vptx.size();
+            index.nStatus      = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+            index.BuildSkip();
+            mapBlockIndex[hashes[height]] = &index;
+        }
+        chainActive.SetTip(&indexes.back());
+
+        // the blocks follow each other in the first block file
+        CDiskBlockPos pos(0, 0);
+        for (int32_t height = 0; height <= TIP_HEIGHT; height++) {
+            BOOST_REQUIRE(WriteBlockToDisk(blocks[height], pos));
+            indexes[height].nFile    = pos.nFile;
+            indexes[height].nDataPos = pos.nPos;
+            pos.nPos += ::GetSerializeSize(blocks[height], SER_DISK, CLIENT_VERSION);
+        }
+    }
+    ~FChainVerifierTests() {
+        for (const auto &hash : hashes)
+            mapBlockIndex.erase(hash);
+        chainActive.SetTip(nullptr);
+        delete pCdMan;
+        pCdMan = nullptr;
+        CBaseParams::SetMapArgs(saved_args);
+        ClearDatadirCache();
+        boost::filesystem::remove_all(data_dir);
+    }
+
+    // flip a byte of the merkle root of the block on disk, after the version and the previous block hash
+    void CorruptBlock(int32_t height) {
+        boost::filesystem::path blockPath = data_dir / "blocks" / "blk00000.dat";
+        std::fstream file(blockPath.string(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekg(indexes[height].nDataPos + 40);
+        char byte = file.get();
+        file.seekp(indexes[height].nDataPos + 40);
+        file.put(byte ^ 0x5a);
+    }
+
+    CVerifyDBProgress ReadProgress() {
+        CVerifyDBProgress progress;
+        BOOST_CHECK(pCdMan->pBlockIndexDb->ReadVerifyProgress(progress));
+        return progress;
+    }
+
+    uint64_t CountTxs(int32_t fromHeight, int32_t toHeight) const {
+        uint64_t count = 0;
+        for (int32_t height = fromHeight; height <= toHeight; height++)
+            count += blocks[height].vptx.size();
+        return count;
+    }
+
+    boost::filesystem::path data_dir;
+    map<string, string> saved_args;
+    vector<CBlock> blocks;
+    vector<uint256> hashes;
+    vector<CBlockIndex> indexes;  // reserved, the pprev and the chain point into it
+};
+
+BOOST_AUTO_TEST_SUITE(chainverifier_tests)
+
+BOOST_AUTO_TEST_CASE(verify_progress_test)
+{
+    CBlockIndexDB blockIndexDb(true, true);
+    CVerifyDBProgress progress;
+    BOOST_CHECK(!blockIndexDb.ReadVerifyProgress(progress) && progress.IsNull());
+
+    progress.tip_hash        = uint256S("0x1234");
+    progress.tip_height      = 1000;
+    progress.check_level     = 3;
+    progress.stop_height     = 712;
+    progress.next_height     = 840;
+    progress.verified_blocks = 161;
+    progress.verified_txs    = 500;
+    progress.state_height    = 920;
+    BOOST_CHECK(blockIndexDb.WriteVerifyProgress(progress));
+
+    // the run goes on from the saved progress
+    CVerifyDBProgress saved;
+    BOOST_CHECK(blockIndexDb.ReadVerifyProgress(saved));
+    BOOST_CHECK(saved.tip_hash == progress.tip_hash && saved.tip_height == 1000 && saved.check_level == 3);
+    BOOST_CHECK(saved.stop_height == 712 && saved.next_height == 840);
+    BOOST_CHECK(saved.verified_blocks == 161 && saved.verified_txs == 500 && saved.state_height == 920);
+    BOOST_CHECK(!saved.finished && saved.error.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(verify_resume_test, FChainVerifierTests)
+{
+    // the blocks above 25 were verified before the restart, the bad block among them is not read again
+    CVerifyDBProgress saved;
+    saved.tip_hash        = hashes[TIP_HEIGHT];
+    saved.tip_height      = TIP_HEIGHT;
+    saved.check_level     = 1;
+    saved.stop_height     = 1;
+    saved.next_height     = 25;
+    saved.verified_blocks = TIP_HEIGHT - 25;
+    saved.verified_txs    = CountTxs(26, TIP_HEIGHT);
+    BOOST_CHECK(pCdMan->pBlockIndexDb->WriteVerifyProgress(saved));
+    CorruptBlock(30);
+
+    CChainVerifier verifier;
+    BOOST_CHECK(verifier.Run(1, 0, 2));
+    CVerifyDBProgress progress = ReadProgress();
+    BOOST_CHECK(progress.finished && progress.error.empty());
+    BOOST_CHECK_EQUAL(progress.stop_height, 1);
+    BOOST_CHECK_EQUAL(progress.next_height, 0);
+    BOOST_CHECK_EQUAL(progress.verified_blocks, (uint64_t)TIP_HEIGHT);
+    BOOST_CHECK_EQUAL(progress.verified_txs, CountTxs(1, TIP_HEIGHT));
+
+    // the finished run of the same tip is not done again
+    CChainVerifier again;
+    BOOST_CHECK(again.Run(1, 0, 2));
+    BOOST_CHECK_EQUAL(ReadProgress().verified_blocks, (uint64_t)TIP_HEIGHT);
+}
+
+BOOST_FIXTURE_TEST_CASE(verify_snapshot_boundary_test, FChainVerifierTests)
+{
+    // the blocks up to the snapshot at 20 have no undo data, the run stops at the first of them
+    for (int32_t height = 0; height <= 20; height++)
+        indexes[height].nStatus &= ~BLOCK_HAVE_UNDO;
+    CorruptBlock(10);
+
+    CChainVerifier verifier;
+    BOOST_CHECK(verifier.Run(1, 0, 1));
+    CVerifyDBProgress progress = ReadProgress();
+    BOOST_CHECK(progress.finished && progress.error.empty());
+    BOOST_CHECK_EQUAL(progress.stop_height, 20);
+    BOOST_CHECK_EQUAL(progress.next_height, 19);
+    BOOST_CHECK_EQUAL(progress.verified_blocks, (uint64_t)(TIP_HEIGHT - 20 + 1));
+    BOOST_CHECK_EQUAL(progress.verified_txs, CountTxs(20, TIP_HEIGHT));
+}
+
+BOOST_FIXTURE_TEST_CASE(verify_bad_block_test, FChainVerifierTests)
+{
+    // the run fails at the bad block, the blocks above it are verified
+    CorruptBlock(30);
+
+    CChainVerifier verifier;
+    BOOST_CHECK(!verifier.Run(1, 0, 2));
+    CVerifyDBProgress progress = ReadProgress();
+    BOOST_CHECK(progress.finished);
+    BOOST_CHECK(progress.error.find("at 30") != string::npos);
+    BOOST_CHECK_EQUAL(progress.next_height, 30);
+    BOOST_CHECK_EQUAL(progress.verified_blocks, (uint64_t)(TIP_HEIGHT - 30));
+
+    // the failed run is not resumed, the next run starts again from the tip and fails at the same block
+    CChainVerifier again;
+    BOOST_CHECK(!again.Run(1, 0, 2));
+    BOOST_CHECK_EQUAL(ReadProgress().verified_blocks, (uint64_t)(TIP_HEIGHT - 30));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
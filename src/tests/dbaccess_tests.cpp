@@ -7,8 +7,15 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <boost/test/unit_test.hpp>
 #include "persistence/dbaccess.h"
+#include "persistence/cachewrapper.h"
+#include "persistence/blockundo.h"
+#include "persistence/dbasyncwriter.h"
+#include "persistence/dbiterator.h"
 
 using namespace std;
 
@@ -60,6 +67,80 @@ BOOST_AUTO_TEST_CASE(dbaccess_test)
 
 }
 
+BOOST_AUTO_TEST_CASE(dbaccess_key_codec_test)
+{
+    typedef tuple<CFixedUInt64, CRegIDKey, uint256> FixedKey;
+    typedef pair<CFixedUInt32, dbk::CDBTailKey<64>> TailKey;
+    static_assert(dbk::CDBKeySize<FixedKey>::SIZE == CFixedUInt64::SIZE + CRegIDKey::KEY_SIZE + 32, "fixed key size");
+    static_assert(dbk::CDBKeySize<TailKey>::SIZE == 0, "variable key size");
+
+    // same encoding as the CDataStream
+    FixedKey fixedKey(CFixedUInt64(100), CRegIDKey(CRegID(10, 2)), uint256S("0x1234"));
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey.write("vote", 4);
+    ssKey << fixedKey;
+    BOOST_CHECK(dbk::GenDbKey(dbk::VOTE, fixedKey) == ssKey.str());
+
+    FixedKey parsedKey;
+    BOOST_CHECK(dbk::ParseDbKey(ssKey.str(), dbk::VOTE, parsedKey));
+    BOOST_CHECK(parsedKey == fixedKey);
+
+    // the tail key is the rest of the slice
+    TailKey tailKey(CFixedUInt32(7), dbk::CDBTailKey<64>("tail"));
+    TailKey parsedTailKey;
+    BOOST_CHECK(dbk::ParseDbKey(dbk::GenDbKey(dbk::VOTE, tailKey), dbk::VOTE, parsedTailKey));
+    BOOST_CHECK(parsedTailKey.first == tailKey.first && parsedTailKey.second.GetKey() == "tail");
+
+    // the long key goes to the heap
+    string longKey(1000, 'k');
+    dbk::CDBKey<string> dbKey(dbk::REGID_KEYID, longKey);
+    BOOST_CHECK(dbKey.GetSlice().size() == 4 + 3 + longKey.size());
+    string parsedLongKey;
+    BOOST_CHECK(dbk::ParseDbKey(dbKey.GetSlice(), dbk::REGID_KEYID, parsedLongKey) && parsedLongKey == longKey);
+
+    // the truncated key can not be parsed
+    string truncated = dbk::GenDbKey(dbk::VOTE, fixedKey).substr(0, 10);
+    BOOST_CHECK_THROW(dbk::ParseDbKey(truncated, dbk::VOTE, parsedKey), std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_max_open_files_test)
+{
+    // the file descriptors reserved at startup cover the max_open_files of the profiles of all the dbs
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    int32_t openFiles = GetDBOpenFiles(DB_PROFILE_APPEND);
+    for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++)
+        openFiles += GetDBOpenFiles(DBProfileTypes[i]);
+    BOOST_CHECK(CCacheDBManager::GetMaxOpenFiles() == openFiles);
+    BOOST_CHECK(GetDBOpenFiles(DB_PROFILE_RANDOM_READ) == 256 && GetDBOpenFiles(DB_PROFILE_WRITE_ONCE) == DB_MIN_OPEN_FILES);
+    // leveldb raises a smaller max_open_files without a warning, no profile goes below it
+    for (int32_t i = 0; i < DB_PROFILE_COUNT; i++)
+        BOOST_CHECK(kDBProfiles[i].max_open_files >= DB_MIN_OPEN_FILES);
+
+    // the block index db and the shared store
+    CBaseParams::SoftSetArgCover("-singledbstore", "1");
+    BOOST_CHECK(CCacheDBManager::GetMaxOpenFiles() == 2 * DB_MIN_OPEN_FILES);
+    CBaseParams::SetMapArgs(savedArgs);
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_store_layout_test)
+{
+    // the chain state of the other -singledbstore layout is kept on -reindex, the manager refuses to open it
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    CBaseParams::SoftSetArgCover("-datadir", (db_dir / "layout").string());
+    ClearDatadirCache();
+    delete new CCacheDBManager(true, false);
+    const boost::filesystem::path accountPath = GetDataDir() / "blocks" / GetDbName(DBNameType::ACCOUNT);
+    BOOST_CHECK(boost::filesystem::exists(accountPath));
+
+    CBaseParams::SoftSetArgCover("-singledbstore", "1");
+    BOOST_CHECK_THROW(delete new CCacheDBManager(true, false), runtime_error);
+    BOOST_CHECK(boost::filesystem::exists(accountPath));
+    BOOST_CHECK(!boost::filesystem::exists(GetDataDir() / "blocks" / "chainstate"));
+
+    CBaseParams::SetMapArgs(savedArgs);
+    ClearDatadirCache();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -157,6 +238,20 @@ static uint32_t GetCacheSerializeSize(CacheType &cache) {
     return ret;
 }
 
+// the estimated memory of a map node charged to the budget, see CCompositeKVCache::CalcNodeSize()
+template <typename CacheType, typename NodeValue>
+static uint32_t GetNodeSize(const string &key, const string &value) {
+    return CacheType::MAP_NODE_OVERHEAD + sizeof(NodeValue) + GetSerSize(key) + GetSerSize(value);
+}
+
+template <typename CacheType>
+static uint32_t GetCacheNodeSize(CacheType &cache) {
+    uint32_t ret = 0;
+    for (auto item : cache.GetMapData())
+        ret += GetNodeSize<CacheType, typename CacheType::Map::value_type>(item.first, item.second);
+    return ret;
+}
+
 BOOST_AUTO_TEST_CASE(dbcache_cache_size_test)
 {
     const bool isWipe = true;
@@ -164,21 +259,746 @@ BOOST_AUTO_TEST_CASE(dbcache_cache_size_test)
     shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
         db_dir, DBNameType::ACCOUNT, false, isWipe);
 
-    auto pDBCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    typedef CCompositeKVCache<prefix, string, string> CacheType;
+    auto pDBCache = make_shared<CacheType>(pDBAccess.get());
     pDBCache->SetData("regid-1", "keyid-1");
-    BOOST_CHECK(pDBCache->GetCacheSize() == GetSerSize(make_pair<string, string>("regid-1", "keyid-1")));
+    // every item is charged with its serialized size and the memory of its map node
+    BOOST_CHECK((pDBCache->GetCacheSize() == GetNodeSize<CacheType, CacheType::Map::value_type>("regid-1", "keyid-1")));
+    BOOST_CHECK(pDBCache->GetCacheSize() > GetSerSize(make_pair<string, string>("regid-1", "keyid-1")));
     pDBCache->SetData("regid-2", "keyid-2");
     pDBCache->SetData("regid-3", "keyid-3");
-    BOOST_CHECK(pDBCache->GetCacheSize() == GetCacheSerializeSize(*pDBCache));
+    BOOST_CHECK(pDBCache->GetCacheSize() == GetCacheNodeSize(*pDBCache));
     pDBCache->Flush();
     BOOST_CHECK(pDBCache->GetCacheSize() == 0);
     BOOST_CHECK(GetCacheSerializeSize(*pDBCache) == 0);
+    // the flushed data is kept as clean data, charged with the nodes of the clean map
+    uint32_t cleanSize = 0;
+    for (int32_t i = 1; i <= 3; i++) {
+        cleanSize += GetNodeSize<CacheType, CacheType::CleanMap::value_type>(strprintf("regid-%d", i),
+                                                                             strprintf("keyid-%d", i));
+    }
+    BOOST_CHECK_EQUAL(pDBCache->GetCleanSize(), cleanSize);
 
-    auto pDBCache2 = make_shared< CCompositeKVCache<prefix, string, string> >(pDBCache.get());
+    auto pDBCache2 = make_shared<CacheType>(pDBCache.get());
     string value1;
     BOOST_CHECK(pDBCache2->GetData(string("regid-1"), value1));
-    BOOST_CHECK(pDBCache->GetCacheSize() == GetSerSize(make_pair<string, string>("regid-1", "keyid-1")));
+    // the read data is clean, it is not counted in the modified data size
+    BOOST_CHECK(pDBCache->GetCacheSize() == 0);
+    BOOST_CHECK_EQUAL(pDBCache->GetCleanSize(), cleanSize);
     BOOST_CHECK(!pDBCache2->IsCalcSize() && pDBCache2->GetCacheSize() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(dbcache_flat_map_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string, CDBFlatMap<string, string, 4>> FlatCache;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache1 = make_shared<FlatCache>(pDBAccess.get());
+    auto pDBCache2 = make_shared<FlatCache>(pDBCache1.get());
+    for (int32_t i = 9; i >= 0; i--) {
+        pDBCache1->SetData(strprintf("regid-%d", i), strprintf("keyid-%d", i));
+    }
+    pDBCache1->Flush();
+
+    pDBCache2->SetData("regid-3", "keyid-3-new");
+    pDBCache2->SetData("regid-a", "keyid-a");
+    pDBCache2->EraseData("regid-5");
+
+    // ordered iteration over the flat map merged with the db data
+    vector<string> keys;
+    CDbIterator<FlatCache> it(*pDBCache2);
+    for (it.First(); it.IsValid(); it.Next()) {
+        keys.push_back(it.GetKey());
+    }
+    BOOST_CHECK(keys.size() == 10);
+    BOOST_CHECK(std::is_sorted(keys.begin(), keys.end()));
+    BOOST_CHECK(std::find(keys.begin(), keys.end(), "regid-5") == keys.end());
+
+    FlatCache::Map elements;
+    BOOST_CHECK(pDBCache2->GetAllElements(elements));
+    BOOST_CHECK(elements.size() == 10 && elements["regid-3"] == "keyid-3-new");
+
+    pDBCache2->Flush();
+    string value;
+    BOOST_CHECK(pDBCache1->GetData(string("regid-3"), value) && value == "keyid-3-new");
+    BOOST_CHECK(pDBCache1->GetData(string("regid-a"), value) && value == "keyid-a");
+    BOOST_CHECK(!pDBCache1->HasData(string("regid-5")));
+
+    // a small map is merged item by item into a large one, the large one is rebuilt by a big map
+    CDBFlatMap<string, string, 4> large, small, big;
+    for (int32_t i = 0; i < 100; i++) {
+        large.emplace(strprintf("key-%03d", i * 2), "old");
+    }
+    small.emplace("key-010", "new");
+    small.emplace("key-011", "new");
+    large.Merge(std::move(small));
+    BOOST_CHECK(small.empty() && large.size() == 101);
+    BOOST_CHECK(large.find("key-010")->second == "new" && large.find("key-011")->second == "new");
+    for (int32_t i = 0; i < 50; i++) {
+        big.emplace(strprintf("key-%03d", i * 4 + 1), "big");
+    }
+    large.Merge(std::move(big));
+    BOOST_CHECK(large.size() == 151);
+    vector<string> mergedKeys;
+    for (const auto &item : large)
+        mergedKeys.push_back(item.first);
+    BOOST_CHECK(std::is_sorted(mergedKeys.begin(), mergedKeys.end()));
+    BOOST_CHECK(large.find("key-011")->second == "new" && large.find("key-021")->second == "big");
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_flat_map_stable_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string, CDBFlatMap<string, string, 4>> FlatCache;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache1 = make_shared<FlatCache>(pDBAccess.get());
+    auto pDBCache2 = make_shared<FlatCache>(pDBCache1.get());
+    pDBCache2->SetData("regid-5", "keyid-5");
+    // the value held like the result of FindData()
+    const string *pValue = &pDBCache2->GetMapData().find("regid-5")->second;
+
+    // the new keys fill the insert buffer and the arena many times, the held value does not move
+    for (int32_t i = 100; i > 0; i--) {
+        pDBCache2->SetData(strprintf("regid-%03d", i), strprintf("keyid-%03d", i));
+    }
+    BOOST_CHECK(pValue == &pDBCache2->GetMapData().find("regid-5")->second && *pValue == "keyid-5");
+
+    // the const iteration neither reorders nor moves the items
+    pDBCache2->SetData("regid-0", "keyid-0");
+    const FlatCache::DataMap &constMap = pDBCache2->GetMapData();
+    vector<string> keys;
+    for (const auto &item : constMap)
+        keys.push_back(item.first);
+    BOOST_CHECK(keys.size() == 102);
+    BOOST_CHECK(pValue == &constMap.find("regid-5")->second && *pValue == "keyid-5");
+    CDBFlatMap<string, string, 4> smallMap;
+    smallMap.emplace("key-b", "b");
+    smallMap.emplace("key-a", "a");
+    const auto &constSmallMap = smallMap;
+    BOOST_CHECK(constSmallMap.begin()->first == "key-b" && smallMap.begin()->first == "key-a");
+
+    // the ordered access sorts the index only, then the erase of other keys keeps the value too
+    keys.clear();
+    for (const auto &item : pDBCache2->GetMapData())
+        keys.push_back(item.first);
+    BOOST_CHECK(keys.size() == 102 && std::is_sorted(keys.begin(), keys.end()));
+    auto &dataMap = pDBCache2->GetMapData();
+    for (int32_t i = 1; i <= 50; i++) {
+        dataMap.erase(dataMap.find(strprintf("regid-%03d", i)));
+    }
+    BOOST_CHECK(pValue == &dataMap.find("regid-5")->second && *pValue == "keyid-5");
+
+    // the merge into the base assigns the existing keys in place
+    pDBCache1->SetData("regid-5", "keyid-5-base");
+    const string *pBaseValue = &pDBCache1->GetMapData().find("regid-5")->second;
+    pDBCache2->Flush();
+    BOOST_CHECK(pBaseValue == &pDBCache1->GetMapData().find("regid-5")->second && *pBaseValue == "keyid-5");
+
+    // the copy owns its items
+    FlatCache::DataMap copied = pDBCache1->GetMapData();
+    pDBCache1->Clear();
+    BOOST_CHECK(copied.size() == 52 && copied.find("regid-5")->second == "keyid-5");
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_drop_data_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string, CDBFlatMap<string, string, 4>> FlatCache;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache1 = make_shared<FlatCache>(pDBAccess.get());
+    for (int32_t i = 0; i < 10; i++) {
+        pDBCache1->SetData(strprintf("regid-%d", i), strprintf("keyid-%d", i));
+    }
+    pDBCache1->Flush();
+
+    // the overlay writes the keys with the tracker active
+    auto pDBCache2 = make_shared<FlatCache>(pDBCache1.get());
+    CDBAccessTracker tracker;
+    {
+        CDBAccessTrackerScope trackerScope(tracker);
+        for (int32_t i = 7; i >= 0; i--) {
+            pDBCache2->SetData(strprintf("regid-%d", i), strprintf("keyid-%d-new", i));
+        }
+    }
+    BOOST_CHECK(tracker.GetWriteKeys().size() == 8);
+    pDBCache1->SetData("regid-2", "keyid-2-base");
+
+    // the empty value of the undo function drops the written keys, they are read from the base again
+    UndoDataFuncMap undoDataFuncMap;
+    pDBCache2->RegisterUndoFunc(undoDataFuncMap);
+    const string &keyPrefix = dbk::GetKeyPrefix(prefix);
+    for (const string regid : {"regid-2", "regid-6", "regid-9"}) {
+        string key = dbk::GenDbKey(prefix, regid);
+        leveldb::Slice slKey(key);
+        slKey.remove_prefix(keyPrefix.size());
+        undoDataFuncMap[prefix](slKey, leveldb::Slice());
+    }
+
+    string value;
+    BOOST_CHECK(pDBCache2->GetMapData().size() == 6);
+    BOOST_CHECK(pDBCache2->GetData(string("regid-2"), value) && value == "keyid-2-base");
+    BOOST_CHECK(pDBCache2->GetData(string("regid-6"), value) && value == "keyid-6");
+    BOOST_CHECK(pDBCache2->GetData(string("regid-1"), value) && value == "keyid-1-new");
+    BOOST_CHECK(pDBCache2->GetData(string("regid-7"), value) && value == "keyid-7-new");
+
+    // the flat map stays ordered after the erases
+    vector<string> keys;
+    for (const auto &item : pDBCache2->GetMapData())
+        keys.push_back(item.first);
+    BOOST_CHECK(keys.size() == 6 && std::is_sorted(keys.begin(), keys.end()));
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_negative_lookup_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    pDBCache->SetData("regid-1", "keyid-1");
+    pDBCache->Flush();
+
+    BOOST_CHECK(pDBAccess->EnableBloomFilter(prefix));
+    string value;
+    BOOST_CHECK(pDBCache->GetData(string("regid-1"), value) && value == "keyid-1");
+    BOOST_CHECK(!pDBCache->GetData(string("regid-2"), value));
+    // the second miss is answered by the negative cache
+    BOOST_CHECK(!pDBCache->GetData(string("regid-2"), value));
+
+    // the negative cache must be updated by the flush
+    auto pDBCache2 = make_shared< CCompositeKVCache<prefix, string, string> >(pDBCache.get());
+    pDBCache2->SetData("regid-2", "keyid-2");
+    pDBCache2->Flush();
+    pDBCache->Flush();
+    BOOST_CHECK(pDBCache->GetData(string("regid-2"), value) && value == "keyid-2");
+
+    // written by other cache, the negative cache must be dropped
+    BOOST_CHECK(!pDBCache->GetData(string("regid-3"), value));
+    auto pOtherCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    pOtherCache->SetData("regid-3", "keyid-3");
+    pOtherCache->Flush();
+    BOOST_CHECK(pDBCache->GetData(string("regid-3"), value) && value == "keyid-3");
+
+    Object stats = pDBAccess->GetStatsJson();
+    BOOST_CHECK(stats.size() == 1);
+}
+
+// the capacity of the bloom filter of the prefix type in the stats, 0 if none
+static uint64_t GetBloomFilterCapacity(const CDBAccess &dbAccess, const dbk::PrefixType prefix) {
+    Object stats = dbAccess.GetStatsJson();
+    const Value &prefixStats = find_value(stats, dbk::GetKeyPrefixMemo(prefix));
+    if (prefixStats.type() != obj_type)
+        return 0;
+    const Value &filterStats = find_value(prefixStats.get_obj(), "bloom_filter");
+    return filterStats.type() == obj_type ? find_value(filterStats.get_obj(), "capacity").get_uint64() : 0;
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_bloom_filter_rebuild_test)
+{
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string> CacheType;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(db_dir, DBNameType::ACCOUNT, false, true);
+    CacheType dbCache(pDBAccess.get());
+    dbCache.SetData("regid-first", "keyid");
+    dbCache.Flush();
+
+    BOOST_CHECK(pDBAccess->EnableBloomFilter(prefix));
+    uint64_t capacity = GetBloomFilterCapacity(*pDBAccess, prefix);
+    BOOST_CHECK(capacity == CDBKeyBloomFilter::MIN_ELEMENTS);
+
+    // the written key is always found by the reader, while the filter is filled and built again
+    std::atomic<bool> stopped{false};
+    std::atomic<uint32_t> missCount{0};
+    std::thread reader([&]() {
+        string value;
+        while (!stopped) {
+            if (!pDBAccess->GetData(prefix, string("regid-first"), value))
+                missCount++;
+        }
+    });
+
+    const int32_t batchCount = 3, batchSize = (int32_t)capacity / 2 + 1;
+    for (int32_t batch = 0; batch < batchCount; batch++) {
+        CacheType batchCache(pDBAccess.get());
+        for (int32_t i = 0; i < batchSize; i++) {
+            batchCache.SetData(strprintf("regid-%d-%d", batch, i), "keyid");
+        }
+        batchCache.Flush();
+    }
+    stopped = true;
+    reader.join();
+    BOOST_CHECK(missCount == 0);
+
+    // built again with the keys in db
+    BOOST_CHECK(GetBloomFilterCapacity(*pDBAccess, prefix) > capacity);
+    string value;
+    for (int32_t batch = 0; batch < batchCount; batch++) {
+        for (int32_t i = 0; i < batchSize; i += 97) {
+            BOOST_CHECK(pDBAccess->GetData(prefix, strprintf("regid-%d-%d", batch, i), value));
+        }
+    }
+    BOOST_CHECK(!pDBAccess->GetData(prefix, string("regid-none"), value));
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_copy_on_write_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache1 = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    pDBCache1->SetData("regid-1", "keyid-1");
+    pDBCache1->SetData("regid-2", "keyid-2");
+    pDBCache1->Flush();
+
+    auto pDBCache2 = make_shared< CCompositeKVCache<prefix, string, string> >(pDBCache1.get());
+    auto pDBCache3 = make_shared< CCompositeKVCache<prefix, string, string> >(pDBCache2.get());
+
+    // the read only access does not copy the value into the child caches
+    string value;
+    BOOST_CHECK(pDBCache3->GetData(string("regid-1"), value) && value == "keyid-1");
+    BOOST_CHECK(pDBCache3->HasData(string("regid-2")));
+    BOOST_CHECK(pDBCache3->GetMapData().empty() && pDBCache2->GetMapData().empty());
+    BOOST_CHECK(pDBCache1->GetMapData().size() == 2);
+
+    // the written value is copied into the written cache only
+    pDBCache3->SetData("regid-1", "keyid-1-new");
+    pDBCache3->EraseData("regid-2");
+    BOOST_CHECK(pDBCache3->GetMapData().size() == 2 && pDBCache2->GetMapData().empty());
+    BOOST_CHECK(pDBCache2->GetData(string("regid-1"), value) && value == "keyid-1");
+
+    pDBCache3->Flush();
+    BOOST_CHECK(pDBCache3->GetMapData().empty() && pDBCache2->GetMapData().size() == 2);
+    BOOST_CHECK(pDBCache2->GetData(string("regid-1"), value) && value == "keyid-1-new");
+    BOOST_CHECK(!pDBCache2->HasData(string("regid-2")));
+    BOOST_CHECK(pDBCache1->GetData(string("regid-1"), value) && value == "keyid-1");
+
+    // a child cache moved onto another base keeps the data written to it, the rest is read from the new base
+    auto pOtherBase = make_shared< CCompositeKVCache<prefix, string, string> >(pDBCache1.get());
+    pOtherBase->SetData("regid-3", "keyid-3");
+    pDBCache3->SetData("regid-1", "keyid-1-moved");
+    pDBCache3->SetBase(pOtherBase.get());
+    BOOST_CHECK(pDBCache3->GetData(string("regid-1"), value) && value == "keyid-1-moved");
+    BOOST_CHECK(pDBCache3->GetData(string("regid-3"), value) && value == "keyid-3");
+    BOOST_CHECK(pDBCache3->GetData(string("regid-2"), value) && value == "keyid-2");
+    pDBCache3->Flush();
+    BOOST_CHECK(pOtherBase->GetData(string("regid-1"), value) && value == "keyid-1-moved");
+    BOOST_CHECK(pDBCache2->GetData(string("regid-1"), value) && value == "keyid-1-new");
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_budget_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    for (int32_t i = 0; i < 100; i++) {
+        pDBCache->SetData(strprintf("regid-%d", i), strprintf("keyid-%d", i));
+    }
+    pDBCache->Flush();
+    // the flushed data is kept as clean data
+    BOOST_CHECK(pDBCache->GetCacheSize() == 0 && pDBCache->GetMapData().empty());
+    uint64_t cleanSize = pDBCache->GetCleanSize();
+    // every item is charged with the memory of its map node, not only the serialized data
+    BOOST_CHECK(cleanSize >= 100 * 2 * sizeof(string));
+
+    // access the first 10 items, they are the most recently used
+    string value;
+    for (int32_t i = 0; i < 10; i++) {
+        BOOST_CHECK(pDBCache->GetData(strprintf("regid-%d", i), value));
+    }
+
+    // the modified item is moved out of the clean data
+    pDBCache->SetData("regid-10", "keyid-10-new");
+    BOOST_CHECK(pDBCache->GetCleanSize() < cleanSize && pDBCache->GetCacheSize() > 0);
+
+    uint64_t oldLimit = DBCacheBudget().GetLimit();
+    DBCacheBudget().SetLimit(cleanSize / 10);
+    BOOST_CHECK(DBCacheBudget().Evict(pDBCache->GetCacheSize()) > 0);
+    DBCacheBudget().SetLimit(oldLimit);
+    BOOST_CHECK(pDBCache->GetCleanSize() <= cleanSize / 10);
+
+    // the items read again are kept by the clock, the evicted ones are read from db again
+    BOOST_CHECK(pDBCache->GetCleanCount() > 0 && pDBCache->GetCleanCount() <= 10);
+    for (int32_t i = 0; i < 100; i++) {
+        BOOST_CHECK(pDBCache->GetData(strprintf("regid-%d", i), value));
+    }
+    BOOST_CHECK(value == "keyid-99");
+    BOOST_CHECK(pDBCache->GetData(string("regid-10"), value) && value == "keyid-10-new");
+
+    // the missing keys are charged to the budget too and evicted with the clean data
+    uint64_t sizeWithoutMissing = pDBCache->GetCleanSize();
+    for (int32_t i = 0; i < 100; i++) {
+        BOOST_CHECK(!pDBCache->GetData(strprintf("missing-%d", i), value));
+    }
+    BOOST_CHECK(pDBCache->GetCleanSize() >= sizeWithoutMissing + 100 * sizeof(string));
+    BOOST_CHECK(pDBCache->GetCleanCount() >= 100);
+
+    DBCacheBudget().SetLimit(1);
+    BOOST_CHECK(DBCacheBudget().Evict(0) > 0);
+    DBCacheBudget().SetLimit(oldLimit);
+    BOOST_CHECK_EQUAL(pDBCache->GetCleanSize(), 0u);
+    BOOST_CHECK(!pDBCache->GetData(string("missing-0"), value));
+    BOOST_CHECK(pDBCache->GetData(string("regid-0"), value) && value == "keyid-0");
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_async_write_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+    CDBFlushStats flushStats;
+    auto pWriter = make_shared<CDBAsyncWriter>(vector<CDBAccess*>{pDBAccess.get()}, flushStats);
+
+    auto pDBCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    pDBCache->SetData("regid-1", "keyid-1");
+    pDBCache->SetData("regid-2", "keyid-2");
+    pDBCache->Flush();
+
+    // the staged writes are readable before they are written to db
+    auto pOtherCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    string value;
+    BOOST_CHECK(pOtherCache->GetData(string("regid-1"), value) && value == "keyid-1");
+    BOOST_CHECK(pDBAccess->GetWrittenBytes() == 0);
+
+    pWriter->Commit();
+    pDBCache->EraseData("regid-2");
+    pDBCache->Flush();
+    BOOST_CHECK(!(pDBAccess->HasData<string, string>(prefix, string("regid-2"))));
+
+    // the iterator merges the pending writes
+    CCompositeKVCache<prefix, string, string>::Map elements;
+    BOOST_CHECK(pOtherCache->GetAllElements(elements));
+    BOOST_CHECK(elements.size() == 1 && elements["regid-1"] == "keyid-1");
+
+    pWriter->Commit();
+    pWriter->WaitForIdle();
+    BOOST_CHECK(pWriter->GetPendingFlushes() == 0);
+    BOOST_CHECK(pDBAccess->GetWrittenBytes() > 0);
+    pWriter = nullptr;
+    BOOST_CHECK(!pDBAccess->IsStagedWrite());
+}
+
+// the keys of the iterator in the order of iteration
+static vector<string> GetIteratorKeys(leveldb::Iterator &it, const dbk::PrefixType prefixType, bool forward) {
+    vector<string> keys;
+    for (forward ? it.SeekToFirst() : it.SeekToLast(); it.Valid(); forward ? it.Next() : it.Prev()) {
+        string key;
+        if (dbk::ParseDbKey(it.key(), prefixType, key))
+            keys.push_back(key);
+    }
+    return keys;
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_pending_iterator_test)
+{
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(db_dir, DBNameType::ACCOUNT, false, true);
+    auto pDBCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+    for (int32_t i = 1; i <= 4; i++) {
+        pDBCache->SetData("regid-" + std::to_string(i), "keyid-" + std::to_string(i));
+    }
+    pDBCache->Flush();
+
+    // a frozen batch which is not written yet and the staged writes over it
+    pDBAccess->SetStagedWrite(true);
+    pDBCache->EraseData("regid-2");
+    pDBCache->SetData("regid-5", "keyid-5");
+    pDBCache->Flush();
+    CDBPendingBatchList batches;
+    batches.emplace_back(pDBAccess.get(), pDBAccess->FreezePendingBatch());
+    pDBCache->EraseData("regid-4");
+    pDBCache->SetData("regid-1", "keyid-1-new");
+    pDBCache->Flush();
+
+    const vector<string> expected = {"regid-1", "regid-3", "regid-5"};
+    const vector<string> reversed(expected.rbegin(), expected.rend());
+    auto checkIterator = [&]() {
+        auto pCursor = pDBAccess->NewIterator(dbk::GetKeyPrefix(prefix));
+        BOOST_CHECK(GetIteratorKeys(*pCursor, prefix, true) == expected);
+        BOOST_CHECK(GetIteratorKeys(*pCursor, prefix, false) == reversed);
+
+        // change the direction in the middle
+        pCursor->Seek(dbk::GenDbKey(prefix, string("regid-2")));
+        string key;
+        BOOST_CHECK(pCursor->Valid() && dbk::ParseDbKey(pCursor->key(), prefix, key) && key == "regid-3");
+        pCursor->Prev();
+        BOOST_CHECK(pCursor->Valid() && dbk::ParseDbKey(pCursor->key(), prefix, key) && key == "regid-1");
+        pCursor->Next();
+        BOOST_CHECK(pCursor->Valid() && dbk::ParseDbKey(pCursor->key(), prefix, key) && key == "regid-3");
+
+        CCompositeKVCache<prefix, string, string>::Map elements;
+        auto pOtherCache = make_shared< CCompositeKVCache<prefix, string, string> >(pDBAccess.get());
+        BOOST_CHECK(pOtherCache->GetAllElements(elements));
+        BOOST_CHECK(elements.size() == 3 && elements["regid-1"] == "keyid-1-new" && elements["regid-5"] == "keyid-5");
+        BOOST_CHECK(pDBAccess->GetDbCount() == 3);
+    };
+
+    // the iterator never waits for the frozen batch, it sees the same data before and after the writes
+    checkIterator();
+    BOOST_CHECK(pDBAccess->IsStagedWrite());
+    WritePendingBatches(batches);
+    checkIterator();
+    pDBAccess->SetStagedWrite(false);
+    checkIterator();
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_best_block_marker_test)
+{
+    shared_ptr<CDBAccess> pAccountDb = make_shared<CDBAccess>(db_dir, DBNameType::ACCOUNT, false, true);
+    shared_ptr<CDBAccess> pBlockDb = make_shared<CDBAccess>(db_dir, DBNameType::BLOCK, false, true);
+    pAccountDb->SetStagedWrite(true);
+    pBlockDb->SetStagedWrite(true);
+
+    auto pAccountCache = make_shared< CCompositeKVCache<dbk::REGID_KEYID, string, string> >(pAccountDb.get());
+    auto pBestBlockCache = make_shared< CSimpleKVCache<dbk::BEST_BLOCKHASH, uint256> >(pBlockDb.get());
+    pAccountCache->SetData("regid-1", "keyid-1");
+    pBestBlockCache->SetData(uint256S("01"));
+    pAccountCache->Flush();
+    pBestBlockCache->Flush();
+
+    // the marker is held back from the batch of the block db and written alone after all the stores
+    CDBPendingBatchList batches;
+    batches.emplace_back(pAccountDb.get(), pAccountDb->FreezePendingBatch());
+    batches.emplace_back(pBlockDb.get(), pBlockDb->FreezePendingBatch());
+    WritePendingBatches(batches);
+    pAccountDb->SetStagedWrite(false);
+    pBlockDb->SetStagedWrite(false);
+
+    uint256 bestBlock;
+    string value;
+    BOOST_CHECK(pBlockDb->GetStore()->Read(dbk::GetKeyPrefix(dbk::BEST_BLOCKHASH), bestBlock) &&
+                bestBlock == uint256S("01"));
+    BOOST_CHECK(pAccountDb->GetData(dbk::REGID_KEYID, string("regid-1"), value) && value == "keyid-1");
+}
+
+BOOST_AUTO_TEST_CASE(dbaccess_shared_store_test)
+{
+    auto pStore = make_shared<CLevelDBWrapper>(db_dir / "chainstate", 1 << 20, false, true);
+    shared_ptr<CDBAccess> pAccountDb = make_shared<CDBAccess>(DBNameType::ACCOUNT, pStore);
+    shared_ptr<CDBAccess> pContractDb = make_shared<CDBAccess>(DBNameType::CONTRACT, pStore);
+    BOOST_CHECK(pAccountDb->IsSharedStore() && pAccountDb->GetStore() == pContractDb->GetStore());
+    pAccountDb->SetStagedWrite(true);
+    pContractDb->SetStagedWrite(true);
+
+    auto pAccountCache = make_shared< CCompositeKVCache<dbk::REGID_KEYID, string, string> >(pAccountDb.get());
+    auto pContractCache = make_shared< CCompositeKVCache<dbk::CONTRACT_DEF, string, string> >(pContractDb.get());
+    pAccountCache->SetData("regid-1", "keyid-1");
+    pAccountCache->SetData("regid-2", "keyid-2");
+    pContractCache->SetData("regid-1", "contract-1");
+    pAccountCache->Flush();
+    pContractCache->Flush();
+    BOOST_CHECK(pStore->IsEmpty());
+
+    // the staged writes of both dbs are written as one batch
+    CDBPendingBatchList batches;
+    batches.emplace_back(pAccountDb.get(), pAccountDb->FreezePendingBatch());
+    batches.emplace_back(pContractDb.get(), pContractDb->FreezePendingBatch());
+    WritePendingBatches(batches);
+    BOOST_CHECK(pStore->GetDbCount() == 3);
+    BOOST_CHECK(pAccountDb->GetWrittenBytes() > 0 && pContractDb->GetWrittenBytes() > 0);
+
+    // every db only sees the keys of its own prefix types
+    BOOST_CHECK(pAccountDb->GetDbCount() == 2);
+    BOOST_CHECK(pContractDb->GetDbCount() == 1);
+    string value;
+    BOOST_CHECK(pContractDb->GetData(dbk::CONTRACT_DEF, string("regid-1"), value) && value == "contract-1");
+    BOOST_CHECK(pAccountDb->GetData(dbk::REGID_KEYID, string("regid-1"), value) && value == "keyid-1");
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_range_iterator_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string> CacheType;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache1 = make_shared<CacheType>(pDBAccess.get());
+    for (int32_t i = 0; i < 8; i++) {
+        pDBCache1->SetData(strprintf("regid-%d", i), strprintf("keyid-%d", i));
+    }
+    pDBCache1->Flush();
+
+    auto pDBCache2 = make_shared<CacheType>(pDBCache1.get());
+    auto pDBCache3 = make_shared<CacheType>(pDBCache2.get());
+    pDBCache2->EraseData("regid-1");
+    pDBCache2->SetData("regid-2", "keyid-2-new");
+    pDBCache3->SetData("regid-1", "keyid-1-new");
+    pDBCache3->EraseData("regid-3");
+    pDBCache3->SetData("regid-35", "keyid-35");
+
+    // the upper layer wins, the erased keys are skipped, and the scan stops before the end key
+    vector<string> keys, values;
+    CDBRangeIterator<CacheType> it(*pDBCache3, string("regid-6"));
+    for (it.First(); it.IsValid(); it.Next()) {
+        keys.push_back(it.GetKey());
+        values.push_back(it.GetValue());
+    }
+    BOOST_CHECK(keys == vector<string>({"regid-0", "regid-1", "regid-2", "regid-35", "regid-4", "regid-5"}));
+    BOOST_CHECK(values[1] == "keyid-1-new" && values[2] == "keyid-2-new");
+
+    // erase the current key while iterating
+    uint32_t count = 0;
+    for (it.First(); it.IsValid(); it.Next()) {
+        pDBCache3->EraseData(it.GetKey());
+        count++;
+    }
+    BOOST_CHECK(count == 6);
+    for (it.First(); it.IsValid(); it.Next()) {
+        BOOST_CHECK(false);
+    }
+
+    CacheType::Map elements;
+    BOOST_CHECK(pDBCache3->GetAllElements(elements));
+    BOOST_CHECK(elements.size() == 2 && elements.count("regid-6") && elements.count("regid-7"));
+}
+
+BOOST_AUTO_TEST_CASE(dbcache_undo_journal_test)
+{
+    const bool isWipe = true;
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string> CacheType;
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(
+        db_dir, DBNameType::ACCOUNT, false, isWipe);
+
+    auto pDBCache = make_shared<CacheType>(pDBAccess.get());
+    pDBCache->SetData("regid-1", "keyid-1");
+    pDBCache->SetData("regid-2", "keyid-2");
+    pDBCache->Flush();
+
+    // the op logs of two txs are appended to the journal
+    auto pChildCache = make_shared<CacheType>(pDBCache.get());
+    CBlockUndoJournal journal;
+    pChildCache->SetDbOpLogMap(&journal);
+    journal.BeginTx(uint256S("01"));
+    pChildCache->SetData("regid-1", "keyid-1-new");
+    pChildCache->SetData("regid-3", "keyid-3");
+    journal.EndTx();
+    journal.BeginTx(uint256S("02"));
+    pChildCache->SetData("regid-1", "keyid-1-newer");
+    pChildCache->EraseData("regid-2");
+    journal.EndTx();
+    pChildCache->SetDbOpLogMap(nullptr);
+    BOOST_CHECK(journal.GetTxCount() == 2);
+
+    vector<CBlockUndoJournal::OpLog> opLogs;
+    vector<TxID> txids;
+    BOOST_CHECK(journal.GetOpLogs(opLogs, &txids));
+    BOOST_CHECK(opLogs.size() == 4 && txids.size() == 2 && txids[1] == uint256S("02"));
+    BOOST_CHECK(opLogs[2].tx_index == 1 && opLogs[2].prefix_type == prefix);
+
+    CBlockUndo blockUndo;
+    BOOST_CHECK(journal.ToBlockUndo(blockUndo));
+    BOOST_CHECK(blockUndo.vtxundo.size() == 2 && blockUndo.vtxundo[0].txid == uint256S("01"));
+    BOOST_CHECK(blockUndo.vtxundo[0].dbOpLogMap.GetDbOpLogsPtr(prefix)->size() == 2);
+
+    // undo in the reverse order restores the state before the block
+    UndoDataFuncMap undoDataFuncMap;
+    pChildCache->RegisterUndoFunc(undoDataFuncMap);
+    for (auto it = opLogs.rbegin(); it != opLogs.rend(); it++) {
+        undoDataFuncMap[it->prefix_type](it->key, it->value);
+    }
+    string value;
+    BOOST_CHECK(pChildCache->GetData(string("regid-1"), value) && value == "keyid-1");
+    BOOST_CHECK(pChildCache->GetData(string("regid-2"), value) && value == "keyid-2");
+    BOOST_CHECK(!pChildCache->HasData(string("regid-3")));
+}
+
+template <typename CacheType>
+static void BenchDbCache(const boost::filesystem::path &dbDir, const string &name, int32_t count) {
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(dbDir, DBNameType::ACCOUNT, false, true);
+    auto pDBCache = make_shared<CacheType>(pDBAccess.get());
+
+    vector<string> keys;
+    for (int32_t i = 0; i < count; i++) {
+        keys.push_back(strprintf("regid-%d", (i * 7919) % count));
+    }
+
+    int64_t beginTime = GetTimeMicros();
+    for (const auto &key : keys) {
+        pDBCache->SetData(key, key);
+    }
+    int64_t setTime = GetTimeMicros();
+
+    auto pChildCache = make_shared<CacheType>(pDBCache.get());
+    string value;
+    for (const auto &key : keys) {
+        BOOST_CHECK(pChildCache->GetData(key, value));
+    }
+    int64_t getTime = GetTimeMicros();
+
+    pChildCache->Flush();
+    pDBCache->Flush();
+    int64_t flushTime = GetTimeMicros();
+
+    BOOST_TEST_MESSAGE(strprintf("%s: count=%d, set=%.2fms, get=%.2fms, flush=%.2fms", name, count,
+                                 0.001 * (setTime - beginTime), 0.001 * (getTime - setTime),
+                                 0.001 * (flushTime - getTime)));
+}
+
+// many small child caches flushed into a large parent, as the per-tx flushes of a block
+template <typename CacheType>
+static void BenchSmallFlushes(const boost::filesystem::path &dbDir, const string &name, int32_t count,
+                              int32_t flushCount, int32_t itemsPerFlush) {
+    shared_ptr<CDBAccess> pDBAccess = make_shared<CDBAccess>(dbDir, DBNameType::ACCOUNT, false, true);
+    auto pDBCache = make_shared<CacheType>(pDBAccess.get());
+    for (int32_t i = 0; i < count; i++) {
+        pDBCache->SetData(strprintf("regid-%d", i), "keyid");
+    }
+    auto pBlockCache = make_shared<CacheType>(pDBCache.get());
+    for (int32_t i = 0; i < count; i++) {
+        BOOST_CHECK(pBlockCache->HasData(strprintf("regid-%d", i)));
+    }
+
+    int64_t beginTime = GetTimeMicros();
+    for (int32_t n = 0; n < flushCount; n++) {
+        CacheType txCache(pBlockCache.get());
+        for (int32_t i = 0; i < itemsPerFlush; i++) {
+            // an existing key and a new key of every tx
+            if (i % 2 == 0)
+                txCache.SetData(strprintf("regid-%d", (n * 7919 + i) % count), strprintf("keyid-%d", n));
+            else
+                txCache.SetData(strprintf("new-%d-%d", n, i), "keyid");
+        }
+        txCache.Flush();
+    }
+    int64_t flushTime = GetTimeMicros();
+
+    string value;
+    BOOST_CHECK(pBlockCache->GetData(strprintf("regid-%d", ((flushCount - 1) * 7919) % count), value) &&
+                value == strprintf("keyid-%d", flushCount - 1));
+    BOOST_CHECK(pBlockCache->GetData(strprintf("new-%d-1", flushCount - 1), value) && value == "keyid");
+    BOOST_TEST_MESSAGE(strprintf("%s: parent=%d, %d flushes of %d items=%.2fms", name, count, flushCount,
+                                 itemsPerFlush, 0.001 * (flushTime - beginTime)));
+}
+
+// a benchmark, not in the default run: unit_test --run_test=dbaccess_tests/dbcache_container_bench_test
+BOOST_AUTO_TEST_CASE(dbcache_container_bench_test, *boost::unit_test::disabled())
+{
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    const int32_t count = 100000;
+    BenchDbCache<CCompositeKVCache<prefix, string, string>>(db_dir / "map", "std::map", count);
+    BenchDbCache<CCompositeKVCache<prefix, string, string, CDBFlatMap<string, string>>>(
+        db_dir / "flat", "CDBFlatMap", count);
+
+    BenchSmallFlushes<CCompositeKVCache<prefix, string, string>>(db_dir / "map-flush", "std::map", count, 2000, 4);
+    BenchSmallFlushes<CCompositeKVCache<prefix, string, string, CDBFlatMap<string, string>>>(
+        db_dir / "flat-flush", "CDBFlatMap", count, 2000, 4);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,296 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "p2p/headersync.h"
+
+using namespace std;
+
+// a chain of count headers on top of the block prevHash at height
+static vector<CBlockHeader> MakeHeaders(const uint256 &prevHash, int32_t height, uint32_t count, uint32_t nonce = 0) {
+    vector<CBlockHeader> headers;
+    uint256 hash = prevHash;
+    for (uint32_t i = 0; i < count; i++) {
+        CBlockHeader header;
+        header.SetPrevBlockHash(hash);
+        header.SetHeight(height + 1 + i);
+        header.SetTime(1500000000 + (height + 1 + i) * 3);
+        header.SetNonce(nonce);
+        header.SetSignature(vector<unsigned char>(64, 's'));
+        hash = header.GetHash();
+        headers.push_back(header);
+    }
+    return headers;
+}
+
+static const int64_t SECOND = 1000000;
+
+// take the headers as the reply of the peer to a getheaders request
+static bool ReplyHeaders(CHeadersSync &sync, NodeId nodeId, const vector<CBlockHeader> &headers, int32_t forkHeight,
+                         string &error) {
+    sync.BlockAnnounced(nodeId, uint256());
+    sync.UpdatePeerHeight(nodeId, 1 << 30);
+    BOOST_REQUIRE(sync.StartHeadersRequest(nodeId, 0));
+    BOOST_CHECK(sync.IsHeadersRequested(nodeId));
+    return sync.AcceptHeaders(nodeId, headers, forkHeight, error);
+}
+
+BOOST_AUTO_TEST_SUITE(headersync_tests)
+
+BOOST_AUTO_TEST_CASE(headers_accept_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(100, tipHash);
+
+    string error;
+    vector<CBlockHeader> headers = MakeHeaders(tipHash, 100, 50);
+    BOOST_CHECK(ReplyHeaders(sync, 1, headers, 100, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 150);
+    BOOST_CHECK(sync.IsSyncing());
+    BOOST_CHECK(sync.HasHeader(headers.back().GetHash()));
+
+    // the next headers link to the tip of the header chain
+    vector<CBlockHeader> more = MakeHeaders(headers.back().GetHash(), 150, 20);
+    BOOST_CHECK(ReplyHeaders(sync, 1, more, -1, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 170);
+
+    // a broken link is rejected
+    vector<CBlockHeader> broken = MakeHeaders(more.back().GetHash(), 170, 10);
+    broken[5].SetPrevBlockHash(uint256S("0x02"));
+    BOOST_CHECK(!ReplyHeaders(sync, 2, broken, -1, error));
+    BOOST_CHECK(!error.empty());
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 170);
+
+    // a header without the signature is rejected
+    vector<CBlockHeader> unsignedHeaders = MakeHeaders(more.back().GetHash(), 170, 1);
+    unsignedHeaders[0].SetSignature(vector<unsigned char>());
+    BOOST_CHECK(!ReplyHeaders(sync, 2, unsignedHeaders, -1, error));
+
+    // a shorter branch from the active chain is ignored, a longer one replaces the header chain
+    vector<CBlockHeader> shortBranch = MakeHeaders(tipHash, 100, 60, 1);
+    BOOST_CHECK(ReplyHeaders(sync, 2, shortBranch, 100, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 170);
+    BOOST_CHECK(sync.HasHeader(headers[0].GetHash()));
+
+    vector<CBlockHeader> longBranch = MakeHeaders(tipHash, 100, 80, 2);
+    BOOST_CHECK(ReplyHeaders(sync, 2, longBranch, 100, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 180);
+    BOOST_CHECK(!sync.HasHeader(headers[0].GetHash()));
+    BOOST_CHECK(sync.HasHeader(longBranch[0].GetHash()));
+
+    // the connected headers are dropped
+    sync.SetTip(140, longBranch[39].GetHash());
+    BOOST_CHECK(!sync.HasHeader(longBranch[39].GetHash()));
+    BOOST_CHECK(sync.HasHeader(longBranch[40].GetHash()));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 180);
+
+    sync.SetTip(180, longBranch.back().GetHash());
+    BOOST_CHECK(!sync.IsSyncing());
+
+    // an invalid block drops the header chain from it
+    vector<CBlockHeader> next = MakeHeaders(longBranch.back().GetHash(), 180, 30);
+    BOOST_CHECK(ReplyHeaders(sync, 1, next, 180, error));
+    sync.BlockInvalid(next[10].GetHash());
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 190);
+}
+
+BOOST_AUTO_TEST_CASE(headers_download_window_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(0, tipHash);
+
+    string error;
+    vector<CBlockHeader> headers = MakeHeaders(tipHash, 0, 1000);
+    BOOST_CHECK(ReplyHeaders(sync, 1, headers, 0, error));
+    sync.UpdatePeerHeight(2, 1000);
+    sync.UpdatePeerHeight(3, 10);
+
+    // the peers get disjoint blocks of the window, up to their initial windows
+    int64_t now = 1000 * SECOND;
+    vector<uint256> hashes1, hashes2;
+    sync.GetBlocksToRequest(1, now, hashes1);
+    sync.GetBlocksToRequest(2, now, hashes2);
+    BOOST_CHECK_EQUAL(hashes1.size(), (size_t)INITIAL_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(hashes2.size(), (size_t)INITIAL_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(hashes1[0] == headers[0].GetHash());
+    BOOST_CHECK(hashes2[0] == headers[INITIAL_BLOCKS_IN_TRANSIT_PER_PEER].GetHash());
+
+    // a peer gets no blocks above its height
+    vector<uint256> hashes3;
+    sync.GetBlocksToRequest(3, now, hashes3);
+    BOOST_CHECK(hashes3.empty());
+
+    // the window of the peer 2 grows with the blocks received in time
+    for (const auto &hash : hashes2)
+        BOOST_CHECK(sync.BlockReceived(2, hash, now + SECOND));
+    BOOST_CHECK_EQUAL(sync.GetPeerWindow(2), INITIAL_BLOCKS_IN_TRANSIT_PER_PEER * 2);
+
+    // the peer 1 holds up the block next to the tip, its request is moved to the peer 2 and its window halved
+    BOOST_CHECK(!sync.CheckStalls(1, now + (BLOCK_STALLING_TIMEOUT + 1) * SECOND));
+    BOOST_CHECK_EQUAL(sync.GetPeerWindow(1), INITIAL_BLOCKS_IN_TRANSIT_PER_PEER / 2);
+
+    vector<uint256> retry;
+    sync.GetBlocksToRequest(1, now + 4 * SECOND, retry);
+    BOOST_CHECK(retry.empty() || retry[0] != headers[0].GetHash());
+    retry.clear();
+    sync.GetBlocksToRequest(2, now + 4 * SECOND, retry);
+    BOOST_CHECK(!retry.empty());
+    BOOST_CHECK(retry[0] == headers[0].GetHash());
+
+    // the window stays in the limits
+    for (int32_t i = 0; i < 10; i++) {
+        sync.SetTip(i, i == 0 ? tipHash : headers[i - 1].GetHash());
+        sync.CheckStalls(1, now + (10 + i * (BLOCK_STALLING_TIMEOUT + 1)) * SECOND);
+    }
+    BOOST_CHECK(sync.GetPeerWindow(1) >= MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(sync.GetPeerWindow(2) <= MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // the headers of a removed peer are dropped from its first unreceived one, they are taken from the others
+    sync.RemovePeer(1);
+    BOOST_CHECK(!sync.IsSyncing());
+}
+
+BOOST_AUTO_TEST_CASE(headers_request_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(100, tipHash);
+
+    // one getheaders request in flight, to a peer ahead of the header chain
+    int64_t now = 1000 * SECOND;
+    sync.UpdatePeerHeight(1, 100);
+    sync.UpdatePeerHeight(2, 5000);
+    sync.UpdatePeerHeight(3, 5000);
+    BOOST_CHECK(!sync.StartHeadersRequest(1, now));
+    BOOST_CHECK(sync.StartHeadersRequest(2, now));
+    BOOST_CHECK(!sync.StartHeadersRequest(3, now));
+
+    // the headers of the peers without the request are ignored
+    string error;
+    vector<CBlockHeader> headers = MakeHeaders(tipHash, 100, MAX_HEADERS_RESULTS);
+    BOOST_CHECK(!sync.IsHeadersRequested(3));
+    BOOST_CHECK(sync.AcceptHeaders(3, headers, 100, error));
+    BOOST_CHECK(!sync.IsSyncing());
+
+    BOOST_CHECK(sync.IsHeadersRequested(2));
+    BOOST_CHECK(sync.AcceptHeaders(2, headers, 100, error));
+    BOOST_CHECK(!sync.IsHeadersRequested(2));
+    vector<uint256> locator = sync.GetLocatorHashes();
+    BOOST_CHECK(locator.front() == headers.back().GetHash());
+    BOOST_CHECK(locator.back() == tipHash);
+
+    // a reply is taken once
+    vector<CBlockHeader> more = MakeHeaders(headers.back().GetHash(), 100 + MAX_HEADERS_RESULTS, 10);
+    BOOST_CHECK(sync.AcceptHeaders(2, more, -1, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 100 + (int32_t)MAX_HEADERS_RESULTS);
+
+    // a full response is followed up, a timed out request moves to another peer and its reply is ignored
+    BOOST_CHECK(sync.StartHeadersRequest(2, now));
+    BOOST_CHECK(sync.StartHeadersRequest(3, now + (CHeadersSync::HEADERS_DOWNLOAD_TIMEOUT + 1) * SECOND));
+    BOOST_CHECK(sync.AcceptHeaders(2, more, -1, error));
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), 100 + (int32_t)MAX_HEADERS_RESULTS);
+
+    // a short response means the peer is synced until it announces a block
+    BOOST_CHECK(sync.AcceptHeaders(3, vector<CBlockHeader>(), -1, error));
+    BOOST_CHECK(!sync.StartHeadersRequest(3, now));
+    sync.BlockAnnounced(3, uint256());
+    BOOST_CHECK(sync.StartHeadersRequest(3, now));
+}
+
+BOOST_AUTO_TEST_CASE(headers_ahead_limit_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(0, tipHash);
+
+    // the header chain stops at MAX_HEADERS_AHEAD headers above the tip, the last reply goes beyond it
+    string error;
+    uint256 prevHash = tipHash;
+    int32_t height   = 0;
+    while (height < MAX_HEADERS_AHEAD) {
+        uint32_t count = height == 0 ? MAX_HEADERS_RESULTS / 2 : MAX_HEADERS_RESULTS;
+        vector<CBlockHeader> headers = MakeHeaders(prevHash, height, count);
+        BOOST_CHECK(ReplyHeaders(sync, 1, headers, height == 0 ? 0 : -1, error));
+        prevHash = headers.back().GetHash();
+        height += count;
+    }
+    BOOST_CHECK(height > MAX_HEADERS_AHEAD);
+    BOOST_CHECK_EQUAL(sync.GetHeaderTipHeight(), MAX_HEADERS_AHEAD);
+
+    // no more requests until the tip moves on
+    BOOST_CHECK(!sync.StartHeadersRequest(1, 0));
+}
+
+BOOST_AUTO_TEST_CASE(headers_peer_height_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(0, tipHash);
+
+    string error;
+    vector<CBlockHeader> headers = MakeHeaders(tipHash, 0, 100);
+    BOOST_CHECK(ReplyHeaders(sync, 1, headers, 0, error));
+
+    // the peer 2 has no blocks until it announces them
+    vector<uint256> hashes;
+    sync.GetBlocksToRequest(2, 0, hashes);
+    BOOST_CHECK(hashes.empty());
+
+    sync.BlockAnnounced(2, headers[9].GetHash());
+    sync.GetBlocksToRequest(2, 0, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), 10u);
+    BOOST_CHECK(hashes.back() == headers[9].GetHash());
+
+    // a later height of a received block
+    hashes.clear();
+    sync.UpdatePeerHeight(2, 50);
+    sync.GetBlocksToRequest(2, 0, hashes);
+    BOOST_CHECK(!hashes.empty());
+    BOOST_CHECK(hashes[0] == headers[10].GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(headers_stall_source_test)
+{
+    CHeadersSync sync;
+    uint256 tipHash = uint256S("0x01");
+    sync.SetTip(0, tipHash);
+
+    // the peer 1 supplies headers of no blocks, the peer 2 can not send them
+    string error;
+    vector<CBlockHeader> headers = MakeHeaders(tipHash, 0, 100);
+    BOOST_CHECK(ReplyHeaders(sync, 1, headers, 0, error));
+    sync.UpdatePeerHeight(2, 100);
+
+    int64_t now = 1000 * SECOND;
+    for (int32_t i = 0; i < 20; i++) {
+        vector<uint256> hashes;
+        sync.GetBlocksToRequest(2, now, hashes);
+        now += (BLOCK_DOWNLOAD_TIMEOUT + 1) * SECOND;
+        BOOST_CHECK(!sync.CheckStalls(2, now));
+    }
+    BOOST_CHECK_EQUAL(sync.GetPeerWindow(2), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // the supplier stalls on its own headers and is disconnected
+    bool disconnect = false;
+    for (int32_t i = 0; i < 20 && !disconnect; i++) {
+        vector<uint256> hashes;
+        sync.GetBlocksToRequest(1, now, hashes);
+        now += (BLOCK_DOWNLOAD_TIMEOUT + 1) * SECOND;
+        disconnect = sync.CheckStalls(1, now);
+    }
+    BOOST_CHECK(disconnect);
+
+    // its unreceived headers are dropped with it
+    sync.RemovePeer(1);
+    BOOST_CHECK(!sync.IsSyncing());
+    BOOST_CHECK(!sync.HasHeader(headers[0].GetHash()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
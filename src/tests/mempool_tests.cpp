@@ -0,0 +1,499 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <limits>
+#include <set>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+#include "miner/miner.h"
+#include "persistence/cachewrapper.h"
+#include "tx/cointransfertx.h"
+#include "tx/txmempool.h"
+
+using namespace std;
+
+static CKeyID GetSenderKeyId(uint32_t senderIndex) {
+    return CKeyID(Hash160(strprintf("sender-%u", senderIndex)));
+}
+
+// add count synthetic transfer txs of senderCount senders, with various fees and sizes
+static void FillMemPool(CTxMemPool &pool, uint32_t count, uint32_t senderCount, uint32_t fuelRate = 0) {
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t senderIndex = i % senderCount;
+        CBaseCoinTransferTx tx(CRegID(1000 + senderIndex, 1), CRegID(2000 + i % 97, 1), 100 + i / senderCount,
+                               COIN, 10000 + (i * 7919) % 100000, string(i % 50, 'm'));
+        tx.signature.assign(70, 's');
+        tx.nRunStep = (i % 3) * 500;
+        pool.AddEntry(tx.GetHash(), CTxMemPoolEntry(&tx, 1500000000 + i, 100), GetSenderKeyId(senderIndex), fuelRate);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(mempool_index_test)
+{
+    CTxMemPool pool;
+    FillMemPool(pool, 2000, 20, 100);
+    BOOST_CHECK_EQUAL(pool.Size(), 2000u);
+
+    // the packing order is by fee rate net of the fuel, the highest first
+    LOCK(pool.cs);
+    const CTxMemPool::PriorityIndex &priorityIndex = pool.GetPriorityIndex();
+    BOOST_CHECK_EQUAL(priorityIndex.size(), 2000u);
+    double lastFeePerKb = std::numeric_limits<double>::max();
+    for (const auto &item : priorityIndex) {
+        const CTxMemPoolEntry &entry = *item.second;
+        double feePerKb = (double(std::get<1>(entry.GetFees())) -
+                           double(entry.GetTransaction()->GetFuel(entry.GetHeight(), 100))) / entry.GetTxSize() * 1000.0;
+        BOOST_CHECK_CLOSE(entry.GetFeePerKb(), feePerKb, 1e-9);
+        BOOST_CHECK(entry.GetFeePerKb() <= lastFeePerKb);
+        lastFeePerKb = entry.GetFeePerKb();
+    }
+
+    // the txs of a sender
+    vector<uint256> txids;
+    pool.GetSenderTxids(GetSenderKeyId(3), txids);
+    BOOST_CHECK_EQUAL(txids.size(), 100u);
+    for (const auto &txid : txids)
+        BOOST_CHECK(pool.memPoolTxs.at(txid).GetSender() == GetSenderKeyId(3));
+
+    // the erased txs leave all the indexes
+    for (const auto &txid : txids)
+        BOOST_CHECK(pool.Erase(txid));
+    BOOST_CHECK(!pool.Erase(txids[0]));
+    BOOST_CHECK_EQUAL(pool.Size(), 1900u);
+    BOOST_CHECK_EQUAL(priorityIndex.size(), 1900u);
+    pool.GetSenderTxids(GetSenderKeyId(3), txids);
+    BOOST_CHECK(txids.empty());
+    for (const auto &item : priorityIndex)
+        BOOST_CHECK(pool.Exists(item.first.txid));
+
+    // a tx of a higher priority tier goes first whatever its fee rate
+    BOOST_CHECK(CTxMemPoolPriorityKey({1, 1.0, uint256()}) < CTxMemPoolPriorityKey({0, 1e9, uint256()}));
+}
+
+// add a transfer tx of the sender with the db keys its rehearsal execution read and wrote
+static uint256 AddTrackedTx(CTxMemPool &pool, uint32_t senderIndex, uint64_t fees, const vector<string> &readKeys,
+                            const vector<string> &writeKeys) {
+    static uint32_t nonce = 0;
+    CBaseCoinTransferTx tx(CRegID(1000 + senderIndex, 1), CRegID(2000, 1), 100, COIN + nonce++, fees, "");
+    tx.signature.assign(70, 's');
+
+    CDBAccessTracker tracker;
+    for (const auto &key : readKeys)
+        tracker.AddRead(string(key));
+    for (const auto &key : writeKeys)
+        tracker.AddWrite(string(key));
+    pool.AddEntry(tx.GetHash(), CTxMemPoolEntry(&tx, 1500000000, 100), GetSenderKeyId(senderIndex), 0, &tracker);
+    return tx.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(mempool_sender_chain_test)
+{
+    CTxMemPool pool;
+    // the txs of the sender 1 spend its account one after another, the tx of the sender 3 spends what the first
+    // tx of the sender 1 paid to the account of the sender 3
+    uint256 a1 = AddTrackedTx(pool, 1, 10000, {"sys"}, {"acct-1", "acct-3"});
+    uint256 b1 = AddTrackedTx(pool, 2, 10000, {"sys"}, {"acct-2"});
+    uint256 a2 = AddTrackedTx(pool, 1, 20000, {"sys"}, {"acct-1"});
+    uint256 c1 = AddTrackedTx(pool, 3, 10000, {"sys"}, {"acct-3"});
+    uint256 a3 = AddTrackedTx(pool, 1, 90000, {"sys"}, {"acct-1"});
+    uint256 d1 = AddTrackedTx(pool, 4, 10000, {"sys"}, {"acct-4"});
+
+    // the chain of a sender is in the order of entering the mempool
+    vector<uint256> txids;
+    pool.GetSenderTxids(GetSenderKeyId(1), txids);
+    BOOST_CHECK(txids == vector<uint256>({a1, a2, a3}));
+
+    // a block touching the account of the sender 1 affects its chain and the txs which read what the chain wrote
+    pool.GetAffectedTxids({"acct-1"}, txids);
+    BOOST_CHECK(txids == vector<uint256>({a1, a2, c1, a3}));
+    pool.GetAffectedTxids({"acct-2", "acct-9"}, txids);
+    BOOST_CHECK(txids == vector<uint256>({b1}));
+    pool.GetAffectedTxids({"acct-3"}, txids);
+    BOOST_CHECK(txids == vector<uint256>({a1, a2, c1, a3}));
+    pool.GetAffectedTxids({"sys"}, txids);
+    BOOST_CHECK_EQUAL(txids.size(), 6u);
+
+    // the erased tx leaves the key index
+    BOOST_CHECK(pool.Erase(d1));
+    pool.GetAffectedTxids({"acct-4"}, txids);
+    BOOST_CHECK(txids.empty());
+
+    // the miner packs a chain in order, the first tx goes with the later one of the highest fee rate
+    vector<uint256> minerTxids = {AddTrackedTx(mempool, 1, 10000, {}, {"acct-1"}),
+                                  AddTrackedTx(mempool, 2, 50000, {}, {"acct-2"}),
+                                  AddTrackedTx(mempool, 1, 20000, {}, {"acct-1"}),
+                                  AddTrackedTx(mempool, 1, 90000, {}, {"acct-1"})};
+    vector<TxPriority> txPriorities;
+    {
+        LOCK(mempool.cs);
+        GetPriorityTx(txPriorities);
+    }
+    BOOST_CHECK_EQUAL(txPriorities.size(), 4u);
+    vector<uint64_t> fees;
+    for (const auto &item : txPriorities)
+        fees.push_back(std::get<1>(item.baseTx->GetFees()));
+    BOOST_CHECK(fees == vector<uint64_t>({10000, 20000, 90000, 50000}));
+
+    for (const auto &txid : minerTxids)
+        BOOST_CHECK(mempool.Erase(txid));
+}
+
+// the packing order of up to 100k txs, run it by --run_test=mempool_tests/mempool_index_bench_test
+BOOST_AUTO_TEST_CASE(mempool_index_bench_test, *boost::unit_test::disabled())
+{
+    for (uint32_t count : {10000, 50000, 100000}) {
+        CTxMemPool pool;
+        int64_t beginTime = GetTimeMicros();
+        FillMemPool(pool, count, 1000);
+        int64_t fillTime = GetTimeMicros();
+
+        LOCK(pool.cs);
+        // the packing order kept by the mempool
+        vector<std::shared_ptr<CBaseTx>> packingTxs;
+        packingTxs.reserve(count);
+        for (const auto &item : pool.GetPriorityIndex())
+            packingTxs.push_back(item.second->GetTransaction());
+        int64_t indexTime = GetTimeMicros();
+
+        // the former way of the miner: the fee rates of all the txs sorted for every block
+        set<pair<double, uint256>> sortedTxs;
+        for (const auto &item : pool.memPoolTxs) {
+            const CTxMemPoolEntry &entry = item.second;
+            double feePerKb = double(std::get<1>(entry.GetFees())) / entry.GetTxSize() * 1000.0;
+            sortedTxs.emplace(-feePerKb, entry.GetTransaction()->GetHash());
+        }
+        int64_t sortTime = GetTimeMicros();
+
+        BOOST_CHECK_EQUAL(packingTxs.size(), (size_t)count);
+        BOOST_CHECK(packingTxs.front()->GetHash() == pool.GetPriorityIndex().begin()->first.txid);
+        BOOST_TEST_MESSAGE(strprintf("mempool of %u txs: fill=%.2fms, packing order by index=%.2fms, by sort=%.2fms",
+                                     count, 0.001 * (fillTime - beginTime), 0.001 * (indexTime - fillTime),
+                                     0.001 * (sortTime - indexTime)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mempool_dump_test)
+{
+    boost::filesystem::path path = boost::filesystem::temp_directory_path() /
+                                   boost::filesystem::unique_path("mempool-%%%%-%%%%.dat");
+    CTxMemPool pool;
+    FillMemPool(pool, 300, 1000);
+    vector<CMemPoolDumpEntry> entries;
+    pool.GetDumpEntries(entries);
+    BOOST_CHECK(WriteMemPoolFile(path, entries));
+
+    // the txs are read back in the order of entering the mempool, with their entry time and height
+    CWorkerPool workerPool("mempooltest", 3);
+    vector<CMemPoolDumpEntry> readEntries;
+    BOOST_CHECK(ReadMemPoolFile(path, &workerPool, readEntries));
+    BOOST_CHECK_EQUAL(readEntries.size(), 300u);
+    {
+        LOCK(pool.cs);
+        size_t i = 0;
+        for (const auto &entry : readEntries) {
+            BOOST_REQUIRE(entry.pTx != nullptr);
+            BOOST_CHECK_EQUAL(entry.time, 1500000000 + (int64_t)i);
+            BOOST_CHECK_EQUAL(entry.height, 100u);
+            BOOST_CHECK(pool.Lookup(entry.pTx->GetHash()) != nullptr);
+            BOOST_CHECK(entry.tx_data.empty());
+            i++;
+        }
+    }
+    // a corrupted or truncated file is rejected
+    {
+        FILE *file = fopen(path.string().c_str(), "r+b");
+        BOOST_REQUIRE(file != nullptr);
+        fseek(file, 1000, SEEK_SET);
+        int32_t c = fgetc(file);
+        fseek(file, 1000, SEEK_SET);
+        fputc(c ^ 0x01, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!ReadMemPoolFile(path, nullptr, readEntries));
+    boost::filesystem::resize_file(path, 2000);
+    BOOST_CHECK(!ReadMemPoolFile(path, nullptr, readEntries));
+    BOOST_CHECK(readEntries.empty());
+    boost::filesystem::remove(path);
+}
+
+// the account state of the uid serialized, empty if the account does not exist
+static CMemPoolDumpEntry MakeDumpEntry(const std::shared_ptr<CBaseTx> &pTx, int64_t time, uint32_t height) {
+    CMemPoolDumpEntry entry;
+    entry.time   = time;
+    entry.height = height;
+    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+    ssTx << pTx;
+    entry.tx_data.assign(ssTx.begin(), ssTx.end());
+    return entry;
+}
+
+/**
+ * Load the mempool.dat of txsPerSender signed transfer txs of every sender into the global mempool, on a synthetic
+ * tip. The first tx pays an account without coins, which spends it in the last tx, so that tx is accepted only
+ * after the one it depends on. A tx with a bad signature is rejected.
+ */
+static void TestLoadMemPool(uint32_t senderCount, uint32_t txsPerSender, CWorkerPool *pWorkerPool) {
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() /
+                                      boost::filesystem::unique_path("mempool-%%%%-%%%%");
+    boost::filesystem::create_directories(dataDir);
+    ECC_Start();
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle(new ECCVerifyHandle());
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    CBaseParams::SoftSetArgCover("-datadir", dataDir.string());
+    // the synthetic tip has no previous blocks, the fuel rate is the initial one
+    CBaseParams::SoftSetArgCover("-blocksizeforburn", "100000000");
+    ClearDatadirCache();
+    pCdMan = new CCacheDBManager(true, false);
+    CBlockIndex tipIndex;
+    tipIndex.height = SysCfg().GetFeatureForkHeight();
+    tipIndex.nTime  = 1600000000;
+    chainActive.SetTip(&tipIndex);
+    mempool.SetMemPoolCache();
+    {
+        const int32_t validHeight = tipIndex.height + 1;
+        const CRegID receiverRegId(1000 + senderCount, 1);
+
+        // the senders and the receiver, which has no coins
+        vector<CKey> keys(senderCount + 1);
+        {
+            CCacheWrapper cw(pCdMan);
+            for (uint32_t i = 0; i <= senderCount; i++) {
+                keys[i].MakeNewKey(true);
+                CAccount account(keys[i].GetPubKey().GetKeyId(), CNickID(), keys[i].GetPubKey());
+                account.regid = CRegID(1000 + i, 1);
+                ReceiptList receipts;
+                if (i < senderCount)
+                    BOOST_CHECK(account.OperateBalance(SYMB::WICC, ADD_FREE, 10000 * COIN,
+                                                       ReceiptCode::TRANSFER_ACTUAL_COINS, receipts));
+                BOOST_CHECK(cw.accountCache.SaveAccount(account));
+            }
+            cw.Flush();
+        }
+        auto makeTx = [&](uint32_t from, const CUserID &to, uint64_t amount) {
+            auto pTx = std::make_shared<CBaseCoinTransferTx>(CRegID(1000 + from, 1), to, validHeight, amount,
+                                                             COIN / 10, "");
+            BOOST_CHECK(keys[from].Sign(pTx->GetHash(), pTx->signature));
+            return pTx;
+        };
+
+        vector<CMemPoolDumpEntry> entries, validEntries;
+        vector<std::pair<std::shared_ptr<CBaseTx>, CPubKey>> validTxs;
+        auto addTx = [&](const std::shared_ptr<CBaseTx> &pTx, uint32_t from, bool isValid) {
+            uint32_t index = entries.size();
+            entries.push_back(MakeDumpEntry(pTx, 1500000000 + index, tipIndex.height - index % 10));
+            if (isValid) {
+                validEntries.push_back(entries.back());
+                validTxs.emplace_back(pTx, keys[from].GetPubKey());
+            }
+        };
+
+        auto pFundTx = makeTx(0, receiverRegId, 5 * COIN);
+        addTx(pFundTx, 0, true);
+        for (uint32_t n = 0; n < txsPerSender; n++) {
+            for (uint32_t i = 0; i < senderCount; i++) {
+                if (n == 0 && i == 0)
+                    continue;
+                CKey toKey;
+                toKey.MakeNewKey(true);
+                addTx(makeTx(i, CUserID(toKey.GetPubKey().GetKeyId()), COIN + n), i, true);
+            }
+            if (n == txsPerSender / 2) {
+                auto pBadTx = makeTx(0, CRegID(1001, 1), 3 * COIN);
+                pBadTx->signature[pBadTx->signature.size() / 2] ^= 0x01;
+                addTx(pBadTx, 0, false);
+            }
+        }
+        auto pSpendTx = makeTx(senderCount, CRegID(1000, 1), COIN);
+        addTx(pSpendTx, senderCount, true);
+
+        int64_t beginTime = GetTimeMicros();
+        BOOST_CHECK(WriteMemPoolFile(GetDataDir() / "mempool.dat", entries));
+        int64_t writeTime = GetTimeMicros();
+        BOOST_CHECK(LoadMemPool(pWorkerPool));
+        int64_t loadTime = GetTimeMicros();
+
+        // the txs enter the mempool in the order of the dump, with their entry time and height
+        vector<CMemPoolDumpEntry> loadedEntries;
+        mempool.GetDumpEntries(loadedEntries);
+        BOOST_REQUIRE_EQUAL(loadedEntries.size(), validEntries.size());
+        for (size_t i = 0; i < loadedEntries.size(); i++) {
+            BOOST_CHECK(loadedEntries[i].tx_data == validEntries[i].tx_data);
+            BOOST_CHECK_EQUAL(loadedEntries[i].time, validEntries[i].time);
+            BOOST_CHECK_EQUAL(loadedEntries[i].height, validEntries[i].height);
+        }
+        // the valid signatures are in the signature cache, the bad one is not accepted
+        for (const auto &item : validTxs)
+            BOOST_CHECK(signatureCache.Get(item.first->GetHash(), item.first->signature, item.second));
+        BOOST_CHECK_EQUAL(mempool.Size(), (uint64_t)validTxs.size());
+
+        BOOST_TEST_MESSAGE(strprintf("mempool load of %u txs, verified ahead=%d: write=%.2fms, load=%.2fms",
+                                     (uint32_t)entries.size(), pWorkerPool != nullptr, 0.001 * (writeTime - beginTime),
+                                     0.001 * (loadTime - writeTime)));
+
+        // the tx ahead of the one it depends on is rejected
+        mempool.Clear();
+        vector<CMemPoolDumpEntry> reversedEntries = {MakeDumpEntry(pSpendTx, 1500000000, 100),
+                                                     MakeDumpEntry(pFundTx, 1500000001, 100)};
+        BOOST_CHECK(WriteMemPoolFile(GetDataDir() / "mempool.dat", reversedEntries));
+        BOOST_CHECK(LoadMemPool(pWorkerPool));
+        BOOST_CHECK(!mempool.Exists(pSpendTx->GetHash()));
+        BOOST_CHECK(mempool.Exists(pFundTx->GetHash()));
+    }
+    mempool.Clear();
+    chainActive.SetTip(nullptr);
+    delete pCdMan;
+    pCdMan = nullptr;
+    CBaseParams::SetMapArgs(savedArgs);
+    ClearDatadirCache();
+    pVerifyHandle.reset();
+    ECC_Stop();
+    boost::filesystem::remove_all(dataDir);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_load_test)
+{
+    // the signatures verified ahead on the workers or by the rehearsal execution load the same mempool
+    CWorkerPool workerPool("mempooltest", 3);
+    TestLoadMemPool(20, 10, &workerPool);
+    TestLoadMemPool(20, 10, nullptr);
+}
+
+// the load of 100k txs, run it by --run_test=mempool_tests/mempool_load_bench_test
+BOOST_AUTO_TEST_CASE(mempool_load_bench_test, *boost::unit_test::disabled())
+{
+    CWorkerPool workerPool("mempooltest", 3);
+    TestLoadMemPool(1000, 100, &workerPool);
+}
+
+static string GetAccountData(CCacheWrapper &cw, const CUserID &uid) {
+    CAccount account;
+    if (!cw.accountCache.GetAccount(uid, account))
+        return "";
+    CDataStream ds(SER_DISK, CLIENT_VERSION);
+    ds << account;
+    return ds.str();
+}
+
+BOOST_AUTO_TEST_CASE(mempool_rescan_bench_test)
+{
+    // a block confirms the first tx of a few senders, the rescan of the touched txs executes their chains again
+    // and ends in the same mempool as the full rescan
+    boost::filesystem::path dataDir = boost::filesystem::temp_directory_path() /
+                                      boost::filesystem::unique_path("mempool-%%%%-%%%%");
+    boost::filesystem::create_directories(dataDir);
+    ECC_Start();
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle(new ECCVerifyHandle());
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    CBaseParams::SoftSetArgCover("-datadir", dataDir.string());
+    // the synthetic tip has no previous blocks, the fuel rate is the initial one
+    CBaseParams::SoftSetArgCover("-blocksizeforburn", "100000000");
+    ClearDatadirCache();
+    pCdMan = new CCacheDBManager(true, false);
+    CBlockIndex tipIndex;
+    tipIndex.height = SysCfg().GetFeatureForkHeight();
+    tipIndex.nTime  = 1600000000;
+    chainActive.SetTip(&tipIndex);
+    {
+        const uint32_t senderCount  = 200;
+        const uint32_t txsPerSender = 10;
+        const uint32_t touchedCount = 5;
+        const int32_t validHeight   = tipIndex.height + 1;
+
+        vector<CRegID> regids;
+        {
+            CCacheWrapper cw(pCdMan);
+            for (uint32_t i = 0; i < senderCount; i++) {
+                regids.emplace_back(1000 + i, 1);
+                CKey key;
+                key.MakeNewKey(true);
+                CAccount account(key.GetPubKey().GetKeyId(), CNickID(), key.GetPubKey());
+                account.regid = regids[i];
+                ReceiptList receipts;
+                BOOST_CHECK(account.OperateBalance(SYMB::WICC, ADD_FREE, 10000 * COIN,
+                                                   ReceiptCode::TRANSFER_ACTUAL_COINS, receipts));
+                BOOST_CHECK(cw.accountCache.SaveAccount(account));
+            }
+            cw.Flush();
+        }
+
+        CTxMemPool pool;
+        pool.SetMemPoolCache();
+        vector<vector<std::shared_ptr<CBaseTx>>> senderTxs(senderCount);
+        for (uint32_t n = 0; n < txsPerSender; n++) {
+            for (uint32_t i = 0; i < senderCount; i++) {
+                CKey toKey;
+                toKey.MakeNewKey(true);
+                auto pTx = std::make_shared<CBaseCoinTransferTx>(regids[i], CUserID(toKey.GetPubKey().GetKeyId()),
+                                                                 validHeight, COIN + n, COIN / 10, "");
+                CValidationState state;
+                BOOST_CHECK(pool.AddUnchecked(pTx->GetHash(), CTxMemPoolEntry(pTx.get(), 1500000000, 100), state));
+                senderTxs[i].push_back(pTx);
+            }
+        }
+        BOOST_REQUIRE_EQUAL(pool.Size(), (uint64_t)senderCount * txsPerSender);
+        {
+            LOCK(pool.cs);
+            for (const auto &item : pool.memPoolTxs)
+                BOOST_CHECK(item.second.IsAccessTracked());
+        }
+
+        // the block confirms the first tx of the touched senders
+        {
+            CCacheWrapper cw(pCdMan);
+            for (uint32_t i = 0; i < touchedCount; i++) {
+                CValidationState state;
+                auto pTx = senderTxs[i][0]->GetNewInstance();
+                CTxExecuteContext context(validHeight, i + 1, INIT_FUEL_RATES, tipIndex.nTime, tipIndex.nTime - 3,
+                                          &cw, &state);
+                BOOST_CHECK(pTx->ExecuteFullTx(context));
+            }
+            cw.Flush();
+        }
+        for (uint32_t i = 0; i < touchedCount; i++)
+            BOOST_CHECK(pool.Erase(senderTxs[i][0]->GetHash()));
+
+        int64_t beginTime = GetTimeMicros();
+        pool.ReScanMemPoolTx();
+        int64_t touchedTime = GetTimeMicros();
+
+        vector<uint256> touchedTxids;
+        pool.QueryHash(touchedTxids);
+        vector<string> touchedAccounts;
+        for (const auto &regid : regids)
+            touchedAccounts.push_back(GetAccountData(*pool.cw, regid));
+
+        pool.BlockDisconnected();
+        int64_t fullBeginTime = GetTimeMicros();
+        pool.ReScanMemPoolTx();
+        int64_t fullTime = GetTimeMicros();
+
+        vector<uint256> fullTxids;
+        pool.QueryHash(fullTxids);
+        BOOST_CHECK_EQUAL(fullTxids.size(), (size_t)(senderCount * txsPerSender - touchedCount));
+        BOOST_CHECK(touchedTxids == fullTxids);
+        for (uint32_t i = 0; i < senderCount; i++)
+            BOOST_CHECK(GetAccountData(*pool.cw, regids[i]) == touchedAccounts[i]);
+
+        BOOST_TEST_MESSAGE(strprintf("mempool rescan of %u txs after a block touching %u senders: touched only=%.2fms,"
+                                     " full=%.2fms", (uint32_t)fullTxids.size(), touchedCount,
+                                     0.001 * (touchedTime - beginTime), 0.001 * (fullTime - fullBeginTime)));
+    }
+    chainActive.SetTip(nullptr);
+    delete pCdMan;
+    pCdMan = nullptr;
+    CBaseParams::SetMapArgs(savedArgs);
+    ClearDatadirCache();
+    pVerifyHandle.reset();
+    ECC_Stop();
+    boost::filesystem::remove_all(dataDir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "chain/merkletree.h"
+#include "crypto/hash.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(merkle_tests)
+
+static vector<uint256> GenLeaves(uint32_t count) {
+    vector<uint256> leaves;
+    for (uint32_t i = 0; i < count; i++) {
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        hasher << i;
+        leaves.push_back(hasher.GetHash());
+    }
+    return leaves;
+}
+
+// the merkle tree of the pairwise Hash() of CBlock::BuildMerkleTree before SHA256D64
+static vector<uint256> BuildMerkleTreeByPairs(const vector<uint256> &leaves) {
+    vector<uint256> tree(leaves);
+    int32_t j = 0;
+    for (int32_t nSize = leaves.size(); nSize > 1; nSize = (nSize + 1) / 2) {
+        for (int32_t i = 0; i < nSize; i += 2) {
+            int32_t i2 = min(i + 1, nSize - 1);
+            tree.push_back(Hash(BEGIN(tree[j + i]), END(tree[j + i]), BEGIN(tree[j + i2]), END(tree[j + i2])));
+        }
+        j += nSize;
+    }
+    return tree;
+}
+
+BOOST_AUTO_TEST_CASE(merkle_tree_levels_test)
+{
+    for (uint32_t count : {1, 2, 3, 4, 5, 7, 8, 9, 31, 33, 100, 1001}) {
+        vector<uint256> leaves = GenLeaves(count);
+        vector<uint256> tree(leaves);
+        BuildMerkleTreeLevels(tree);
+        BOOST_CHECK_MESSAGE(tree == BuildMerkleTreeByPairs(leaves), strprintf("count=%u", count));
+
+        // the partial tree takes its node hashes from the same levels
+        vector<bool> vMatch(count, false);
+        for (uint32_t i = 0; i < count; i += 3)
+            vMatch[i] = true;
+        CPartialMerkleTree partialTree(leaves, vMatch);
+        vector<uint256> vMatchedTxid;
+        BOOST_CHECK(partialTree.ExtractMatches(vMatchedTxid) == tree.back());
+        BOOST_CHECK(vMatchedTxid.size() == (count + 2) / 3);
+    }
+}
+
+// the trees of up to 50k txs by pairs and by levels, run it by --run_test=merkle_tests/merkle_tree_bench_test
+BOOST_AUTO_TEST_CASE(merkle_tree_bench_test, *boost::unit_test::disabled())
+{
+    for (uint32_t count : {1000, 5000, 20000, 50000}) {
+        vector<uint256> leaves = GenLeaves(count);
+
+        int64_t beginTime      = GetTimeMicros();
+        vector<uint256> expected = BuildMerkleTreeByPairs(leaves);
+        int64_t pairTime       = GetTimeMicros();
+        vector<uint256> tree(leaves);
+        BuildMerkleTreeLevels(tree);
+        int64_t levelTime      = GetTimeMicros();
+
+        BOOST_CHECK(tree == expected);
+        BOOST_TEST_MESSAGE(strprintf("merkle tree of %u txs: by pairs=%.2fms, by levels=%.2fms", count,
+                                     0.001 * (pairTime - beginTime), 0.001 * (levelTime - pairTime)));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,325 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "miner/miner.h"
+#include "persistence/cachewrapper.h"
+#include "tx/blockpricemediantx.h"
+#include "tx/cointransfertx.h"
+#include "tx/pricefeedtx.h"
+#include "tx/txmempool.h"
+
+using namespace std;
+
+// the chain state of a synthetic tip in the stable coin release, with funded senders and the global mempool
+struct FBlockTemplateTests {
+    FBlockTemplateTests() {
+        data_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("miner-%%%%-%%%%");
+        boost::filesystem::create_directories(data_dir);
+        ECC_Start();
+        pVerifyHandle.reset(new ECCVerifyHandle());
+        saved_args = CBaseParams::GetMapArgs();
+        CBaseParams::SoftSetArgCover("-datadir", data_dir.string());
+        // the synthetic tip has no previous blocks, the fuel rate is the initial one
+        CBaseParams::SoftSetArgCover("-blocksizeforburn", "100000000");
+        ClearDatadirCache();
+        pCdMan = new CCacheDBManager(true, false);
+        tip_index.height     = SysCfg().GetFeatureForkHeight();
+        tip_index.nTime      = 1600000000;
+        tip_index.pBlockHash = &tip_hash;
+        chainActive.SetTip(&tip_index);
+        mempool.SetMemPoolCache();
+
+        CCacheWrapper cw(pCdMan);
+        for (uint32_t i = 0; i < SENDER_COUNT; i++) {
+            keys.emplace_back();
+            keys[i].MakeNewKey(true);
+            CAccount account(keys[i].GetPubKey().GetKeyId(), CNickID(), keys[i].GetPubKey());
+            account.regid = CRegID(1000 + i, 1);
+            ReceiptList receipts;
+            BOOST_CHECK(account.OperateBalance(SYMB::WICC, ADD_FREE, 10000 * COIN, ReceiptCode::TRANSFER_ACTUAL_COINS,
+                                               receipts));
+            BOOST_CHECK(cw.accountCache.SaveAccount(account));
+        }
+        cw.Flush();
+    }
+    ~FBlockTemplateTests() {
+        mempool.Clear();
+        chainActive.SetTip(nullptr);
+        delete pCdMan;
+        pCdMan = nullptr;
+        CBaseParams::SetMapArgs(saved_args);
+        ClearDatadirCache();
+        pVerifyHandle.reset();
+        ECC_Stop();
+        boost::filesystem::remove_all(data_dir);
+    }
+
+    // add a signed transfer tx of every sender to the mempool
+    void AddTransfers(uint64_t amount) {
+        for (uint32_t i = 0; i < SENDER_COUNT; i++) {
+            CKey toKey;
+            toKey.MakeNewKey(true);
+            auto pTx = std::make_shared<CBaseCoinTransferTx>(CRegID(1000 + i, 1), CUserID(toKey.GetPubKey().GetKeyId()),
+                                                             tip_index.height + 1, amount, COIN / 10 + i * 1000, "");
+            BOOST_CHECK(keys[i].Sign(pTx->GetHash(), pTx->signature));
+            CValidationState state;
+            BOOST_CHECK(mempool.AddUnchecked(pTx->GetHash(), CTxMemPoolEntry(pTx.get(), 1500000000, 100), state));
+        }
+    }
+
+    int64_t GetBlockTime() const { return tip_index.nTime + 3; }
+
+    static const uint32_t SENDER_COUNT = 50;
+
+    boost::filesystem::path data_dir;
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle;
+    map<string, string> saved_args;
+    uint256 tip_hash = uint256S("1");
+    CBlockIndex tip_index;
+    vector<CKey> keys;
+};
+
+static vector<uint256> GetTxids(const CBlock &block) {
+    vector<uint256> txids;
+    for (const auto &pTx : block.vptx)
+        txids.push_back(pTx->GetHash());
+    return txids;
+}
+
+// pack the txs of the mempool in batches of batchSize, until all of them are tried
+static void PackAll(CBlockTemplate &blockTemplate, uint32_t batchSize) {
+    LOCK2(cs_main, mempool.cs);
+    bool hasMore = true;
+    while (hasMore)
+        BOOST_REQUIRE(blockTemplate.PackTxs(batchSize, []() { return true; }, hasMore));
+}
+
+static size_t FindMedianTx(const CBlock &block) {
+    for (size_t i = 0; i < block.vptx.size(); i++) {
+        if (block.vptx[i]->IsPriceMedianTx())
+            return i;
+    }
+    return block.vptx.size();
+}
+
+BOOST_FIXTURE_TEST_SUITE(miner_tests, FBlockTemplateTests)
+
+BOOST_AUTO_TEST_CASE(block_template_batch_test)
+{
+    // the txs packed in batches, as while the producer waits, make the block built at once at the slot
+    AddTransfers(COIN);
+    AddTransfers(2 * COIN);
+
+    CBlockTemplate batchTemplate, slotTemplate;
+    {
+        LOCK2(cs_main, mempool.cs);
+        batchTemplate.Reset(&tip_index, GetBlockTime(), true);
+        slotTemplate.Reset(&tip_index, GetBlockTime(), true);
+    }
+    PackAll(batchTemplate, 7);
+    PackAll(slotTemplate, std::numeric_limits<uint32_t>::max());
+
+    CBlock batchBlock, slotBlock;
+    batchTemplate.GetBlock(batchBlock);
+    slotTemplate.GetBlock(slotBlock);
+    // the two txs of every sender and the median tx
+    BOOST_CHECK_EQUAL(batchTemplate.GetTxCount(), 2 * SENDER_COUNT + 1);
+    BOOST_CHECK(GetTxids(batchBlock) == GetTxids(slotBlock));
+    BOOST_CHECK_EQUAL(batchBlock.GetFuel(), slotBlock.GetFuel());
+    BOOST_CHECK_EQUAL(batchBlock.GetFuelRate(), slotBlock.GetFuelRate());
+
+    // nothing is left to pack until a tx enters the mempool
+    LOCK2(cs_main, mempool.cs);
+    bool hasMore = true;
+    BOOST_CHECK(batchTemplate.PackTxs(7, []() { return true; }, hasMore));
+    BOOST_CHECK(!hasMore);
+    BOOST_CHECK_EQUAL(batchTemplate.GetTxCount(), 2 * SENDER_COUNT + 1);
+}
+
+BOOST_AUTO_TEST_CASE(block_template_reset_test)
+{
+    AddTransfers(COIN);
+
+    CBlockTemplate blockTemplate;
+    BOOST_CHECK(!blockTemplate.IsFor(&tip_index, GetBlockTime()));
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime(), true);
+    }
+    PackAll(blockTemplate, 10);
+    BOOST_CHECK_EQUAL(blockTemplate.GetTxCount(), SENDER_COUNT + 1);
+    BOOST_CHECK(blockTemplate.IsFor(&tip_index, GetBlockTime()));
+
+    // another slot time or another tip makes the template stale
+    BOOST_CHECK(!blockTemplate.IsFor(&tip_index, GetBlockTime() + 3));
+    uint256 otherHash = uint256S("2");
+    CBlockIndex otherIndex;
+    otherIndex.height     = tip_index.height;
+    otherIndex.nTime      = tip_index.nTime;
+    otherIndex.pBlockHash = &otherHash;
+    BOOST_CHECK(!blockTemplate.IsFor(&otherIndex, GetBlockTime()));
+
+    // the template built again drops the txs executed for the old slot and packs them again
+    CBlock oldBlock;
+    blockTemplate.GetBlock(oldBlock);
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime() + 3, true);
+    }
+    BOOST_CHECK(blockTemplate.IsFor(&tip_index, GetBlockTime() + 3));
+    BOOST_CHECK_EQUAL(blockTemplate.GetTxCount(), 0u);
+    PackAll(blockTemplate, 10);
+    CBlock newBlock;
+    blockTemplate.GetBlock(newBlock);
+    BOOST_CHECK(GetTxids(newBlock) == GetTxids(oldBlock));
+
+    // the template of a slot of another delegate packs nothing
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime() + 6, false);
+    }
+    PackAll(blockTemplate, 10);
+    BOOST_CHECK(!blockTemplate.IsActive());
+    BOOST_CHECK_EQUAL(blockTemplate.GetTxCount(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(block_template_late_tx_test)
+{
+    // the txs entering the mempool after the median tx is packed go behind it and the txs packed already
+    AddTransfers(COIN);
+
+    CBlockTemplate blockTemplate;
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime(), true);
+    }
+    PackAll(blockTemplate, 10);
+    CBlock earlyBlock;
+    blockTemplate.GetBlock(earlyBlock);
+    size_t medianPos = FindMedianTx(earlyBlock);
+    BOOST_REQUIRE(medianPos < earlyBlock.vptx.size());
+
+    AddTransfers(2 * COIN);
+    PackAll(blockTemplate, 10);
+    CBlock lateBlock;
+    blockTemplate.GetBlock(lateBlock);
+    BOOST_REQUIRE_EQUAL(lateBlock.vptx.size(), earlyBlock.vptx.size() + SENDER_COUNT);
+    BOOST_CHECK_EQUAL(FindMedianTx(lateBlock), medianPos);
+    // the early txs keep their places, the reward tx at 0 changes with the fees
+    for (size_t i = 1; i < earlyBlock.vptx.size(); i++)
+        BOOST_CHECK(lateBlock.vptx[i]->GetHash() == earlyBlock.vptx[i]->GetHash());
+    for (size_t i = earlyBlock.vptx.size(); i < lateBlock.vptx.size(); i++) {
+        BOOST_CHECK(!lateBlock.vptx[i]->IsPriceMedianTx());
+        BOOST_CHECK(mempool.Exists(lateBlock.vptx[i]->GetHash()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_template_late_price_feed_test)
+{
+    // a price feed tx entering the mempool after the median tx is packed goes before it, and is in its prices
+    {
+        // the first sender is the only delegate, with the stake of a price feeder
+        CCacheWrapper cw(pCdMan);
+        CAccount account;
+        BOOST_REQUIRE(cw.accountCache.GetAccount(CRegID(1000, 1), account));
+        ReceiptList receipts;
+        BOOST_CHECK(account.OperateBalance(SYMB::WICC, ADD_FREE, 300000 * COIN, ReceiptCode::TRANSFER_ACTUAL_COINS,
+                                           receipts));
+        BOOST_CHECK(account.OperateBalance(SYMB::WICC, STAKE, 210000 * COIN, ReceiptCode::TRANSFER_ACTUAL_COINS,
+                                           receipts));
+        BOOST_CHECK(cw.accountCache.SaveAccount(account));
+        BOOST_CHECK(cw.delegateCache.SetActiveDelegates({VoteDelegate(CRegID(1000, 1), 1)}));
+        cw.Flush();
+    }
+    AddTransfers(COIN);
+
+    CBlockTemplate blockTemplate;
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime(), true);
+    }
+    PackAll(blockTemplate, 10);
+    CBlock earlyBlock;
+    blockTemplate.GetBlock(earlyBlock);
+    size_t medianPos = FindMedianTx(earlyBlock);
+    BOOST_REQUIRE(medianPos < earlyBlock.vptx.size());
+    const PriceCoinPair coinPair(SYMB::WICC, SYMB::USD);
+    BOOST_CHECK(((CBlockPriceMedianTx *)earlyBlock.vptx[medianPos].get())->median_prices.count(coinPair) == 0);
+
+    auto pFeedTx = std::make_shared<CPriceFeedTx>(CRegID(1000, 1), tip_index.height + 1, SYMB::WICC, COIN / 100,
+                                                  vector<CPricePoint>{CPricePoint(coinPair, 10000)});
+    BOOST_CHECK(keys[0].Sign(pFeedTx->GetHash(), pFeedTx->signature));
+    {
+        CValidationState state;
+        BOOST_CHECK(mempool.AddUnchecked(pFeedTx->GetHash(), CTxMemPoolEntry(pFeedTx.get(), 1500000000, 100), state));
+    }
+    AddTransfers(2 * COIN);
+    PackAll(blockTemplate, 10);
+
+    CBlock lateBlock;
+    blockTemplate.GetBlock(lateBlock);
+    BOOST_REQUIRE_EQUAL(lateBlock.vptx.size(), earlyBlock.vptx.size() + SENDER_COUNT + 1);
+    vector<uint256> lateTxids = GetTxids(lateBlock);
+    size_t feedPos = std::find(lateTxids.begin(), lateTxids.end(), pFeedTx->GetHash()) - lateTxids.begin();
+    size_t lateMedianPos = FindMedianTx(lateBlock);
+    BOOST_REQUIRE(lateMedianPos < lateBlock.vptx.size());
+    BOOST_CHECK(feedPos < lateMedianPos);
+    const auto &medianPrices = ((CBlockPriceMedianTx *)lateBlock.vptx[lateMedianPos].get())->median_prices;
+    BOOST_CHECK(medianPrices.count(coinPair) > 0 && medianPrices.at(coinPair) == 10000);
+
+    // the txs packed before are all still in the block, only once
+    for (size_t i = 1; i < earlyBlock.vptx.size(); i++) {
+        if (!earlyBlock.vptx[i]->IsPriceMedianTx())
+            BOOST_CHECK(std::count(lateTxids.begin(), lateTxids.end(), earlyBlock.vptx[i]->GetHash()) == 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_template_failed_tx_test)
+{
+    // a tx failed to execute on the candidate is written to the log db only once the candidate is produced
+    SysCfg().SetLogFailures(true);
+    uint64_t changeCount = mempool.GetChangeCount();
+    AddTransfers(COIN);
+    BOOST_CHECK_EQUAL(mempool.GetChangeCount(), changeCount + SENDER_COUNT);
+    // a change notified before the wait ends it at once, the wait for no change ends at the deadline
+    BOOST_CHECK(mempool.WaitForChange(changeCount, GetTimeMillis() + 1000));
+    BOOST_CHECK(!mempool.WaitForChange(mempool.GetChangeCount(), GetTimeMillis() + 10));
+    {
+        // the first sender spent its coins after its tx entered the mempool
+        CCacheWrapper cw(pCdMan);
+        CAccount account;
+        BOOST_REQUIRE(cw.accountCache.GetAccount(CRegID(1000, 1), account));
+        ReceiptList receipts;
+        BOOST_CHECK(account.OperateBalance(SYMB::WICC, SUB_FREE, account.GetToken(SYMB::WICC).free_amount,
+                                           ReceiptCode::TRANSFER_ACTUAL_COINS, receipts));
+        BOOST_CHECK(cw.accountCache.SaveAccount(account));
+        cw.Flush();
+    }
+
+    CBlockTemplate blockTemplate;
+    {
+        LOCK2(cs_main, mempool.cs);
+        blockTemplate.Reset(&tip_index, GetBlockTime(), true);
+    }
+    PackAll(blockTemplate, 10);
+    BOOST_CHECK_EQUAL(blockTemplate.GetTxCount(), SENDER_COUNT);
+
+    vector<std::tuple<uint256, uint8_t, string> > failures;
+    BOOST_CHECK(pCdMan->pLogCache->GetExecuteFail(tip_index.height + 1, failures));
+    BOOST_CHECK(failures.empty());
+
+    blockTemplate.LogFailedTxs();
+    BOOST_CHECK(pCdMan->pLogCache->GetExecuteFail(tip_index.height + 1, failures));
+    BOOST_CHECK_EQUAL(failures.size(), 1u);
+    SysCfg().SetLogFailures(false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
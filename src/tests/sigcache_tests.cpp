@@ -0,0 +1,289 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+#include "persistence/cachewrapper.h"
+#include "sigcache.h"
+#include "tx/coinutxotx.h"
+#include "tx/dextx.h"
+#include "tx/wasmcontracttx.h"
+
+using namespace std;
+using namespace dex;
+
+// the execution of the tx part which checks the signatures, it returns the result and sets the state
+typedef std::function<bool(CBaseTx &tx, CTxExecuteContext &context)> SigExecuteFunc;
+
+struct FSigCacheTests {
+    FSigCacheTests() {
+        root_dir = "/tmp/coind_unit_test";
+        if (boost::filesystem::exists(root_dir))
+            BOOST_CHECK(boost::filesystem::is_directory(root_dir));
+        else
+            BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(root_dir));
+
+        db_dir = root_dir / "sigcache_tests";
+        BOOST_CHECK_MESSAGE(!boost::filesystem::exists(db_dir), "must remove dir " + db_dir.string() + " first");
+
+        BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(db_dir));
+
+        ECC_Start();
+        pVerifyHandle.reset(new ECCVerifyHandle());
+        savedArgs = CBaseParams::GetMapArgs();
+        CBaseParams::SoftSetArgCover("-datadir", db_dir.string());
+        ClearDatadirCache();
+        pCdMan = new CCacheDBManager(true, false);
+        signatureCache.Clear();
+    }
+    ~FSigCacheTests() {
+        signatureCache.Clear();
+        delete pCdMan;
+        pCdMan = nullptr;
+        CBaseParams::SetMapArgs(savedArgs);
+        ClearDatadirCache();
+        pVerifyHandle.reset();
+        ECC_Stop();
+        BOOST_CHECK_NO_THROW(boost::filesystem::remove_all(db_dir));
+    }
+
+    // a registered account with the balances, the nickid is indexed if not empty
+    CRegID AddAccount(CKey &key, uint32_t regHeight, const CNickID &nickid = CNickID(),
+                      const map<TokenSymbol, uint64_t> &balances = {}) {
+        key.MakeNewKey(true);
+        CAccount account(key.GetPubKey().GetKeyId(), nickid, key.GetPubKey());
+        account.regid = CRegID(regHeight, 1);
+        ReceiptList receipts;
+        for (const auto &item : balances) {
+            BOOST_CHECK(account.OperateBalance(item.first, ADD_FREE, item.second, ReceiptCode::TRANSFER_ACTUAL_COINS,
+                                               receipts));
+        }
+        CCacheWrapper cw(pCdMan);
+        BOOST_CHECK(cw.accountCache.SaveAccount(account));
+        if (!nickid.IsEmpty())
+            BOOST_CHECK(cw.accountCache.SetNickId(account, regHeight));
+        cw.Flush();
+        return account.regid;
+    }
+
+    // the (sighash, sig, pubkeys) items of the tx verify, and the pre-pass caches the valid ones only
+    void CheckSigVerifyItems(CBaseTx &tx, CBaseTx &tamperedTx, const vector<uint8_t> &tamperedSig,
+                             size_t itemCount) {
+        CCacheWrapper cw(pCdMan);
+        vector<CSigVerifyItem> items, tamperedItems;
+        tx.GetSigVerifyItems(cw, height, items);
+        tamperedTx.GetSigVerifyItems(cw, height, tamperedItems);
+        BOOST_CHECK(items.size() == itemCount);
+        BOOST_CHECK(tamperedItems.size() == itemCount);
+        for (const auto &item : items) {
+            bool verified = false;
+            for (const auto &pubKey : item.pubKeys)
+                verified = verified || pubKey.Verify(item.sigHash, *item.pSignature);
+            BOOST_CHECK(verified);
+        }
+
+        CWorkerPool pool("test", 2);
+        CSignatureCache cache;
+        VerifySignatures(pool, cache, items);
+        VerifySignatures(pool, cache, tamperedItems);
+        for (const auto &item : items) {
+            bool cached = false;
+            for (const auto &pubKey : item.pubKeys)
+                cached = cached || cache.Get(item.sigHash, *item.pSignature, pubKey);
+            BOOST_CHECK(cached);
+        }
+        bool tamperedFound = false;
+        for (const auto &item : tamperedItems) {
+            if (item.pSignature != &tamperedSig)
+                continue;
+            tamperedFound = true;
+            for (const auto &pubKey : item.pubKeys)
+                BOOST_CHECK(!cache.Get(item.sigHash, *item.pSignature, pubKey));
+        }
+        BOOST_CHECK(tamperedFound);
+    }
+
+    // execute a copy of the tx on a new cache, the changes are dropped
+    bool ExecuteTx(CBaseTx &tx, const SigExecuteFunc &executeFunc, string &rejectReason) {
+        CCacheWrapper cw(pCdMan);
+        std::shared_ptr<CBaseTx> pTx = tx.GetNewInstance();
+        pTx->nFuelRate = fuelRate;
+        CValidationState state;
+        CTxExecuteContext context(height, 1, fuelRate, blockTime, blockTime - 3, &cw, &state);
+        bool ret = executeFunc(*pTx, context);
+        rejectReason = state.GetRejectReason();
+        return ret;
+    }
+
+    // the serial execution gives the same result with and without the signatures verified by the pre-pass
+    void CheckPreVerifiedExecution(CBaseTx &tx, const SigExecuteFunc &executeFunc, bool expectedResult) {
+        signatureCache.Clear();
+        string rejectReason;
+        bool result = ExecuteTx(tx, executeFunc, rejectReason);
+        BOOST_CHECK(result == expectedResult);
+
+        signatureCache.Clear();
+        vector<CSigVerifyItem> items;
+        {
+            CCacheWrapper cw(pCdMan);
+            tx.GetSigVerifyItems(cw, height, items);
+        }
+        CWorkerPool pool("test", 2);
+        VerifySignatures(pool, signatureCache, items);
+        string preVerifiedRejectReason;
+        BOOST_CHECK(ExecuteTx(tx, executeFunc, preVerifiedRejectReason) == result);
+        BOOST_CHECK(preVerifiedRejectReason == rejectReason);
+    }
+
+    boost::filesystem::path root_dir;
+    boost::filesystem::path db_dir;
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle;
+    map<string, string> savedArgs;
+
+    const int32_t height     = SysCfg().GetVer3ForkHeight() + 1;
+    const uint32_t blockTime = 1600000000;
+    const uint32_t fuelRate  = 1;
+};
+
+BOOST_FIXTURE_TEST_SUITE(sigcache_tests, FSigCacheTests)
+
+BOOST_AUTO_TEST_CASE(dex_operator_sig_test)
+{
+    const DexID dexId = 1;
+    CKey userKey, operatorKey;
+    CRegID userRegid = AddAccount(userKey, 1001, CNickID(), {{SYMB::WICC, 10 * COIN}, {SYMB::WUSD, 1000 * COIN}});
+    CRegID operatorRegid = AddAccount(operatorKey, 1002, CNickID(), {{SYMB::WICC, 10 * COIN}});
+    {
+        CCacheWrapper cw(pCdMan);
+        DexOperatorDetail operatorDetail;
+        operatorDetail.owner_regid        = operatorRegid;
+        operatorDetail.fee_receiver_regid = operatorRegid;
+        operatorDetail.name               = "sig-dex";
+        operatorDetail.activated          = true;
+        BOOST_CHECK(cw.dexCache.CreateDexOperator(dexId, operatorDetail));
+        cw.Flush();
+    }
+
+    CDEXOperatorOrderTx tx(userRegid, height, SYMB::WICC, COIN, ORDER_LIMIT_PRICE, ORDER_BUY, SYMB::WUSD,
+                           SYMB::WICC, 0, 10 * COIN, PRICE_BOOST / 10, dexId, PublicMode::PUBLIC, 0, 0,
+                           operatorRegid, COIN / 100, "");
+    BOOST_CHECK(userKey.Sign(tx.GetHash(), tx.signature));
+    BOOST_CHECK(operatorKey.Sign(tx.GetHash(), tx.operator_signature));
+
+    CDEXOperatorOrderTx tamperedTx(tx);
+    tamperedTx.operator_signature[10] ^= 1;
+
+    CheckSigVerifyItems(tx, tamperedTx, tamperedTx.operator_signature, 2);
+
+    auto checkAndExecuteTx = [](CBaseTx &tx, CTxExecuteContext &context) { return tx.CheckAndExecuteTx(context); };
+    CheckPreVerifiedExecution(tx, checkAndExecuteTx, true);
+    CheckPreVerifiedExecution(tamperedTx, checkAndExecuteTx, false);
+
+    string rejectReason;
+    BOOST_CHECK(!ExecuteTx(tamperedTx, checkAndExecuteTx, rejectReason));
+    BOOST_CHECK(rejectReason == "bad-operator-signature");
+}
+
+BOOST_AUTO_TEST_CASE(utxo_multisig_test)
+{
+    // the previous utxo tx is read from the block files, so only the multisig check of the input is executed
+    CKey senderKey, key1, key2;
+    CRegID senderRegid = AddAccount(senderKey, 1001, CNickID(), {{SYMB::WICC, 10 * COIN}});
+    vector<CUserID> uids = {AddAccount(key1, 1002), AddAccount(key2, 1003)};
+
+    string redeemScript("");
+    uint256 multiSignHash;
+    TxID prevUtxoTxid = uint256S("1234");
+    {
+        CCacheWrapper cw(pCdMan);
+        CAccount senderAccount, account1, account2;
+        BOOST_CHECK(cw.accountCache.GetAccount(senderRegid, senderAccount));
+        BOOST_CHECK(cw.accountCache.GetAccount(uids[0], account1));
+        BOOST_CHECK(cw.accountCache.GetAccount(uids[1], account2));
+        vector<string> addresses = {account1.keyid.ToAddress(), account2.keyid.ToAddress()};
+        BOOST_CHECK(ComputeRedeemScript(2, 2, addresses, redeemScript));
+        BOOST_CHECK(ComputeUtxoMultisignHash(prevUtxoTxid, 0, senderAccount, redeemScript, multiSignHash));
+    }
+    vector<UnsignedCharArray> signatures(2);
+    BOOST_CHECK(key1.Sign(multiSignHash, signatures[0]));
+    BOOST_CHECK(key2.Sign(multiSignHash, signatures[1]));
+
+    // every tx owns its input conditions
+    auto makeTx = [&](vector<UnsignedCharArray> &txSignatures) {
+        vector<CUtxoCondStorageBean> conds = {
+            CUtxoCondStorageBean(std::make_shared<CMultiSignAddressCondIn>(2, 2, uids, txSignatures))};
+        vector<CUtxoInput> vins = {CUtxoInput(prevUtxoTxid, 0, conds)};
+        vector<CUtxoOutput> vouts;
+        string memo("");
+        std::shared_ptr<CCoinUtxoTransferTx> pTx = std::make_shared<CCoinUtxoTransferTx>(
+            senderRegid, height, SYMB::WICC, COIN, SYMB::WICC, vins, vouts, memo);
+        BOOST_CHECK(senderKey.Sign(pTx->GetHash(), pTx->signature));
+        return pTx;
+    };
+    auto getMultiSignCond = [](CCoinUtxoTransferTx &tx) -> CMultiSignAddressCondIn & {
+        return dynamic_cast<CMultiSignAddressCondIn &>(*tx.vins[0].conds[0].sp_utxo_cond);
+    };
+
+    std::shared_ptr<CCoinUtxoTransferTx> pTx = makeTx(signatures);
+    vector<UnsignedCharArray> tamperedSignatures = signatures;
+    tamperedSignatures[1][10] ^= 1;
+    std::shared_ptr<CCoinUtxoTransferTx> pTamperedTx = makeTx(tamperedSignatures);
+
+    CheckSigVerifyItems(*pTx, *pTamperedTx, getMultiSignCond(*pTamperedTx).signatures[1], 3);
+
+    auto verifyMultiSig = [&](CBaseTx &tx, CTxExecuteContext &context) {
+        return VerifyMultiSig(context, multiSignHash, getMultiSignCond(dynamic_cast<CCoinUtxoTransferTx &>(tx)));
+    };
+    CheckPreVerifiedExecution(*pTx, verifyMultiSig, true);
+    CheckPreVerifiedExecution(*pTamperedTx, verifyMultiSig, false);
+}
+
+BOOST_AUTO_TEST_CASE(wasm_permission_sig_test)
+{
+    CKey payerKey, key1, key2;
+    CRegID payerRegid = AddAccount(payerKey, 1001, CNickID(), {{SYMB::WICC, 10 * COIN}});
+    const CNickID nickid1("sigsigner1"), nickid2("sigsigner2");
+    AddAccount(key1, 1002, nickid1);
+    AddAccount(key2, 1003, nickid2);
+
+    // the permission signatures are not in the tx hash
+    CWasmContractTx tx;
+    tx.txUid        = payerRegid;
+    tx.valid_height = height;
+    tx.llFees       = COIN;
+    tx.signatures   = {wasm::signature_pair{nickid1.value, {}}, wasm::signature_pair{nickid2.value, {}}};
+    vector<uint8_t> signature;
+    BOOST_CHECK(key1.Sign(tx.GetHash(), signature));
+    tx.set_signature(nickid1.value, signature);
+    BOOST_CHECK(key2.Sign(tx.GetHash(), signature));
+    tx.set_signature(nickid2.value, signature);
+    BOOST_CHECK(payerKey.Sign(tx.GetHash(), tx.signature));
+
+    CWasmContractTx tamperedTx(tx);
+    tamperedTx.signatures[1].signature[10] ^= 1;
+
+    CheckSigVerifyItems(tx, tamperedTx, tamperedTx.signatures[1].signature, 3);
+
+    auto getAccountsFromSignatures = [](CBaseTx &tx, CTxExecuteContext &context) {
+        vector<uint64_t> authorizationAccounts;
+        try {
+            dynamic_cast<CWasmContractTx &>(tx).get_accounts_from_signatures(*context.pCw, authorizationAccounts);
+        } catch (...) {
+            return false;
+        }
+        return authorizationAccounts.size() == 3;
+    };
+    CheckPreVerifiedExecution(tx, getAccountsFromSignatures, true);
+    CheckPreVerifiedExecution(tamperedTx, getAccountsFromSignatures, false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,160 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+#include "persistence/cachewrapper.h"
+#include "persistence/snapshot.h"
+
+using namespace std;
+
+struct FSnapshotTests {
+    FSnapshotTests() {
+        root_dir = "/tmp/coind_unit_test";
+        if (boost::filesystem::exists(root_dir))
+            BOOST_CHECK(boost::filesystem::is_directory(root_dir));
+        else
+            BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(root_dir));
+
+        db_dir = root_dir / "snapshot_tests";
+        BOOST_CHECK_MESSAGE(!boost::filesystem::exists(db_dir), "must remove dir " + db_dir.string() + " first");
+
+        BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(db_dir));
+    }
+    ~FSnapshotTests() {
+        BOOST_CHECK_NO_THROW(boost::filesystem::remove_all(db_dir));
+    }
+
+    boost::filesystem::path root_dir;
+    boost::filesystem::path db_dir;
+};
+
+BOOST_FIXTURE_TEST_SUITE(snapshot_tests, FSnapshotTests)
+
+BOOST_AUTO_TEST_CASE(snapshot_test)
+{
+    auto pStore = make_shared<CLevelDBWrapper>(db_dir / "snapshot", 1 << 20, false, true);
+    pStore->Write("idac-1", string("account-1"));
+    const leveldb::Snapshot *pSnapshot = pStore->GetSnapshot();
+    pStore->Write("idac-2", string("account-2"));
+    pStore->Erase("idac-1");
+
+    // the snapshot iterator sees the db as it was when the snapshot was taken
+    uint32_t count = 0;
+    std::unique_ptr<leveldb::Iterator> pCursor(pStore->NewIterator(pSnapshot));
+    for (pCursor->SeekToFirst(); pCursor->Valid(); pCursor->Next()) {
+        BOOST_CHECK(pCursor->key().ToString() == "idac-1");
+        count++;
+    }
+    BOOST_CHECK(count == 1);
+    pCursor.reset();
+    pStore->ReleaseSnapshot(pSnapshot);
+
+    CChainSnapshotChunk chunk;
+    chunk.db_name_type = DBNameType::ACCOUNT;
+    chunk.entry_count  = 1;
+    chunk.data         = "idac-1account-1";
+    chunk.checksum     = chunk.ComputeChecksum();
+    chunk.data[0]      = 'x';
+    BOOST_CHECK(chunk.ComputeChecksum() != chunk.checksum);
+
+    BOOST_CHECK(IsSnapshotExcludedPrefix(dbk::TXID_DISKINDEX));
+    BOOST_CHECK(!IsSnapshotExcludedPrefix(dbk::BEST_BLOCKHASH));
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_load_test)
+{
+    // a snapshot with a bad chunk or of another state hash is rejected before any chunk is written
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    const uint256 blockHash = uint256S("0x1234");
+    CBaseParams::SoftSetArgCover("-datadir", (db_dir / "snapshot-src").string());
+    ClearDatadirCache();
+    pCdMan = new CCacheDBManager(true, false);
+    {
+        CCacheWrapper cw(pCdMan);
+        for (uint32_t i = 0; i < 100; i++) {
+            vector<unsigned char> keyId(20, 0);
+            keyId[0] = i + 1;
+            CAccount account(CKeyID(uint160(keyId)), CNickID(), CPubKey{});
+            account.regid = CRegID(1000 + i, 1);
+            BOOST_CHECK(cw.accountCache.SaveAccount(account));
+        }
+        BOOST_CHECK(cw.blockCache.SetBestBlock(blockHash));
+        cw.Flush();
+    }
+    BOOST_CHECK(pCdMan->Flush());
+
+    boost::filesystem::path snapshotPath = db_dir / "chain.snapshot";
+    CChainSnapshotStats writtenStats;
+    {
+        CChainSnapshotWriter writer(*pCdMan, 10, blockHash);
+        BOOST_CHECK(writer.WriteToFile(snapshotPath, writtenStats));
+    }
+    delete pCdMan;
+
+    // a byte of the data of the last chunk, before the end record of type, chunk count and state hash
+    boost::filesystem::path badPath = db_dir / "bad.snapshot";
+    boost::filesystem::copy_file(snapshotPath, badPath);
+    {
+        std::fstream file(badPath.string(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(boost::filesystem::file_size(badPath) - 40);
+        file.put('x');
+    }
+    // the height of the header, after the network magic and the version
+    boost::filesystem::path badHeightPath = db_dir / "badheight.snapshot";
+    boost::filesystem::copy_file(snapshotPath, badHeightPath);
+    {
+        std::fstream file(badHeightPath.string(), std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(sizeof(MessageStartChars) + sizeof(uint32_t));
+        file.put(11);
+    }
+
+    CBaseParams::SoftSetArgCover("-datadir", (db_dir / "snapshot-dst").string());
+    ClearDatadirCache();
+    pCdMan = new CCacheDBManager(true, false);
+    auto isEmpty = []() {
+        for (int32_t i = 0; i < DBNameType::DB_NAME_COUNT; i++) {
+            std::unique_ptr<leveldb::Iterator> pCursor(pCdMan->GetDbAccess((DBNameType)i)->GetStore()->NewIterator());
+            pCursor->SeekToFirst();
+            if (pCursor->Valid())
+                return false;
+        }
+        return true;
+    };
+    BOOST_CHECK(isEmpty());
+
+    CWorkerPool workerPool("test", 2);
+    CChainSnapshotHeader header;
+    CChainSnapshotStats stats;
+    BOOST_CHECK(!LoadChainSnapshot(*pCdMan, badPath, &workerPool, uint256(), header, stats));
+    BOOST_CHECK(isEmpty());
+    BOOST_CHECK(!LoadChainSnapshot(*pCdMan, badHeightPath, &workerPool, writtenStats.state_hash, header, stats));
+    BOOST_CHECK(isEmpty());
+    BOOST_CHECK(!LoadChainSnapshot(*pCdMan, snapshotPath, &workerPool, uint256S("0x1"), header, stats));
+    BOOST_CHECK(isEmpty());
+
+    BOOST_CHECK(LoadChainSnapshot(*pCdMan, snapshotPath, &workerPool, writtenStats.state_hash, header, stats));
+    BOOST_CHECK(header.height == 10 && header.block_hash == blockHash);
+    BOOST_CHECK(stats.state_hash == writtenStats.state_hash && stats.entry_count == writtenStats.entry_count);
+    BOOST_CHECK(pCdMan->pBlockCache->GetBestBlockHash() == blockHash);
+    CAccount account;
+    BOOST_CHECK(pCdMan->pAccountCache->GetAccount(CRegID(1099, 1), account));
+    // the bloom filters built after the load, as by init, know the loaded keys
+    BOOST_CHECK(pCdMan->GetDbAccess(DBNameType::ACCOUNT)->EnableBloomFilter(dbk::REGID_KEYID));
+    BOOST_CHECK(pCdMan->pAccountCache->GetAccount(CRegID(1050, 1), account));
+
+    delete pCdMan;
+    pCdMan = nullptr;
+    CBaseParams::SetMapArgs(savedArgs);
+    ClearDatadirCache();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
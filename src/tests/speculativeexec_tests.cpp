@@ -0,0 +1,277 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+#include "persistence/blockundo.h"
+#include "persistence/cachewrapper.h"
+#include "persistence/dbaccess.h"
+#include "persistence/speculativeexec.h"
+#include "tx/cointransfertx.h"
+
+using namespace std;
+
+struct FSpeculativeExecTests {
+    FSpeculativeExecTests() {
+        root_dir = "/tmp/coind_unit_test";
+        if (boost::filesystem::exists(root_dir))
+            BOOST_CHECK(boost::filesystem::is_directory(root_dir));
+        else
+            BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(root_dir));
+
+        db_dir = root_dir / "speculativeexec_tests";
+        BOOST_CHECK_MESSAGE(!boost::filesystem::exists(db_dir), "must remove dir " + db_dir.string() + " first");
+
+        BOOST_CHECK_NO_THROW(boost::filesystem::create_directory(db_dir));
+    }
+    ~FSpeculativeExecTests() {
+        BOOST_CHECK_NO_THROW(boost::filesystem::remove_all(db_dir));
+    }
+
+    boost::filesystem::path root_dir;
+    boost::filesystem::path db_dir;
+};
+
+BOOST_FIXTURE_TEST_SUITE(speculativeexec_tests, FSpeculativeExecTests)
+
+// move the balance between the accounts, the values are the balances
+template <typename CacheType>
+static bool ExecuteTransfer(CacheType &cache, const string &from, const string &to, int64_t amount) {
+    string fromValue, toValue;
+    if (!cache.GetData(from, fromValue) || std::stoll(fromValue) < amount)
+        return false;
+    cache.SetData(from, std::to_string(std::stoll(fromValue) - amount));
+    int64_t toBalance = cache.GetData(to, toValue) ? std::stoll(toValue) : 0;
+    cache.SetData(to, std::to_string(toBalance + amount));
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(speculative_exec_test)
+{
+    const dbk::PrefixType prefix = dbk::REGID_KEYID;
+    typedef CCompositeKVCache<prefix, string, string> CacheType;
+    const int32_t accountCount = 50;
+    const int32_t txCount      = 200;
+
+    // tx 0 funds the new account read by tx 1, tx 2 scans the cache and can not be tracked
+    vector<tuple<string, string, int64_t>> transfers;
+    transfers.emplace_back("acc-0", "acc-new", 500);
+    transfers.emplace_back("acc-new", "acc-1", 300);
+    for (int32_t i = 2; i < txCount; i++) {
+        transfers.emplace_back(strprintf("acc-%d", (i * 7) % accountCount), strprintf("acc-%d", (i * 13) % accountCount),
+                               i % 3 == 0 ? 5000 : 10);
+    }
+    auto executeTx = [&](size_t index, CacheType &cache) {
+        if (index == 2) {
+            map<string, string> elements;
+            cache.GetAllElements(elements);
+        }
+        return ExecuteTransfer(cache, std::get<0>(transfers[index]), std::get<1>(transfers[index]),
+                               std::get<2>(transfers[index]));
+    };
+
+    shared_ptr<CDBAccess> pSerialDb   = make_shared<CDBAccess>(db_dir / "serial", DBNameType::ACCOUNT, false, true);
+    shared_ptr<CDBAccess> pParallelDb = make_shared<CDBAccess>(db_dir / "parallel", DBNameType::ACCOUNT, false, true);
+    auto pSerialCache   = make_shared<CacheType>(pSerialDb.get());
+    auto pParallelCache = make_shared<CacheType>(pParallelDb.get());
+    for (int32_t i = 0; i < accountCount; i++) {
+        pSerialCache->SetData(strprintf("acc-%d", i), "1000");
+        pParallelCache->SetData(strprintf("acc-%d", i), "1000");
+    }
+    pSerialCache->Flush();
+    pParallelCache->Flush();
+
+    // serial execution
+    CacheType serialBlockCache(pSerialCache.get());
+    CBlockUndoJournal serialJournal;
+    vector<bool> serialResults;
+    for (int32_t i = 0; i < txCount; i++) {
+        serialJournal.BeginTx(uint256S(strprintf("%x", i + 1)));
+        serialBlockCache.SetDbOpLogMap(&serialJournal);
+        serialResults.push_back(executeTx(i, serialBlockCache));
+        serialBlockCache.SetDbOpLogMap(nullptr);
+        serialJournal.EndTx();
+    }
+
+    // speculative execution on the workers, committed in order
+    CWorkerPool pool("test", 3);
+    CacheType parallelBlockCache(pParallelCache.get());
+    CSpeculativeExecutor<CacheType> executor(pool, parallelBlockCache);
+    CBlockUndoJournal parallelJournal;
+    executor.Speculate(0, txCount, executeTx);
+    for (int32_t i = 0; i < txCount; i++) {
+        parallelJournal.BeginTx(uint256S(strprintf("%x", i + 1)));
+        BOOST_CHECK(executor.Commit(i, parallelJournal) == serialResults[i]);
+        parallelJournal.EndTx();
+    }
+    BOOST_CHECK(executor.GetReexecutedCount() >= 2);
+    BOOST_CHECK(executor.GetReexecutedCount() < (uint32_t)txCount);
+
+    // the same state and the same undo op logs
+    string serialValue, parallelValue;
+    for (int32_t i = 0; i < accountCount; i++) {
+        BOOST_CHECK(serialBlockCache.GetData(strprintf("acc-%d", i), serialValue));
+        BOOST_CHECK(parallelBlockCache.GetData(strprintf("acc-%d", i), parallelValue));
+        BOOST_CHECK(serialValue == parallelValue);
+    }
+    BOOST_CHECK(parallelBlockCache.GetData(string("acc-new"), parallelValue) && parallelValue == "200");
+
+    vector<CBlockUndoJournal::OpLog> serialOpLogs, parallelOpLogs;
+    BOOST_CHECK(serialJournal.GetOpLogs(serialOpLogs));
+    BOOST_CHECK(parallelJournal.GetOpLogs(parallelOpLogs));
+    BOOST_CHECK(serialOpLogs.size() == parallelOpLogs.size());
+    for (size_t i = 0; i < serialOpLogs.size() && i < parallelOpLogs.size(); i++) {
+        BOOST_CHECK(serialOpLogs[i].tx_index == parallelOpLogs[i].tx_index);
+        BOOST_CHECK(serialOpLogs[i].key.ToString() == parallelOpLogs[i].key.ToString());
+        BOOST_CHECK(serialOpLogs[i].value.ToString() == parallelOpLogs[i].value.ToString());
+    }
+}
+
+// the account state of the uid serialized, empty if the account does not exist
+static string GetAccountData(CCacheWrapper &cw, const CUserID &uid) {
+    CAccount account;
+    if (!cw.accountCache.GetAccount(uid, account))
+        return "";
+    CDataStream ds(SER_DISK, CLIENT_VERSION);
+    ds << account;
+    return ds.str();
+}
+
+BOOST_AUTO_TEST_CASE(parallel_transfer_test)
+{
+    // a run of BCOIN and UCOIN transfers executed on the account db like ConnectBlock(), serially and
+    // speculatively on the workers, ends in the same accounts and the same undo op logs
+    ECC_Start();
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle(new ECCVerifyHandle());
+    map<string, string> savedArgs = CBaseParams::GetMapArgs();
+    CBaseParams::SoftSetArgCover("-datadir", db_dir.string());
+    ClearDatadirCache();
+    pCdMan = new CCacheDBManager(true, false);
+    {
+        const int32_t height     = SysCfg().GetFeatureForkHeight() + 1;
+        const uint32_t blockTime = 1600000000;
+        const uint32_t fuelRate  = 1;
+        const size_t senderCount = 16;
+        const size_t txCount     = 400;
+
+        vector<CKey> keys(senderCount);
+        vector<CRegID> regids;
+        {
+            CCacheWrapper cw(pCdMan);
+            for (size_t i = 0; i < senderCount; i++) {
+                keys[i].MakeNewKey(true);
+                regids.emplace_back(1000 + i, 1);
+                CAccount account(keys[i].GetPubKey().GetKeyId(), CNickID(), keys[i].GetPubKey());
+                account.regid = regids[i];
+                ReceiptList receipts;
+                BOOST_CHECK(account.OperateBalance(SYMB::WICC, ADD_FREE, 10000 * COIN,
+                                                   ReceiptCode::TRANSFER_ACTUAL_COINS, receipts));
+                BOOST_CHECK(account.OperateBalance(SYMB::WGRT, ADD_FREE, 10000 * COIN,
+                                                   ReceiptCode::TRANSFER_ACTUAL_COINS, receipts));
+                BOOST_CHECK(cw.accountCache.SaveAccount(account));
+            }
+            cw.Flush();
+        }
+        // the senders are read from db
+        BOOST_CHECK(pCdMan->Flush());
+
+        // every fourth tx pays one of the senders, so some txs read the accounts written by the earlier ones
+        vector<std::shared_ptr<CBaseTx>> txs;
+        vector<CUserID> uids(regids.begin(), regids.end());
+        for (size_t i = 0; i < txCount; i++) {
+            size_t sender = i % senderCount;
+            CUserID toUid;
+            if (i % 4 == 0) {
+                toUid = regids[(i * 7 + 3) % senderCount];
+            } else {
+                CKey key;
+                key.MakeNewKey(true);
+                toUid = key.GetPubKey().GetKeyId();
+                uids.push_back(toUid);
+            }
+
+            std::shared_ptr<CBaseTx> pTx;
+            if (i % 2 == 0)
+                pTx = std::make_shared<CBaseCoinTransferTx>(regids[sender], toUid, height, COIN + i, COIN / 10, "");
+            else
+                pTx = std::make_shared<CCoinTransferTx>(regids[sender], toUid, height, i % 3 ? SYMB::WICC : SYMB::WGRT,
+                                                        COIN + i, SYMB::WICC, COIN / 100, "");
+            BOOST_CHECK(keys[sender].Sign(pTx->GetHash(), pTx->signature));
+            txs.push_back(pTx);
+        }
+
+        // the tx execution of ConnectBlock(), on a copy of the tx
+        auto executeTx = [&](vector<std::shared_ptr<CBaseTx>> &executedTxs, size_t index, CCacheWrapper &cw) {
+            executedTxs[index]            = txs[index]->GetNewInstance();
+            executedTxs[index]->nFuelRate = fuelRate;
+            CValidationState state;
+            CTxExecuteContext context(height, index + 1, fuelRate, blockTime, blockTime - 3, &cw, &state);
+            return executedTxs[index]->CheckAndExecuteTx(context);
+        };
+
+        CCacheWrapper serialCw(pCdMan);
+        CBlockUndoJournal serialJournal;
+        vector<std::shared_ptr<CBaseTx>> serialTxs(txCount);
+        int64_t beginTime = GetTimeMicros();
+        for (size_t i = 0; i < txCount; i++) {
+            CTxUndoOpLogger opLogger(serialCw, txs[i]->GetHash(), serialJournal);
+            BOOST_CHECK(executeTx(serialTxs, i, serialCw));
+        }
+        int64_t serialTime = GetTimeMicros() - beginTime;
+
+        CWorkerPool pool("test", 4);
+        CCacheWrapper parallelCw(pCdMan);
+        CBlockUndoJournal parallelJournal;
+        vector<std::shared_ptr<CBaseTx>> parallelTxs(txCount);
+        CSpeculativeExecutor<CCacheWrapper> executor(pool, parallelCw);
+        beginTime = GetTimeMicros();
+        executor.Speculate(0, txCount, [&](size_t index, CCacheWrapper &txCw) {
+            return executeTx(parallelTxs, index, txCw);
+        });
+        for (size_t i = 0; i < txCount; i++) {
+            CTxUndoOpLogger opLogger(parallelCw, txs[i]->GetHash(), parallelJournal);
+            BOOST_CHECK(executor.Commit(i, parallelJournal));
+        }
+        int64_t parallelTime = GetTimeMicros() - beginTime;
+        BOOST_CHECK(executor.GetReexecutedCount() > 0);
+        BOOST_CHECK(executor.GetReexecutedCount() < txCount);
+        BOOST_TEST_MESSAGE(strprintf("%u transfers: serial=%.2fms, parallel with %u workers=%.2fms, %u executed again",
+                                     (uint32_t)txCount, 0.001 * serialTime, pool.GetThreadCount() + 1,
+                                     0.001 * parallelTime, executor.GetReexecutedCount()));
+
+        for (const auto &uid : uids) {
+            string serialData = GetAccountData(serialCw, uid);
+            BOOST_CHECK(!serialData.empty());
+            BOOST_CHECK(serialData == GetAccountData(parallelCw, uid));
+        }
+
+        vector<CBlockUndoJournal::OpLog> serialOpLogs, parallelOpLogs;
+        vector<TxID> serialTxids, parallelTxids;
+        BOOST_CHECK(serialJournal.GetOpLogs(serialOpLogs, &serialTxids));
+        BOOST_CHECK(parallelJournal.GetOpLogs(parallelOpLogs, &parallelTxids));
+        BOOST_CHECK(serialTxids == parallelTxids);
+        BOOST_CHECK(serialOpLogs.size() == parallelOpLogs.size());
+        for (size_t i = 0; i < serialOpLogs.size() && i < parallelOpLogs.size(); i++) {
+            BOOST_CHECK(serialOpLogs[i].tx_index == parallelOpLogs[i].tx_index);
+            BOOST_CHECK(serialOpLogs[i].key.ToString() == parallelOpLogs[i].key.ToString());
+            BOOST_CHECK(serialOpLogs[i].value.ToString() == parallelOpLogs[i].value.ToString());
+        }
+    }
+
+    delete pCdMan;
+    pCdMan = nullptr;
+    CBaseParams::SetMapArgs(savedArgs);
+    ClearDatadirCache();
+    pVerifyHandle.reset();
+    ECC_Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
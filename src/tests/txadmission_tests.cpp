@@ -0,0 +1,299 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "init.h"
+#include "main.h"
+
+#include <algorithm>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "rpc/core/rpccommons.h"
+#include "rpc/core/rpcserver.h"
+#include "tx/cointransfertx.h"
+#include "tx/txadmission.h"
+#include "wallet/wallet.h"
+
+using namespace std;
+
+struct ECCSetup {
+    ECCSetup() { ECC_Start(); pVerifyHandle.reset(new ECCVerifyHandle()); }
+    ~ECCSetup() { pVerifyHandle.reset(); ECC_Stop(); }
+
+    std::unique_ptr<ECCVerifyHandle> pVerifyHandle;
+};
+
+// a synthetic mempool of the admission: the signature check of the tx execution and a rehearsal which takes
+// the fees from the balances of the senders, under one lock like cs_main
+class CTestMemPool {
+public:
+    CSignatureCache sigCache;
+    std::map<uint256, CPubKey> pubKeys;  // the pubkeys of the senders by the txids
+    std::map<uint32_t, uint64_t> balances;
+    std::mutex mutex;
+    uint32_t commitCount = 0;
+
+    void GetSigVerifyItems(const vector<std::shared_ptr<CBaseTx>> &txs, vector<CSigVerifyItem> &items) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &pTx : txs)
+            items.emplace_back(pTx->GetHash(), pTx->signature, vector<CPubKey>({pubKeys[pTx->GetHash()]}));
+    }
+
+    bool Commit(CBaseTx &tx, string &message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        commitCount++;
+        const uint256 &txid   = tx.GetHash();
+        const CPubKey &pubKey = pubKeys[txid];
+        if (!sigCache.Get(txid, tx.signature, pubKey)) {
+            if (!pubKey.Verify(txid, tx.signature)) {
+                message = "bad-tx-signature";
+                return false;
+            }
+            sigCache.Set(txid, tx.signature, pubKey);
+        }
+
+        uint64_t &balance = balances[tx.txUid.get<CRegID>().GetHeight()];
+        if (balance < tx.llFees) {
+            message = "not-sufficient-funds";
+            return false;
+        }
+        balance -= tx.llFees;
+        message = txid.GetHex();
+        return true;
+    }
+};
+
+// count signed transfer txs of senderCount senders
+static vector<std::shared_ptr<CBaseTx>> MakeSignedTxs(CTestMemPool &pool, uint32_t count, uint32_t senderCount) {
+    vector<CKey> keys(senderCount);
+    for (auto &key : keys)
+        key.MakeNewKey(true);
+
+    vector<std::shared_ptr<CBaseTx>> txs;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t senderIndex = i % senderCount;
+        auto pTx = std::make_shared<CBaseCoinTransferTx>(CRegID(1000 + senderIndex, 1), CRegID(2000, 1), 100,
+                                                          COIN + i, 10000, "");
+        BOOST_CHECK(keys[senderIndex].Sign(pTx->GetHash(), pTx->signature));
+        pool.pubKeys[pTx->GetHash()] = keys[senderIndex].GetPubKey();
+        txs.push_back(pTx);
+    }
+    return txs;
+}
+
+static CTxAdmission::SigItemsFunc GetSigItemsFunc(CTestMemPool &pool) {
+    return [&pool](const vector<std::shared_ptr<CBaseTx>> &txs, vector<CSigVerifyItem> &items) {
+        pool.GetSigVerifyItems(txs, items);
+    };
+}
+
+static CTxAdmission::CommitFunc GetCommitFunc(CTestMemPool &pool) {
+    return [&pool](CBaseTx &tx, string &message) { return pool.Commit(tx, message); };
+}
+
+// the admission functions of the node: the signatures are collected under cs_main, the commit takes cs_main and
+// cs_wallet like the commit of the wallet
+static CTxAdmission::SigItemsFunc GetLockingSigItemsFunc(CTestMemPool &pool) {
+    return [&pool](const vector<std::shared_ptr<CBaseTx>> &txs, vector<CSigVerifyItem> &items) {
+        LOCK(cs_main);
+        pool.GetSigVerifyItems(txs, items);
+    };
+}
+
+static CTxAdmission::CommitFunc GetLockingCommitFunc(CTestMemPool &pool) {
+    return [&pool](CBaseTx &tx, string &message) {
+        if (pWalletMain == nullptr) {
+            LOCK(cs_main);
+            return pool.Commit(tx, message);
+        }
+        LOCK2(cs_main, pWalletMain->cs_wallet);
+        return pool.Commit(tx, message);
+    };
+}
+
+// the tx committed by the test RPC
+static std::shared_ptr<CBaseTx> pRPCTestTx;
+
+static Value testcommittx(const Array& params, bool fHelp) {
+    return CommitTx(*pRPCTestTx, params.size() > 0 && params[0].get_bool(), "testcommittx error: ");
+}
+
+// call the RPC through the locks of the RPC server, false if it does not return in time (deadlock)
+static bool CallRPCInTime(const CRPCCommand &cmd, const Array &params, Value &result, string &error) {
+    auto pPromise = std::make_shared<std::promise<std::pair<Value, string>>>();
+    std::future<std::pair<Value, string>> future = pPromise->get_future();
+    std::thread([cmd, params, pPromise]() {
+        std::pair<Value, string> ret;
+        try {
+            ret.first = CallRPCActor(cmd, params);
+        } catch (const Object &errObj) {
+            ret.second = find_value(errObj, "message").get_str();
+        }
+        pPromise->set_value(ret);
+    }).detach();
+
+    if (future.wait_for(std::chrono::seconds(30)) != std::future_status::ready)
+        return false;
+
+    std::pair<Value, string> ret = future.get();
+    result = ret.first;
+    error  = ret.second;
+    return true;
+}
+
+BOOST_FIXTURE_TEST_SUITE(txadmission_tests, ECCSetup)
+
+BOOST_AUTO_TEST_CASE(txadmission_result_test)
+{
+    CTestMemPool pool;
+    vector<std::shared_ptr<CBaseTx>> txs = MakeSignedTxs(pool, 300, 3);
+    // the sender 2 pays the fees of 50 txs only, the last tx has a bad signature
+    pool.balances = {{1000, 100 * 10000}, {1001, 100 * 10000}, {1002, 50 * 10000}};
+    txs.back()->signature[10] ^= 0x01;
+
+    // the txs are rejected until the admission is started
+    CTxAdmission admission(pool.sigCache, GetSigItemsFunc(pool), GetCommitFunc(pool));
+    CTxAdmission::CResult result = admission.Submit(txs[0]).get();
+    BOOST_CHECK_EQUAL(result.status, CTxAdmission::REJECTED);
+    BOOST_CHECK_EQUAL(pool.commitCount, 0u);
+
+    admission.Start(2);
+    vector<std::shared_future<CTxAdmission::CResult>> futures;
+    for (const auto &pTx : txs)
+        futures.push_back(admission.Submit(pTx));
+
+    uint32_t acceptedCount = 0;
+    for (size_t i = 0; i < txs.size(); i++) {
+        const CTxAdmission::CResult &txResult = futures[i].get();
+        if (txResult.status == CTxAdmission::ACCEPTED) {
+            acceptedCount++;
+            BOOST_CHECK_EQUAL(txResult.message, txs[i]->GetHash().GetHex());
+        } else {
+            BOOST_CHECK_EQUAL(txResult.status, CTxAdmission::REJECTED);
+            BOOST_CHECK(i % 3 == 2);
+        }
+
+        // the result is kept for the queries
+        CTxAdmission::CResult queried = admission.GetResult(txs[i]->GetHash());
+        BOOST_CHECK_EQUAL(queried.status, txResult.status);
+        BOOST_CHECK_EQUAL(queried.message, txResult.message);
+    }
+    BOOST_CHECK_EQUAL(acceptedCount, 250u);
+    BOOST_CHECK_EQUAL(admission.GetResult(txs.back()->GetHash()).message, "bad-tx-signature");
+    BOOST_CHECK_EQUAL(admission.GetResult(uint256S("0x01")).status, CTxAdmission::UNKNOWN);
+
+    // the signatures of the batches were verified ahead of the commits
+    for (size_t i = 0; i + 1 < txs.size(); i++)
+        BOOST_CHECK(pool.sigCache.Get(txs[i]->GetHash(), txs[i]->signature, pool.pubKeys[txs[i]->GetHash()]));
+
+    admission.Stop();
+    BOOST_CHECK_EQUAL(admission.Submit(txs[1]).get().status, CTxAdmission::REJECTED);
+}
+
+BOOST_AUTO_TEST_CASE(txadmission_rpc_lock_test)
+{
+    CTestMemPool pool;
+    vector<std::shared_ptr<CBaseTx>> txs = MakeSignedTxs(pool, 4, 2);
+    pool.balances = {{1000, COIN}, {1001, COIN}};
+    txs[3]->signature[10] ^= 0x01;
+
+    CTxAdmission admission(pool.sigCache, GetLockingSigItemsFunc(pool), GetLockingCommitFunc(pool));
+    admission.Start(1);
+    CTxAdmission *pPrevAdmission = pTxAdmission;
+    pTxAdmission = &admission;
+
+    const CRPCCommand lockedCmd     = {"testcommittx", &testcommittx, true, false, false};
+    const CRPCCommand threadSafeCmd = {"testcommittx", &testcommittx, true, true, false};
+    Value result;
+    string error;
+
+    // the RPC run under cs_main and cs_wallet commits, the server waits for the admission after the locks
+    pRPCTestTx = txs[0];
+    BOOST_REQUIRE(CallRPCInTime(lockedCmd, Array(), result, error));
+    BOOST_CHECK_EQUAL(error, "");
+    BOOST_CHECK_EQUAL(find_value(result.get_obj(), "txid").get_str(), txs[0]->GetHash().GetHex());
+    BOOST_CHECK_EQUAL(admission.GetResult(txs[0]->GetHash()).status, CTxAdmission::ACCEPTED);
+
+    // the thread-safe RPC waits in the RPC
+    pRPCTestTx = txs[1];
+    BOOST_REQUIRE(CallRPCInTime(threadSafeCmd, Array(), result, error));
+    BOOST_CHECK_EQUAL(error, "");
+    BOOST_CHECK_EQUAL(find_value(result.get_obj(), "txid").get_str(), txs[1]->GetHash().GetHex());
+
+    // the async commit under the locks returns the status
+    pRPCTestTx = txs[2];
+    Array asyncParams;
+    asyncParams.push_back(true);
+    BOOST_REQUIRE(CallRPCInTime(lockedCmd, asyncParams, result, error));
+    BOOST_CHECK_EQUAL(error, "");
+    string status = find_value(result.get_obj(), "status").get_str();
+    BOOST_CHECK(status == "queued" || status == "accepted");
+    while (admission.GetResult(txs[2]->GetHash()).status == CTxAdmission::QUEUED)
+        MilliSleep(10);
+    BOOST_CHECK_EQUAL(admission.GetResult(txs[2]->GetHash()).status, CTxAdmission::ACCEPTED);
+
+    // the rejection of a deferred admission is the error of the RPC
+    pRPCTestTx = txs[3];
+    BOOST_REQUIRE(CallRPCInTime(lockedCmd, Array(), result, error));
+    BOOST_CHECK_EQUAL(error, "testcommittx error: bad-tx-signature");
+
+    pTxAdmission = pPrevAdmission;
+    admission.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txadmission_bench_test)
+{
+    const uint32_t count        = 4000;
+    const uint32_t workerCount  = std::max<uint32_t>(std::min<uint32_t>(std::thread::hardware_concurrency(), 16), 2) - 1;
+
+    // the former way: every tx is verified and committed under the lock by its RPC thread
+    CTestMemPool serialPool;
+    vector<std::shared_ptr<CBaseTx>> serialTxs = MakeSignedTxs(serialPool, count, 100);
+    for (uint32_t i = 0; i < 100; i++)
+        serialPool.balances[1000 + i] = COIN;
+
+    int64_t beginTime = GetTimeMicros();
+    uint32_t serialAccepted = 0;
+    for (const auto &pTx : serialTxs) {
+        string message;
+        if (serialPool.Commit(*pTx, message))
+            serialAccepted++;
+    }
+    int64_t serialTime = std::max<int64_t>(GetTimeMicros() - beginTime, 1);
+
+    // the staged admission
+    CTestMemPool stagedPool;
+    vector<std::shared_ptr<CBaseTx>> stagedTxs = MakeSignedTxs(stagedPool, count, 100);
+    for (uint32_t i = 0; i < 100; i++)
+        stagedPool.balances[1000 + i] = COIN;
+
+    CTxAdmission admission(stagedPool.sigCache, GetSigItemsFunc(stagedPool), GetCommitFunc(stagedPool));
+    admission.Start(workerCount);
+    beginTime = GetTimeMicros();
+    vector<std::shared_future<CTxAdmission::CResult>> futures;
+    futures.reserve(count);
+    for (const auto &pTx : stagedTxs)
+        futures.push_back(admission.Submit(pTx));
+
+    uint32_t stagedAccepted = 0;
+    for (auto &future : futures) {
+        if (future.get().status == CTxAdmission::ACCEPTED)
+            stagedAccepted++;
+    }
+    int64_t stagedTime = std::max<int64_t>(GetTimeMicros() - beginTime, 1);
+    admission.Stop();
+
+    BOOST_CHECK_EQUAL(serialAccepted, count);
+    BOOST_CHECK_EQUAL(stagedAccepted, count);
+    BOOST_TEST_MESSAGE(strprintf("admission of %u signed txs: serial=%.0f txs/s, staged with %u workers=%.0f txs/s",
+                                 count, count * 1000000.0 / serialTime, workerCount,
+                                 count * 1000000.0 / stagedTime));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,141 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "persistence/txdb.h"
+#include "tx/blockrewardtx.h"
+#include "tx/cointransfertx.h"
+
+using namespace std;
+
+// a block of the height with txCount transfer txs, the txs differ by the height and the index
+static CBlock MakeBlock(uint32_t height, uint32_t txCount) {
+    CBlock block;
+    block.SetHeight(height);
+    for (uint32_t i = 0; i < txCount; i++) {
+        block.vptx.push_back(std::make_shared<CBaseCoinTransferTx>(CRegID(100 + i, 1), CRegID(200, 1), height,
+                                                                   COIN + i, 10000, ""));
+    }
+    return block;
+}
+
+static std::shared_ptr<CBaseTx> MakeRewardTx(uint32_t height) {
+    auto pRewardTx          = std::make_shared<CBlockRewardTx>();
+    pRewardTx->txUid        = CRegID(height, 1);
+    pRewardTx->valid_height = height;
+    pRewardTx->reward_fees  = height * 1000;
+    return pRewardTx;
+}
+
+BOOST_AUTO_TEST_SUITE(txdb_tests)
+
+BOOST_AUTO_TEST_CASE(tx_mem_cache_layer_test)
+{
+    CTxMemCache baseCache;
+    CBlock block1 = MakeBlock(1, 3), block2 = MakeBlock(2, 2);
+    BOOST_CHECK(baseCache.AddBlockTx(block1));
+    BOOST_CHECK(baseCache.AddBlockTx(block2));
+    BOOST_CHECK(baseCache.HasTx(block1.vptx[0]->GetHash()) && baseCache.HasTx(block2.vptx[1]->GetHash()));
+    BOOST_CHECK_EQUAL(baseCache.GetSize(), 5u);
+
+    // the child sees the blocks of the base and the blocks added to it
+    CTxMemCache childCache(&baseCache);
+    CBlock block3 = MakeBlock(3, 2);
+    BOOST_CHECK(childCache.AddBlockTx(block3));
+    BOOST_CHECK(childCache.HasTx(block1.vptx[2]->GetHash()));
+    BOOST_CHECK(childCache.HasTx(block3.vptx[0]->GetHash()));
+    BOOST_CHECK(!baseCache.HasTx(block3.vptx[0]->GetHash()));
+
+    // the block removed on the child is shadowed by an empty txid list, the base still has it until the flush
+    BOOST_CHECK(childCache.RemoveBlockTx(1));
+    for (const auto &pTx : block1.vptx) {
+        BOOST_CHECK(!childCache.HasTx(pTx->GetHash()));
+        BOOST_CHECK(baseCache.HasTx(pTx->GetHash()));
+    }
+    BOOST_CHECK(childCache.HasTx(block2.vptx[0]->GetHash()));
+
+    // a grandchild sees the removal of the child
+    CTxMemCache grandchildCache(&childCache);
+    BOOST_CHECK(!grandchildCache.HasTx(block1.vptx[0]->GetHash()));
+    BOOST_CHECK(grandchildCache.HasTx(block3.vptx[1]->GetHash()));
+
+    // a block added again at the removed height replaces the txids of the base block
+    CBlock block1b = MakeBlock(1, 1);
+    block1b.vptx[0]->valid_height = 101;
+    BOOST_CHECK(grandchildCache.AddBlockTx(block1b));
+    BOOST_CHECK(grandchildCache.HasTx(block1b.vptx[0]->GetHash()));
+    BOOST_CHECK(!grandchildCache.HasTx(block1.vptx[1]->GetHash()));
+    BOOST_CHECK(!childCache.HasTx(block1b.vptx[0]->GetHash()));
+
+    // the flush merges the added and removed blocks into the base
+    grandchildCache.Flush();
+    BOOST_CHECK(childCache.HasTx(block1b.vptx[0]->GetHash()));
+    BOOST_CHECK_EQUAL(grandchildCache.GetSize(), 0u);
+    childCache.Flush();
+    BOOST_CHECK(baseCache.HasTx(block1b.vptx[0]->GetHash()));
+    for (size_t i = 1; i < block1.vptx.size(); i++)
+        BOOST_CHECK(!baseCache.HasTx(block1.vptx[i]->GetHash()));
+    BOOST_CHECK(baseCache.HasTx(block3.vptx[0]->GetHash()));
+    BOOST_CHECK_EQUAL(baseCache.GetSize(), 5u);
+
+    // a removal flushed to the base erases the block
+    CTxMemCache otherChild(&baseCache);
+    BOOST_CHECK(otherChild.RemoveBlockTx(2));
+    otherChild.Flush();
+    BOOST_CHECK(!baseCache.HasTx(block2.vptx[0]->GetHash()) && !baseCache.HasTx(block2.vptx[1]->GetHash()));
+    BOOST_CHECK_EQUAL(baseCache.GetSize(), 3u);
+
+    // the removal of the top level cache erases the block at once
+    BOOST_CHECK(baseCache.RemoveBlockTx(3));
+    BOOST_CHECK(!baseCache.HasTx(block3.vptx[0]->GetHash()));
+    BOOST_CHECK_EQUAL(baseCache.GetSize(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE(reward_tx_queue_test)
+{
+    const uint32_t maxSize = BLOCK_REWARD_MATURITY * 2;
+    CRewardTxQueue queue(maxSize);
+    vector<uint256> blockHashes;
+    for (uint32_t i = 0; i < maxSize; i++) {
+        blockHashes.push_back(uint256S(strprintf("%x", i + 1)));
+        queue.Push(blockHashes.back(), MakeRewardTx(i + 1));
+    }
+
+    // the queued tx is an unexecuted copy, a change of the pushed or the returned tx does not reach it
+    auto pPushedTx = MakeRewardTx(maxSize + 1);
+    uint256 lastHash = uint256S(strprintf("%x", maxSize + 1));
+    queue.Push(lastHash, pPushedTx);
+    blockHashes.push_back(lastHash);
+    pPushedTx->nRunStep = 12345;
+    auto pTx = queue.Get(lastHash);
+    BOOST_REQUIRE(pTx != nullptr);
+    BOOST_CHECK(pTx->GetHash() == MakeRewardTx(maxSize + 1)->GetHash());
+    BOOST_CHECK_EQUAL(pTx->nRunStep, 0u);
+    pTx->nRunStep = 1;
+    BOOST_CHECK_EQUAL(queue.Get(lastHash)->nRunStep, 0u);
+
+    // the oldest one is evicted when the queue holds more than 2 * maturity blocks
+    BOOST_CHECK(queue.Get(blockHashes[0]) == nullptr);
+    for (size_t i = 1; i < blockHashes.size(); i++) {
+        auto pQueuedTx = queue.Get(blockHashes[i]);
+        BOOST_REQUIRE(pQueuedTx != nullptr);
+        BOOST_CHECK(pQueuedTx->GetHash() == MakeRewardTx(i + 1)->GetHash());
+    }
+
+    // a block pushed again keeps its place in the queue
+    queue.Push(blockHashes[1], MakeRewardTx(999));
+    BOOST_CHECK(queue.Get(blockHashes[1])->GetHash() == MakeRewardTx(2)->GetHash());
+    queue.Push(uint256S("ffff"), MakeRewardTx(1000));
+    BOOST_CHECK(queue.Get(blockHashes[1]) == nullptr);
+    BOOST_CHECK(queue.Get(blockHashes[2]) != nullptr);
+
+    queue.Clear();
+    BOOST_CHECK(queue.Get(blockHashes[2]) == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,68 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "main.h"
+
+#include <string>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "tx/txserializer.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(txserializer_tests)
+
+BOOST_AUTO_TEST_CASE(tx_wire_size_test)
+{
+    vector<std::shared_ptr<CBaseTx>> txs;
+    for (uint32_t i = 0; i < 20; i++) {
+        CRegID fromRegid(100 + i, 1), toRegid(200 + i, 2);
+        string memo(i * 13, 'm');
+        if (i % 2 == 0)
+            txs.push_back(std::make_shared<CBaseCoinTransferTx>(fromRegid, toRegid, 1000 + i, i * 100000, 10000, memo));
+        else
+            txs.push_back(std::make_shared<CCoinTransferTx>(fromRegid, toRegid, 1000 + i, SYMB::WICC, i * 100000,
+                                                            SYMB::WICC, 10000, memo));
+        txs.back()->signature.assign(i * 3, 's');
+    }
+
+    CDataStream ssTxs(SER_NETWORK, PROTOCOL_VERSION);
+    ssTxs << txs;
+    uint32_t streamSize = ssTxs.size();
+
+    vector<std::shared_ptr<CBaseTx>> readTxs;
+    ssTxs >> readTxs;
+    BOOST_CHECK(ssTxs.empty());
+    BOOST_CHECK_EQUAL(readTxs.size(), txs.size());
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        // the created txs are serialized for their sizes, the read ones take them from the stream
+        BOOST_CHECK_EQUAL(txs[i]->serialize_size.size, 0U);
+        BOOST_CHECK_EQUAL(readTxs[i]->serialize_size.size, txs[i]->GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION));
+        BOOST_CHECK_EQUAL(readTxs[i]->GetTxSize(), txs[i]->GetTxSize());
+        BOOST_CHECK(readTxs[i]->GetHash() == txs[i]->GetHash());
+
+        // the copies may be modified, they are serialized again for their sizes
+        std::shared_ptr<CBaseTx> pCopy = readTxs[i]->GetNewInstance();
+        BOOST_CHECK_EQUAL(pCopy->serialize_size.size, 0U);
+        pCopy->signature.push_back('s');
+        BOOST_CHECK_EQUAL(pCopy->GetTxSize(), readTxs[i]->GetTxSize() + 1);
+    }
+    BOOST_CHECK_EQUAL(::GetSerializeSize(readTxs, SER_NETWORK, PROTOCOL_VERSION), streamSize);
+    BOOST_CHECK_EQUAL(::GetSerializeSize(txs, SER_NETWORK, PROTOCOL_VERSION), streamSize);
+
+    // the encoding does not depend on the format, the size read from the disk is taken for the network and back
+    CDataStream ssDiskTxs(SER_DISK, CLIENT_VERSION);
+    ssDiskTxs << txs;
+    uint32_t diskStreamSize = ssDiskTxs.size();
+    BOOST_CHECK_EQUAL(diskStreamSize, streamSize);
+    vector<std::shared_ptr<CBaseTx>> diskTxs;
+    ssDiskTxs >> diskTxs;
+    for (size_t i = 0; i < diskTxs.size(); i++)
+        BOOST_CHECK_EQUAL(diskTxs[i]->serialize_size.size, txs[i]->GetSerializeSize(SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK_EQUAL(::GetSerializeSize(readTxs, SER_DISK, CLIENT_VERSION), diskStreamSize);
+    BOOST_CHECK_EQUAL(::GetSerializeSize(diskTxs, SER_NETWORK, PROTOCOL_VERSION), streamSize);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
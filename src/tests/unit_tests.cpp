@@ -8,9 +8,11 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include "crypto/sha256.h"
+
 // unit tests for basic units of coind
 struct UnitTestingSetup {
-    UnitTestingSetup() { }
+    UnitTestingSetup() { SHA256AutoDetect(); }
     ~UnitTestingSetup() { }
 
 
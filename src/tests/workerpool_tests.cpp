@@ -0,0 +1,40 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include "commons/util/workerpool.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(workerpool_tests)
+
+BOOST_AUTO_TEST_CASE(workerpool_concurrent_run_test)
+{
+    // the block import and the block connecting share the block workers, their rounds must not mix
+    CWorkerPool pool("test", 3);
+    const size_t taskCount = 1000;
+    vector<std::thread> callers;
+    vector<vector<int32_t>> results(4);
+    std::atomic<uint32_t> badRounds(0);  // the boost checks are not thread safe
+    for (size_t c = 0; c < results.size(); c++) {
+        callers.emplace_back([&pool, &results, &badRounds, c, taskCount]() {
+            for (int32_t round = 0; round < 200; round++) {
+                vector<int32_t> &result = results[c];
+                result.assign(taskCount, 0);
+                pool.Run(taskCount, [&result](size_t i) { result[i]++; });
+                if (std::count(result.begin(), result.end(), 1) != (int64_t)taskCount)
+                    badRounds++;
+            }
+        });
+    }
+    for (auto &caller : callers)
+        caller.join();
+    BOOST_CHECK_EQUAL(badRounds.load(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
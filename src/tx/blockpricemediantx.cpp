@@ -255,7 +255,6 @@ bool CCdpForceLiquidator::Execute() {
     }
 
     // 2. get all CDPs to be force settled
-    CdpRatioSortedCache::Map cdpMap;
     uint64_t forceLiquidateRatio = 0;
     if (!cw.sysParamCache.GetCdpParam(cdpCoinPair, CdpParamType::CDP_FORCE_LIQUIDATE_RATIO, forceLiquidateRatio)) {
         return state.DoS(100, ERRORMSG("%s(), read force liquidate ratio param error! cdpCoinPair=%s",
@@ -263,40 +262,32 @@ bool CCdpForceLiquidator::Execute() {
                 READ_SYS_PARAM_FAIL, "read-force-liquidate-ratio-error");
     }
 
-    cw.cdpCache.GetCdpListByCollateralRatio(cdpCoinPair, forceLiquidateRatio, bcoin_price, cdpMap);
-
     LogPrint(BCLog::CDP, "%s(), tx_cord=%d-%d, globalCollateralRatioFloor=%llu, bcoin_price: %llu, "
-            "forceLiquidateRatio: %llu, cdpMap: %llu\n", __func__, context.height, context.index,
-            globalCollateralRatioFloor, bcoin_price, forceLiquidateRatio, cdpMap.size());
-
-    // 3. force settle each cdp
-    if (cdpMap.size() == 0) {
-        return true;
-    }
-
-    {
-        // TODO: remove me.
-        // print all force liquidating cdps
-        LogPrint(BCLog::CDP, "%s(), have %llu cdps to force settle, in detail:\n",
-                    __func__, cdpMap.size());
-        for (const auto &cdpKey : cdpMap) {
-            LogPrint(BCLog::CDP, "%s\n", cdpKey.second.ToString());
-        }
-    }
+            "forceLiquidateRatio: %llu\n", __func__, context.height, context.index,
+            globalCollateralRatioFloor, bcoin_price, forceLiquidateRatio);
 
     NET_TYPE netType = SysCfg().NetworkID();
     if (netType == TEST_NET && context.height < 1800000  && assetSymbol == SYMB::WICC && scoinSymbol == SYMB::WUSD) {
         // soft fork to compat old data of testnet
         // TODO: remove me if reset testnet.
+        CdpRatioSortedCache::Map cdpMap;
+        cw.cdpCache.GetCdpListByCollateralRatio(cdpCoinPair, forceLiquidateRatio, bcoin_price, cdpMap);
+        if (cdpMap.size() == 0) {
+            return true;
+        }
         return ForceLiquidateCDPCompat(cdpMap, receipts);
     }
 
+    // 3. force settle each cdp, in the order of collateral ratio.
+    // the cdps are read lazily, at most FORCE_SETTLE_CDP_MAX_COUNT_PER_BLOCK cdps will be settled in a block
     int32_t count             = 0;
     uint64_t totalCloseoutScoins = 0;
     uint64_t totalSelloutBcoins  = 0;
     uint64_t totalInflateFcoins  = 0;
-    for (auto &cdpPair : cdpMap) {
-        auto &cdp = cdpPair.second;
+    auto spCdpIt = cw.cdpCache.CreateCdpRatioIterator(cdpCoinPair, forceLiquidateRatio, bcoin_price);
+    for (spCdpIt->First(); spCdpIt->IsValid(); spCdpIt->Next()) {
+        // copy the cdp, it will be erased from the cache which is iterated
+        CUserCDP cdp = spCdpIt->GetValue();
         if (count + 1 > FORCE_SETTLE_CDP_MAX_COUNT_PER_BLOCK)
             break;
 
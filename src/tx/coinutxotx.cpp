@@ -6,6 +6,7 @@
 
 #include "coinutxotx.h"
 #include "main.h"
+#include "sigcache.h"
 #include <string>
 #include <cstdarg>
 
@@ -52,9 +53,7 @@ bool ComputeRedeemScript(const uint8_t m, const uint8_t n, vector<string>& addre
 }
 
 // internal function to this file only
-bool ComputeRedeemScript(const CTxExecuteContext &context, const CMultiSignAddressCondIn &p2maIn, string &redeemScript) {
-    CCacheWrapper &cw = *context.pCw;
-
+bool ComputeRedeemScript(CCacheWrapper &cw, const CMultiSignAddressCondIn &p2maIn, string &redeemScript) {
     CAccount acct;
     vector<string> vAddress;
     for (const auto &uid : p2maIn.uids) {
@@ -69,6 +68,10 @@ bool ComputeRedeemScript(const CTxExecuteContext &context, const CMultiSignAddre
     return true;
 }
 
+bool ComputeRedeemScript(const CTxExecuteContext &context, const CMultiSignAddressCondIn &p2maIn, string &redeemScript) {
+    return ComputeRedeemScript(*context.pCw, p2maIn, redeemScript);
+}
+
 bool ComputeMultiSignKeyId(const string &redeemScript, CKeyID &keyId) {
     uint160 redeemScriptHash = Hash160(redeemScript); //equal to RIPEMD160(SHAR256(redeemScript))
     keyId = CKeyID(redeemScriptHash);
@@ -483,6 +486,41 @@ bool CCoinUtxoTransferTx::ExecuteTx(CTxExecuteContext &context) {
     return true;
 }
 
+void CCoinUtxoTransferTx::GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items) {
+    CBaseTx::GetSigVerifyItems(cw, height, items);
+
+    CAccount txAcct;
+    if (!cw.accountCache.GetAccount(txUid, txAcct))
+        return;
+
+    // the multisig signatures of the inputs, every signature is tried with the uids in order, see VerifyMultiSig()
+    for (const auto &input : vins) {
+        for (const auto &inputCond : input.conds) {
+            if (inputCond.sp_utxo_cond->cond_type != UtxoCondType::IP2MA)
+                continue;
+
+            const auto &p2maCondIn = dynamic_cast<const CMultiSignAddressCondIn &>(*inputCond.sp_utxo_cond);
+            string redeemScript("");
+            uint256 utxoMultiSignHash;
+            if (!ComputeRedeemScript(cw, p2maCondIn, redeemScript) ||
+                !ComputeUtxoMultisignHash(input.prev_utxo_txid, input.prev_utxo_vout_index, txAcct, redeemScript,
+                                          utxoMultiSignHash))
+                break;
+
+            vector<CPubKey> pubKeys;
+            CAccount acct;
+            for (const auto &uid : p2maCondIn.uids) {
+                if (!cw.accountCache.GetAccount(uid, acct) || !acct.HaveOwnerPubKey())
+                    break;
+                pubKeys.push_back(acct.owner_pubkey);
+            }
+            for (const auto &signature : p2maCondIn.signatures)
+                items.emplace_back(utxoMultiSignHash, signature, pubKeys);
+            break;
+        }
+    }
+}
+
 
 ////////////////////////////////////////
 /// class CCoinUtxoPasswordProofTx
@@ -17,6 +17,7 @@ bool ComputeRedeemScript(const uint8_t m, const uint8_t n, vector<string>& addre
 bool ComputeMultiSignKeyId(const string &redeemScript, CKeyID &keyId);
 bool ComputeUtxoMultisignHash(const TxID &prevUtxoTxId, uint16_t prevUtxoTxVoutIndex, const CAccount &txAcct,
                             string &redeemScript, uint256 &hash);
+bool VerifyMultiSig(const CTxExecuteContext &context, const uint256 &utxoMultiSignHash, const CMultiSignAddressCondIn &p2maIn);
 
 ////////////////////////////////////////
 /// class CCoinUtxoTransferTx
@@ -94,6 +95,7 @@ public:
     virtual bool CheckTx(CTxExecuteContext &context);
     virtual bool ExecuteTx(CTxExecuteContext &context);
 
+    virtual void GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items);
 };
 
 ////////////////////////////////////////
@@ -8,6 +8,7 @@
 #include "config/configuration.h"
 #include "entities/receipt.h"
 #include "main.h"
+#include "sigcache.h"
 
 #include <algorithm>
 
@@ -325,6 +326,19 @@ namespace dex {
         return true;
     }
 
+    void CDEXOrderBaseTx::GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items) {
+        CBaseTx::GetSigVerifyItems(cw, height, items);
+
+        // the operator uid must be the fee receiver regid of the dex operator, see CheckOrderOperatorParam()
+        if (!has_operator_config || !operator_uid.is<CRegID>() || !CheckSignatureSize(operator_signature))
+            return;
+
+        CAccount operatorAccount;
+        if (!cw.accountCache.GetAccount(operator_uid, operatorAccount) || !operatorAccount.IsRegistered())
+            return;
+        items.emplace_back(GetHash(), operator_signature, vector<CPubKey>{operatorAccount.owner_pubkey});
+    }
+
     bool CDEXOrderBaseTx::GetOrderOperator(CTxExecuteContext &context,
                             DexOperatorDetail &operatorDetail){
 
@@ -50,6 +50,8 @@ namespace dex {
 
         virtual bool ExecuteTx(CTxExecuteContext &context);
 
+        virtual void GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items);
+
         virtual string ToString(CAccountDBCache &accountCache); //logging usage
         virtual Object ToJson(const CAccountDBCache &accountCache) const; //json-rpc usage
     protected:
@@ -20,6 +20,7 @@
 #include "crypto/hash.h"
 #include "commons/util/util.h"
 #include "main.h"
+#include "sigcache.h"
 #include "vm/luavm/luavmrunenv.h"
 #include "miner/miner.h"
 #include "config/version.h"
@@ -340,6 +341,25 @@ bool CBaseTx::CheckMinFee(CTxExecuteContext &context, uint64_t minFee) const {
     return true;
 }
 
+void CBaseTx::GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items) {
+    // same conditions as the signature check of CheckBaseTx()
+    if (nTxType == BLOCK_REWARD_TX || nTxType == PRICE_MEDIAN_TX || nTxType == UCOIN_MINT_TX ||
+        nTxType == UCOIN_BLOCK_REWARD_TX || GetFeatureForkVersion(height) < MAJOR_VER_R2 ||
+        !CheckSignatureSize(signature))
+        return;
+
+    CPubKey pubKey;
+    if (txUid.is<CPubKey>()) {
+        pubKey = txUid.get<CPubKey>();
+    } else {
+        CAccount txAccount;
+        if (!cw.accountCache.GetAccount(txUid, txAccount) || !txAccount.IsRegistered())
+            return;
+        pubKey = txAccount.owner_pubkey;
+    }
+    items.emplace_back(GetHash(), signature, vector<CPubKey>{pubKey});
+}
+
 bool CBaseTx::CheckTxAvailableFromVer(CTxExecuteContext &context, FeatureForkVersionEnum ver) {
     if (GetFeatureForkVersion(context.height) < ver)
         return context.pState->DoS(100, ERRORMSG("%s, tx type=%s is unavailable before height=%d",
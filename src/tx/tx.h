@@ -41,6 +41,7 @@ static const unordered_map<TxExecuteContextType, string> kTxExecuteContextTypeNa
 
 class CCacheWrapper;
 class CValidationState;
+struct CSigVerifyItem;
 
 static const std::unordered_map<TxType, AccountPermType> kTxTypePermMap = {
     { BCOIN_TRANSFER_TX,            AccountPermType::PERM_SEND_COIN  },
@@ -123,6 +124,18 @@ public:
           context_type(contextType) {}
 };
 
+/**
+ * The serialized size of a tx read from a stream, 0 if unknown. It is not copied with the tx, since the
+ * fields of the copy may be modified, the copy is serialized again for its size.
+ */
+struct CSerializeSizeCache {
+    uint32_t size = 0;
+
+    CSerializeSizeCache() {}
+    CSerializeSizeCache(const CSerializeSizeCache &other) {}
+    CSerializeSizeCache& operator=(const CSerializeSizeCache &other) { size = 0; return *this; }
+};
+
 class CBaseTx {
 public:
     static const int32_t CURRENT_VERSION = INIT_TX_VERSION;
@@ -138,6 +151,7 @@ public:
     uint64_t nRunStep;     //!< only in memory
     int32_t nFuelRate;     //!< only in memory
     mutable TxID sigHash;  //!< only in memory
+    CSerializeSizeCache serialize_size;  //!< only in memory, the size read from a stream without the tx type
     CAccount txAccount;    //!< only in memory
     ReceiptList receipts;  //!< not persisted within Tx Cache
 
@@ -177,9 +191,14 @@ public:
 
     virtual uint32_t GetSerializeSize(int32_t nType, int32_t nVersion) const { return 0; }
 
+    // the serialized size without the tx type, it is serialized again only if the tx was not read from a stream
+    uint32_t GetTxSize() const {
+        return serialize_size.size > 0 ? serialize_size.size : GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+    }
+
     virtual uint64_t GetFuel(int32_t height, uint32_t nFuelRate);
     virtual double GetPriority() const {
-        return TRANSACTION_PRIORITY_CEILING / GetSerializeSize(SER_NETWORK, PROTOCOL_VERSION);
+        return TRANSACTION_PRIORITY_CEILING / GetTxSize();
     }
     virtual void SerializeForHash(CHashWriter &hw) const = 0;
     virtual std::shared_ptr<CBaseTx> GetNewInstance() const           = 0;
@@ -188,6 +207,10 @@ public:
 
     virtual bool GetInvolvedKeyIds(CCacheWrapper &cw, set<CKeyID> &keyIds);
 
+    // the signatures of the tx that can be verified ahead of the execution, for the block pre-verification.
+    // the ones that can not be resolved in the state before the block are left to the execution.
+    virtual void GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items);
+
     bool CheckBaseTx(CTxExecuteContext &context);
     virtual bool CheckTx(CTxExecuteContext &context) = 0;
     virtual bool ExecuteTx(CTxExecuteContext &context) = 0;
@@ -211,8 +234,10 @@ public:
 
 
 public:
+    // the encoding of the txs does not depend on the format, the size read in any format is taken for all of them,
+    // 1 byte for the tx type
     static unsigned int GetSerializePtrSize(const std::shared_ptr<CBaseTx> &pBaseTx, int nType, int nVersion){
-        return pBaseTx->GetSerializeSize(nType, nVersion) + 1;
+        return pBaseTx->GetTxSize() + 1;
     }
 
     template<typename Stream>
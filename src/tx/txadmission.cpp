@@ -0,0 +1,177 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txadmission.h"
+
+#include "commons/util/util.h"
+#include "logging.h"
+#include "tx/tx.h"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+CTxAdmission *pTxAdmission = nullptr;
+
+CTxAdmission::CTxAdmission(CSignatureCache &sigCacheIn, const SigItemsFunc &sigItemsFuncIn,
+                           const CommitFunc &commitFuncIn)
+    : sig_cache(sigCacheIn), sig_items_func(sigItemsFuncIn), commit_func(commitFuncIn) {}
+
+CTxAdmission::~CTxAdmission() { Stop(); }
+
+void CTxAdmission::Start(uint32_t workerCount) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (is_started)
+        return;
+
+    if (workerCount > 0)
+        pWorkerPool.reset(new CWorkerPool("admission", workerCount));
+    is_started  = true;
+    is_stopping = false;
+    thread      = std::thread(&CTxAdmission::ThreadAdmit, this);
+}
+
+void CTxAdmission::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        is_stopping = true;
+    }
+    cond.notify_all();
+    if (thread.joinable())
+        thread.join();
+
+    std::deque<CQueueItem> rejected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rejected.swap(queue);
+    }
+    CResult result;
+    result.status  = REJECTED;
+    result.message = "shutting down";
+    for (auto &item : rejected)
+        SetResult(item, result);
+
+    pWorkerPool.reset();
+}
+
+shared_future<CTxAdmission::CResult> CTxAdmission::Submit(const shared_ptr<CBaseTx> &pTx) {
+    CQueueItem item;
+    item.txid     = pTx->GetHash();
+    item.pTx      = pTx;
+    item.pPromise = std::make_shared<std::promise<CResult>>();
+    shared_future<CResult> future = item.pPromise->get_future().share();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = pending.find(item.txid);
+    if (it != pending.end())
+        return it->second;
+
+    if (!is_started || is_stopping || queue.size() >= MAX_QUEUE_SIZE) {
+        CResult result;
+        result.status  = REJECTED;
+        result.message = is_stopping || !is_started ? "tx admission is not running" : "tx admission queue is full";
+        lock.unlock();
+        item.pPromise->set_value(result);
+        return future;
+    }
+
+    pending.emplace(item.txid, future);
+    queue.push_back(std::move(item));
+    lock.unlock();
+    cond.notify_one();
+
+    return future;
+}
+
+CTxAdmission::CResult CTxAdmission::GetResult(const uint256 &txid) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    CResult result;
+    if (pending.count(txid)) {
+        result.status = QUEUED;
+    } else {
+        auto it = results.find(txid);
+        if (it != results.end())
+            result = it->second;
+    }
+    return result;
+}
+
+const char *CTxAdmission::GetStatusName(Status status) {
+    static const char *statusNames[] = {"unknown", "queued", "accepted", "rejected"};
+    return statusNames[status];
+}
+
+void CTxAdmission::ThreadAdmit() {
+    RenameThread("coin-txadmission");
+
+    vector<CQueueItem> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&] { return is_stopping || !queue.empty(); });
+            if (is_stopping)
+                return;
+
+            size_t count = std::min<size_t>(queue.size(), MAX_BATCH_SIZE);
+            batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.begin() + count));
+            queue.erase(queue.begin(), queue.begin() + count);
+        }
+        AdmitBatch(batch);
+        batch.clear();
+    }
+}
+
+void CTxAdmission::AdmitBatch(vector<CQueueItem> &batch) {
+    int64_t beginTime = GetTimeMicros();
+    size_t sigCount   = 0;
+    if (pWorkerPool != nullptr) {
+        vector<shared_ptr<CBaseTx>> txs;
+        txs.reserve(batch.size());
+        for (const auto &item : batch)
+            txs.push_back(item.pTx);
+
+        vector<CSigVerifyItem> items;
+        items.reserve(batch.size());
+        sig_items_func(txs, items);
+        VerifySignatures(*pWorkerPool, sig_cache, items);
+        sigCount = items.size();
+    }
+    int64_t verifyTime = GetTimeMicros();
+
+    uint32_t acceptedCount = 0;
+    for (auto &item : batch) {
+        CResult result;
+        try {
+            result.status = commit_func(*item.pTx, result.message) ? ACCEPTED : REJECTED;
+        } catch (std::exception &e) {
+            result.status  = REJECTED;
+            result.message = e.what();
+        }
+        if (result.status == ACCEPTED)
+            acceptedCount++;
+        SetResult(item, result);
+    }
+
+    LogPrint(BCLog::RPCCMD, "admitted %u of %u txs, pre-verify %u signatures: %.2fms, commit: %.2fms\n",
+             acceptedCount, (uint32_t)batch.size(), (uint32_t)sigCount, 0.001 * (verifyTime - beginTime),
+             0.001 * (GetTimeMicros() - verifyTime));
+}
+
+void CTxAdmission::SetResult(CQueueItem &item, const CResult &result) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.erase(item.txid);
+        if (results.emplace(item.txid, result).second) {
+            result_order.push_back(item.txid);
+            if (result_order.size() > MAX_RESULT_COUNT) {
+                results.erase(result_order.front());
+                result_order.pop_front();
+            }
+        } else {
+            results[item.txid] = result;
+        }
+    }
+    item.pPromise->set_value(result);
+}
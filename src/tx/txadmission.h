@@ -0,0 +1,102 @@
+// Copyright (c) 2017-2019 The WaykiChain Developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef TX_TXADMISSION_H
+#define TX_TXADMISSION_H
+
+#include "commons/uint256.h"
+#include "commons/util/workerpool.h"
+#include "sigcache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class CBaseTx;
+
+/**
+ * CTxAdmission
+ * The staged mempool admission of the txs submitted by RPC (-admissionworkers). The RPC threads decode the
+ * txs and queue them. The admission thread takes them in batches: the signatures of a batch are collected
+ * under cs_main and verified on the admission workers without it, the valid ones are put into the signature
+ * cache. Then the txs are committed one by one, the rehearsal execution under cs_main mostly hits the cache.
+ * The callers wait for the result of a tx, or query it by the txid later.
+ */
+class CTxAdmission {
+public:
+    // the txs of a batch, the signatures of a batch are verified in one round of the workers
+    static const uint32_t MAX_BATCH_SIZE   = 1000;
+    // the queued txs, a tx is rejected at once when the queue is full
+    static const uint32_t MAX_QUEUE_SIZE   = 50000;
+    // the results kept for the queries, the oldest ones are dropped
+    static const uint32_t MAX_RESULT_COUNT = 100000;
+
+    enum Status { UNKNOWN, QUEUED, ACCEPTED, REJECTED };
+
+    struct CResult {
+        Status status = UNKNOWN;
+        std::string message;  // the message of the commit if accepted, the reject reason if rejected
+    };
+
+    // collect the signatures of the txs to verify ahead
+    typedef std::function<void(const std::vector<std::shared_ptr<CBaseTx>> &txs, std::vector<CSigVerifyItem> &items)>
+        SigItemsFunc;
+    // commit the tx to the mempool, message is the result of the commit or the reject reason
+    typedef std::function<bool(CBaseTx &tx, std::string &message)> CommitFunc;
+
+public:
+    CTxAdmission(CSignatureCache &sigCacheIn, const SigItemsFunc &sigItemsFuncIn, const CommitFunc &commitFuncIn);
+    ~CTxAdmission();
+
+    // start the admission thread with workerCount workers besides it
+    void Start(uint32_t workerCount);
+    // stop the admission thread after the current batch, the queued txs are rejected
+    void Stop();
+
+    // queue the tx, the same tx queued already shares its result
+    std::shared_future<CResult> Submit(const std::shared_ptr<CBaseTx> &pTx);
+    // the result of a submitted tx, UNKNOWN if it is not submitted or dropped already
+    CResult GetResult(const uint256 &txid) const;
+
+    static const char *GetStatusName(Status status);
+
+private:
+    struct CQueueItem {
+        uint256 txid;
+        std::shared_ptr<CBaseTx> pTx;
+        std::shared_ptr<std::promise<CResult>> pPromise;
+    };
+
+    void ThreadAdmit();
+    void AdmitBatch(std::vector<CQueueItem> &batch);
+    void SetResult(CQueueItem &item, const CResult &result);
+
+private:
+    CSignatureCache &sig_cache;
+    SigItemsFunc sig_items_func;
+    CommitFunc commit_func;
+    std::unique_ptr<CWorkerPool> pWorkerPool;
+    std::thread thread;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<CQueueItem> queue;
+    std::map<uint256, std::shared_future<CResult>> pending;
+    std::map<uint256, CResult> results;
+    std::deque<uint256> result_order;  // the txids of the results, the oldest first
+    bool is_started  = false;
+    bool is_stopping = false;
+};
+
+/** The staged admission of the RPC txs, nullptr if -admissionworkers=0 */
+extern CTxAdmission *pTxAdmission;
+
+#endif  // TX_TXADMISSION_H
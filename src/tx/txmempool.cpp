@@ -5,26 +5,40 @@
 
 #include "txmempool.h"
 #include "commons/uint256.h"
+#include "commons/util/workerpool.h"
+#include "crypto/hash.h"
 #include "main.h"
+#include "persistence/blockundo.h"
 #include "persistence/txdb.h"
 #include "tx/tx.h"
+#include "tx/txserializer.h"
 #include "miner/miner.h"
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 
 CTxMemPoolEntry::CTxMemPoolEntry() {
     nTxSize   = 0;
     dPriority = 0.0;
+    feePerKb  = 0.0;
+
+    nTime          = 0;
+    height         = 0;
+    sequence       = 0;
+    executedHeight = 0;
 
-    nTime   = 0;
-    height = 0;
+    accessTracked = false;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(CBaseTx *pBaseTx, int64_t time, uint32_t height) : nTime(time), height(height) {
+CTxMemPoolEntry::CTxMemPoolEntry(CBaseTx *pBaseTx, int64_t time, uint32_t height)
+    : nTime(time), height(height), sequence(0), executedHeight(0), accessTracked(false) {
+    // the size read from a stream is not copied with the tx
+    nTxSize   = pBaseTx->GetTxSize();
+    dPriority = pBaseTx->GetPriority();
     pTx       = pBaseTx->GetNewInstance();
     nFees     = pTx->GetFees();
-    nTxSize   = ::GetSerializeSize(*pTx, SER_NETWORK, PROTOCOL_VERSION);
-    dPriority = pTx->GetPriority();
+    feePerKb  = ComputeFeePerKb(0);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry &other) {
@@ -32,9 +46,120 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry &other) {
     this->nFees     = other.nFees;
     this->nTxSize   = other.nTxSize;
     this->dPriority = other.dPriority;
+    this->feePerKb  = other.feePerKb;
+
+    this->nTime          = other.nTime;
+    this->height         = other.height;
+    this->sequence       = other.sequence;
+    this->sender         = other.sender;
+    this->executedHeight = other.executedHeight;
+
+    this->readKeys      = other.readKeys;
+    this->writeKeys     = other.writeKeys;
+    this->accessTracked = other.accessTracked;
+}
 
-    this->nTime  = other.nTime;
-    this->height = other.height;
+CTxMemPoolPriorityKey CTxMemPoolEntry::GetPriorityKey() const {
+    return {(int64_t)(dPriority / TRANSACTION_PRIORITY_CEILING), feePerKb, pTx->GetHash()};
+}
+
+double CTxMemPoolEntry::ComputeFeePerKb(uint32_t fuelRate) const {
+    if (nTxSize == 0)
+        return 0.0;
+
+    // the fuel of the run steps is burned, the rest goes to the miner
+    return (double(std::get<1>(nFees)) - double(pTx->GetFuel(height, fuelRate))) / nTxSize * 1000.0;
+}
+
+bool WriteMemPoolFile(const boost::filesystem::path &path, const vector<CMemPoolDumpEntry> &entries) {
+    boost::filesystem::path tmpPath = path;
+    tmpPath += ".new";
+
+    CAutoFile fileout(fopen(tmpPath.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return ERRORMSG("%s, open mempool file %s failed", __func__, tmpPath.string());
+
+    try {
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        fileout << FLATDATA(SysCfg().MessageStart()) << CMemPoolDumpEntry::CURRENT_VERSION << (uint64_t)entries.size();
+        for (const auto &entry : entries) {
+            fileout << entry;
+            hasher << entry;
+        }
+        fileout << hasher.GetHash();
+    } catch (std::exception &e) {
+        return ERRORMSG("%s, write mempool file %s failed, %s", __func__, tmpPath.string(), e.what());
+    }
+
+    fflush(fileout);
+    FileCommit(fileout);
+    fileout.fclose();
+    if (!RenameOver(tmpPath, path))
+        return ERRORMSG("%s, rename mempool file to %s failed", __func__, path.string());
+
+    return true;
+}
+
+bool ReadMemPoolFile(const boost::filesystem::path &path, CWorkerPool *pWorkerPool,
+                     vector<CMemPoolDumpEntry> &entries) {
+    entries.clear();
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return ERRORMSG("%s, open mempool file %s failed", __func__, path.string());
+
+    try {
+        uint8_t messageStart[MESSAGE_START_SIZE];
+        uint32_t version;
+        uint64_t count;
+        filein >> FLATDATA(messageStart) >> version >> count;
+        if (memcmp(messageStart, SysCfg().MessageStart(), sizeof(messageStart)) != 0)
+            return ERRORMSG("%s, mempool file %s is of another network", __func__, path.string());
+        if (version != CMemPoolDumpEntry::CURRENT_VERSION)
+            return ERRORMSG("%s, unsupported mempool file version %u", __func__, version);
+
+        // the entries are read as they are, a truncated file fails before the count is reserved in full
+        CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+        entries.reserve(std::min<uint64_t>(count, 1000000));
+        for (uint64_t i = 0; i < count; i++) {
+            entries.emplace_back();
+            filein >> entries.back();
+            hasher << entries.back();
+        }
+
+        uint256 checksum;
+        filein >> checksum;
+        if (checksum != hasher.GetHash()) {
+            entries.clear();
+            return ERRORMSG("%s, checksum mismatch of mempool file %s", __func__, path.string());
+        }
+    } catch (std::exception &e) {
+        entries.clear();
+        return ERRORMSG("%s, read mempool file %s failed, %s", __func__, path.string(), e.what());
+    }
+
+    // decode the txs, a malformed one is left nullptr
+    auto decodeTx = [&entries](size_t i) {
+        CMemPoolDumpEntry &entry = entries[i];
+        try {
+            CDataStream ssTx(entry.tx_data.data(), entry.tx_data.data() + entry.tx_data.size(), SER_DISK,
+                             CLIENT_VERSION);
+            ssTx >> entry.pTx;
+            if (!ssTx.empty())
+                entry.pTx.reset();
+        } catch (std::exception &e) {
+            entry.pTx.reset();
+        }
+        entry.tx_data.clear();
+        entry.tx_data.shrink_to_fit();
+    };
+    if (pWorkerPool != nullptr) {
+        pWorkerPool->Run(entries.size(), decodeTx);
+    } else {
+        for (size_t i = 0; i < entries.size(); i++)
+            decodeTx(i);
+    }
+
+    return true;
 }
 
 CTxMemPool::CTxMemPool() {
@@ -42,15 +167,21 @@ CTxMemPool::CTxMemPool() {
     // accepting transactions becomes O(N^2) where N is the number
     // of transactions in the pool
     fSanityCheck         = false;
+    untrackedCount       = 0;
+    nextSequence         = 0;
+    fullRescan           = false;
+    lastFuelRate         = 0;
+    changeCount          = 0;
 }
 
 void CTxMemPool::Remove(CBaseTx *pBaseTx, list<std::shared_ptr<CBaseTx> > &removed, bool fRecursive) {
     // Remove transaction from memory pool
     LOCK(cs);
     uint256 txid = pBaseTx->GetHash();
-    if (memPoolTxs.count(txid)) {
-        removed.push_front(std::shared_ptr<CBaseTx>(memPoolTxs[txid].GetTransaction()));
-        memPoolTxs.erase(txid);
+    auto it = memPoolTxs.find(txid);
+    if (it != memPoolTxs.end()) {
+        removed.push_front(it->second.GetTransaction());
+        Erase(txid);
         EraseTransactionFromWallet(txid);
     }
 }
@@ -61,14 +192,123 @@ bool CTxMemPool::AddUnchecked(const uint256 &txid, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     {
-        if (!CheckTxInMemPool(txid, entry, state))
+        CDBAccessTracker tracker;
+        if (!CheckTxInMemPool(txid, entry, state, true, &tracker))
             return false;
 
-        memPoolTxs.insert(make_pair(txid, entry));
+        // the rehearsal execution saved the account of txUid to cw
+        CKeyID sender;
+        cw->accountCache.GetKeyId(entry.GetTransaction()->txUid, sender);
+        AddEntry(txid, entry, sender, GetElementForBurn(chainActive.Tip()), &tracker);
+        auto it = memPoolTxs.find(txid);
+        if (it != memPoolTxs.end())
+            it->second.executedHeight = chainActive.Height() + 1;
     }
     return true;
 }
 
+void CTxMemPool::AddEntry(const uint256 &txid, const CTxMemPoolEntry &entry, const CKeyID &sender,
+                          uint32_t fuelRate, const CDBAccessTracker *pTracker) {
+    LOCK(cs);
+    auto ret = memPoolTxs.emplace(txid, entry);
+    if (!ret.second)
+        return;
+
+    CTxMemPoolEntry &newEntry = ret.first->second;
+    newEntry.feePerKb         = newEntry.ComputeFeePerKb(fuelRate);
+    newEntry.sequence         = nextSequence++;
+    newEntry.sender           = sender;
+
+    priorityIndex.emplace(newEntry.GetPriorityKey(), &newEntry);
+    sequenceIndex.emplace(newEntry.sequence, &newEntry);
+    senderIndex[sender].emplace(newEntry.sequence, &newEntry);
+    newEntry.readKeys.clear();
+    newEntry.writeKeys.clear();
+    SetAccessKeys(newEntry, pTracker);
+    NotifyChange();
+}
+
+bool CTxMemPool::Erase(const uint256 &txid) {
+    LOCK(cs);
+    auto it = memPoolTxs.find(txid);
+    if (it == memPoolTxs.end())
+        return false;
+
+    CTxMemPoolEntry &entry = it->second;
+    priorityIndex.erase(entry.GetPriorityKey());
+    sequenceIndex.erase(entry.sequence);
+    auto senderIt = senderIndex.find(entry.sender);
+    if (senderIt != senderIndex.end()) {
+        senderIt->second.erase(entry.sequence);
+        if (senderIt->second.empty())
+            senderIndex.erase(senderIt);
+    }
+
+    // what the tx wrote to cw is dropped by the next rescan, the txs which read it are executed again
+    DropPricePoints(entry);
+    if (entry.accessTracked)
+        dirtyKeys.insert(entry.writeKeys.begin(), entry.writeKeys.end());
+    else
+        fullRescan = true;
+    EraseAccessKeys(entry);
+    memPoolTxs.erase(it);
+
+    return true;
+}
+
+void CTxMemPool::SetAccessKeys(CTxMemPoolEntry &entry, const CDBAccessTracker *pTracker) {
+    if (pTracker == nullptr || pTracker->IsUnsafe()) {
+        entry.accessTracked = false;
+        untrackedCount++;
+        return;
+    }
+
+    entry.accessTracked = true;
+    entry.readKeys      = pTracker->GetReadKeys();
+    entry.writeKeys     = pTracker->GetWriteKeys();
+    for (const auto &key : entry.readKeys)
+        readKeyIndex[key].insert(entry.sequence);
+}
+
+void CTxMemPool::EraseAccessKeys(CTxMemPoolEntry &entry) {
+    if (!entry.accessTracked) {
+        assert(untrackedCount > 0);
+        untrackedCount--;
+        return;
+    }
+
+    for (const auto &key : entry.readKeys) {
+        auto it = readKeyIndex.find(key);
+        if (it == readKeyIndex.end())
+            continue;
+
+        it->second.erase(entry.sequence);
+        if (it->second.empty())
+            readKeyIndex.erase(it);
+    }
+    entry.readKeys.clear();
+    entry.writeKeys.clear();
+}
+
+void CTxMemPool::DropPricePoints(const CTxMemPoolEntry &entry) {
+    // the price points are in the memory cache of cw, which is not tracked by keys
+    if (entry.pTx->nTxType != PRICE_FEED_TX || entry.executedHeight == 0)
+        return;
+
+    const CPriceFeedTx &priceFeedTx = (const CPriceFeedTx &)*entry.pTx;
+    cw->ppCache.DropPrice(entry.executedHeight, priceFeedTx.txUid.get<CRegID>(), priceFeedTx.price_points);
+}
+
+void CTxMemPool::UpdateFeePerKb(CTxMemPoolEntry &entry, uint32_t fuelRate) {
+    double feePerKb = entry.ComputeFeePerKb(fuelRate);
+    if (feePerKb == entry.feePerKb)
+        return;
+
+    priorityIndex.erase(entry.GetPriorityKey());
+    entry.feePerKb = feePerKb;
+    priorityIndex.emplace(entry.GetPriorityKey(), &entry);
+}
+
 void CTxMemPool::QueryHash(vector<uint256> &txids) {
     LOCK(cs);
 
@@ -80,7 +320,7 @@ void CTxMemPool::QueryHash(vector<uint256> &txids) {
 }
 
 bool CTxMemPool::CheckTxInMemPool(const uint256 &txid, const CTxMemPoolEntry &memPoolEntry, CValidationState &state,
-                                  bool bRehearsalExecute) {
+                                  bool bRehearsalExecute, CDBAccessTracker *pTracker) {
     CBlockIndex *pTip =  chainActive.Tip();
     if (pTip == nullptr) 
         throw runtime_error("CheckTxInMemPool:: ChainActive.Tip() is null");
@@ -106,7 +346,14 @@ bool CTxMemPool::CheckTxInMemPool(const uint256 &txid, const CTxMemPoolEntry &me
         CTxExecuteContext context(newHeight, 0, fuelRate, blockTime, prevBlockTime, spCW.get(), &state, 
                                 TxExecuteContextType::VALIDATE_MEMPOOL);
 
-        if (!memPoolEntry.GetTransaction()->ExecuteFullTx(context)) { //rehearsal only within cache env
+        bool executed;
+        if (pTracker != nullptr) {
+            CDBAccessTrackerScope trackerScope(*pTracker);
+            executed = memPoolEntry.GetTransaction()->ExecuteFullTx(context);
+        } else {
+            executed = memPoolEntry.GetTransaction()->ExecuteFullTx(context);
+        }
+        if (!executed) { //rehearsal only within cache env
             pCdMan->pLogCache->SetExecuteFail(newHeight, memPoolEntry.GetTransaction()->GetHash(),
                                               state.GetRejectCode(), state.GetRejectReason());
             return false;
@@ -122,19 +369,167 @@ void CTxMemPool::SetMemPoolCache() {
     cw.reset(new CCacheWrapper(pCdMan));
 }
 
-void CTxMemPool::ReScanMemPoolTx() {
-    cw.reset(new CCacheWrapper(pCdMan));
+void CTxMemPool::BlockConnected(const CBlockIndex *pIndex) {
+    LOCK(cs);
+    if (fullRescan || untrackedCount > 0 || memPoolTxs.empty())
+        return;
+
+    // the txs are executed at the next height, the rules may change with the feature fork version
+    if (GetFeatureForkVersion(pIndex->height) != GetFeatureForkVersion(pIndex->height + 1)) {
+        fullRescan = true;
+        return;
+    }
+
+    // the keys written by the block are taken from its undo journal, the op log key is encoded as the db key
+    CBlockUndoJournal undoJournal;
+    vector<CBlockUndoJournal::OpLog> opLogs;
+    if (!(pIndex->nStatus & BLOCK_UNDO_JOURNAL) || pIndex->pprev == nullptr ||
+        !undoJournal.ReadFromDisk(pIndex->GetUndoPos(), pIndex->pprev->GetBlockHash()) ||
+        !undoJournal.GetOpLogs(opLogs)) {
+        LogPrint(BCLog::INFO, "%s, no undo journal of block %d, rescan all the mempool txs\n", __func__,
+                 pIndex->height);
+        fullRescan = true;
+        return;
+    }
 
+    for (const auto &opLog : opLogs) {
+        string key = dbk::GetKeyPrefix(opLog.prefix_type);
+        key.append(opLog.key.data(), opLog.key.size());
+        dirtyKeys.insert(std::move(key));
+    }
+}
+
+void CTxMemPool::BlockDisconnected() {
     LOCK(cs);
+    fullRescan = true;
+}
+
+void CTxMemPool::ReScanMemPoolTx() {
+    LOCK(cs);
+    int64_t beginTime     = GetTimeMicros();
+    CBlockIndex *pTip     = chainActive.Tip();
+    HeightType newHeight  = pTip->height + 1;
+    uint32_t fuelRate     = GetElementForBurn(pTip);
+    uint32_t prevFuelRate = lastFuelRate;
+    bool fuelRateChanged  = fuelRate != prevFuelRate;
+    lastFuelRate          = fuelRate;
+
+    set<uint64_t> sequences;
+    bool isFullRescan = fullRescan || untrackedCount > 0 || memPoolTxs.empty();
+    if (isFullRescan) {
+        cw.reset(new CCacheWrapper(pCdMan));
+        for (const auto &item : sequenceIndex)
+            sequences.insert(item.first);
+    } else {
+        // the expired txs leave the mempool first, the txs which read what they wrote are executed again
+        static int validHeight = SysCfg().GetTxCacheHeight();
+        vector<uint256> expiredTxids;
+        for (const auto &item : sequenceIndex) {
+            const auto &pTx = item.second->GetTransaction();
+            if (!pTx->IsValidHeight(newHeight, validHeight)) {
+                expiredTxids.push_back(pTx->GetHash());
+            } else if (pTx->nTxType == PRICE_FEED_TX ||
+                       (fuelRateChanged && pTx->GetFuel(newHeight, fuelRate) != pTx->GetFuel(newHeight, prevFuelRate))) {
+                sequences.insert(item.first);
+            }
+        }
+        for (const auto &txid : expiredTxids) {
+            Erase(txid);
+            EraseTransactionFromWallet(txid);
+        }
+
+        // what the affected txs wrote is dropped from cw, they are executed again on the new chain state
+        for (uint64_t sequence : sequences) {
+            const CTxMemPoolEntry *pEntry = sequenceIndex.at(sequence);
+            dirtyKeys.insert(pEntry->writeKeys.begin(), pEntry->writeKeys.end());
+        }
+        GetAffectedEntries(dirtyKeys, sequences);
+        for (uint64_t sequence : sequences) {
+            const CTxMemPoolEntry *pEntry = sequenceIndex.at(sequence);
+            dirtyKeys.insert(pEntry->writeKeys.begin(), pEntry->writeKeys.end());
+        }
+        cw->DropData(dirtyKeys);
+    }
+
+    // re-execute the txs in the order they entered the mempool, the fee rates go with the new run steps
     CValidationState state;
-    for (map<uint256, CTxMemPoolEntry>::iterator iterTx = memPoolTxs.begin(); iterTx != memPoolTxs.end();) {
-        if (!CheckTxInMemPool(iterTx->first, iterTx->second, state, true)) {
-            uint256 txid = iterTx->first;
-            iterTx       = memPoolTxs.erase(iterTx++);
+    for (uint64_t sequence : sequences) {
+        auto it = sequenceIndex.find(sequence);
+        if (it == sequenceIndex.end())
+            continue;
+
+        uint256 txid           = it->second->GetTransaction()->GetHash();
+        CTxMemPoolEntry &entry = memPoolTxs[txid];
+        DropPricePoints(entry);
+        entry.executedHeight = 0;
+        CDBAccessTracker tracker;
+        if (!CheckTxInMemPool(txid, entry, state, true, &tracker)) {
+            Erase(txid);
             EraseTransactionFromWallet(txid);
             continue;
         }
-        ++iterTx;
+        entry.executedHeight = newHeight;
+        EraseAccessKeys(entry);
+        SetAccessKeys(entry, &tracker);
+        if (!fuelRateChanged)
+            UpdateFeePerKb(entry, fuelRate);
+    }
+    if (fuelRateChanged) {
+        for (auto &item : memPoolTxs)
+            UpdateFeePerKb(item.second, fuelRate);
+    }
+
+    // the failed txs wrote nothing to cw and the txs which read their old writes were executed again
+    dirtyKeys.clear();
+    fullRescan = false;
+
+    if (SysCfg().IsBenchmark())
+        LogPrint(BCLog::INFO, "- Rescan mempool: %u of %u txs executed again%s, %.2fms\n", (uint32_t)sequences.size(),
+                 (uint32_t)memPoolTxs.size(), isFullRescan ? " (full)" : "", 0.001 * (GetTimeMicros() - beginTime));
+}
+
+void CTxMemPool::GetAffectedEntries(const CDBAccessTracker::KeySet &keys, set<uint64_t> &sequences) const {
+    // the closure of the txs reading the keys, through the keys written by them
+    CDBAccessTracker::KeySet visitedKeys(keys);
+    vector<const string *> pendingKeys;
+    pendingKeys.reserve(keys.size());
+    for (const auto &key : keys)
+        pendingKeys.push_back(&key);
+
+    while (!pendingKeys.empty()) {
+        const string *pKey = pendingKeys.back();
+        pendingKeys.pop_back();
+        auto it = readKeyIndex.find(*pKey);
+        if (it == readKeyIndex.end())
+            continue;
+
+        for (uint64_t sequence : it->second) {
+            if (!sequences.insert(sequence).second)
+                continue;
+
+            for (const auto &writeKey : sequenceIndex.at(sequence)->writeKeys) {
+                auto ret = visitedKeys.insert(writeKey);
+                if (ret.second)
+                    pendingKeys.push_back(&*ret.first);
+            }
+        }
+    }
+}
+
+void CTxMemPool::GetDumpEntries(vector<CMemPoolDumpEntry> &entries) const {
+    LOCK(cs);
+    entries.clear();
+    entries.reserve(sequenceIndex.size());
+    for (const auto &item : sequenceIndex) {
+        const CTxMemPoolEntry &memPoolEntry = *item.second;
+        CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+        ssTx << memPoolEntry.GetTransaction();
+
+        entries.emplace_back();
+        CMemPoolDumpEntry &entry = entries.back();
+        entry.time               = memPoolEntry.GetTime();
+        entry.height             = memPoolEntry.GetHeight();
+        entry.tx_data.assign(ssTx.begin(), ssTx.end());
     }
 }
 
@@ -142,6 +537,13 @@ void CTxMemPool::Clear() {
     LOCK(cs);
 
     memPoolTxs.clear();
+    priorityIndex.clear();
+    sequenceIndex.clear();
+    senderIndex.clear();
+    readKeyIndex.clear();
+    untrackedCount = 0;
+    dirtyKeys.clear();
+    fullRescan = false;
     cw.reset(new CCacheWrapper(pCdMan));
 }
 
@@ -161,4 +563,65 @@ std::shared_ptr<CBaseTx> CTxMemPool::Lookup(const uint256 txid) const {
     if (i == memPoolTxs.end())
         return std::shared_ptr<CBaseTx>();
     return i->second.GetTransaction();
-}
\ No newline at end of file
+}
+
+const CTxMemPool::PriorityIndex &CTxMemPool::GetPriorityIndex() const {
+    AssertLockHeld(cs);
+    return priorityIndex;
+}
+
+const CTxMemPool::SenderChain *CTxMemPool::GetSenderChain(const CKeyID &sender) const {
+    AssertLockHeld(cs);
+    auto it = senderIndex.find(sender);
+    return it != senderIndex.end() ? &it->second : nullptr;
+}
+
+uint64_t CTxMemPool::GetNextSequence() const {
+    AssertLockHeld(cs);
+    return nextSequence;
+}
+
+void CTxMemPool::NotifyChange() {
+    {
+        boost::unique_lock<boost::mutex> lock(changeMutex);
+        changeCount++;
+    }
+    changeCond.notify_all();
+}
+
+uint64_t CTxMemPool::GetChangeCount() const {
+    boost::unique_lock<boost::mutex> lock(changeMutex);
+    return changeCount;
+}
+
+bool CTxMemPool::WaitForChange(uint64_t changeCountIn, int64_t deadlineMs) const {
+    boost::unique_lock<boost::mutex> lock(changeMutex);
+    while (changeCount == changeCountIn) {
+        int64_t leftMs = deadlineMs - GetTimeMillis();
+        if (leftMs <= 0)
+            return false;
+
+        changeCond.timed_wait(lock, boost::posix_time::milliseconds(leftMs));
+    }
+    return true;
+}
+
+void CTxMemPool::GetSenderTxids(const CKeyID &sender, vector<uint256> &txids) const {
+    LOCK(cs);
+    txids.clear();
+    auto it = senderIndex.find(sender);
+    if (it == senderIndex.end())
+        return;
+
+    for (const auto &item : it->second)
+        txids.push_back(item.second->GetTransaction()->GetHash());
+}
+
+void CTxMemPool::GetAffectedTxids(const CDBAccessTracker::KeySet &keys, vector<uint256> &txids) const {
+    LOCK(cs);
+    set<uint64_t> sequences;
+    GetAffectedEntries(keys, sequences);
+    txids.clear();
+    for (uint64_t sequence : sequences)
+        txids.push_back(sequenceIndex.at(sequence)->GetTransaction()->GetHash());
+}
@@ -9,30 +9,67 @@
 
 #include "entities/account.h"
 #include "persistence/cachewrapper.h"
+#include "persistence/dbaccesstracker.h"
 #include "sync.h"
 
+#include <boost/filesystem/path.hpp>
+
 #include <list>
 #include <map>
 #include <memory>
+#include <set>
+#include <unordered_map>
 
 using namespace std;
 
 class CValidationState;
 class CBaseTx;
+class CBlockIndex;
+class CWorkerPool;
 class uint256;
 
+/*
+ * The key of the packing order of CTxMemPool, the first one is packed first: the txs of a higher priority
+ * tier, then the ones of a higher fee rate. The priorities of the common txs are below
+ * TRANSACTION_PRIORITY_CEILING, they are of the same tier and go by their fee rates.
+ */
+struct CTxMemPoolPriorityKey {
+    int64_t priority_tier;
+    double fee_per_kb;
+    uint256 txid;
+
+    bool operator<(const CTxMemPoolPriorityKey &other) const {
+        if (priority_tier != other.priority_tier)
+            return priority_tier > other.priority_tier;
+        if (fee_per_kb != other.fee_per_kb)
+            return fee_per_kb > other.fee_per_kb;
+        return txid < other.txid;
+    }
+};
+
 /*
  * CTxMemPool stores these:
  */
 class CTxMemPoolEntry {
+    friend class CTxMemPool;
+
 private:
     std::shared_ptr<CBaseTx> pTx;
     std::pair<TokenSymbol, uint64_t> nFees;  // Cached to avoid expensive parent-transaction lookups
     uint32_t nTxSize;                     // Cached to avoid recomputing tx size
     double dPriority;                     // Cached to avoid recomputing priority
+    double feePerKb;                      // Fee rate net of the fuel of the last rehearsal execution
 
     int64_t nTime;     // Local time when entering the mempool
     uint32_t height;  // Chain height when entering the mempool
+    uint64_t sequence; // Order of entering the mempool
+    CKeyID sender;     // Account of txUid
+    uint32_t executedHeight; // Height of the last rehearsal execution, the price points of a price feed tx are at it
+
+    // the db keys read and written by the last rehearsal execution, the read keys include the written ones
+    CDBAccessTracker::KeySet readKeys;
+    CDBAccessTracker::KeySet writeKeys;
+    bool accessTracked;  // false if the execution accessed the state untracked, the keys are incomplete
 
 public:
     CTxMemPoolEntry(CBaseTx *ptx, int64_t time, uint32_t height);
@@ -44,11 +81,52 @@ public:
     inline std::pair<TokenSymbol, uint64_t> GetFees() const { return nFees; }
     inline uint32_t GetTxSize() const { return nTxSize; }
     inline double GetPriority() const { return dPriority; }
+    inline double GetFeePerKb() const { return feePerKb; }
 
     inline int64_t GetTime() const { return nTime; }
     inline uint32_t GetHeight() const { return height; }
+    inline uint64_t GetSequence() const { return sequence; }
+    inline const CKeyID &GetSender() const { return sender; }
+    inline bool IsAccessTracked() const { return accessTracked; }
+    inline const CDBAccessTracker::KeySet &GetWriteKeys() const { return writeKeys; }
+
+    CTxMemPoolPriorityKey GetPriorityKey() const;
+
+private:
+    double ComputeFeePerKb(uint32_t fuelRate) const;
 };
 
+/*
+ * An entry of the mempool dump of -persistmempool (mempool.dat). The layout of the dump is
+ *   {network magic}{version}{entry count}{entry}..{entry}{checksum}
+ *   entry    = {time}{height}{tx data}, tx data = the serialized tx
+ *   checksum = hash of the entries
+ * The entries are in the order of entering the mempool, a tx follows the txs of its sender it may depend on.
+ * The tx data is kept as bytes, so the txs are decoded by the workers when the dump is read.
+ */
+class CMemPoolDumpEntry {
+public:
+    static const uint32_t CURRENT_VERSION = 1;
+
+    int64_t time    = 0;  // local time when entering the mempool
+    uint32_t height = 0;  // chain height when entering the mempool
+    std::string tx_data;
+    std::shared_ptr<CBaseTx> pTx;  // decoded from tx_data when read, nullptr if it is malformed
+
+public:
+    IMPLEMENT_SERIALIZE(
+        READWRITE(time);
+        READWRITE(height);
+        READWRITE(tx_data);
+    )
+};
+
+// write the entries to the file, the old file is replaced once the new one is complete
+bool WriteMemPoolFile(const boost::filesystem::path &path, const vector<CMemPoolDumpEntry> &entries);
+// read the entries of the file and decode their txs, on the workers unless pWorkerPool is nullptr
+bool ReadMemPoolFile(const boost::filesystem::path &path, CWorkerPool *pWorkerPool,
+                     vector<CMemPoolDumpEntry> &entries);
+
 /*
  * CTxMemPool stores valid-according-to-the-current-best-chain
  * transactions that may be included in the next block.
@@ -61,8 +139,12 @@ public:
  */
 class CTxMemPool {
 public:
+    typedef map<CTxMemPoolPriorityKey, const CTxMemPoolEntry *> PriorityIndex;
+    // the txs of a sender by the order of entering the mempool, a tx may depend on the earlier ones
+    typedef map<uint64_t, const CTxMemPoolEntry *> SenderChain;
+
     mutable CCriticalSection cs;
-    map<uint256, CTxMemPoolEntry > memPoolTxs;
+    map<uint256, CTxMemPoolEntry > memPoolTxs;  // modified only by the methods, which keep the indexes
     std::shared_ptr<CCacheWrapper> cw;
 
 public:
@@ -71,11 +153,32 @@ public:
 public:
     void SetSanityCheck(bool fSanityCheckIn) { fSanityCheck = fSanityCheckIn; }
     bool AddUnchecked(const uint256 &txid, const CTxMemPoolEntry &entry, CValidationState &state);
+    /**
+     * Add the entry to the mempool and its indexes without any checks, the fee rate is net of the fuel at fuelRate.
+     * pTracker holds the db keys accessed by the rehearsal execution of the tx, nullptr if they are not tracked.
+     */
+    void AddEntry(const uint256 &txid, const CTxMemPoolEntry &entry, const CKeyID &sender, uint32_t fuelRate,
+                  const CDBAccessTracker *pTracker = nullptr);
+    // erase the tx from the mempool and its indexes, e.g. it is confirmed in a block
+    bool Erase(const uint256 &txid);
     void Remove(CBaseTx *pBaseTx, list<std::shared_ptr<CBaseTx> > &removed, bool fRecursive = false);
     void QueryHash(vector<uint256> &txids);
     bool CheckTxInMemPool(const uint256 &txid, const CTxMemPoolEntry &entry, CValidationState &state,
-                          bool bRehearsalExecute = true);
+                          bool bRehearsalExecute = true, CDBAccessTracker *pTracker = nullptr);
     void SetMemPoolCache();
+
+    // the block is connected to the tip, the txs which read the keys it wrote are executed again by the rescan
+    void BlockConnected(const CBlockIndex *pIndex);
+    // the tip is disconnected, all the txs are executed again by the rescan
+    void BlockDisconnected();
+    /**
+     * Execute the txs again on the new tip. Only the txs which read a key written by the connected blocks or
+     * by the txs erased since the last rescan are executed again, and the txs which read a key they wrote, so
+     * the chains of the senders touched by the blocks. The price feed txs are executed again at every height,
+     * their price points are kept at the height of the execution, and so are the txs whose fuel changed with
+     * the fuel rate, the fees must still cover it. All the txs are executed again after a disconnected block,
+     * or when any tx of the mempool accessed the state untracked.
+     */
     void ReScanMemPoolTx();
     void Clear();
 
@@ -83,8 +186,55 @@ public:
     bool Exists(const uint256 txid);
     std::shared_ptr<CBaseTx> Lookup(const uint256 txid) const;
 
+    // the entries in the packing order, the caller must hold cs while it uses them
+    const PriorityIndex &GetPriorityIndex() const;
+    // the chain of the sender, nullptr if the sender has no tx, the caller must hold cs while it uses it
+    const SenderChain *GetSenderChain(const CKeyID &sender) const;
+    // the sequence of the next tx entering the mempool, it changes only when a tx enters, the caller must hold cs
+    uint64_t GetNextSequence() const;
+    // wake up the waiters for a change, a tx entered the mempool or the tip changed
+    void NotifyChange();
+    // the count of the changes notified, it is read before the mempool is looked at
+    uint64_t GetChangeCount() const;
+    /**
+     * Wait until a change is notified after changeCountIn was read, or until deadlineMs. The wait is an
+     * interruption point of the thread. Returns false on the deadline.
+     */
+    bool WaitForChange(uint64_t changeCountIn, int64_t deadlineMs) const;
+    // the txs of the sender in the order of its chain
+    void GetSenderTxids(const CKeyID &sender, vector<uint256> &txids) const;
+    // the txs which read any of the keys, or read a key written by such a tx, in the order of entering the mempool
+    void GetAffectedTxids(const CDBAccessTracker::KeySet &keys, vector<uint256> &txids) const;
+    // the entries of the mempool dump, in the order of entering the mempool
+    void GetDumpEntries(vector<CMemPoolDumpEntry> &entries) const;
+
+private:
+    void UpdateFeePerKb(CTxMemPoolEntry &entry, uint32_t fuelRate);
+    void SetAccessKeys(CTxMemPoolEntry &entry, const CDBAccessTracker *pTracker);
+    void EraseAccessKeys(CTxMemPoolEntry &entry);
+    void DropPricePoints(const CTxMemPoolEntry &entry);
+    void GetAffectedEntries(const CDBAccessTracker::KeySet &keys, set<uint64_t> &sequences) const;
+
 private:
     bool fSanityCheck; // Normally false, true if -checkmempool or -regtest
+
+    // the indexes of memPoolTxs, kept by AddEntry() and Erase()
+    PriorityIndex priorityIndex;                                 // by the packing order
+    map<uint64_t, const CTxMemPoolEntry *> sequenceIndex;        // by the order of entering the mempool
+    map<CKeyID, SenderChain> senderIndex;                        // by the account of txUid
+    unordered_map<string, set<uint64_t> > readKeyIndex;          // by the db keys read, to the sequences
+    uint32_t untrackedCount;                                     // the entries not tracked by keys
+    uint64_t nextSequence;
+
+    // the state changed since the last rescan
+    CDBAccessTracker::KeySet dirtyKeys;  // the keys written by the connected blocks and the erased txs
+    bool fullRescan;                     // all the txs must be executed again
+    uint32_t lastFuelRate;               // the fee rates are net of the fuel at it
+
+    // the changes waited for by the block template, guarded by changeMutex instead of cs
+    mutable boost::mutex changeMutex;
+    mutable boost::condition_variable changeCond;
+    uint64_t changeCount;
 };
 
 
@@ -32,6 +32,12 @@
 
 using namespace std;
 
+// the position of the stream that moves on with the bytes read from it, for the size of the tx read.
+// the streams without one return false, the size of their txs is computed again when it is needed.
+template<typename Stream>
+inline bool GetStreamReadPos(Stream &is, int64_t &pos) { return false; }
+inline bool GetStreamReadPos(CDataStream &is, int64_t &pos) { pos = -(int64_t)is.size(); return true; }
+inline bool GetStreamReadPos(CBufferedFile &is, int64_t &pos) { pos = is.GetPos(); return true; }
 
 template<typename Stream>
 void CBaseTx::SerializePtr(Stream& os, const std::shared_ptr<CBaseTx> &pBaseTx, int serType, int version) {
@@ -138,6 +144,8 @@ template<typename Stream>
 void CBaseTx::UnserializePtr(Stream& is, std::shared_ptr<CBaseTx> &pBaseTx, int serType, int version) {
     uint8_t nTxType;
     is.read((char *)&(nTxType), sizeof(nTxType));
+    int64_t beginPos = 0, endPos = 0;
+    bool hasReadPos = GetStreamReadPos(is, beginPos);
     switch((TxType)nTxType) {
         case BLOCK_REWARD_TX: {
             pBaseTx = std::make_shared<CBlockRewardTx>();
@@ -341,6 +349,8 @@ void CBaseTx::UnserializePtr(Stream& is, std::shared_ptr<CBaseTx> &pBaseTx, int
                                 __FUNCTION__, pBaseTx->nTxType, GetTxType(pBaseTx->nTxType)));
     }
     pBaseTx->nTxType = TxType(nTxType);
+    if (hasReadPos && GetStreamReadPos(is, endPos))
+        pBaseTx->serialize_size.size = endPos - beginPos;
 }
 
 #endif //TX_SERIALIZER_H
@@ -8,6 +8,7 @@
 #include "commons/serialize.h"
 #include "crypto/hash.h"
 #include "main.h"
+#include "sigcache.h"
 #include "miner/miner.h"
 #include "persistence/contractdb.h"
 #include "persistence/txdb.h"
@@ -122,6 +123,19 @@ void CWasmContractTx::validate_authorization(const std::vector<uint64_t>& author
 
 //bool CWasmContractTx::validate_payer_signature(CTxExecuteContext &context)
 
+void CWasmContractTx::GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items) {
+    CBaseTx::GetSigVerifyItems(cw, height, items);
+
+    // the permission signatures, see get_accounts_from_signatures()
+    TxID signature_hash = GetHash();
+    for (const auto &s : signatures) {
+        CAccount account;
+        if (!cw.accountCache.GetAccount(CNickID(s.account), account) || !account.IsRegistered())
+            continue;
+        items.emplace_back(signature_hash, s.signature, vector<CPubKey>{account.owner_pubkey});
+    }
+}
+
 void
 CWasmContractTx::get_accounts_from_signatures(CCacheWrapper& database, std::vector <uint64_t>& authorization_accounts) {
 
@@ -150,7 +164,7 @@ CWasmContractTx::get_accounts_from_signatures(CCacheWrapper& database, std::vect
         CHAIN_ASSERT( database.accountCache.GetAccount(CNickID(s.account), account),
                       wasm_chain::account_access_exception, "%s",
                       "can not get account from nickid '%s'", wasm::name(s.account).to_string())        
-        CHAIN_ASSERT( account.owner_pubkey.Verify(signature_hash, s.signature),
+        CHAIN_ASSERT( ::VerifySignature(signature_hash, s.signature, account.owner_pubkey),
                       wasm_chain::unsatisfied_authorization,
                       "can not verify signature '%s bye public key '%s' and hash '%s' ",
                       to_hex(s.signature), account.owner_pubkey.ToString(), signature_hash.ToString() )
@@ -63,6 +63,7 @@ public:
     virtual map<TokenSymbol, uint64_t> GetValues()      const { return map<TokenSymbol, uint64_t>{{SYMB::WICC, 0}}; }
     virtual uint64_t                   GetFuel(int32_t height, uint32_t fuelRate);
     virtual bool                       GetInvolvedKeyIds(CCacheWrapper &cw, set<CKeyID> &keyIds);
+    virtual void                       GetSigVerifyItems(CCacheWrapper &cw, int32_t height, vector<CSigVerifyItem> &items);
     virtual string ToString(CAccountDBCache &accountCache);
     virtual Object ToJson(const CAccountDBCache &accountCache) const;
 